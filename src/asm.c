@@ -0,0 +1,744 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "mu-mips.h"
+#include "fpu.h"
+#include "asm.h"
+
+/* operand shapes */
+enum {
+	K_R3,	/* rd, rs, rt */
+	K_SHIFT,	/* rd, rt, sa */
+	K_JR,	/* rs */
+	K_JALR,	/* rs | rd, rs */
+	K_FIXED,	/* no operands */
+	K_MF,	/* rd */
+	K_MT,	/* rs */
+	K_MULDIV,	/* rs, rt */
+	K_IMM,	/* rt, rs, imm */
+	K_LUI,	/* rt, imm */
+	K_MEM,	/* rt, off(rs) */
+	K_FMEM,	/* ft, off(rs) */
+	K_BR2,	/* rs, rt, label */
+	K_BR1,	/* rs, label */
+	K_JUMP,	/* label */
+	K_COP,	/* rt, $rd (MFC0/MTC0, CFC1/CTC1, RDHWR) */
+	K_FMOVE,	/* rt, fs */
+	K_BC1,	/* label */
+	K_LI, K_LA, K_MOVE, K_B	/* pseudo instructions */
+};
+
+typedef struct {
+	const char *name;
+	int kind;
+	uint32_t word;	/* every fixed field */
+} asm_op_t;
+
+static const asm_op_t ops[] = {
+	{ "add", K_R3, 0x20 }, { "addu", K_R3, 0x21 }, { "sub", K_R3, 0x22 }, { "subu", K_R3, 0x23 },
+	{ "and", K_R3, 0x24 }, { "or", K_R3, 0x25 }, { "xor", K_R3, 0x26 }, { "nor", K_R3, 0x27 },
+	{ "slt", K_R3, 0x2A },
+	{ "sll", K_SHIFT, 0x00 }, { "srl", K_SHIFT, 0x02 }, { "sra", K_SHIFT, 0x03 },
+	{ "jr", K_JR, 0x08 }, { "jalr", K_JALR, 0x09 },
+	{ "syscall", K_FIXED, 0x0C }, { "break", K_FIXED, 0x0D }, { "eret", K_FIXED, 0x42000018 }, { "nop", K_FIXED, 0 },
+	{ "mfhi", K_MF, 0x10 }, { "mflo", K_MF, 0x12 }, { "mthi", K_MT, 0x11 }, { "mtlo", K_MT, 0x13 },
+	{ "mult", K_MULDIV, 0x18 }, { "multu", K_MULDIV, 0x19 }, { "div", K_MULDIV, 0x1A }, { "divu", K_MULDIV, 0x1B },
+	{ "addi", K_IMM, 0x08u << 26 }, { "addiu", K_IMM, 0x09u << 26 }, { "slti", K_IMM, 0x0Au << 26 },
+	{ "andi", K_IMM, 0x0Cu << 26 }, { "ori", K_IMM, 0x0Du << 26 }, { "xori", K_IMM, 0x0Eu << 26 },
+	{ "lui", K_LUI, 0x0Fu << 26 },
+	{ "lb", K_MEM, 0x20u << 26 }, { "lh", K_MEM, 0x21u << 26 }, { "lw", K_MEM, 0x23u << 26 },
+	{ "sb", K_MEM, 0x28u << 26 }, { "sh", K_MEM, 0x29u << 26 }, { "sw", K_MEM, 0x2Bu << 26 },
+	{ "ll", K_MEM, 0x30u << 26 }, { "sc", K_MEM, 0x38u << 26 },
+	{ "lwc1", K_FMEM, 0x31u << 26 }, { "ldc1", K_FMEM, 0x35u << 26 },
+	{ "swc1", K_FMEM, 0x39u << 26 }, { "sdc1", K_FMEM, 0x3Du << 26 },
+	{ "beq", K_BR2, 0x04u << 26 }, { "bne", K_BR2, 0x05u << 26 },
+	{ "blez", K_BR1, 0x06u << 26 }, { "bgtz", K_BR1, 0x07u << 26 },
+	{ "bltz", K_BR1, 0x01u << 26 }, { "bgez", K_BR1, 0x01u << 26 | 1 << 16 },
+	{ "j", K_JUMP, 0x02u << 26 }, { "jal", K_JUMP, 0x03u << 26 },
+	{ "mfc0", K_COP, 0x10u << 26 }, { "mtc0", K_COP, 0x10u << 26 | 0x04 << 21 },
+	{ "cfc1", K_COP, 0x11u << 26 | 0x02 << 21 }, { "ctc1", K_COP, 0x11u << 26 | 0x06 << 21 },
+	{ "rdhwr", K_COP, 0x1Fu << 26 | 0x3B },
+	{ "mfc1", K_FMOVE, 0x11u << 26 }, { "mtc1", K_FMOVE, 0x11u << 26 | 0x04 << 21 },
+	{ "bc1f", K_BC1, 0x11u << 26 | 0x08 << 21 }, { "bc1t", K_BC1, 0x11u << 26 | 0x08 << 21 | 1 << 16 },
+	{ "li", K_LI, 0 }, { "la", K_LA, 0 }, { "move", K_MOVE, 0x21 }, { "b", K_B, 0x04u << 26 },
+	{ NULL, 0, 0 }
+};
+
+static const char *reg_names[32] = {
+	"zero", "at", "v0", "v1", "a0", "a1", "a2", "a3", "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+	"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7", "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"
+};
+
+#define MAX_OPERANDS 8
+
+/* assembler state for one source file */
+typedef struct {
+	object_t *obj;
+	int section;
+	uint32_t capacity[NUM_SECTIONS];
+	uint32_t symbol_capacity, reloc_capacity;
+	int line;
+} asm_ctx_t;
+
+static int fail(asm_ctx_t *c, const char *format, const char *arg)
+{
+	char word[SYM_NAME], message[128];
+
+	if (c->obj->error[0] == '\0') {
+		snprintf(word, sizeof(word), "%.*s", SYM_NAME - 1, arg);
+		snprintf(message, sizeof(message), format, word);
+		snprintf(c->obj->error, sizeof(c->obj->error), "%.100s:%d: %s", c->obj->source, c->line, message);
+	}
+	return FALSE;
+}
+
+static void emit_bytes(asm_ctx_t *c, const void *bytes, uint32_t length)
+{
+	object_t *obj = c->obj;
+	int s = c->section;
+
+	if (obj->size[s] + length > c->capacity[s]) {
+		c->capacity[s] = (obj->size[s] + length) * 2 + 64;
+		obj->bytes[s] = realloc(obj->bytes[s], c->capacity[s]);
+	}
+	if (bytes != NULL) {
+		memcpy(obj->bytes[s] + obj->size[s], bytes, length);
+	} else {
+		memset(obj->bytes[s] + obj->size[s], 0, length);
+	}
+	obj->size[s] += length;
+}
+
+static void emit_word(asm_ctx_t *c, uint32_t word)
+{
+	emit_bytes(c, &word, 4);	/* the guest is little endian like the host */
+}
+
+/***************************************************************/
+/* Symbol table: a name is looked up, or added as undefined         */
+/***************************************************************/
+static uint32_t symbol(asm_ctx_t *c, const char *name)
+{
+	object_t *obj = c->obj;
+	uint32_t i;
+
+	for (i = 0; i < obj->num_symbols; i++) {
+		if (!strcmp(obj->symbols[i].name, name)) {
+			return i;
+		}
+	}
+	if (obj->num_symbols == c->symbol_capacity) {
+		c->symbol_capacity = c->symbol_capacity * 2 + 32;
+		obj->symbols = realloc(obj->symbols, c->symbol_capacity * sizeof(obj_symbol_t));
+	}
+	memset(&obj->symbols[i], 0, sizeof(obj_symbol_t));
+	snprintf(obj->symbols[i].name, SYM_NAME, "%s", name);
+	obj->symbols[i].section = SEC_UNDEF;
+	return obj->num_symbols++;
+}
+
+static int define(asm_ctx_t *c, const char *name)
+{
+	uint32_t index = symbol(c, name);	/* may grow the table */
+	obj_symbol_t *sym = &c->obj->symbols[index];
+
+	if (sym->section != SEC_UNDEF) {
+		return fail(c, "%s is defined twice", name);
+	}
+	sym->section = c->section;
+	sym->value = c->obj->size[c->section];
+	return TRUE;
+}
+
+static void relocate(asm_ctx_t *c, int type, const char *name, int32_t addend)
+{
+	object_t *obj = c->obj;
+	obj_reloc_t *r;
+
+	if (obj->num_relocs == c->reloc_capacity) {
+		c->reloc_capacity = c->reloc_capacity * 2 + 32;
+		obj->relocs = realloc(obj->relocs, c->reloc_capacity * sizeof(obj_reloc_t));
+	}
+	r = &obj->relocs[obj->num_relocs++];
+	r->section = c->section;
+	r->type = type;
+	r->offset = obj->size[c->section];
+	r->symbol = symbol(c, name);
+	r->addend = addend;
+}
+
+/***************************************************************/
+/* Operand parsing                                                                                   */
+/***************************************************************/
+static int parse_reg(asm_ctx_t *c, const char *text, int *reg)
+{
+	char *end;
+	int i;
+
+	if (text[0] != '$') {
+		return fail(c, "%s is not a register", text);
+	}
+	text++;
+	if (text[0] == 'r' && isdigit((unsigned char)text[1])) {
+		text++;	/* $rN, as print_instruction writes them */
+	}
+	if (isdigit((unsigned char)text[0])) {
+		*reg = strtol(text, &end, 10);
+		if (*end == '\0' && *reg < 32) {
+			return TRUE;
+		}
+	}
+	for (i = 0; i < 32; i++) {
+		if (!strcmp(text, reg_names[i])) {
+			*reg = i;
+			return TRUE;
+		}
+	}
+	if (!strcmp(text, "s8")) {
+		*reg = 30;
+		return TRUE;
+	}
+	return fail(c, "$%s is not a register", text);
+}
+
+static int parse_freg(asm_ctx_t *c, const char *text, int *reg)
+{
+	char *end;
+
+	if (text[0] != '$' || text[1] != 'f' || !isdigit((unsigned char)text[2])) {
+		return fail(c, "%s is not a floating-point register", text);
+	}
+	*reg = strtol(text + 2, &end, 10);
+	if (*end != '\0' || *reg >= 32) {
+		return fail(c, "%s is not a floating-point register", text);
+	}
+	return TRUE;
+}
+
+static int parse_number(const char *text, int64_t *value)
+{
+	char *end;
+
+	if (text[0] == '\'' && text[1] != '\0' && text[2] == '\'' && text[3] == '\0') {
+		*value = (unsigned char)text[1];
+		return TRUE;
+	}
+	*value = strtoll(text, &end, 0);
+	return end != text && *end == '\0';
+}
+
+/* "name", "name+4" or "name-8" */
+static int parse_symbol(asm_ctx_t *c, char *text, char **name, int32_t *addend)
+{
+	char *sign = strpbrk(text + 1, "+-");
+	int64_t value = 0;
+
+	if (sign != NULL) {
+		if (!parse_number(sign + 1, &value)) {
+			return fail(c, "bad offset in %s", text);
+		}
+		if (*sign == '-') {
+			value = -value;
+		}
+		*sign = '\0';
+	}
+	if (!(isalpha((unsigned char)text[0]) || text[0] == '_' || text[0] == '.')) {
+		return fail(c, "%s is not a number or symbol", text);
+	}
+	*name = text;
+	*addend = value;
+	return TRUE;
+}
+
+/***************************************************************/
+/* A 16-bit immediate: a number, %hi(sym) or %lo(sym)                */
+/***************************************************************/
+static int parse_imm16(asm_ctx_t *c, char *text, uint32_t *imm)
+{
+	int64_t value;
+	char *name, *close;
+	int32_t addend;
+	int type;
+
+	if (!strncmp(text, "%hi(", 4) || !strncmp(text, "%lo(", 4)) {
+		type = text[1] == 'h' ? RELOC_HI16 : RELOC_LO16;
+		close = strrchr(text, ')');
+		if (close == NULL || close[1] != '\0') {
+			return fail(c, "unbalanced %s", text);
+		}
+		*close = '\0';
+		if (!parse_symbol(c, text + 4, &name, &addend)) {
+			return FALSE;
+		}
+		relocate(c, type, name, addend);
+		*imm = 0;
+		return TRUE;
+	}
+	if (!parse_number(text, &value)) {
+		return fail(c, "%s is not a 16-bit immediate (use %%hi/%%lo for addresses)", text);
+	}
+	if (value < -32768 || value > 65535) {
+		return fail(c, "%s does not fit in 16 bits", text);
+	}
+	*imm = value & 0xFFFF;
+	return TRUE;
+}
+
+/* "off(rs)", "(rs)" or "%lo(sym)(rs)" */
+static int parse_mem(asm_ctx_t *c, char *text, uint32_t *imm, int *base)
+{
+	char *open = strrchr(text, '(');
+	char *close = strrchr(text, ')');
+
+	if (open == NULL || close == NULL || close < open || close[1] != '\0') {
+		return fail(c, "%s is not an off(base) operand", text);
+	}
+	*close = '\0';
+	if (!parse_reg(c, open + 1, base)) {
+		return FALSE;
+	}
+	*open = '\0';
+	if (text[0] == '\0') {
+		*imm = 0;
+		return TRUE;
+	}
+	return parse_imm16(c, text, imm);
+}
+
+/* a branch or jump target: a label, or a raw offset/target as the hex files use */
+static int parse_target(asm_ctx_t *c, char *text, int type, uint32_t *field)
+{
+	int64_t value;
+	char *name;
+	int32_t addend;
+
+	if (parse_number(text, &value)) {
+		*field = value & (type == RELOC_26 ? 0x03FFFFFF : 0xFFFF);
+		return TRUE;
+	}
+	if (!parse_symbol(c, text, &name, &addend)) {
+		return FALSE;
+	}
+	relocate(c, type, name, addend);
+	*field = 0;
+	return TRUE;
+}
+
+/***************************************************************/
+/* One instruction (or pseudo instruction) into the text section   */
+/***************************************************************/
+static int instruction(asm_ctx_t *c, const char *mnemonic, char **arg, int n)
+{
+	const asm_op_t *op;
+	/* operands of each kind, in enum order (JALR takes one or two) */
+	static const int counts[] = { 3, 3, 1, 1, 0, 1, 1, 2, 3, 2, 2, 2, 3, 2, 1, 2, 2, 1, 2, 2, 2, 1 };
+	int rs = 0, rt = 0, rd = 0, fmt, funct, operands;
+	uint32_t imm = 0, word;
+	int64_t value;
+
+	if (c->section != SEC_TEXT) {
+		return fail(c, "%s outside .text", mnemonic);
+	}
+	for (op = ops; op->name != NULL && strcasecmp(op->name, mnemonic); op++);
+
+	if (op->name == NULL) {
+		int fs, ft = 0, fd = 0;
+
+		if (!fpu_lookup(mnemonic, &fmt, &funct, &operands)) {
+			return fail(c, "unknown instruction %s", mnemonic);
+		}
+		if (n != (funct >= 0x30 ? 2 : operands)) {
+			return fail(c, "wrong number of operands for %s", mnemonic);
+		}
+		if (funct >= 0x30) {	/* C.cond.fmt fs, ft */
+			if (!parse_freg(c, arg[0], &fs) || !parse_freg(c, arg[1], &ft)) return FALSE;
+		} else {
+			if (!parse_freg(c, arg[0], &fd) || !parse_freg(c, arg[1], &fs)) return FALSE;
+			if (operands == 3 && !parse_freg(c, arg[2], &ft)) return FALSE;
+		}
+		emit_word(c, 0x11u << 26 | fmt << 21 | ft << 16 | fs << 11 | fd << 6 | funct);
+		return TRUE;
+	}
+
+	if (op->kind == K_JALR ? (n != 1 && n != 2) : n != counts[op->kind]) {
+		return fail(c, "wrong number of operands for %s", mnemonic);
+	}
+	word = op->word;
+	switch (op->kind) {
+		case K_R3:
+			if (!parse_reg(c, arg[0], &rd) || !parse_reg(c, arg[1], &rs) || !parse_reg(c, arg[2], &rt)) return FALSE;
+			break;
+		case K_SHIFT:
+			if (!parse_reg(c, arg[0], &rd) || !parse_reg(c, arg[1], &rt)) return FALSE;
+			if (!parse_number(arg[2], &value) || value < 0 || value > 31) {
+				return fail(c, "shift amount %s is not 0..31", arg[2]);
+			}
+			word |= value << 6;
+			break;
+		case K_JR:
+		case K_MT:
+			if (!parse_reg(c, arg[0], &rs)) return FALSE;
+			break;
+		case K_JALR:
+			rd = 31;
+			if (n == 2 && !parse_reg(c, arg[0], &rd)) return FALSE;
+			if (!parse_reg(c, arg[n - 1], &rs)) return FALSE;
+			break;
+		case K_MF:
+			if (!parse_reg(c, arg[0], &rd)) return FALSE;
+			break;
+		case K_MULDIV:
+			if (!parse_reg(c, arg[0], &rs) || !parse_reg(c, arg[1], &rt)) return FALSE;
+			break;
+		case K_IMM:
+			if (!parse_reg(c, arg[0], &rt) || !parse_reg(c, arg[1], &rs) || !parse_imm16(c, arg[2], &imm)) return FALSE;
+			break;
+		case K_LUI:
+			if (!parse_reg(c, arg[0], &rt) || !parse_imm16(c, arg[1], &imm)) return FALSE;
+			break;
+		case K_MEM:
+			if (!parse_reg(c, arg[0], &rt) || !parse_mem(c, arg[1], &imm, &rs)) return FALSE;
+			break;
+		case K_FMEM:
+			if (!parse_freg(c, arg[0], &rt) || !parse_mem(c, arg[1], &imm, &rs)) return FALSE;
+			break;
+		case K_BR2:
+			if (!parse_reg(c, arg[0], &rs) || !parse_reg(c, arg[1], &rt) || !parse_target(c, arg[2], RELOC_PC16, &imm)) return FALSE;
+			break;
+		case K_BR1:
+			if (!parse_reg(c, arg[0], &rs) || !parse_target(c, arg[1], RELOC_PC16, &imm)) return FALSE;
+			break;
+		case K_B:
+		case K_BC1:
+			if (!parse_target(c, arg[0], RELOC_PC16, &imm)) return FALSE;
+			break;
+		case K_JUMP:
+			if (!parse_target(c, arg[0], RELOC_26, &imm)) return FALSE;
+			break;
+		case K_COP:
+			if (!parse_reg(c, arg[0], &rt) || arg[1][0] != '$' || !parse_number(arg[1] + 1, &value) || value < 0 || value > 31) {
+				return fail(c, "bad operands for %s", mnemonic);
+			}
+			rd = value;
+			break;
+		case K_FMOVE:
+			if (!parse_reg(c, arg[0], &rt) || !parse_freg(c, arg[1], &rd)) return FALSE;
+			break;
+		case K_MOVE:	/* ADDU rd, rs, $zero */
+			if (!parse_reg(c, arg[0], &rd) || !parse_reg(c, arg[1], &rs)) return FALSE;
+			break;
+		case K_LI:
+			if (!parse_reg(c, arg[0], &rt) || !parse_number(arg[1], &value) || value < INT32_MIN || value > UINT32_MAX) {
+				return fail(c, "bad operands for %s", mnemonic);
+			}
+			if (value >= -32768 && value <= 32767) {	/* ADDIU rt, $zero, imm */
+				emit_word(c, 0x09u << 26 | rt << 16 | (value & 0xFFFF));
+			} else if (value >= 0 && value <= 0xFFFF) {	/* ORI rt, $zero, imm */
+				emit_word(c, 0x0Du << 26 | rt << 16 | value);
+			} else {	/* LUI + ORI */
+				emit_word(c, 0x0Fu << 26 | rt << 16 | ((value >> 16) & 0xFFFF));
+				emit_word(c, 0x0Du << 26 | rt << 21 | rt << 16 | (value & 0xFFFF));
+			}
+			return TRUE;
+		case K_LA: {	/* LUI %hi + ADDIU %lo */
+			char *name;
+			int32_t addend;
+
+			if (!parse_reg(c, arg[0], &rt) || !parse_symbol(c, arg[1], &name, &addend)) return FALSE;
+			relocate(c, RELOC_HI16, name, addend);
+			emit_word(c, 0x0Fu << 26 | rt << 16);
+			relocate(c, RELOC_LO16, name, addend);
+			emit_word(c, 0x09u << 26 | rt << 21 | rt << 16);
+			return TRUE;
+		}
+	}
+	emit_word(c, word | rs << 21 | rt << 16 | rd << 11 | imm);
+	return TRUE;
+}
+
+/***************************************************************/
+/* Directives: sections, symbols and data                                      */
+/***************************************************************/
+static int string_literal(asm_ctx_t *c, const char *text, int terminate)
+{
+	const char *p;
+	uint8_t byte;
+
+	if (text[0] != '"' || strlen(text) < 2 || text[strlen(text) - 1] != '"') {
+		return fail(c, "%s is not a string", text);
+	}
+	for (p = text + 1; p < text + strlen(text) - 1; p++) {
+		byte = *p;
+		if (*p == '\\') {
+			p++;
+			switch (*p) {
+				case 'n': byte = '\n'; break;
+				case 't': byte = '\t'; break;
+				case '0': byte = '\0'; break;
+				default: byte = *p; break;
+			}
+		}
+		emit_bytes(c, &byte, 1);
+	}
+	if (terminate) {
+		emit_bytes(c, NULL, 1);
+	}
+	return TRUE;
+}
+
+static int directive(asm_ctx_t *c, const char *name, char **arg, int n)
+{
+	int64_t value;
+	int i;
+
+	if (!strcmp(name, ".text") || !strcmp(name, ".data")) {
+		c->section = name[1] == 't' ? SEC_TEXT : SEC_DATA;
+		return TRUE;
+	}
+	if (!strcmp(name, ".globl") || !strcmp(name, ".global")) {
+		for (i = 0; i < n; i++) {
+			uint32_t index = symbol(c, arg[i]);
+			c->obj->symbols[index].global = TRUE;
+		}
+		return TRUE;
+	}
+	if (!strcmp(name, ".word")) {
+		for (i = 0; i < n; i++) {
+			char *sym;
+			int32_t addend;
+
+			if (parse_number(arg[i], &value)) {
+				emit_word(c, (uint32_t)value);
+				continue;
+			}
+			if (!parse_symbol(c, arg[i], &sym, &addend)) {
+				return FALSE;
+			}
+			relocate(c, RELOC_32, sym, addend);
+			emit_word(c, 0);
+		}
+		return TRUE;
+	}
+	if (!strcmp(name, ".half") || !strcmp(name, ".byte")) {
+		for (i = 0; i < n; i++) {
+			uint16_t half;
+
+			if (!parse_number(arg[i], &value)) {
+				return fail(c, "%s is not a number", arg[i]);
+			}
+			half = value;
+			emit_bytes(c, &half, name[1] == 'h' ? 2 : 1);
+		}
+		return TRUE;
+	}
+	if (!strcmp(name, ".space") || !strcmp(name, ".align")) {
+		if (n != 1 || !parse_number(arg[0], &value) || value < 0 || value > (name[1] == 's' ? 0x10000000 : 12)) {
+			return fail(c, "bad operand for %s", name);
+		}
+		if (name[1] == 'a') {
+			value = (-c->obj->size[c->section]) & ((1u << value) - 1);
+		}
+		emit_bytes(c, NULL, value);
+		return TRUE;
+	}
+	if (!strcmp(name, ".ascii") || !strcmp(name, ".asciiz")) {
+		for (i = 0; i < n; i++) {
+			if (!string_literal(c, arg[i], name[6] == 'z')) {
+				return FALSE;
+			}
+		}
+		return TRUE;
+	}
+	return fail(c, "unknown directive %s", name);
+}
+
+/***************************************************************/
+/* Split "op a, b, c" into words; commas inside quotes or          */
+/* parentheses do not split                                                        */
+/***************************************************************/
+static int split(char *line, char **mnemonic, char **arg)
+{
+	char *p = line, *start;
+	int n = 0, depth = 0, quoted = FALSE;
+
+	while (isspace((unsigned char)*p)) p++;
+	*mnemonic = p;
+	while (*p != '\0' && !isspace((unsigned char)*p)) p++;
+	if (*p != '\0') {
+		*p++ = '\0';
+	}
+	while (*p != '\0' && n < MAX_OPERANDS) {
+		while (isspace((unsigned char)*p)) p++;
+		if (*p == '\0') {
+			break;
+		}
+		start = p;
+		for (; *p != '\0' && (quoted || depth > 0 || *p != ','); p++) {
+			if (*p == '"' && (p == start || p[-1] != '\\')) quoted = !quoted;
+			if (!quoted && *p == '(') depth++;
+			if (!quoted && *p == ')') depth--;
+		}
+		arg[n] = start;
+		if (*p == ',') {
+			*p++ = '\0';
+		}
+		/* trim the end */
+		start = arg[n] + strlen(arg[n]);
+		while (start > arg[n] && isspace((unsigned char)start[-1])) *--start = '\0';
+		n++;
+	}
+	return n;
+}
+
+/***************************************************************/
+/* Assemble one source file into a relocatable object. Every label */
+/* becomes a symbol, local unless .globl; every reference to one is */
+/* left to the linker as a relocation                                            */
+/***************************************************************/
+int assemble(const char *path, object_t *obj)
+{
+	char line[1024], *p, *colon, *mnemonic, *arg[MAX_OPERANDS];
+	asm_ctx_t c;
+	int n, quoted;
+	uint32_t i;
+	FILE *fp;
+
+	memset(obj, 0, sizeof(*obj));
+	memset(&c, 0, sizeof(c));
+	snprintf(obj->source, sizeof(obj->source), "%s", path);
+	c.obj = obj;
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		snprintf(obj->error, sizeof(obj->error), "Can't open %s", path);
+		return FALSE;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		c.line++;
+		/* comments run from # or // (outside a string) to the end of the line */
+		for (p = line, quoted = FALSE; *p != '\0'; p++) {
+			if (*p == '"') quoted = !quoted;
+			if (!quoted && (*p == '#' || (p[0] == '/' && p[1] == '/') || *p == '\n' || *p == '\r')) {
+				*p = '\0';
+				break;
+			}
+		}
+		/* any number of "label:" before the statement */
+		p = line;
+		for (;;) {
+			while (isspace((unsigned char)*p)) p++;
+			for (colon = p; isalnum((unsigned char)*colon) || *colon == '_' || *colon == '.' || *colon == '$'; colon++);
+			if (colon == p || *colon != ':') {
+				break;
+			}
+			*colon = '\0';
+			if (!define(&c, p)) {
+				break;
+			}
+			p = colon + 1;
+		}
+		if (obj->error[0] != '\0') {
+			break;
+		}
+		n = split(p, &mnemonic, arg);
+		if (*mnemonic == '\0') {
+			continue;
+		}
+		if (!(*mnemonic == '.' ? directive(&c, mnemonic, arg, n) : instruction(&c, mnemonic, arg, n))) {
+			break;
+		}
+	}
+	fclose(fp);
+	/* whatever is still undefined must come from another object */
+	for (i = 0; i < obj->num_symbols; i++) {
+		if (obj->symbols[i].section == SEC_UNDEF) {
+			obj->symbols[i].global = TRUE;
+		}
+	}
+	return obj->error[0] == '\0';
+}
+
+/***************************************************************/
+/* Objects on disk: a header, the section bytes, the symbol table  */
+/* and the relocations, in host byte order                                   */
+/***************************************************************/
+typedef struct {
+	uint32_t magic, version;
+	uint32_t size[NUM_SECTIONS];
+	uint32_t num_symbols, num_relocs;
+} obj_header_t;
+
+int object_write(const object_t *obj, const char *path)
+{
+	obj_header_t h = { OBJ_MAGIC, OBJ_VERSION, { obj->size[SEC_TEXT], obj->size[SEC_DATA] },
+		obj->num_symbols, obj->num_relocs };
+	FILE *fp = fopen(path, "wb");
+	int ok, s;
+
+	if (fp == NULL) {
+		return FALSE;
+	}
+	ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+	for (s = 0; s < NUM_SECTIONS; s++) {
+		ok = ok && fwrite(obj->bytes[s], 1, obj->size[s], fp) == obj->size[s];
+	}
+	ok = ok && fwrite(obj->symbols, sizeof(obj_symbol_t), obj->num_symbols, fp) == obj->num_symbols;
+	ok = ok && fwrite(obj->relocs, sizeof(obj_reloc_t), obj->num_relocs, fp) == obj->num_relocs;
+	return fclose(fp) == 0 && ok;
+}
+
+int object_read(const char *path, object_t *obj)
+{
+	obj_header_t h;
+	FILE *fp;
+	int ok, s;
+
+	memset(obj, 0, sizeof(*obj));
+	snprintf(obj->source, sizeof(obj->source), "%s", path);
+	fp = fopen(path, "rb");
+	if (fp == NULL) {
+		snprintf(obj->error, sizeof(obj->error), "Can't open %s", path);
+		return FALSE;
+	}
+	ok = fread(&h, sizeof(h), 1, fp) == 1 && h.magic == OBJ_MAGIC && h.version == OBJ_VERSION &&
+		h.size[SEC_TEXT] < MEM_TEXT_END - MEM_TEXT_BEGIN && h.size[SEC_DATA] < MEM_DATA_END - MEM_DATA_BEGIN &&
+		h.num_symbols < 0x1000000 && h.num_relocs < 0x1000000;
+	if (ok) {
+		for (s = 0; s < NUM_SECTIONS; s++) {
+			obj->size[s] = h.size[s];
+			obj->bytes[s] = malloc(h.size[s] + 1);
+			ok = ok && fread(obj->bytes[s], 1, h.size[s], fp) == h.size[s];
+		}
+		obj->num_symbols = h.num_symbols;
+		obj->num_relocs = h.num_relocs;
+		obj->symbols = malloc(h.num_symbols * sizeof(obj_symbol_t) + 1);
+		obj->relocs = malloc(h.num_relocs * sizeof(obj_reloc_t) + 1);
+		ok = ok && fread(obj->symbols, sizeof(obj_symbol_t), h.num_symbols, fp) == h.num_symbols;
+		ok = ok && fread(obj->relocs, sizeof(obj_reloc_t), h.num_relocs, fp) == h.num_relocs;
+		for (s = 0; ok && s < (int)h.num_symbols; s++) {
+			obj->symbols[s].name[SYM_NAME - 1] = '\0';
+		}
+	}
+	fclose(fp);
+	if (!ok) {
+		snprintf(obj->error, sizeof(obj->error), "%s is not a mu-mips object", path);
+		object_free(obj);
+	}
+	return ok;
+}
+
+void object_free(object_t *obj)
+{
+	int s;
+	for (s = 0; s < NUM_SECTIONS; s++) {
+		free(obj->bytes[s]);
+		obj->bytes[s] = NULL;
+	}
+	free(obj->symbols);
+	free(obj->relocs);
+	obj->symbols = NULL;
+	obj->relocs = NULL;
+}
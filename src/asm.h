@@ -0,0 +1,61 @@
+#ifndef ASM_H
+#define ASM_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Relocatable objects: one assembled source file with its own text and data,   */
+/* the symbols it defines or needs, and the words the linker must patch          */
+/******************************************************************************/
+#define OBJ_MAGIC   0x424F554D	/* "MUOB" */
+#define OBJ_VERSION 1
+
+#define SEC_TEXT  0
+#define SEC_DATA  1
+#define NUM_SECTIONS 2
+#define SEC_UNDEF 0xFF	/* referenced here, defined in another object */
+
+/* how a relocation patches its word with S + A (P: address of the word) */
+#define RELOC_32   0	/* .word: the whole word */
+#define RELOC_26   1	/* J/JAL: target field, same 256 MB segment */
+#define RELOC_PC16 2	/* branches: (S + A - P) / 4, this core's offset from the branch itself */
+#define RELOC_HI16 3	/* LUI %hi: carries into the high half when %lo is negative */
+#define RELOC_LO16 4	/* %lo: the low half */
+
+#define SYM_NAME 64
+
+typedef struct {
+	char name[SYM_NAME];
+	uint8_t section;
+	uint8_t global;
+	uint32_t value;	/* offset in its section */
+} obj_symbol_t;
+
+typedef struct {
+	uint8_t section;	/* section of the patched word */
+	uint8_t type;
+	uint32_t offset;
+	uint32_t symbol;	/* index into the symbol table */
+	int32_t addend;
+} obj_reloc_t;
+
+typedef struct {
+	char source[256];
+	uint8_t *bytes[NUM_SECTIONS];
+	uint32_t size[NUM_SECTIONS];
+	obj_symbol_t *symbols;
+	uint32_t num_symbols;
+	obj_reloc_t *relocs;
+	uint32_t num_relocs;
+	char error[256];	/* "file:line: message" of the first error */
+} object_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int assemble(const char *path, object_t *obj);
+int object_write(const object_t *obj, const char *path);
+int object_read(const char *path, object_t *obj);
+void object_free(object_t *obj);
+
+#endif
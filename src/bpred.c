@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "bpred.h"
+#include "timing.h"
+
+#define BRANCH_TOP 10
+
+static const char *bp_names[] = { "static", "bimodal", "gshare", "tournament", "tage" };
+static const uint32_t tage_history[TAGE_TABLES] = { 4, 8, 16, 32 };
+
+/***************************************************************/
+/* "gshare,bits=12,hist=12,btb=512,ras=16"                                  */
+/***************************************************************/
+bpred_t *bpred_create(const char *spec)
+{
+	bpred_t *bp = calloc(1, sizeof(bpred_t));
+	char buffer[MAX_CMD_LINE], *opt, *value, *end;
+	int i, ok;
+
+	bp->kind = BP_GSHARE;
+	bp->bits = 12;
+	bp->history_bits = 12;
+	bp->btb_size = 512;
+	bp->ras_size = 16;
+
+	snprintf(buffer, sizeof(buffer), "%s", spec != NULL ? spec : "");
+	for (opt = strtok_r(buffer, ",", &end); opt != NULL; opt = strtok_r(NULL, ",", &end)) {
+		value = strchr(opt, '=');
+		if (value == NULL) {
+			for (i = 0; i <= BP_TAGE; i++) {
+				if (!strcmp(opt, bp_names[i])) {
+					bp->kind = i;
+					break;
+				}
+			}
+			if (i > BP_TAGE) {
+				printf("Error: unknown predictor %s\n", opt);
+				free(bp);
+				return NULL;
+			}
+			continue;
+		}
+		*value++ = '\0';
+		if (!strcmp(opt, "bits")) ok = parse_option(opt, value, 24, &bp->bits);
+		else if (!strcmp(opt, "hist")) ok = parse_option(opt, value, 32, &bp->history_bits);
+		else if (!strcmp(opt, "btb")) ok = parse_option(opt, value, 1u << 24, &bp->btb_size);
+		else if (!strcmp(opt, "ras")) ok = parse_option(opt, value, 65536, &bp->ras_size);
+		else {
+			printf("Error: unknown predictor option %s\n", opt);
+			ok = FALSE;
+		}
+		if (!ok) {
+			free(bp);
+			return NULL;
+		}
+	}
+	if (bp->bits < 2 || bp->bits > 24 || bp->history_bits > 32 || bp->btb_size == 0 || bp->btb_size > (1u << 24)
+			|| (bp->btb_size & (bp->btb_size - 1)) != 0 || bp->ras_size == 0 || bp->ras_size > 65536) {
+		printf("Error: bad predictor size (bits 2-24, hist <= 32, btb a power of two up to 16M, ras 1-65536)\n");
+		free(bp);
+		return NULL;
+	}
+
+	bp->bimodal = malloc(1u << bp->bits);
+	bp->gshare = malloc(1u << bp->bits);
+	bp->chooser = malloc(1u << bp->bits);
+	bp->tage_bits = bp->bits > 4 ? bp->bits - 2 : 2;
+	for (i = 0; i < TAGE_TABLES; i++) {
+		bp->tage[i] = malloc(sizeof(tage_entry_t) << bp->tage_bits);
+	}
+	bp->btb_tag = malloc(bp->btb_size * sizeof(uint32_t));
+	bp->btb_target = malloc(bp->btb_size * sizeof(uint32_t));
+	bp->ras = malloc(bp->ras_size * sizeof(uint32_t));
+	bpred_clear(bp);
+	return bp;
+}
+
+void bpred_destroy(bpred_t *bp)
+{
+	int i;
+	if (bp == NULL) {
+		return;
+	}
+	free(bp->bimodal);
+	free(bp->gshare);
+	free(bp->chooser);
+	for (i = 0; i < TAGE_TABLES; i++) {
+		free(bp->tage[i]);
+	}
+	free(bp->btb_tag);
+	free(bp->btb_target);
+	free(bp->ras);
+	free(bp->stats);
+	free(bp);
+}
+
+/***************************************************************/
+/* Forget everything learned and zero the statistics                       */
+/***************************************************************/
+void bpred_clear(bpred_t *bp)
+{
+	int i;
+
+	memset(bp->bimodal, 1, 1u << bp->bits);	/* weakly not taken */
+	memset(bp->gshare, 1, 1u << bp->bits);
+	memset(bp->chooser, 1, 1u << bp->bits);
+	for (i = 0; i < TAGE_TABLES; i++) {
+		memset(bp->tage[i], 0, sizeof(tage_entry_t) << bp->tage_bits);
+	}
+	memset(bp->btb_tag, 0xFF, bp->btb_size * sizeof(uint32_t));
+	bp->history = 0;
+	bp->ras_top = bp->ras_count = 0;
+	bp->branches = bp->direction_wrong = 0;
+	bp->jumps = bp->target_wrong = 0;
+	bp->returns = bp->return_wrong = 0;
+	free(bp->stats);
+	bp->stats = NULL;
+	bp->stat_capacity = bp->stat_count = 0;
+}
+
+static void counter_update(uint8_t *ctr, int taken, uint8_t max)
+{
+	if (taken && *ctr < max) {
+		(*ctr)++;
+	} else if (!taken && *ctr > 0) {
+		(*ctr)--;
+	}
+}
+
+/***************************************************************/
+/* TAGE-lite: a bimodal base plus tagged tables with geometric        */
+/* history lengths; the longest matching table provides                    */
+/***************************************************************/
+static uint32_t fold(uint64_t history, uint32_t length, uint32_t bits)
+{
+	uint32_t result = 0;
+	uint64_t h = length >= 64 ? history : history & ((1ULL << length) - 1);
+	while (h != 0) {
+		result ^= h & ((1u << bits) - 1);
+		h >>= bits;
+	}
+	return result;
+}
+
+static uint32_t tage_index(bpred_t *bp, int t, uint32_t pc)
+{
+	return ((pc >> 2) ^ (pc >> (2 + bp->tage_bits)) ^ fold(bp->history, tage_history[t], bp->tage_bits))
+			& ((1u << bp->tage_bits) - 1);
+}
+
+static uint8_t tage_tag(bpred_t *bp, int t, uint32_t pc)
+{
+	return ((pc >> 2) ^ fold(bp->history, tage_history[t], 8) ^ (fold(bp->history, tage_history[t], 7) << 1)) & 0xFF;
+}
+
+static int tage_predict_update(bpred_t *bp, uint32_t pc, int taken)
+{
+	uint32_t base = (pc >> 2) & ((1u << bp->bits) - 1);
+	uint32_t index[TAGE_TABLES];
+	uint8_t tag[TAGE_TABLES];
+	int t, provider = -1, alt = -1, prediction, alt_prediction;
+	tage_entry_t *e;
+
+	for (t = 0; t < TAGE_TABLES; t++) {
+		index[t] = tage_index(bp, t, pc);
+		tag[t] = tage_tag(bp, t, pc);
+	}
+	for (t = TAGE_TABLES - 1; t >= 0; t--) {
+		if (bp->tage[t][index[t]].tag == tag[t]) {
+			if (provider < 0) {
+				provider = t;
+			} else if (alt < 0) {
+				alt = t;
+			}
+		}
+	}
+	alt_prediction = alt >= 0 ? bp->tage[alt][index[alt]].ctr >= 4 : bp->bimodal[base] >= 2;
+	prediction = provider >= 0 ? bp->tage[provider][index[provider]].ctr >= 4 : alt_prediction;
+
+	if (provider >= 0) {
+		e = &bp->tage[provider][index[provider]];
+		counter_update(&e->ctr, taken, 7);
+		if (prediction != alt_prediction) {
+			if (prediction == taken && e->useful < 3) e->useful++;
+			if (prediction != taken && e->useful > 0) e->useful--;
+		}
+	} else {
+		counter_update(&bp->bimodal[base], taken, 3);
+	}
+
+	/* on a miss, claim an entry in a longer-history table */
+	if (prediction != taken) {
+		int allocated = FALSE;
+		for (t = provider + 1; t < TAGE_TABLES; t++) {
+			e = &bp->tage[t][index[t]];
+			if (e->useful == 0) {
+				e->tag = tag[t];
+				e->ctr = taken ? 4 : 3;
+				allocated = TRUE;
+				break;
+			}
+		}
+		if (!allocated) {
+			for (t = provider + 1; t < TAGE_TABLES; t++) {
+				if (bp->tage[t][index[t]].useful > 0) {
+					bp->tage[t][index[t]].useful--;
+				}
+			}
+		}
+	}
+	return prediction;
+}
+
+/***************************************************************/
+/* Predict, then train, the direction of a conditional branch          */
+/***************************************************************/
+static int direction(bpred_t *bp, const inst_record_t *r, int taken)
+{
+	uint32_t mask = (1u << bp->bits) - 1;
+	uint32_t b = (r->pc >> 2) & mask;
+	uint32_t g = ((r->pc >> 2) ^ (uint32_t)(bp->history & ((1ULL << bp->history_bits) - 1))) & mask;
+	int prediction, pb, pg;
+
+	switch (bp->kind) {
+		case BP_STATIC:
+			prediction = (int32_t)(r->instruction << 16) < 0;	/* negative offset */
+			break;
+		case BP_BIMODAL:
+			prediction = bp->bimodal[b] >= 2;
+			counter_update(&bp->bimodal[b], taken, 3);
+			break;
+		case BP_GSHARE:
+			prediction = bp->gshare[g] >= 2;
+			counter_update(&bp->gshare[g], taken, 3);
+			break;
+		case BP_TOURNAMENT:
+			pb = bp->bimodal[b] >= 2;
+			pg = bp->gshare[g] >= 2;
+			prediction = bp->chooser[b] >= 2 ? pg : pb;
+			if (pb != pg) {
+				counter_update(&bp->chooser[b], pg == taken, 3);
+			}
+			counter_update(&bp->bimodal[b], taken, 3);
+			counter_update(&bp->gshare[g], taken, 3);
+			break;
+		default:
+			prediction = tage_predict_update(bp, r->pc, taken);
+			break;
+	}
+	bp->history = (bp->history << 1) | (taken ? 1 : 0);
+	return prediction;
+}
+
+/***************************************************************/
+/* BTB lookup and fill (direct mapped, full-PC tags)                        */
+/***************************************************************/
+static int btb_hit(bpred_t *bp, uint32_t pc, uint32_t target)
+{
+	uint32_t i = (pc >> 2) & (bp->btb_size - 1);
+	int hit = bp->btb_tag[i] == pc && bp->btb_target[i] == target;
+	bp->btb_tag[i] = pc;
+	bp->btb_target[i] = target;
+	return hit;
+}
+
+static branch_stat_t *branch_entry(bpred_t *bp, uint32_t pc)
+{
+	uint32_t i, mask;
+
+	if (bp->stat_count * 2 >= bp->stat_capacity) {
+		branch_stat_t *old = bp->stats;
+		uint32_t old_capacity = bp->stat_capacity;
+		bp->stat_capacity = old_capacity ? old_capacity * 2 : 256;
+		bp->stats = calloc(bp->stat_capacity, sizeof(branch_stat_t));
+		bp->stat_count = 0;
+		for (i = 0; i < old_capacity; i++) {
+			if (old[i].pc != 0) {
+				*branch_entry(bp, old[i].pc) = old[i];
+			}
+		}
+		free(old);
+	}
+	mask = bp->stat_capacity - 1;
+	for (i = (pc >> 2) * 2654435761u & mask; bp->stats[i].pc != 0 && bp->stats[i].pc != pc; i = (i + 1) & mask)
+		;
+	if (bp->stats[i].pc == 0) {
+		bp->stats[i].pc = pc;
+		bp->stat_count++;
+	}
+	return &bp->stats[i];
+}
+
+/***************************************************************/
+/* Predict one branch/jump and learn from it. Returns BP_CORRECT if */
+/* the fetch unit would have followed the right path                         */
+/***************************************************************/
+int bpred_retire(bpred_t *bp, const inst_record_t *r, uint16_t flags)
+{
+	int taken = r->next_pc != r->pc + 4;
+	int correct;
+	branch_stat_t *s;
+
+	if (flags & INST_BRANCH) {
+		bp->branches++;
+		correct = direction(bp, r, taken) == taken;
+		if (!correct) {
+			bp->direction_wrong++;
+		} else if (taken && !btb_hit(bp, r->pc, r->next_pc)) {
+			/* right direction, but nowhere to fetch from until decode */
+			correct = FALSE;
+			bp->target_wrong++;
+		}
+	} else if ((flags & INST_RETURN) && bp->ras_count > 0) {
+		uint32_t predicted;
+		bp->returns++;
+		bp->ras_top = (bp->ras_top + bp->ras_size - 1) % bp->ras_size;
+		bp->ras_count--;
+		predicted = bp->ras[bp->ras_top];
+		correct = predicted == r->next_pc;
+		if (!correct) {
+			bp->return_wrong++;
+		}
+	} else {
+		bp->jumps++;
+		correct = btb_hit(bp, r->pc, r->next_pc);
+		if (!correct) {
+			bp->target_wrong++;
+		}
+	}
+
+	/* calls push the return address; the oldest entry is overwritten when full */
+	if (flags & INST_CALL) {
+		bp->ras[bp->ras_top] = r->pc + 4;
+		bp->ras_top = (bp->ras_top + 1) % bp->ras_size;
+		if (bp->ras_count < bp->ras_size) {
+			bp->ras_count++;
+		}
+	}
+
+	s = branch_entry(bp, r->pc);
+	s->executed++;
+	s->taken += taken;
+	s->mispredicted += !correct;
+	return correct ? BP_CORRECT : BP_WRONG;
+}
+
+/***************************************************************/
+/* Report                                                                                             */
+/***************************************************************/
+static int by_mispredicts(const void *a, const void *b)
+{
+	const branch_stat_t *x = a, *y = b;
+	return x->mispredicted < y->mispredicted ? 1 : x->mispredicted > y->mispredicted ? -1 : 0;
+}
+
+void bpred_print(bpred_t *bp, FILE *fp, int json)
+{
+	branch_stat_t *top = malloc((bp->stat_count + 1) * sizeof(branch_stat_t));
+	uint64_t total = bp->branches + bp->jumps + bp->returns;
+	uint64_t wrong = bp->direction_wrong + bp->target_wrong + bp->return_wrong;
+	uint32_t i, n = 0;
+
+	for (i = 0; i < bp->stat_capacity; i++) {
+		if (bp->stats[i].pc != 0) {
+			top[n++] = bp->stats[i];
+		}
+	}
+	qsort(top, n, sizeof(branch_stat_t), by_mispredicts);
+	if (n > BRANCH_TOP) {
+		n = BRANCH_TOP;
+	}
+
+	if (json) {
+		fprintf(fp, ",\"bpred\":{\"predictor\":\"%s\",\"branches\":%llu,\"direction_mispredicts\":%llu,"
+				"\"jumps\":%llu,\"target_mispredicts\":%llu,\"returns\":%llu,\"return_mispredicts\":%llu,"
+				"\"accuracy\":%.4f,\"worst\":[", bp_names[bp->kind],
+				(unsigned long long)bp->branches, (unsigned long long)bp->direction_wrong,
+				(unsigned long long)bp->jumps, (unsigned long long)bp->target_wrong,
+				(unsigned long long)bp->returns, (unsigned long long)bp->return_wrong,
+				total ? 1.0 - (double)wrong / total : 1.0);
+		for (i = 0; i < n; i++) {
+			fprintf(fp, "%s{\"pc\":%u,\"executed\":%u,\"taken\":%u,\"mispredicted\":%u}", i ? "," : "",
+					top[i].pc, top[i].executed, top[i].taken, top[i].mispredicted);
+		}
+		fprintf(fp, "]}");
+	} else {
+		fprintf(fp, "Branch predictor (%s, %u-entry tables, BTB %u, RAS %u)\n",
+				bp_names[bp->kind], 1u << bp->bits, bp->btb_size, bp->ras_size);
+		fprintf(fp, "-------------------------------------\n");
+		fprintf(fp, "branches\t: %llu (%llu direction mispredicts)\n",
+				(unsigned long long)bp->branches, (unsigned long long)bp->direction_wrong);
+		fprintf(fp, "jumps\t\t: %llu\n", (unsigned long long)bp->jumps);
+		fprintf(fp, "returns\t\t: %llu (%llu RAS mispredicts)\n",
+				(unsigned long long)bp->returns, (unsigned long long)bp->return_wrong);
+		fprintf(fp, "target misses\t: %llu\n", (unsigned long long)bp->target_wrong);
+		fprintf(fp, "accuracy\t: %.2f%%\n", total ? 100.0 * (1.0 - (double)wrong / total) : 100.0);
+		fprintf(fp, "[PC]\t\t[executed]\t[taken]\t[mispredicted]\n");
+		for (i = 0; i < n; i++) {
+			fprintf(fp, "0x%08x\t%u\t\t%u\t%u\n", top[i].pc, top[i].executed, top[i].taken, top[i].mispredicted);
+		}
+		fprintf(fp, "-------------------------------------\n");
+	}
+	free(top);
+}
@@ -0,0 +1,71 @@
+#ifndef BPRED_H
+#define BPRED_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+/******************************************************************************/
+/* Branch prediction: direction predictor, BTB and return-address stack        */
+/******************************************************************************/
+#define BP_STATIC     0	/* backward taken, forward not taken */
+#define BP_BIMODAL    1
+#define BP_GSHARE     2
+#define BP_TOURNAMENT 3
+#define BP_TAGE       4
+
+/* what the front end got right, as seen by the pipeline model */
+#define BP_NONE    0	/* no predictor attached */
+#define BP_CORRECT 1
+#define BP_WRONG   2
+
+#define TAGE_TABLES 4
+
+typedef struct {
+	uint8_t ctr;	/* 3-bit signed counter, taken when >= 4 */
+	uint8_t tag;
+	uint8_t useful;
+} tage_entry_t;
+
+typedef struct {
+	uint32_t pc;
+	uint32_t executed, taken, mispredicted;
+} branch_stat_t;
+
+typedef struct bpred {
+	int kind;
+	uint32_t bits;	/* log2 of the direction tables */
+	uint32_t history_bits;
+	uint64_t history;	/* global outcome history, newest in bit 0 */
+
+	uint8_t *bimodal;	/* 2-bit counters */
+	uint8_t *gshare;
+	uint8_t *chooser;	/* tournament: >= 2 picks gshare */
+	tage_entry_t *tage[TAGE_TABLES];
+	uint32_t tage_bits;
+
+	uint32_t btb_size;
+	uint32_t *btb_tag, *btb_target;
+
+	uint32_t ras_size, ras_top, ras_count;
+	uint32_t *ras;
+
+	uint64_t branches, direction_wrong;
+	uint64_t jumps, target_wrong;
+	uint64_t returns, return_wrong;
+
+	branch_stat_t *stats;	/* open-addressed per-branch table */
+	uint32_t stat_capacity, stat_count;
+} bpred_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+bpred_t *bpred_create(const char *spec);
+void bpred_destroy(bpred_t *bp);
+void bpred_clear(bpred_t *bp);
+int bpred_retire(bpred_t *bp, const inst_record_t *r, uint16_t flags);
+void bpred_print(bpred_t *bp, FILE *fp, int json);
+
+#endif
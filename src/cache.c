@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "cache.h"
+
+#define PC_TOP 10
+
+static int is_pow2(uint32_t x)
+{
+	return x != 0 && (x & (x - 1)) == 0;
+}
+
+static uint32_t log2u(uint32_t x)
+{
+	uint32_t n = 0;
+	while (x >>= 1) {
+		n++;
+	}
+	return n;
+}
+
+/* LRU ranks are a permutation of 0..ways-1 in every set; touching a way */
+/* only shifts the ranks below it, so they have to start distinct          */
+static void cache_rank(cache_t *c)
+{
+	uint32_t i;
+	for (i = 0; i < c->sets * c->ways; i++) {
+		c->age[i] = i % c->ways;
+	}
+}
+
+/***************************************************************/
+/* Parse "32k:8:64[:lru|plru|random[:wb|wt]]" into a cache            */
+/***************************************************************/
+static cache_t *cache_create(const char *name, char *spec)
+{
+	cache_t *c = calloc(1, sizeof(cache_t));
+	char *field, *end;
+	int n = 0, ok = TRUE;
+
+	c->name = name;
+	c->repl = REPL_LRU;
+	c->write_policy = WRITE_BACK;
+	c->rng = 0x2545F491;
+	for (field = strtok_r(spec, ":", &end); field != NULL; field = strtok_r(NULL, ":", &end), n++) {
+		char *suffix;
+		switch (n) {
+			case 0:
+				c->size = strtoul(field, &suffix, 10);
+				if (*suffix == 'k' || *suffix == 'K') {
+					c->size <<= 10;
+					suffix++;
+				} else if (*suffix == 'm' || *suffix == 'M') {
+					c->size <<= 20;
+					suffix++;
+				}
+				ok &= suffix != field && *suffix == '\0';
+				break;
+			case 1:
+				c->ways = strtoul(field, &suffix, 10);
+				ok &= suffix != field && *suffix == '\0';
+				break;
+			case 2:
+				c->line = strtoul(field, &suffix, 10);
+				ok &= suffix != field && *suffix == '\0';
+				break;
+			case 3:
+				c->repl = !strcmp(field, "plru") ? REPL_PLRU : !strcmp(field, "random") ? REPL_RANDOM : REPL_LRU;
+				ok &= c->repl != REPL_LRU || !strcmp(field, "lru");
+				break;
+			case 4:
+				c->write_policy = !strcmp(field, "wt") ? WRITE_THROUGH : WRITE_BACK;
+				ok &= c->write_policy == WRITE_THROUGH || !strcmp(field, "wb");
+				break;
+			default: ok = FALSE; break;
+		}
+	}
+	if (!ok || n < 3 || !is_pow2(c->size) || !is_pow2(c->line) || c->line < 4 || c->ways == 0 || c->ways > 32
+			|| c->size < c->line * c->ways || !is_pow2(c->size / (c->line * c->ways))
+			|| (c->repl == REPL_PLRU && !is_pow2(c->ways))) {
+		printf("Error: bad %s geometry (want <size>:<ways>:<line>[:lru|plru|random[:wb|wt]], powers of two, at most 32 ways)\n", name);
+		free(c);
+		return NULL;
+	}
+	c->sets = c->size / (c->line * c->ways);
+	c->offset_bits = log2u(c->line);
+	c->index_bits = log2u(c->sets);
+	c->tags = calloc((size_t)c->sets * c->ways, sizeof(uint32_t));
+	c->age = malloc((size_t)c->sets * c->ways * sizeof(uint8_t));
+	c->plru = calloc(c->sets, sizeof(uint32_t));
+	cache_rank(c);
+	return c;
+}
+
+static void cache_destroy(cache_t *c)
+{
+	if (c == NULL) {
+		return;
+	}
+	free(c->tags);
+	free(c->age);
+	free(c->plru);
+	free(c);
+}
+
+static void cache_clear(cache_t *c)
+{
+	if (c == NULL) {
+		return;
+	}
+	memset(c->tags, 0, (size_t)c->sets * c->ways * sizeof(uint32_t));
+	cache_rank(c);
+	memset(c->plru, 0, c->sets * sizeof(uint32_t));
+	c->reads = c->writes = c->hits = c->misses = c->evictions = c->writebacks = 0;
+}
+
+/***************************************************************/
+/* Replacement state                                                                       */
+/***************************************************************/
+static void cache_touch(cache_t *c, uint32_t set, uint32_t way)
+{
+	uint32_t i, node, level, levels;
+	uint8_t *age;
+
+	switch (c->repl) {
+		case REPL_LRU:
+			age = c->age + (size_t)set * c->ways;
+			for (i = 0; i < c->ways; i++) {
+				if (age[i] < age[way]) {
+					age[i]++;
+				}
+			}
+			age[way] = 0;
+			break;
+		case REPL_PLRU:
+			/* each tree node remembers which half was used last */
+			levels = log2u(c->ways);
+			for (node = 1, level = 0; level < levels; level++) {
+				uint32_t bit = (way >> (levels - 1 - level)) & 1;
+				if (bit) {
+					c->plru[set] |= 1u << node;
+				} else {
+					c->plru[set] &= ~(1u << node);
+				}
+				node = node * 2 + bit;
+			}
+			break;
+	}
+}
+
+static uint32_t cache_victim(cache_t *c, uint32_t set)
+{
+	uint32_t *tags = c->tags + (size_t)set * c->ways;
+	uint32_t i, node, level, levels, victim = 0;
+	uint8_t *age;
+
+	for (i = 0; i < c->ways; i++) {
+		if (!(tags[i] & LINE_VALID)) {
+			return i;
+		}
+	}
+	switch (c->repl) {
+		case REPL_LRU:
+			age = c->age + (size_t)set * c->ways;
+			for (i = 1; i < c->ways; i++) {
+				if (age[i] > age[victim]) {
+					victim = i;
+				}
+			}
+			break;
+		case REPL_PLRU:
+			levels = log2u(c->ways);
+			for (node = 1, level = 0; level < levels; level++) {
+				uint32_t bit = !((c->plru[set] >> node) & 1);
+				victim = (victim << 1) | bit;
+				node = node * 2 + bit;
+			}
+			break;
+		case REPL_RANDOM:
+			c->rng ^= c->rng << 13;
+			c->rng ^= c->rng >> 17;
+			c->rng ^= c->rng << 5;
+			victim = c->rng % c->ways;
+			break;
+	}
+	return victim;
+}
+
+/***************************************************************/
+/* Look up one level. On a miss with allocation, *evicted receives  */
+/* the address of a dirty victim (or stays 0 if none was written)   */
+/***************************************************************/
+static int cache_lookup(cache_t *c, uint32_t address, int write, int allocate, uint32_t *evicted, int *dirty)
+{
+	uint32_t set = (address >> c->offset_bits) & (c->sets - 1);
+	uint32_t tag = address >> (c->offset_bits + c->index_bits);
+	uint32_t *tags = c->tags + (size_t)set * c->ways;
+	uint32_t want = (tag << LINE_TAG_SHIFT) | LINE_VALID;
+	uint32_t way;
+
+	*dirty = FALSE;
+	if (write) {
+		c->writes++;
+	} else {
+		c->reads++;
+	}
+	for (way = 0; way < c->ways; way++) {
+		if ((tags[way] & ~LINE_DIRTY) == want) {
+			c->hits++;
+			if (write && c->write_policy == WRITE_BACK) {
+				tags[way] |= LINE_DIRTY;
+			}
+			cache_touch(c, set, way);
+			return TRUE;
+		}
+	}
+	c->misses++;
+	if (!allocate) {
+		return FALSE;
+	}
+	way = cache_victim(c, set);
+	if (tags[way] & LINE_VALID) {
+		c->evictions++;
+		if (tags[way] & LINE_DIRTY) {
+			c->writebacks++;
+			*dirty = TRUE;
+			*evicted = (((tags[way] >> LINE_TAG_SHIFT) << c->index_bits) | set) << c->offset_bits;
+		}
+	}
+	tags[way] = want | ((write && c->write_policy == WRITE_BACK) ? LINE_DIRTY : 0);
+	cache_touch(c, set, way);
+	return FALSE;
+}
+
+/***************************************************************/
+/* Per-PC miss attribution                                                              */
+/***************************************************************/
+static pc_miss_t *pc_entry(cache_hier_t *h, uint32_t pc)
+{
+	uint32_t i, mask;
+
+	if (h->pc_count * 2 >= h->pc_capacity) {
+		pc_miss_t *old = h->pcs;
+		uint32_t old_capacity = h->pc_capacity;
+		h->pc_capacity = old_capacity ? old_capacity * 2 : 1024;
+		h->pcs = calloc(h->pc_capacity, sizeof(pc_miss_t));
+		h->pc_count = 0;
+		for (i = 0; i < old_capacity; i++) {
+			if (old[i].pc != 0) {
+				*pc_entry(h, old[i].pc) = old[i];
+			}
+		}
+		free(old);
+	}
+	mask = h->pc_capacity - 1;
+	for (i = (pc >> 2) * 2654435761u & mask; h->pcs[i].pc != 0 && h->pcs[i].pc != pc; i = (i + 1) & mask)
+		;
+	if (h->pcs[i].pc == 0) {
+		h->pcs[i].pc = pc;
+		h->pc_count++;
+	}
+	return &h->pcs[i];
+}
+
+/***************************************************************/
+/* Send a line request below L1; returns its latency                       */
+/***************************************************************/
+static uint32_t lower_access(cache_hier_t *h, uint32_t address, int write, uint32_t *l2_miss)
+{
+	uint32_t evicted = 0;
+	int dirty, hit;
+
+	if (h->l2 == NULL) {
+		if (write) h->mem_writes++; else h->mem_reads++;
+		*l2_miss = 0;
+		return write ? 0 : h->mem_latency;
+	}
+	hit = cache_lookup(h->l2, address, write, !write || h->l2->write_policy == WRITE_BACK, &evicted, &dirty);
+	if (dirty) {
+		h->mem_writes++;
+	}
+	if (hit) {
+		*l2_miss = 0;
+		if (write && h->l2->write_policy == WRITE_THROUGH) {
+			h->mem_writes++;
+		}
+		return write ? 0 : h->l2_latency;
+	}
+	*l2_miss = 1;
+	if (write) {
+		if (h->l2->write_policy == WRITE_THROUGH) h->mem_writes++;
+		return 0;
+	}
+	h->mem_reads++;
+	return h->l2_latency + h->mem_latency;
+}
+
+static uint32_t l1_access(cache_hier_t *h, cache_t *c, uint32_t pc, uint32_t address, int write)
+{
+	uint32_t evicted = 0, latency = 0, l2_miss = 0, ignore;
+	int dirty, hit;
+
+	hit = cache_lookup(c, address, write, !write || c->write_policy == WRITE_BACK, &evicted, &dirty);
+	if (dirty) {
+		lower_access(h, evicted, TRUE, &ignore);
+	}
+	if (write && c->write_policy == WRITE_THROUGH) {
+		/* stores drain through a write buffer and never stall */
+		lower_access(h, address, TRUE, &ignore);
+	} else if (!hit) {
+		latency = lower_access(h, address, FALSE, &l2_miss);
+	}
+	if (!hit || l2_miss) {
+		pc_miss_t *e = pc_entry(h, pc);
+		if (!hit) {
+			if (c == h->l1i) e->l1i++; else e->l1d++;
+		}
+		e->l2 += l2_miss;
+	}
+	return latency;
+}
+
+/***************************************************************/
+/* Stall cycles beyond an L1 hit for a fetch / a data access          */
+/***************************************************************/
+uint32_t cache_fetch(cache_hier_t *h, uint32_t pc)
+{
+	return l1_access(h, h->l1i, pc, pc, FALSE);
+}
+
+uint32_t cache_data(cache_hier_t *h, uint32_t pc, uint32_t address, int write)
+{
+	return l1_access(h, h->l1d, pc, address, write);
+}
+
+/***************************************************************/
+/* "l1i=16k:2:32,l1d=16k:4:32:lru:wb,l2=256k:8:64:plru,l2lat=10,memlat=100" */
+/***************************************************************/
+cache_hier_t *cache_hier_create(const char *spec)
+{
+	cache_hier_t *h = calloc(1, sizeof(cache_hier_t));
+	char buffer[MAX_CMD_LINE], l1i[64] = "16k:2:32:lru", l1d[64] = "16k:4:32:lru:wb", l2[64] = "256k:8:64:plru:wb";
+	char *opt, *value, *end;
+	int want_l2 = TRUE;
+
+	h->l1_latency = 1;
+	h->l2_latency = 10;
+	h->mem_latency = 100;
+	snprintf(buffer, sizeof(buffer), "%s", spec != NULL ? spec : "");
+	for (opt = strtok_r(buffer, ",", &end); opt != NULL; opt = strtok_r(NULL, ",", &end)) {
+		value = strchr(opt, '=');
+		if (value == NULL) {
+			printf("Error: cache option %s needs a value\n", opt);
+			free(h);
+			return NULL;
+		}
+		*value++ = '\0';
+		if (!strcmp(opt, "l1i")) snprintf(l1i, sizeof(l1i), "%s", value);
+		else if (!strcmp(opt, "l1d")) snprintf(l1d, sizeof(l1d), "%s", value);
+		else if (!strcmp(opt, "l2")) {
+			want_l2 = strcmp(value, "none") != 0;
+			snprintf(l2, sizeof(l2), "%s", value);
+		}
+		else if (!strcmp(opt, "l2lat") || !strcmp(opt, "memlat")) {
+			if (!parse_option(opt, value, CACHE_MAX_LATENCY, opt[0] == 'l' ? &h->l2_latency : &h->mem_latency)) {
+				free(h);
+				return NULL;
+			}
+		}
+		else {
+			printf("Error: unknown cache option %s\n", opt);
+			free(h);
+			return NULL;
+		}
+	}
+	h->l1i = cache_create("L1I", l1i);
+	h->l1d = cache_create("L1D", l1d);
+	h->l2 = want_l2 ? cache_create("L2", l2) : NULL;
+	if (h->l1i == NULL || h->l1d == NULL || (want_l2 && h->l2 == NULL)) {
+		cache_hier_destroy(h);
+		return NULL;
+	}
+	return h;
+}
+
+void cache_hier_destroy(cache_hier_t *h)
+{
+	if (h == NULL) {
+		return;
+	}
+	cache_destroy(h->l1i);
+	cache_destroy(h->l1d);
+	cache_destroy(h->l2);
+	free(h->pcs);
+	free(h);
+}
+
+void cache_hier_clear(cache_hier_t *h)
+{
+	cache_clear(h->l1i);
+	cache_clear(h->l1d);
+	cache_clear(h->l2);
+	free(h->pcs);
+	h->pcs = NULL;
+	h->pc_capacity = h->pc_count = 0;
+	h->mem_reads = h->mem_writes = 0;
+}
+
+/***************************************************************/
+/* Report                                                                                             */
+/***************************************************************/
+static int by_misses(const void *a, const void *b)
+{
+	const pc_miss_t *x = a, *y = b;
+	uint64_t mx = (uint64_t)x->l1i + x->l1d + x->l2, my = (uint64_t)y->l1i + y->l1d + y->l2;
+	return mx < my ? 1 : mx > my ? -1 : 0;
+}
+
+static void cache_print(cache_t *c, FILE *fp, int json)
+{
+	if (c == NULL) {
+		return;
+	}
+	if (json) {
+		fprintf(fp, "\"%s\":{\"reads\":%llu,\"writes\":%llu,\"hits\":%llu,\"misses\":%llu,"
+				"\"evictions\":%llu,\"writebacks\":%llu}", c->name,
+				(unsigned long long)c->reads, (unsigned long long)c->writes,
+				(unsigned long long)c->hits, (unsigned long long)c->misses,
+				(unsigned long long)c->evictions, (unsigned long long)c->writebacks);
+		return;
+	}
+	fprintf(fp, "%s\t%uB %u-way %uB lines %s %s: %llu hits, %llu misses (%.2f%%), %llu evictions, %llu writebacks\n",
+			c->name, c->size, c->ways, c->line,
+			c->repl == REPL_LRU ? "LRU" : c->repl == REPL_PLRU ? "PLRU" : "random",
+			c->write_policy == WRITE_BACK ? "WB" : "WT",
+			(unsigned long long)c->hits, (unsigned long long)c->misses,
+			c->hits + c->misses ? 100.0 * c->misses / (c->hits + c->misses) : 0.0,
+			(unsigned long long)c->evictions, (unsigned long long)c->writebacks);
+}
+
+void cache_hier_print(cache_hier_t *h, FILE *fp, int json)
+{
+	pc_miss_t *top = malloc((h->pc_count + 1) * sizeof(pc_miss_t));
+	uint32_t i, n = 0;
+
+	for (i = 0; i < h->pc_capacity; i++) {
+		if (h->pcs[i].pc != 0) {
+			top[n++] = h->pcs[i];
+		}
+	}
+	qsort(top, n, sizeof(pc_miss_t), by_misses);
+	if (n > PC_TOP) {
+		n = PC_TOP;
+	}
+
+	if (json) {
+		fprintf(fp, ",\"caches\":{");
+		cache_print(h->l1i, fp, json);
+		fprintf(fp, ",");
+		cache_print(h->l1d, fp, json);
+		if (h->l2 != NULL) {
+			fprintf(fp, ",");
+			cache_print(h->l2, fp, json);
+		}
+		fprintf(fp, ",\"mem_reads\":%llu,\"mem_writes\":%llu,\"miss_pcs\":[",
+				(unsigned long long)h->mem_reads, (unsigned long long)h->mem_writes);
+		for (i = 0; i < n; i++) {
+			fprintf(fp, "%s{\"pc\":%u,\"l1i\":%u,\"l1d\":%u,\"l2\":%u}", i ? "," : "",
+					top[i].pc, top[i].l1i, top[i].l1d, top[i].l2);
+		}
+		fprintf(fp, "]}");
+	} else {
+		fprintf(fp, "Caches (L2 %u cycles, memory %u cycles)\n", h->l2_latency, h->mem_latency);
+		fprintf(fp, "-------------------------------------\n");
+		cache_print(h->l1i, fp, json);
+		cache_print(h->l1d, fp, json);
+		cache_print(h->l2, fp, json);
+		fprintf(fp, "memory\t%llu line reads, %llu writes\n",
+				(unsigned long long)h->mem_reads, (unsigned long long)h->mem_writes);
+		fprintf(fp, "[PC]\t\t[L1I]\t[L1D]\t[L2 misses]\n");
+		for (i = 0; i < n; i++) {
+			fprintf(fp, "0x%08x\t%u\t%u\t%u\n", top[i].pc, top[i].l1i, top[i].l1d, top[i].l2);
+		}
+		fprintf(fp, "-------------------------------------\n");
+	}
+	free(top);
+}
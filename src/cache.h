@@ -0,0 +1,61 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+/******************************************************************************/
+/* Split L1 I/D and unified L2 cache model                                                        */
+/******************************************************************************/
+#define REPL_LRU    0
+#define REPL_PLRU   1
+#define REPL_RANDOM 2
+
+#define WRITE_BACK    0	/* write-allocate, dirty lines written on eviction */
+#define WRITE_THROUGH 1	/* no-write-allocate, every store goes down a level */
+
+#define CACHE_MAX_LATENCY 100000	/* l2lat= and memlat= */
+
+/* a tag word packs the tag with the line state */
+#define LINE_VALID 0x1
+#define LINE_DIRTY 0x2
+#define LINE_TAG_SHIFT 2
+
+typedef struct {
+	const char *name;
+	uint32_t size, ways, line, sets;
+	int repl, write_policy;
+	uint32_t offset_bits, index_bits;
+	uint32_t *tags;		/* sets * ways tag words */
+	uint8_t *age;		/* LRU rank per way, 0 = most recent */
+	uint32_t *plru;		/* tree bits per set */
+	uint32_t rng;
+	uint64_t reads, writes, hits, misses, evictions, writebacks;
+} cache_t;
+
+typedef struct {
+	uint32_t pc;
+	uint32_t l1i, l1d, l2;
+} pc_miss_t;
+
+typedef struct cache_hier {
+	cache_t *l1i, *l1d, *l2;	/* l2 may be NULL */
+	uint32_t l1_latency, l2_latency, mem_latency;
+	uint64_t mem_reads, mem_writes;
+	pc_miss_t *pcs;		/* open-addressed per-PC miss table */
+	uint32_t pc_capacity, pc_count;
+} cache_hier_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+cache_hier_t *cache_hier_create(const char *spec);
+void cache_hier_destroy(cache_hier_t *h);
+void cache_hier_clear(cache_hier_t *h);
+uint32_t cache_fetch(cache_hier_t *h, uint32_t pc);
+uint32_t cache_data(cache_hier_t *h, uint32_t pc, uint32_t address, int write);
+void cache_hier_print(cache_hier_t *h, FILE *fp, int json);
+
+#endif
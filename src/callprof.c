@@ -0,0 +1,479 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "smp.h"
+#include "timing.h"
+#include "callprof.h"
+
+int CALLPROF_ACTIVE;
+
+typedef struct {
+	uint32_t addr;
+	uint32_t order;	/* line in the .sym file: the globals come first */
+	char name[64];
+} callprof_sym_t;
+
+typedef struct {
+	uint32_t addr;
+	char name[64];
+} callprof_func_t;
+
+typedef struct {
+	uint32_t node;
+	uint32_t ret;	/* the JR $ra that returns from this frame */
+	uint32_t start;
+	uint64_t start_cycles;
+} callprof_frame_t;
+
+static callprof_sym_t *syms;
+static uint32_t num_syms;
+
+static callprof_func_t *funcs;
+static uint32_t num_funcs, func_capacity;
+static uint32_t *func_slots, func_slot_bits;	/* index + 1 by address, 0: empty */
+
+static callprof_node_t *nodes;
+static uint32_t num_nodes, node_capacity;
+static uint32_t *node_slots, node_slot_bits;	/* index + 1 by (parent, function) */
+
+static callprof_frame_t stack[CALLPROF_MAX_DEPTH];
+static uint32_t depth;
+static uint32_t lost;	/* calls past the depth limit not yet returned from */
+static uint64_t overflows;
+static uint32_t last;	/* INSTRUCTION_COUNT up to which the top frame has been charged */
+static uint64_t last_cycles;
+
+static uint32_t slot(uint32_t key, uint32_t bits)
+{
+	return (key * 2654435761u) >> (32 - bits);
+}
+
+/***************************************************************/
+/* Symbols come from <program>.sym, as for hooks; without one the  */
+/* functions go by address                                                                                                */
+/***************************************************************/
+static int by_address(const void *a, const void *b)
+{
+	const callprof_sym_t *x = a, *y = b;
+
+	if (x->addr != y->addr) {
+		return x->addr < y->addr ? -1 : 1;
+	}
+	return x->order < y->order ? -1 : x->order > y->order;
+}
+
+static void load_symbols()
+{
+	char path[300], line[256], *dot;
+	unsigned int value;
+	uint32_t capacity = 0;
+	FILE *fp;
+
+	free(syms);
+	syms = NULL;
+	num_syms = 0;
+	snprintf(path, sizeof(path), "%s", prog_file);
+	dot = strrchr(path, '.');
+	if (dot != NULL && strchr(dot, '/') == NULL) {
+		*dot = '\0';
+	}
+	strcat(path, ".sym");
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		return;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (num_syms == capacity) {
+			capacity = capacity ? capacity * 2 : 256;
+			syms = realloc(syms, capacity * sizeof(callprof_sym_t));
+		}
+		if (sscanf(line, "%x %63s", &value, syms[num_syms].name) == 2) {
+			syms[num_syms].addr = value;
+			syms[num_syms].order = num_syms;
+			num_syms++;
+		}
+	}
+	fclose(fp);
+	qsort(syms, num_syms, sizeof(callprof_sym_t), by_address);
+}
+
+static void symbol_name(uint32_t addr, char *name, size_t size)
+{
+	uint32_t lo = 0, hi = num_syms, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (syms[mid].addr < addr) lo = mid + 1;
+		else hi = mid;
+	}
+	if (lo < num_syms && syms[lo].addr == addr) {
+		snprintf(name, size, "%s", syms[lo].name);
+	} else {
+		snprintf(name, size, "0x%08x", addr);
+	}
+}
+
+/***************************************************************/
+/* Function and call-path tables                                                                                */
+/***************************************************************/
+static void grow_slots(uint32_t **slots, uint32_t *bits, uint32_t count, uint32_t (*key)(uint32_t))
+{
+	uint32_t i, s;
+
+	if (*slots != NULL && count * 2 < (1u << *bits)) {
+		return;
+	}
+	*bits = *slots != NULL ? *bits + 1 : 10;
+	free(*slots);
+	*slots = calloc(1u << *bits, sizeof(uint32_t));
+	for (i = 0; i < count; i++) {
+		for (s = slot(key(i), *bits); (*slots)[s] != 0; s = (s + 1) & ((1u << *bits) - 1));
+		(*slots)[s] = i + 1;
+	}
+}
+
+static uint32_t func_key(uint32_t i)
+{
+	return funcs[i].addr;
+}
+
+static uint32_t node_key(uint32_t i)
+{
+	return nodes[i].parent * 0x9E3779B1u ^ nodes[i].func;
+}
+
+static uint32_t function(uint32_t addr)
+{
+	uint32_t s, mask = (1u << func_slot_bits) - 1;
+
+	for (s = slot(addr, func_slot_bits); func_slots[s] != 0; s = (s + 1) & mask) {
+		if (funcs[func_slots[s] - 1].addr == addr) {
+			return func_slots[s] - 1;
+		}
+	}
+	if (num_funcs == func_capacity) {
+		func_capacity = func_capacity ? func_capacity * 2 : 256;
+		funcs = realloc(funcs, func_capacity * sizeof(callprof_func_t));
+	}
+	funcs[num_funcs].addr = addr;
+	symbol_name(addr, funcs[num_funcs].name, sizeof(funcs[num_funcs].name));
+	func_slots[s] = ++num_funcs;
+	grow_slots(&func_slots, &func_slot_bits, num_funcs, func_key);
+	return num_funcs - 1;
+}
+
+static uint32_t child(uint32_t parent, uint32_t func)
+{
+	uint32_t s, mask = (1u << node_slot_bits) - 1;
+	uint32_t key = parent * 0x9E3779B1u ^ func;
+
+	for (s = slot(key, node_slot_bits); node_slots[s] != 0; s = (s + 1) & mask) {
+		callprof_node_t *n = &nodes[node_slots[s] - 1];
+		if (n->parent == parent && n->func == func) {
+			return node_slots[s] - 1;
+		}
+	}
+	if (num_nodes == node_capacity) {
+		node_capacity = node_capacity ? node_capacity * 2 : 1024;
+		nodes = realloc(nodes, node_capacity * sizeof(callprof_node_t));
+	}
+	memset(&nodes[num_nodes], 0, sizeof(callprof_node_t));
+	nodes[num_nodes].parent = parent;
+	nodes[num_nodes].func = func;
+	node_slots[s] = ++num_nodes;
+	grow_slots(&node_slots, &node_slot_bits, num_nodes, node_key);
+	return num_nodes - 1;
+}
+
+/***************************************************************/
+/* Charge the instructions and cycles since the last event to the  */
+/* function on top, and close frames into their paths' inclusive cost */
+/***************************************************************/
+static void charge(uint32_t now, uint64_t cycles)
+{
+	callprof_node_t *n = &nodes[stack[depth - 1].node];
+
+	n->excl += (uint32_t)(now - last);
+	if (cycles > last_cycles) {
+		n->excl_cycles += cycles - last_cycles;
+	}
+	last = now;
+	last_cycles = cycles;
+}
+
+static void pop(uint32_t now, uint64_t cycles)
+{
+	callprof_frame_t *f = &stack[--depth];
+
+	nodes[f->node].incl += (uint32_t)(now - f->start);
+	if (cycles > f->start_cycles) {
+		nodes[f->node].incl_cycles += cycles - f->start_cycles;
+	}
+}
+
+/* only hart 0 is profiled: the console may have another one loaded */
+static uint32_t hart0_count()
+{
+	return HART_ID == 0 ? INSTRUCTION_COUNT : HARTS[0].instruction_count;
+}
+
+/***************************************************************/
+/* A new profile, rooted at the function the PC is in                     */
+/***************************************************************/
+void callprof_start()
+{
+	num_funcs = 0;
+	num_nodes = 0;
+	free(func_slots);
+	free(node_slots);
+	func_slots = node_slots = NULL;
+	grow_slots(&func_slots, &func_slot_bits, 0, func_key);
+	grow_slots(&node_slots, &node_slot_bits, 0, node_key);
+	load_symbols();
+
+	depth = 1;
+	lost = 0;
+	overflows = 0;
+	/* no parent, so a call to the root's own function makes a child rather than resolving to node 0 */
+	stack[0].node = child(CALLPROF_NO_PARENT, function(HART_ID == 0 ? CURRENT_STATE.PC : HARTS[0].state.PC));
+	stack[0].ret = 0xFFFFFFFF;	/* the root is never returned from */
+	stack[0].start = last = hart0_count();
+	stack[0].start_cycles = last_cycles = timing_cycles();
+	nodes[0].calls = 1;
+	CALLPROF_ACTIVE = TRUE;
+}
+
+void callprof_stop()
+{
+	uint64_t cycles = timing_cycles();
+	uint32_t now = hart0_count();
+
+	if (!CALLPROF_ACTIVE) {
+		return;
+	}
+	charge(now, cycles);
+	while (depth > 0) {
+		pop(now, cycles);
+	}
+	CALLPROF_ACTIVE = FALSE;
+}
+
+void callprof_reset()
+{
+	if (CALLPROF_ACTIVE) {
+		callprof_start();
+	}
+}
+
+/***************************************************************/
+/* Hooks: JAL/JALR, JR $ra, and hooked routines returning natively */
+/***************************************************************/
+void callprof_call(uint32_t target, uint32_t ret, uint32_t now)
+{
+	uint64_t cycles = timing_cycles();
+	callprof_frame_t *f;
+	uint32_t node;
+
+	charge(now, cycles);
+	if (depth == CALLPROF_MAX_DEPTH) {
+		lost++;
+		overflows++;
+		return;
+	}
+	node = child(stack[depth - 1].node, function(target));
+	nodes[node].calls++;
+	f = &stack[depth++];
+	f->node = node;
+	f->ret = ret;
+	f->start = now;
+	f->start_cycles = cycles;
+}
+
+void callprof_return(uint32_t target, uint32_t now)
+{
+	uint64_t cycles = timing_cycles();
+	uint32_t i;
+
+	charge(now, cycles);
+	if (lost) {
+		lost--;
+		return;
+	}
+	/* unwind to the frame that returns there; a JR $ra matching none is a plain jump */
+	for (i = depth - 1; i > 0 && stack[i].ret != target; i--);
+	while (i > 0 && depth > i) {
+		pop(now, cycles);
+	}
+}
+
+/***************************************************************/
+/* Reports: frames still open count up to now                            */
+/***************************************************************/
+static uint64_t *open_costs(int cycles)
+{
+	uint64_t *incl = malloc((num_nodes + 1) * sizeof(uint64_t));
+	uint64_t now_cycles = timing_cycles();
+	uint32_t i, now = hart0_count();
+
+	if (CALLPROF_ACTIVE) {
+		charge(now, now_cycles);
+	}
+	for (i = 0; i < num_nodes; i++) {
+		incl[i] = cycles ? nodes[i].incl_cycles : nodes[i].incl;
+	}
+	for (i = 0; CALLPROF_ACTIVE && i < depth; i++) {
+		if (!cycles) {
+			incl[stack[i].node] += (uint32_t)(now - stack[i].start);
+		} else if (now_cycles > stack[i].start_cycles) {
+			incl[stack[i].node] += now_cycles - stack[i].start_cycles;
+		}
+	}
+	return incl;
+}
+
+typedef struct {
+	uint32_t func;
+	uint64_t calls, excl, incl, excl_cycles, incl_cycles;
+} callprof_row_t;
+
+static int by_inclusive(const void *a, const void *b)
+{
+	const callprof_row_t *x = a, *y = b;
+
+	if (x->incl != y->incl) {
+		return x->incl > y->incl ? -1 : 1;
+	}
+	return x->excl > y->excl ? -1 : x->excl < y->excl;
+}
+
+static double percent(uint64_t part, uint64_t total)
+{
+	return total ? 100.0 * part / total : 0.0;
+}
+
+void callprof_print(int top)
+{
+	uint64_t *incl, *incl_cycles, total, total_cycles;
+	callprof_row_t *rows;
+	uint32_t i, a;
+	int n;
+
+	if (num_nodes == 0) {
+		printf("Error: no call profile (callprof on)\n");
+		return;
+	}
+	incl = open_costs(FALSE);
+	incl_cycles = open_costs(TRUE);
+	total = incl[0];
+	total_cycles = incl_cycles[0];
+
+	/* per function; a recursive call's inclusive cost is already in its outermost frame's */
+	rows = calloc(num_funcs, sizeof(callprof_row_t));
+	for (i = 0; i < num_funcs; i++) {
+		rows[i].func = i;
+	}
+	for (i = 0; i < num_nodes; i++) {
+		callprof_row_t *r = &rows[nodes[i].func];
+		r->calls += nodes[i].calls;
+		r->excl += nodes[i].excl;
+		r->excl_cycles += nodes[i].excl_cycles;
+		for (a = i; a != 0 && nodes[nodes[a].parent].func != nodes[i].func; a = nodes[a].parent);
+		if (a == 0) {
+			r->incl += incl[i];
+			r->incl_cycles += incl_cycles[i];
+		}
+	}
+	qsort(rows, num_funcs, sizeof(callprof_row_t), by_inclusive);
+	n = top < 0 || (uint32_t)top > num_funcs ? (int)num_funcs : top;
+
+	if (JSON_OUTPUT) {
+		printf("{\"callprof\":{\"instructions\":%llu,\"cycles\":%llu,\"paths\":%u,\"overflows\":%llu,\"functions\":[",
+				(unsigned long long)total, (unsigned long long)total_cycles, num_nodes,
+				(unsigned long long)overflows);
+		for (i = 0; i < (uint32_t)n; i++) {
+			printf("%s{\"addr\":%u,\"name\":\"%s\",\"calls\":%llu,\"excl\":%llu,\"incl\":%llu,"
+					"\"excl_cycles\":%llu,\"incl_cycles\":%llu}", i ? "," : "",
+					funcs[rows[i].func].addr, funcs[rows[i].func].name,
+					(unsigned long long)rows[i].calls, (unsigned long long)rows[i].excl,
+					(unsigned long long)rows[i].incl, (unsigned long long)rows[i].excl_cycles,
+					(unsigned long long)rows[i].incl_cycles);
+		}
+		printf("]}}\n");
+	} else {
+		printf("Call profile: %llu instructions", (unsigned long long)total);
+		if (total_cycles) {
+			printf(", %llu cycles", (unsigned long long)total_cycles);
+		}
+		printf(", %u functions on %u call paths", num_funcs, num_nodes);
+		if (overflows) {
+			printf(", %llu calls past depth %d untracked", (unsigned long long)overflows, CALLPROF_MAX_DEPTH);
+		}
+		printf("\n[Function]\t\t[Calls]\t\t[Exclusive]\t[%%]\t[Inclusive]\t[%%]%s\n",
+				total_cycles ? "\t[Excl cycles]\t[Incl cycles]" : "");
+		for (i = 0; i < (uint32_t)n; i++) {
+			printf("%-23s\t%-10llu\t%-10llu\t%5.1f\t%-10llu\t%5.1f", funcs[rows[i].func].name,
+					(unsigned long long)rows[i].calls, (unsigned long long)rows[i].excl,
+					percent(rows[i].excl, total), (unsigned long long)rows[i].incl,
+					percent(rows[i].incl, total));
+			if (total_cycles) {
+				printf("\t%-10llu\t%-10llu", (unsigned long long)rows[i].excl_cycles,
+						(unsigned long long)rows[i].incl_cycles);
+			}
+			printf("\n");
+		}
+	}
+	free(rows);
+	free(incl);
+	free(incl_cycles);
+}
+
+/***************************************************************/
+/* Collapsed stacks, "main;foo;bar <exclusive cost>" per call path,  */
+/* the input of flamegraph.pl and speedscope                                     */
+/***************************************************************/
+int callprof_folded(const char *path, int cycles)
+{
+	uint32_t chain[CALLPROF_MAX_DEPTH + 1];
+	uint32_t i, k, a;
+	uint64_t value;
+	FILE *fp;
+
+	if (num_nodes == 0) {
+		printf("Error: no call profile (callprof on)\n");
+		return FALSE;
+	}
+	free(open_costs(FALSE));	/* charges the open top frame */
+	if (cycles) {
+		for (i = 0, value = 0; i < num_nodes; i++) {
+			value += nodes[i].excl_cycles;
+		}
+		if (value == 0) {
+			printf("Error: no cycles in the profile (select a timing model before the run)\n");
+			return FALSE;
+		}
+	}
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		printf("Error: Can't create %s\n", path);
+		return FALSE;
+	}
+	for (i = 0; i < num_nodes; i++) {
+		value = cycles ? nodes[i].excl_cycles : nodes[i].excl;
+		if (value == 0) {
+			continue;
+		}
+		for (k = 0, a = i; a != 0; a = nodes[a].parent) {
+			chain[k++] = a;
+		}
+		fprintf(fp, "%s", funcs[nodes[0].func].name);
+		while (k > 0) {
+			fprintf(fp, ";%s", funcs[nodes[chain[--k]].func].name);
+		}
+		fprintf(fp, " %llu\n", (unsigned long long)value);
+	}
+	fclose(fp);
+	return TRUE;
+}
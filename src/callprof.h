@@ -0,0 +1,42 @@
+#ifndef CALLPROF_H
+#define CALLPROF_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Call-graph profiler: a shadow call stack kept from JAL/JALR and JR $ra,     */
+/* instructions (and timing-model cycles) charged to call paths at every call  */
+/* and return, so the cost follows the calls rather than the instructions      */
+/******************************************************************************/
+#define CALLPROF_MAX_DEPTH 1024	/* deeper calls are counted but not tracked */
+#define CALLPROF_TOP 20	/* functions listed by default */
+#define CALLPROF_NO_PARENT UINT32_MAX
+
+typedef struct {
+	uint32_t func;	/* index into the function table */
+	uint32_t parent;	/* node of the caller's path, CALLPROF_NO_PARENT for the root */
+	uint64_t calls;
+	uint64_t excl, incl;	/* instructions */
+	uint64_t excl_cycles, incl_cycles;
+} callprof_node_t;
+
+extern int CALLPROF_ACTIVE;	/* handle_instruction() reports calls and returns */
+
+/* a call or return executing now: the instruction itself is counted once cycle() finishes it */
+#define CALLPROF_CALL(target, ret) \
+	do { if (__builtin_expect(CALLPROF_ACTIVE, 0) && HART_ID == 0) callprof_call((target), (ret), INSTRUCTION_COUNT + 1); } while (0)
+#define CALLPROF_RETURN(target) \
+	do { if (__builtin_expect(CALLPROF_ACTIVE, 0) && HART_ID == 0) callprof_return((target), INSTRUCTION_COUNT + 1); } while (0)
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void callprof_start();
+void callprof_stop();
+void callprof_reset();	/* INSTRUCTION_COUNT was replaced: restart a running profile */
+void callprof_call(uint32_t target, uint32_t ret, uint32_t now);
+void callprof_return(uint32_t target, uint32_t now);
+void callprof_print(int top);
+int callprof_folded(const char *path, int cycles);
+
+#endif
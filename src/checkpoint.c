@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "mu-mips.h"
+#include "smp.h"
+#include "cp0.h"
+#include "guard.h"
+#include "filemap.h"
+#include "mmio.h"
+#include "timing.h"
+#include "sample.h"
+#include "idle.h"
+#include "hle.h"
+#include "callprof.h"
+#include "checkpoint.h"
+
+uint32_t CKPT_INTERVAL;
+uint32_t CKPT_DEADLINE;
+
+static char auto_path[256];
+static pid_t writer;	/* child still writing the last checkpoint, or 0 */
+static char writer_path[256];
+static int exit_hook;
+
+/* the writer's output, in the child */
+static FILE *out;
+static uint8_t *page_buffer;
+static uint32_t page_size, pages_written;
+static uint32_t last[1 << CKPT_HASH_BITS];	/* generation << 16 | word position + 1, by hash */
+static uint32_t generation;	/* one per page, so the table is never cleared */
+
+/***************************************************************/
+/* Page codec: LZ77 over 32-bit words, one page at a time so any     */
+/* page decodes on its own. A page is a series of                        */
+/*   varint literals, the literal words, varint match length         */
+/*   [, varint distance back in words when the length is nonzero]    */
+/* and an overlapping match covers runs of zeros or a repeated word */
+/***************************************************************/
+static uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+	while (v >= 0x80) {
+		*p++ = v | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return p;
+}
+
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint32_t *v)
+{
+	int shift;
+
+	*v = 0;
+	for (shift = 0; p < end && shift < 35; shift += 7) {
+		*v |= (uint32_t)(*p & 0x7F) << shift;
+		if (!(*p++ & 0x80)) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+/* encoded length, or page_size when the page does not shrink */
+static uint32_t page_encode(const uint32_t *in, uint8_t *encoded)
+{
+	uint32_t words = page_size / 4, i = 0, literal = 0, candidate, length, h;
+	uint8_t *p = encoded;
+
+	generation = (generation + 1) & 0xFFFF;
+	if (generation == 0) {
+		memset(last, 0, sizeof(last));
+		generation = 1;
+	}
+	while (i < words) {
+		h = (in[i] * 2654435761u) >> (32 - CKPT_HASH_BITS);
+		candidate = last[h] >> 16 == generation ? (last[h] & 0xFFFF) : 0;
+		last[h] = generation << 16 | (i + 1);
+		if (candidate-- == 0 || in[candidate] != in[i]) {
+			i++;
+			continue;
+		}
+		for (length = 1; i + length < words && in[candidate + length] == in[i + length]; length++);
+		if (length < 2) {
+			i++;
+			continue;
+		}
+		if (p - encoded + (i - literal) * 4 + 15 > page_size) {
+			return page_size;
+		}
+		p = put_varint(p, i - literal);
+		memcpy(p, in + literal, (i - literal) * 4);
+		p += (i - literal) * 4;
+		p = put_varint(p, length);
+		p = put_varint(p, i - candidate);
+		i += length;
+		literal = i;
+	}
+	if (p - encoded + (words - literal) * 4 + 10 >= page_size) {
+		return page_size;
+	}
+	p = put_varint(p, words - literal);
+	memcpy(p, in + literal, (words - literal) * 4);
+	p += (words - literal) * 4;
+	p = put_varint(p, 0);
+	return p - encoded;
+}
+
+static int page_decode(const uint8_t *p, uint32_t length, uint32_t *page)
+{
+	const uint8_t *end = p + length;
+	uint32_t words = page_size / 4, i = 0, n, distance;
+
+	while (p < end) {
+		if ((p = get_varint(p, end, &n)) == NULL || n > words - i || (uint64_t)n * 4 > (uint64_t)(end - p)) {
+			return FALSE;
+		}
+		memcpy(page + i, p, n * 4);
+		p += n * 4;
+		i += n;
+		if ((p = get_varint(p, end, &n)) == NULL || n > words - i) {
+			return FALSE;
+		}
+		if (n == 0) {
+			continue;
+		}
+		if ((p = get_varint(p, end, &distance)) == NULL || distance == 0 || distance > i) {
+			return FALSE;
+		}
+		for (; n > 0; n--, i++) {
+			page[i] = page[i - distance];
+		}
+	}
+	return i == words;
+}
+
+/***************************************************************/
+/* In the child: one record per nonzero page                            */
+/***************************************************************/
+static void save_page(uint32_t address, const uint8_t *page)
+{
+	uint32_t record[2] = { address, 0 };
+
+	if (page[0] == 0 && !memcmp(page, page + 1, page_size - 1)) {
+		return;
+	}
+	record[1] = page_encode((const uint32_t *)page, page_buffer);
+	fwrite(record, sizeof(record), 1, out);
+	fwrite(record[1] == page_size ? page : page_buffer, 1, record[1], out);
+	pages_written++;
+}
+
+static int write_file(const char *path)
+{
+	ckpt_header_t header;
+	uint32_t end[2];
+	char temp[300];
+	int ok;
+
+	snprintf(temp, sizeof(temp), "%s.tmp", path);
+	out = fopen(temp, "wb");
+	if (out == NULL) {
+		return FALSE;
+	}
+	setvbuf(out, NULL, _IOFBF, 1 << 20);
+	page_buffer = malloc(page_size);
+
+	memset(&header, 0, sizeof(header));
+	header.magic = CKPT_MAGIC;
+	header.version = CKPT_VERSION;
+	header.page_size = page_size;
+	header.num_harts = NUM_HARTS;
+	header.hart_id = HART_ID;
+	header.smp_mode = SMP_MODE;
+	header.smp_quantum = SMP_QUANTUM;
+	header.cp0_enabled = CP0_ENABLED;
+	header.exc_handler = EXC_HANDLER;
+	header.program_entry = PROGRAM_ENTRY;
+	header.program_size = PROGRAM_SIZE;
+	snprintf(header.prog_file, sizeof(header.prog_file), "%s", prog_file);
+	memcpy(header.exceptions, EXC_COUNTS, sizeof(header.exceptions));
+	fwrite(&header, sizeof(header), 1, out);
+	fwrite(HARTS, sizeof(hart_t), NUM_HARTS, out);
+
+	ok = mem_scan(save_page);
+	end[0] = CKPT_END;
+	end[1] = pages_written;
+	fwrite(end, sizeof(end), 1, out);
+	ok = !ferror(out) && ok;
+	ok = fclose(out) == 0 && ok;
+	if (!ok || rename(temp, path) != 0) {
+		unlink(temp);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Collect the writer; block: wait for it. TRUE once none is left      */
+/***************************************************************/
+static int reap(int block)
+{
+	int status;
+
+	if (writer == 0) {
+		return TRUE;
+	}
+	if (waitpid(writer, &status, block ? 0 : WNOHANG) == 0) {
+		return FALSE;
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		printf("Error: checkpoint to %s failed\n", writer_path);
+	}
+	writer = 0;
+	return TRUE;
+}
+
+void checkpoint_wait()
+{
+	reap(TRUE);
+}
+
+/* state the file does not carry */
+static int checkpointable()
+{
+	if (MMIO_ACTIVE || NUM_FILEMAPS > 0) {
+		printf("Error: checkpoints do not cover devices or file mappings\n");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Fork a writer for the current state; the parent goes on at once  */
+/* and its later writes do not reach the child's copy of memory      */
+/***************************************************************/
+static int start_writer(const char *path)
+{
+	pid_t pid;
+
+	smp_save(HART_ID);
+	page_size = sysconf(_SC_PAGESIZE);
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		printf("Error: Can't fork a checkpoint writer\n");
+		return FALSE;
+	}
+	if (pid == 0) {
+		_exit(write_file(path) ? 0 : 1);
+	}
+	writer = pid;
+	snprintf(writer_path, sizeof(writer_path), "%s", path);
+	if (!exit_hook) {
+		atexit(checkpoint_wait);	/* a script that ends right after still gets its file */
+		exit_hook = TRUE;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* checkpoint <file>: one writer at a time                                     */
+/***************************************************************/
+int checkpoint_write(const char *path)
+{
+	if (!checkpointable()) {
+		return FALSE;
+	}
+	reap(TRUE);
+	if (!start_writer(path)) {
+		return FALSE;
+	}
+	if (INTERACTIVE) {
+		printf("Checkpoint at %u instructions going to %s\n", INSTRUCTION_COUNT, path);
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Checkpoint to <path> every <interval> instructions of a run (0: */
+/* stop). The file is replaced each time, never left half written   */
+/***************************************************************/
+void checkpoint_every(uint32_t interval, const char *path)
+{
+	if (interval != 0 && !checkpointable()) {
+		return;
+	}
+	CKPT_INTERVAL = interval;
+	CKPT_DEADLINE = INSTRUCTION_COUNT + interval;
+	if (path != NULL) {
+		snprintf(auto_path, sizeof(auto_path), "%s", path);
+	}
+}
+
+/* the run reached CKPT_DEADLINE; a writer still busy skips this one */
+void checkpoint_tick()
+{
+	CKPT_DEADLINE = INSTRUCTION_COUNT + CKPT_INTERVAL;
+	if (reap(FALSE)) {
+		start_writer(auto_path);
+	}
+}
+
+/***************************************************************/
+/* Replace the whole simulation with the one in <path>                  */
+/***************************************************************/
+int checkpoint_resume(const char *path)
+{
+	static hart_t harts[MAX_HARTS];
+	ckpt_header_t header;
+	uint32_t record[2], pages = 0;
+	uint8_t *buffer, *host;
+	uint64_t len;
+	int ok = FALSE;
+	FILE *fp;
+
+	reap(TRUE);
+	page_size = sysconf(_SC_PAGESIZE);
+	fp = fopen(path, "rb");
+	if (fp == NULL) {
+		printf("Error: Can't open %s\n", path);
+		return FALSE;
+	}
+	if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != CKPT_MAGIC || header.version != CKPT_VERSION ||
+			header.num_harts < 1 || header.num_harts > MAX_HARTS || header.hart_id >= header.num_harts ||
+			fread(harts, sizeof(hart_t), header.num_harts, fp) != header.num_harts) {
+		printf("Error: %s is not a checkpoint\n", path);
+		fclose(fp);
+		return FALSE;
+	}
+	if (header.page_size != page_size) {
+		printf("Error: %s was written with %u-byte pages, this host has %u\n", path, header.page_size, page_size);
+		fclose(fp);
+		return FALSE;
+	}
+
+	setvbuf(fp, NULL, _IOFBF, 1 << 20);
+	if (!mem_clear()) {
+		fclose(fp);
+		return FALSE;
+	}
+	buffer = malloc(page_size);
+	while (fread(record, sizeof(record), 1, fp) == 1) {
+		if (record[0] == CKPT_END) {
+			ok = record[1] == pages;
+			break;
+		}
+		len = page_size;
+		host = record[0] % page_size == 0 ? mem_span(record[0], &len) : NULL;
+		if (host == NULL || len != page_size || record[1] > page_size || fread(buffer, 1, record[1], fp) != record[1]) {
+			break;
+		}
+		if (record[1] == page_size) {
+			memcpy(host, buffer, page_size);
+		} else if (!page_decode(buffer, record[1], (uint32_t *)host)) {
+			break;
+		}
+		pages++;
+	}
+	free(buffer);
+	fclose(fp);
+	if (!ok) {
+		printf("Error: %s is damaged after %u pages\n", path, pages);
+		RUN_FLAG = FALSE;
+		return FALSE;
+	}
+
+	NUM_HARTS = header.num_harts;
+	SMP_MODE = header.smp_mode;
+	SMP_QUANTUM = header.smp_quantum;
+	memcpy(HARTS, harts, header.num_harts * sizeof(hart_t));
+	smp_load(header.hart_id);
+	memcpy(EXC_COUNTS, header.exceptions, sizeof(EXC_COUNTS));
+	CP0_ENABLED = header.cp0_enabled;
+	EXC_HANDLER = header.exc_handler;
+	PROGRAM_ENTRY = header.program_entry;
+	PROGRAM_SIZE = header.program_size;
+	memcpy(prog_file, header.prog_file, sizeof(prog_file));
+	prog_file[sizeof(prog_file) - 1] = '\0';
+	timing_reset();
+	sample_reset();
+	idle_reset();
+	hle_reset();
+	callprof_reset();	/* the shadow stack counted from the old INSTRUCTION_COUNT */
+	if (CKPT_INTERVAL != 0) {
+		CKPT_DEADLINE = INSTRUCTION_COUNT + CKPT_INTERVAL;
+	}
+	if (INTERACTIVE) {
+		printf("Resumed %s: %u harts at %u instructions, %u pages\n", path, NUM_HARTS, INSTRUCTION_COUNT, pages);
+	}
+	return TRUE;
+}
@@ -0,0 +1,41 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+
+#include "cp0.h"
+
+/******************************************************************************/
+/* Checkpoints: every hart, the counters and the nonzero guest pages, each page  */
+/* compressed on its own. A forked child writes the file from its copy-on-write  */
+/* view of memory while the simulation carries on                                   */
+/******************************************************************************/
+#define CKPT_MAGIC   0x54504B4D	/* "MKPT" */
+#define CKPT_VERSION 2
+#define CKPT_END     0xFFFFFFFF	/* address of the closing record, above every page */
+#define CKPT_HASH_BITS 12	/* match finder slots per page */
+
+typedef struct {
+	uint32_t magic, version;
+	uint32_t page_size;
+	uint32_t num_harts, hart_id;
+	uint32_t smp_mode, smp_quantum;
+	uint32_t cp0_enabled, exc_handler;
+	uint32_t program_entry, program_size;
+	char prog_file[256];
+	uint64_t exceptions[NUM_EXC];
+} ckpt_header_t;	/* then num_harts hart_t and the page records */
+
+extern uint32_t CKPT_INTERVAL;	/* automatic checkpoint every so many instructions, 0: off */
+extern uint32_t CKPT_DEADLINE;	/* INSTRUCTION_COUNT of the next one */
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int checkpoint_write(const char *path);
+int checkpoint_resume(const char *path);
+void checkpoint_every(uint32_t interval, const char *path);
+void checkpoint_tick();
+void checkpoint_wait();
+
+#endif
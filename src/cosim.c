@@ -0,0 +1,772 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include "mu-mips.h"
+#include "smp.h"
+#include "hle.h"
+#include "idle.h"
+#include "lanes.h"
+#include "filemap.h"
+#include "mmio.h"
+#include "timing.h"
+#include "checkpoint.h"
+#include "cosim.h"
+
+int COSIM_TRACK;
+
+#define PAGE_BYTES (1u << COSIM_PAGE_BITS)
+#define PAGE_WORDS (PAGE_BYTES / 4)
+
+enum { ENGINE_REFERENCE, ENGINE_IDLE, ENGINE_LANES };
+static const char *engine_names[] = { "reference", "idle", "lanes" };
+
+/* what the checker asks an engine process to do */
+enum { OP_RUN, OP_HASH, OP_STATE, OP_PAGE, OP_SAVE, OP_KEEP, OP_BACK, OP_QUIT };
+
+typedef struct {
+	uint32_t op;
+	uint32_t arg;	/* OP_RUN: count to stop at, OP_HASH: addresses that follow, OP_PAGE: address */
+	uint32_t block;	/* OP_RUN: stop at the end of the basic block as well */
+} request_t;
+
+/* after a run: then the pages written since the last reply and their hashes */
+typedef struct {
+	uint32_t count, run_flag;
+	uint32_t num_dirty;
+	uint64_t state_hash;
+} run_reply_t;
+
+typedef struct {
+	CPU_State state;
+	uint32_t count, run_flag;
+} engine_state_t;
+
+/* an engine process */
+static struct {
+	int engine;
+	int requests, replies;
+	int snapshot_parent;	/* the parent process holds the previous snapshot */
+	uint32_t lane_base;	/* INSTRUCTION_COUNT when the lane was created */
+} srv;
+
+static uint8_t written[1u << (32 - COSIM_PAGE_BITS - 3)];
+static uint32_t *dirty;	/* pages written since the last snapshot */
+static uint32_t num_dirty, dirty_capacity;
+
+/* the checker's view of an engine process */
+typedef struct {
+	pid_t pid;
+	int requests, replies;
+	run_reply_t run;	/* the last one */
+	uint32_t *dirty;	/* sorted */
+	uint64_t *dirty_hashes;
+	uint32_t *missing, num_missing;	/* indices in pages[] only the other side wrote */
+	uint64_t *hashes;	/* of pages[] */
+} side_t;
+
+static side_t side[2];	/* the reference, then the engine under test */
+static uint32_t *pages, num_pages;	/* written by either side in the last run */
+static uint32_t *lookup;	/* addresses of missing pages, as sent */
+static uint64_t checks, pages_compared;
+static uint32_t diverged_at;
+
+static int put(int fd, const void *data, size_t length)
+{
+	const uint8_t *p = data;
+	ssize_t n;
+
+	while (length > 0) {
+		n = write(fd, p, length);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return FALSE;
+		}
+		p += n;
+		length -= n;
+	}
+	return TRUE;
+}
+
+static int get(int fd, void *data, size_t length)
+{
+	uint8_t *p = data;
+	ssize_t n;
+
+	while (length > 0) {
+		n = read(fd, p, length);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return FALSE;
+		}
+		p += n;
+		length -= n;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Written-page set, fed by every guest store in the engine processes */
+/***************************************************************/
+void cosim_dirty(uint32_t address)
+{
+	uint32_t page = address >> COSIM_PAGE_BITS;
+
+	if (written[page >> 3] & (1u << (page & 7))) {
+		return;
+	}
+	written[page >> 3] |= 1u << (page & 7);
+	if (num_dirty == dirty_capacity) {
+		dirty_capacity = dirty_capacity * 2 + 256;
+		dirty = realloc(dirty, dirty_capacity * sizeof(uint32_t));
+	}
+	dirty[num_dirty++] = page << COSIM_PAGE_BITS;
+}
+
+static void dirty_clear()
+{
+	uint32_t i, page;
+
+	for (i = 0; i < num_dirty; i++) {
+		page = dirty[i] >> COSIM_PAGE_BITS;
+		written[page >> 3] &= ~(1u << (page & 7));
+	}
+	num_dirty = 0;
+}
+
+static int by_address(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t hash_words(uint64_t h, const uint32_t *words, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		h = (h ^ words[i]) * 0x100000001B3ull;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+/* the link monitor (LL_*) stays out: an SC that comes out differently */
+/* shows up in its rt one instruction later                                  */
+static uint64_t hash_state()
+{
+	uint32_t status[2] = { INSTRUCTION_COUNT, RUN_FLAG };
+	uint64_t h = hash_words(0xCBF29CE484222325ull, status, 2);
+
+	h = hash_words(h, &CURRENT_STATE.PC, (offsetof(CPU_State, LL_ADDR) - offsetof(CPU_State, PC)) / 4);
+	return hash_words(h, &CURRENT_STATE.STATUS, (sizeof(CPU_State) - offsetof(CPU_State, STATUS)) / 4);
+}
+
+static void page_read(uint32_t address, uint32_t *words)
+{
+	uint8_t *first = mem_host_ptr(address), *last = mem_host_ptr(address + PAGE_BYTES - 1);
+	uint32_t i;
+
+	if (first != NULL && last == first + PAGE_BYTES - 1) {
+		memcpy(words, first, PAGE_BYTES);
+		return;
+	}
+	for (i = 0; i < PAGE_WORDS; i++) {
+		words[i] = mem_read_32(address + 4 * i);
+	}
+}
+
+static uint64_t hash_page(uint32_t address)
+{
+	uint32_t words[PAGE_WORDS];
+
+	page_read(address, words);
+	return hash_words(0xCBF29CE484222325ull, words, PAGE_WORDS);
+}
+
+/***************************************************************/
+/* Engine process                                                                                                         */
+/***************************************************************/
+static void engine_run(uint32_t target, int block)
+{
+	uint32_t pc;
+
+	if (srv.engine == ENGINE_LANES) {
+		if (RUN_FLAG && target != INSTRUCTION_COUNT) {
+			lanes_run(target - INSTRUCTION_COUNT);
+			lanes_commit(0);
+			INSTRUCTION_COUNT = srv.lane_base + LANES.group[0].count[0];
+		}
+		return;
+	}
+	while (RUN_FLAG && INSTRUCTION_COUNT != target) {
+		pc = CURRENT_STATE.PC;
+		cycle();
+		if (block && CURRENT_STATE.PC != pc + 4) {
+			break;
+		}
+		if (srv.engine == ENGINE_IDLE && CURRENT_STATE.PC <= pc && INSTRUCTION_COUNT != target) {
+			idle_skip(pc, target - INSTRUCTION_COUNT);
+		}
+	}
+}
+
+/***************************************************************/
+/* Snapshot: the child carries on and the parent waits as the saved */
+/* state, resuming if the child exits with 0. Dropping also ends the */
+/* snapshot before it, so only the newest one is kept.                   */
+/***************************************************************/
+static void fork_snapshot(int drop)
+{
+	uint32_t ok = TRUE;
+	pid_t child;
+	int status;
+
+	dirty_clear();
+	fflush(stdout);
+	child = fork();
+	if (child <= 0) {
+		ok = child == 0;
+		srv.snapshot_parent |= ok;
+		put(srv.replies, &ok, sizeof(ok));
+		return;
+	}
+	if (drop && srv.snapshot_parent) {
+		kill(getppid(), SIGKILL);
+		srv.snapshot_parent = FALSE;
+	}
+	if (waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		_exit(1);
+	}
+}
+
+static void serve()
+{
+	request_t req;
+	run_reply_t run;
+	engine_state_t st;
+	uint32_t words[PAGE_WORDS], *addresses = NULL, i;
+	uint64_t *hashes = NULL;
+
+	while (get(srv.requests, &req, sizeof(req))) {
+		switch (req.op) {
+			case OP_RUN:
+				engine_run(req.arg, req.block);
+				qsort(dirty, num_dirty, sizeof(uint32_t), by_address);
+				hashes = realloc(hashes, (num_dirty + 1) * sizeof(uint64_t));
+				for (i = 0; i < num_dirty; i++) {
+					hashes[i] = hash_page(dirty[i]);
+				}
+				run.count = INSTRUCTION_COUNT;
+				run.run_flag = RUN_FLAG;
+				run.num_dirty = num_dirty;
+				run.state_hash = hash_state();
+				put(srv.replies, &run, sizeof(run));
+				put(srv.replies, dirty, num_dirty * sizeof(uint32_t));
+				put(srv.replies, hashes, num_dirty * sizeof(uint64_t));
+				dirty_clear();
+				break;
+			case OP_HASH:
+				addresses = realloc(addresses, (req.arg + 1) * sizeof(uint32_t));
+				hashes = realloc(hashes, (req.arg + 1) * sizeof(uint64_t));
+				if (!get(srv.requests, addresses, req.arg * sizeof(uint32_t))) {
+					_exit(1);
+				}
+				for (i = 0; i < req.arg; i++) {
+					hashes[i] = hash_page(addresses[i]);
+				}
+				put(srv.replies, hashes, req.arg * sizeof(uint64_t));
+				break;
+			case OP_STATE:
+				st.state = CURRENT_STATE;
+				st.count = INSTRUCTION_COUNT;
+				st.run_flag = RUN_FLAG;
+				put(srv.replies, &st, sizeof(st));
+				break;
+			case OP_PAGE:
+				page_read(req.arg, words);
+				put(srv.replies, words, sizeof(words));
+				break;
+			case OP_SAVE:
+			case OP_KEEP:
+				fork_snapshot(req.op == OP_SAVE);
+				break;
+			case OP_BACK:
+				_exit(0);
+			default:
+				_exit(1);
+		}
+	}
+	_exit(1);
+}
+
+/***************************************************************/
+/* Checker                                                                                                                  */
+/***************************************************************/
+static int request(side_t *s, uint32_t op, uint32_t arg, uint32_t block)
+{
+	request_t req = { op, arg, block };
+	return put(s->requests, &req, sizeof(req));
+}
+
+static int spawn(side_t *s, int engine)
+{
+	int req[2], rep[2], i;
+	uint32_t ok = FALSE;
+
+	if (pipe(req) != 0) {
+		return FALSE;
+	}
+	if (pipe(rep) != 0) {
+		close(req[0]);
+		close(req[1]);
+		return FALSE;
+	}
+	fflush(stdout);
+	s->pid = fork();
+	if (s->pid == 0) {
+		close(req[1]);
+		close(rep[0]);
+		for (i = 0; i < 2; i++) {
+			if (&side[i] != s && side[i].pid > 0) {
+				close(side[i].requests);
+				close(side[i].replies);
+			}
+		}
+		srv.engine = engine;
+		srv.requests = req[0];
+		srv.replies = rep[1];
+		srv.snapshot_parent = FALSE;
+		/* both sides execute one instruction at a time; hooks, timing */
+		/* and tracing would only make them slower or noisier             */
+		INTERACTIVE = FALSE;
+		TRACE = FALSE;
+		TIMING_ACTIVE = FALSE;
+		HLE_ACTIVE = FALSE;
+		CKPT_INTERVAL = 0;
+		COSIM_TRACK = TRUE;
+		dirty_clear();
+		ok = engine != ENGINE_LANES || lanes_create(1);
+		srv.lane_base = INSTRUCTION_COUNT;
+		put(srv.replies, &ok, sizeof(ok));
+		if (ok) {
+			serve();
+		}
+		fflush(stdout);
+		_exit(1);
+	}
+	close(req[0]);
+	close(rep[1]);
+	if (s->pid < 0) {
+		s->pid = 0;
+		close(req[1]);
+		close(rep[0]);
+		return FALSE;
+	}
+	s->requests = req[1];
+	s->replies = rep[0];
+	return get(s->replies, &ok, sizeof(ok)) && ok;
+}
+
+/* dropped snapshots and the processes they leave behind are */
+/* reparented to us (we are their subreaper) and reaped here  */
+static void reap(int options)
+{
+	pid_t pid;
+
+	while ((pid = waitpid(-1, NULL, options)) > 0 || (pid < 0 && errno == EINTR));
+}
+
+static void shutdown_sides()
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (side[i].pid > 0) {
+			request(&side[i], OP_QUIT, 0, 0);
+			close(side[i].requests);
+			close(side[i].replies);
+			side[i].pid = 0;
+		}
+	}
+	reap(0);
+}
+
+static int save(uint32_t op)
+{
+	uint32_t ok[2] = { FALSE, FALSE };
+
+	reap(WNOHANG);
+	return request(&side[0], op, 0, 0) && request(&side[1], op, 0, 0) &&
+		get(side[0].replies, &ok[0], sizeof(uint32_t)) && get(side[1].replies, &ok[1], sizeof(uint32_t)) &&
+		ok[0] && ok[1];
+}
+
+static int back()
+{
+	return request(&side[0], OP_BACK, 0, 0) && request(&side[1], OP_BACK, 0, 0);
+}
+
+static int receive(side_t *s)
+{
+	if (!get(s->replies, &s->run, sizeof(s->run))) {
+		return FALSE;
+	}
+	s->dirty = realloc(s->dirty, (s->run.num_dirty + 1) * sizeof(uint32_t));
+	s->dirty_hashes = realloc(s->dirty_hashes, (s->run.num_dirty + 1) * sizeof(uint64_t));
+	return get(s->replies, s->dirty, s->run.num_dirty * sizeof(uint32_t)) &&
+		get(s->replies, s->dirty_hashes, s->run.num_dirty * sizeof(uint64_t));
+}
+
+/* both sides run to target in parallel; at a block boundary the engine */
+/* follows the reference to wherever its block ended                            */
+static int advance(uint32_t target, int block)
+{
+	if (!request(&side[0], OP_RUN, target, block)) {
+		return FALSE;
+	}
+	if (block) {
+		if (!receive(&side[0])) {
+			return FALSE;
+		}
+		target = side[0].run.count;
+	}
+	if (!request(&side[1], OP_RUN, target, FALSE)) {
+		return FALSE;
+	}
+	if (!block && !receive(&side[0])) {
+		return FALSE;
+	}
+	return receive(&side[1]);
+}
+
+/***************************************************************/
+/* Do the sides agree after the last run? The registers by hash,  */
+/* then every page either of them wrote; a page only one side     */
+/* wrote is hashed on the other side too. -1 if one of them died.  */
+/***************************************************************/
+static int check()
+{
+	side_t *a = &side[0], *b = &side[1], *s;
+	uint32_t i = 0, j = 0, k, m, n = a->run.num_dirty + b->run.num_dirty + 1;
+
+	pages = realloc(pages, n * sizeof(uint32_t));
+	lookup = realloc(lookup, n * sizeof(uint32_t));
+	for (k = 0; k < 2; k++) {
+		side[k].hashes = realloc(side[k].hashes, n * sizeof(uint64_t));
+		side[k].missing = realloc(side[k].missing, n * sizeof(uint32_t));
+		side[k].num_missing = 0;
+	}
+	for (num_pages = 0; i < a->run.num_dirty || j < b->run.num_dirty; num_pages++) {
+		if (j == b->run.num_dirty || (i < a->run.num_dirty && a->dirty[i] < b->dirty[j])) {
+			pages[num_pages] = a->dirty[i];
+			a->hashes[num_pages] = a->dirty_hashes[i++];
+			b->missing[b->num_missing++] = num_pages;
+		} else if (i == a->run.num_dirty || b->dirty[j] < a->dirty[i]) {
+			pages[num_pages] = b->dirty[j];
+			b->hashes[num_pages] = b->dirty_hashes[j++];
+			a->missing[a->num_missing++] = num_pages;
+		} else {
+			pages[num_pages] = a->dirty[i];
+			a->hashes[num_pages] = a->dirty_hashes[i++];
+			b->hashes[num_pages] = b->dirty_hashes[j++];
+		}
+	}
+
+	for (k = 0; k < 2; k++) {
+		s = &side[k];
+		if (s->num_missing == 0) {
+			continue;
+		}
+		for (m = 0; m < s->num_missing; m++) {
+			lookup[m] = pages[s->missing[m]];
+		}
+		s->dirty_hashes = realloc(s->dirty_hashes, n * sizeof(uint64_t));
+		if (!request(s, OP_HASH, s->num_missing, 0) || !put(s->requests, lookup, s->num_missing * sizeof(uint32_t)) ||
+				!get(s->replies, s->dirty_hashes, s->num_missing * sizeof(uint64_t))) {
+			return -1;
+		}
+		for (m = 0; m < s->num_missing; m++) {
+			s->hashes[s->missing[m]] = s->dirty_hashes[m];
+		}
+	}
+	checks++;
+	pages_compared += num_pages;
+	return a->run.count == b->run.count && a->run.run_flag == b->run.run_flag &&
+		a->run.state_hash == b->run.state_hash &&
+		!memcmp(a->hashes, b->hashes, num_pages * sizeof(uint64_t));
+}
+
+static void row(const char *name, uint32_t a, uint32_t b, int always)
+{
+	if (always || a != b) {
+		printf("[%s]\t: 0x%08x\t0x%08x%s\n", name, a, b, a != b ? "\t*" : "");
+	}
+}
+
+/***************************************************************/
+/* The sides agree at count `from` and run to `to` (normally one    */
+/* instruction on): both states side by side and the differing words */
+/***************************************************************/
+static int divergence(int engine, uint32_t from, uint32_t to)
+{
+	engine_state_t before, st[2];
+	uint32_t words[2][PAGE_WORDS], instruction, i, j, shown;
+	char name[16];
+	int first = TRUE, same;
+
+	diverged_at = from;
+	if (!request(&side[0], OP_STATE, 0, 0) || !get(side[0].replies, &before, sizeof(before)) ||
+			!request(&side[0], OP_PAGE, before.state.PC & ~(PAGE_BYTES - 1), 0) ||
+			!get(side[0].replies, words[0], sizeof(words[0]))) {
+		return FALSE;
+	}
+	instruction = words[0][(before.state.PC & (PAGE_BYTES - 1)) / 4];
+	if (!save(OP_KEEP) || !advance(to, FALSE) || (same = check()) < 0) {
+		return FALSE;
+	}
+	if (same) {
+		printf("Error: %s diverged after instruction %u but not when rerun from there\n", engine_names[engine], from);
+		return TRUE;
+	}
+	for (i = 0; i < 2; i++) {
+		if (!request(&side[i], OP_STATE, 0, 0) || !get(side[i].replies, &st[i], sizeof(st[i]))) {
+			return FALSE;
+		}
+	}
+
+	if (JSON_OUTPUT) {
+		printf("{\"cosim\":{\"engine\":\"%s\",\"diverged\":%u,\"span\":%u,\"pc\":%u,\"instruction\":%u,\"states\":[",
+				engine_names[engine], from, to - from, before.state.PC, instruction);
+		rdump_json(0, &st[0].state, st[0].count);
+		printf(",");
+		rdump_json(0, &st[1].state, st[1].count);
+		printf("],\"pages\":[");
+		for (i = 0; i < num_pages; i++) {
+			if (side[0].hashes[i] != side[1].hashes[i]) {
+				printf(first ? "%u" : ",%u", pages[i]);
+				first = FALSE;
+			}
+		}
+		printf("]}}\n");
+		return TRUE;
+	}
+	printf("-------------------------------------\n");
+	printf("%s diverges from the reference\n", engine_names[engine]);
+	printf("-------------------------------------\n");
+	if (to - from == 1) {
+		printf("instruction\t: %u\n", from);
+	} else {
+		printf("instructions\t: %u to %u, run as one span\n", from, to - 1);
+	}
+	printf("pc\t\t: 0x%08x (0x%08x)\n", before.state.PC, instruction);
+	printf("-------------------------------------\n");
+	printf("[Register]\t[reference]\t[%s]\n", engine_names[engine]);
+	printf("-------------------------------------\n");
+	printf("[Count]\t: %u\t\t%u%s\n", st[0].count, st[1].count, st[0].count != st[1].count ? "\t*" : "");
+	printf("[Running]\t: %u\t\t%u%s\n", st[0].run_flag, st[1].run_flag, st[0].run_flag != st[1].run_flag ? "\t*" : "");
+	row("PC", st[0].state.PC, st[1].state.PC, TRUE);
+	for (i = 0; i < MIPS_REGS; i++) {
+		snprintf(name, sizeof(name), "R%u", i);
+		row(name, st[0].state.REGS[i], st[1].state.REGS[i], TRUE);
+	}
+	row("HI", st[0].state.HI, st[1].state.HI, TRUE);
+	row("LO", st[0].state.LO, st[1].state.LO, TRUE);
+	row("STATUS", st[0].state.STATUS, st[1].state.STATUS, FALSE);
+	row("CAUSE", st[0].state.CAUSE, st[1].state.CAUSE, FALSE);
+	row("EPC", st[0].state.EPC, st[1].state.EPC, FALSE);
+	row("BADVADDR", st[0].state.BADVADDR, st[1].state.BADVADDR, FALSE);
+	for (i = 0; i < 32; i++) {
+		snprintf(name, sizeof(name), "F%u", i);
+		row(name, st[0].state.FPR[i], st[1].state.FPR[i], FALSE);
+	}
+	row("FCSR", st[0].state.FCSR, st[1].state.FCSR, FALSE);
+	for (i = 0; i < num_pages; i++) {
+		if (side[0].hashes[i] == side[1].hashes[i]) {
+			continue;
+		}
+		for (j = 0; j < 2; j++) {
+			if (!request(&side[j], OP_PAGE, pages[i], 0) || !get(side[j].replies, words[j], sizeof(words[j]))) {
+				return FALSE;
+			}
+		}
+		if (first) {
+			printf("-------------------------------------\n");
+			printf("[Address]\t[reference]\t[%s]\n", engine_names[engine]);
+			printf("-------------------------------------\n");
+			first = FALSE;
+		}
+		for (j = shown = 0; j < PAGE_WORDS && shown < COSIM_MAX_WORDS; j++) {
+			if (words[0][j] != words[1][j]) {
+				snprintf(name, sizeof(name), "0x%08x", pages[i] + 4 * j);
+				row(name, words[0][j], words[1][j], TRUE);
+				shown++;
+			}
+		}
+	}
+	printf("-------------------------------------\n");
+	return TRUE;
+}
+
+/***************************************************************/
+/* The sides agree at the snapshot, base, and not k instructions   */
+/* later: rewind and halve the distance until one instruction is left */
+/***************************************************************/
+static int bisect(int engine, uint32_t base, uint32_t k)
+{
+	uint32_t lo = 0, hi = k, from = 0, mid;
+	int same, depth = 0, from_depth = 0;
+
+	if (!back()) {
+		return FALSE;
+	}
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (!save(OP_KEEP) || !advance(base + mid, FALSE) || (same = check()) < 0) {
+			return FALSE;
+		}
+		if (same) {
+			lo = mid;
+			depth++;
+		} else {
+			from = lo;
+			from_depth = depth;
+			hi = mid;
+			if (!back()) {
+				return FALSE;
+			}
+		}
+	}
+
+	/* an engine whose work depends on how far it may run (loop skipping) */
+	/* can go wrong over a span and not over its last instruction alone   */
+	if (from != lo) {
+		if (!save(OP_KEEP) || !advance(base + hi, FALSE) || (same = check()) < 0 || !back()) {
+			return FALSE;
+		}
+		if (same) {
+			for (; depth > from_depth; depth--) {
+				if (!back()) {
+					return FALSE;
+				}
+			}
+		} else {
+			from = lo;
+		}
+	}
+	return divergence(engine, base + from, base + hi);
+}
+
+/***************************************************************/
+/* Run the program from the current state under the reference and */
+/* an engine, checking every interval instructions (COSIM_BLOCK:  */
+/* every basic block) until it halts or max instructions have run.  */
+/* The simulator's own state is left as it was.                           */
+/***************************************************************/
+int cosim_run(const char *name, uint32_t interval, uint32_t max)
+{
+	struct timespec begin, end;
+	uint32_t start = INSTRUCTION_COUNT, base = start, saved = start, step;
+	int engine, same = TRUE, ok = TRUE;
+	double seconds;
+	void (*old_pipe)(int);
+
+	for (engine = ENGINE_IDLE; engine <= ENGINE_LANES && strcmp(name, engine_names[engine]); engine++);
+	if (engine > ENGINE_LANES) {
+		printf("Error: no engine %s (idle or lanes)\n", name);
+		return FALSE;
+	}
+	if (NUM_HARTS > 1) {
+		printf("Error: co-simulation runs a single hart\n");
+		return FALSE;
+	}
+	if (MMIO_ACTIVE || NUM_FILEMAPS > 0) {
+		printf("Error: both engines would share the devices and mapped files; detach them first\n");
+		return FALSE;
+	}
+	if (RUN_FLAG == FALSE) {
+		if (!QUIET) {
+			printf("Simulation Stopped\n\n");
+		}
+		return FALSE;
+	}
+
+	checkpoint_wait();	/* every child from here on is ours */
+	prctl(PR_SET_CHILD_SUBREAPER, 1);
+	checks = pages_compared = 0;
+	old_pipe = signal(SIGPIPE, SIG_IGN);
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	if (!spawn(&side[0], ENGINE_REFERENCE) || !spawn(&side[1], engine)) {
+		printf("Error: could not start the %s engine\n", side[1].pid > 0 ? name : "reference");
+		shutdown_sides();
+		signal(SIGPIPE, old_pipe);
+		prctl(PR_SET_CHILD_SUBREAPER, 0);
+		return FALSE;
+	}
+	while (ok) {
+		step = interval == COSIM_BLOCK ? UINT32_MAX : interval;
+		if (max != 0 && start + max - base < step) {
+			step = start + max - base;
+		}
+		if (base == start || base - saved >= COSIM_SNAPSHOT) {
+			saved = base;
+			if (!save(OP_SAVE)) {
+				ok = FALSE;
+				break;
+			}
+		}
+		if (!advance(base + step, interval == COSIM_BLOCK) || (same = check()) < 0) {
+			ok = FALSE;
+			break;
+		}
+		if (!same) {
+			ok = bisect(engine, saved, side[0].run.count - saved);
+			break;
+		}
+		base = side[0].run.count;
+		if (!side[0].run.run_flag || (max != 0 && base - start == max)) {
+			break;
+		}
+	}
+	shutdown_sides();
+	signal(SIGPIPE, old_pipe);
+	prctl(PR_SET_CHILD_SUBREAPER, 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+	if (!ok) {
+		printf("Error: a co-simulation engine process died\n");
+		return FALSE;
+	}
+	if (JSON_OUTPUT) {
+		printf("{\"cosim\":{\"engine\":\"%s\",\"instructions\":%u,\"checks\":%llu,\"pages\":%llu,"
+				"\"host_seconds\":%.6f,\"agree\":%s}}\n",
+				engine_names[engine], (same ? base : diverged_at) - start, (unsigned long long)checks,
+				(unsigned long long)pages_compared, seconds, same ? "true" : "false");
+		return same;
+	}
+	printf("Co-simulation\t: %s against the reference\n", engine_names[engine]);
+	printf("instructions\t: %u\n", (same ? base : diverged_at) - start);
+	printf("checks\t\t: %llu\n", (unsigned long long)checks);
+	printf("pages compared\t: %llu\n", (unsigned long long)pages_compared);
+	printf("host_seconds\t: %.6f\n", seconds);
+	if (same) {
+		printf("result\t\t: identical\n\n");
+	} else {
+		printf("result\t\t: diverged at instruction %u\n\n", diverged_at);
+	}
+	return same;
+}
@@ -0,0 +1,26 @@
+#ifndef COSIM_H
+#define COSIM_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Lockstep co-simulation: the reference interpreter and a faster engine run in */
+/* two forked processes from the same state. At every check their registers and */
+/* the pages either of them wrote are compared by hash; a divergence is bisected */
+/* down to the instruction that sets them apart                                          */
+/******************************************************************************/
+#define COSIM_PAGE_BITS 12	/* granularity of the written-page set */
+#define COSIM_INTERVAL  1000000	/* default instructions between checks */
+#define COSIM_BLOCK     0	/* interval: check at the end of every basic block */
+#define COSIM_SNAPSHOT  1000000	/* instructions between the snapshots a divergence is bisected from */
+#define COSIM_MAX_WORDS 8	/* differing words shown per page */
+
+extern int COSIM_TRACK;	/* this process records the pages it writes */
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void cosim_dirty(uint32_t address);
+int cosim_run(const char *engine, uint32_t interval, uint32_t max);
+
+#endif
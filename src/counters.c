@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mu-mips.h"
+#include "counters.h"
+#include "smp.h"
+#include "timing.h"
+#include "sample.h"
+
+__thread uint64_t PERF[NUM_PERF];
+
+static double host_seconds;
+static struct timespec timer_begin;
+static const char *exit_path;
+
+static const char *perf_names[NUM_PERF] = {
+	"loads", "stores", "branches_taken", "branches_not_taken",
+	"jumps", "muldiv", "syscalls", "unimplemented"
+};
+
+/***************************************************************/
+/* Clear the counters of the current hart and the host timer          */
+/***************************************************************/
+void perf_reset()
+{
+	memset(PERF, 0, sizeof(PERF));
+	host_seconds = 0;
+}
+
+/***************************************************************/
+/* Host wall time is accumulated around run/sim only                   */
+/***************************************************************/
+void perf_timer_start()
+{
+	clock_gettime(CLOCK_MONOTONIC, &timer_begin);
+}
+
+void perf_timer_stop()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	host_seconds += (now.tv_sec - timer_begin.tv_sec) + (now.tv_nsec - timer_begin.tv_nsec) / 1e9;
+}
+
+/***************************************************************/
+/* C API: sum the counters of every hart                                         */
+/***************************************************************/
+void perf_read(perf_counters_t *out)
+{
+	uint64_t sum[NUM_PERF];
+	int i, j;
+
+	smp_save(HART_ID);
+	memset(out, 0, sizeof(*out));
+	memset(sum, 0, sizeof(sum));
+	for (i = 0; i < NUM_HARTS; i++) {
+		out->instructions += HARTS[i].instruction_count;
+		for (j = 0; j < NUM_PERF; j++) {
+			sum[j] += HARTS[i].perf[j];
+		}
+	}
+	out->loads = sum[PERF_LOADS];
+	out->stores = sum[PERF_STORES];
+	out->branches_taken = sum[PERF_BRANCH_TAKEN];
+	out->branches_not_taken = sum[PERF_BRANCH_NOT_TAKEN];
+	out->jumps = sum[PERF_JUMPS];
+	out->muldiv = sum[PERF_MULDIV];
+	out->syscalls = sum[PERF_SYSCALLS];
+	out->unimplemented = sum[PERF_UNIMPLEMENTED];
+	out->host_seconds = host_seconds;
+	out->mips = host_seconds > 0 ? out->instructions / host_seconds / 1e6 : 0;
+}
+
+/***************************************************************/
+/* Print the counters as a table or a JSON object                          */
+/***************************************************************/
+void perf_print(FILE *fp, int json)
+{
+	perf_counters_t c;
+	uint64_t values[NUM_PERF];
+	int i;
+
+	perf_read(&c);
+	values[PERF_LOADS] = c.loads;
+	values[PERF_STORES] = c.stores;
+	values[PERF_BRANCH_TAKEN] = c.branches_taken;
+	values[PERF_BRANCH_NOT_TAKEN] = c.branches_not_taken;
+	values[PERF_JUMPS] = c.jumps;
+	values[PERF_MULDIV] = c.muldiv;
+	values[PERF_SYSCALLS] = c.syscalls;
+	values[PERF_UNIMPLEMENTED] = c.unimplemented;
+
+	if (json) {
+		fprintf(fp, "{\"counters\":{\"instructions\":%llu", (unsigned long long)c.instructions);
+		for (i = 0; i < NUM_PERF; i++) {
+			fprintf(fp, ",\"%s\":%llu", perf_names[i], (unsigned long long)values[i]);
+		}
+		fprintf(fp, ",\"host_seconds\":%.6f,\"mips\":%.3f}", c.host_seconds, c.mips);
+		timing_print(fp, json);
+		sample_print(fp, json);
+		fprintf(fp, "}\n");
+		return;
+	}
+
+	fprintf(fp, "-------------------------------------\n");
+	fprintf(fp, "Performance Counters\n");
+	fprintf(fp, "-------------------------------------\n");
+	fprintf(fp, "instructions\t: %llu\n", (unsigned long long)c.instructions);
+	for (i = 0; i < NUM_PERF; i++) {
+		fprintf(fp, "%s\t: %llu\n", perf_names[i], (unsigned long long)values[i]);
+	}
+	fprintf(fp, "host_seconds\t: %.6f\n", c.host_seconds);
+	fprintf(fp, "mips\t\t: %.3f\n", c.mips);
+	fprintf(fp, "-------------------------------------\n");
+	timing_print(fp, json);
+	sample_print(fp, json);
+}
+
+/***************************************************************/
+/* Write the JSON counters to <path> ("-" for stdout) at exit          */
+/***************************************************************/
+static void perf_exit_handler()
+{
+	FILE *fp;
+
+	if (!strcmp(exit_path, "-")) {
+		perf_print(stdout, TRUE);
+		return;
+	}
+	fp = fopen(exit_path, "w");
+	if (fp == NULL) {
+		fprintf(stderr, "Error: Can't open stats file %s\n", exit_path);
+		return;
+	}
+	perf_print(fp, TRUE);
+	fclose(fp);
+}
+
+void perf_dump_at_exit(const char *path)
+{
+	if (exit_path == NULL) {
+		atexit(perf_exit_handler);
+	}
+	exit_path = path;
+}
@@ -0,0 +1,45 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/******************************************************************************/
+/* Performance counters                                                                                                  */
+/******************************************************************************/
+#define PERF_LOADS          0
+#define PERF_STORES         1
+#define PERF_BRANCH_TAKEN   2
+#define PERF_BRANCH_NOT_TAKEN 3
+#define PERF_JUMPS          4
+#define PERF_MULDIV         5
+#define PERF_SYSCALLS       6
+#define PERF_UNIMPLEMENTED  7
+#define NUM_PERF            8
+
+/* one increment at the instruction that already decides the event */
+#define PERF_BRANCH(taken) (PERF[(taken) ? PERF_BRANCH_TAKEN : PERF_BRANCH_NOT_TAKEN]++)
+
+/* per-hart event counts, saved and restored with the rest of the hart */
+extern __thread uint64_t PERF[NUM_PERF];
+
+typedef struct {
+	uint64_t instructions;
+	uint64_t loads, stores;
+	uint64_t branches_taken, branches_not_taken;
+	uint64_t jumps, muldiv, syscalls, unimplemented;
+	double host_seconds;	/* wall time spent inside run/sim */
+	double mips;		/* simulated instructions per host second, in millions */
+} perf_counters_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void perf_reset();
+void perf_timer_start();
+void perf_timer_stop();
+void perf_read(perf_counters_t *out);
+void perf_print(FILE *fp, int json);
+void perf_dump_at_exit(const char *path);
+
+#endif
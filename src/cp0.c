@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "smp.h"
+#include "cp0.h"
+#include "mmio.h"
+
+int CP0_ENABLED;
+int EXC_HANDLER;
+__thread int EXC_PENDING;
+uint64_t EXC_COUNTS[NUM_EXC];
+
+static __thread uint32_t pending_badvaddr;
+
+static const char *exc_name(int code)
+{
+	switch (code) {
+		case EXC_INT: return "Int";
+		case EXC_ADEL: return "AdEL";
+		case EXC_ADES: return "AdES";
+		case EXC_SYS: return "Sys";
+		case EXC_BP: return "Bp";
+		case EXC_RI: return "RI";
+		case EXC_OV: return "Ov";
+		case EXC_FPE: return "FPE";
+	}
+	return "?";
+}
+
+/***************************************************************/
+/* The loaders report what they wrote: a handler is installed once */
+/* code lands on the vector (a first instruction of 0 is a NOP too) */
+/***************************************************************/
+void cp0_loaded(uint32_t address, uint64_t length)
+{
+	if (length > 0 && EXC_VECTOR - address < length) {
+		EXC_HANDLER = TRUE;
+	}
+}
+
+/***************************************************************/
+/* Note an exception of the executing instruction; cycle() delivers */
+/* it after handle_instruction(), discarding the instruction's effects */
+/***************************************************************/
+void exception_raise(int code, uint32_t badvaddr)
+{
+	if (EXC_PENDING) {
+		return;	/* the first one raised by an instruction wins */
+	}
+	EXC_PENDING = code + 1;
+	pending_badvaddr = badvaddr;
+}
+
+/***************************************************************/
+/* Precise delivery: the faulting instruction leaves no trace but   */
+/* EPC, Cause, BadVAddr and Status.EXL, and the handler runs next.   */
+/* A fault inside the handler, or with no handler loaded, stops.     */
+/***************************************************************/
+void exception_take()
+{
+	int code = EXC_PENDING - 1;
+
+	EXC_PENDING = 0;
+	__atomic_fetch_add(&EXC_COUNTS[code], 1, __ATOMIC_RELAXED);
+	NEXT_STATE = CURRENT_STATE;
+	if ((CURRENT_STATE.STATUS & STATUS_EXL) || !EXC_HANDLER) {
+		if (!QUIET) {
+			printf("Exception %s at 0x%08x (BadVAddr 0x%08x) %s; simulation stopped\n", exc_name(code),
+					CURRENT_STATE.PC, pending_badvaddr,
+					CURRENT_STATE.STATUS & STATUS_EXL ? "inside the handler" : "with no handler loaded");
+		}
+		NEXT_STATE.CAUSE = (CURRENT_STATE.CAUSE & CAUSE_IP) | code << 2;
+		RUN_FLAG = FALSE;
+		return;
+	}
+	NEXT_STATE.EPC = CURRENT_STATE.PC;
+	NEXT_STATE.CAUSE = (CURRENT_STATE.CAUSE & CAUSE_IP) | code << 2;
+	if (code == EXC_ADEL || code == EXC_ADES) {
+		NEXT_STATE.BADVADDR = pending_badvaddr;
+	}
+	NEXT_STATE.STATUS |= STATUS_EXL;
+	NEXT_STATE.LL_BIT = 0;
+	NEXT_STATE.PC = EXC_VECTOR;
+}
+
+/***************************************************************/
+/* An unmasked device interrupt: the instruction at PC has not run  */
+/* yet, so it becomes EPC and the handler runs in its place; with no  */
+/* handler loaded it stops the simulation like any other exception   */
+/***************************************************************/
+void interrupt_take()
+{
+	__atomic_fetch_add(&EXC_COUNTS[EXC_INT], 1, __ATOMIC_RELAXED);
+	NEXT_STATE = CURRENT_STATE;
+	if (!EXC_HANDLER) {
+		if (!QUIET) {
+			printf("Exception Int at 0x%08x with no handler loaded; simulation stopped\n", CURRENT_STATE.PC);
+		}
+		NEXT_STATE.CAUSE = (CURRENT_STATE.CAUSE & CAUSE_IP) | EXC_INT << 2;
+		CURRENT_STATE = NEXT_STATE;
+		RUN_FLAG = FALSE;
+		return;
+	}
+	NEXT_STATE.EPC = CURRENT_STATE.PC;
+	NEXT_STATE.CAUSE = (CURRENT_STATE.CAUSE & CAUSE_IP) | EXC_INT << 2;
+	NEXT_STATE.STATUS |= STATUS_EXL;
+	NEXT_STATE.LL_BIT = 0;
+	NEXT_STATE.PC = EXC_VECTOR;
+	CURRENT_STATE = NEXT_STATE;
+}
+
+/* ERET */
+void exception_return()
+{
+	NEXT_STATE.PC = CURRENT_STATE.EPC;
+	NEXT_STATE.STATUS &= ~STATUS_EXL;
+	NEXT_STATE.LL_BIT = 0;
+	if (MMIO_ACTIVE && HART_ID == 0) {
+		mmio_kick();	/* a pending interrupt may be taken now */
+	}
+}
+
+/***************************************************************/
+/* MFC0/MTC0                                                                                                       */
+/***************************************************************/
+uint32_t cp0_read(int reg)
+{
+	switch (reg) {
+		case CP0_BADVADDR: return CURRENT_STATE.BADVADDR;
+		case CP0_COUNT: return INSTRUCTION_COUNT;
+		case CP0_STATUS: return CURRENT_STATE.STATUS;
+		case CP0_CAUSE: return CURRENT_STATE.CAUSE;
+		case CP0_EPC: return CURRENT_STATE.EPC;
+	}
+	return 0;
+}
+
+void cp0_write(int reg, uint32_t value)
+{
+	switch (reg) {
+		case CP0_STATUS:
+			NEXT_STATE.STATUS = value;
+			if (MMIO_ACTIVE && HART_ID == 0) {
+				mmio_kick();
+			}
+			break;
+		case CP0_CAUSE: NEXT_STATE.CAUSE = (NEXT_STATE.CAUSE & CAUSE_IP) | (value & ~CAUSE_IP); break;	/* IP belongs to the devices */
+		case CP0_EPC: NEXT_STATE.EPC = value; break;
+	}
+}
+
+/***************************************************************/
+/* Print the CP0 registers and how many exceptions were taken       */
+/***************************************************************/
+void cp0_print()
+{
+	int i, first = TRUE;
+
+	if (JSON_OUTPUT) {
+		printf("{\"exceptions\":%s,\"status\":%u,\"cause\":%u,\"epc\":%u,\"badvaddr\":%u,\"taken\":{",
+				CP0_ENABLED ? "true" : "false", CURRENT_STATE.STATUS, CURRENT_STATE.CAUSE,
+				CURRENT_STATE.EPC, CURRENT_STATE.BADVADDR);
+		for (i = 0; i < NUM_EXC; i++) {
+			if (EXC_COUNTS[i] != 0) {
+				printf("%s\"%s\":%llu", first ? "" : ",", exc_name(i), (unsigned long long)EXC_COUNTS[i]);
+				first = FALSE;
+			}
+		}
+		printf("}}\n");
+		return;
+	}
+	printf("Exceptions %s\n", CP0_ENABLED ? "on" : "off");
+	printf("[Status]\t: 0x%08x\n[Cause]\t\t: 0x%08x\n[EPC]\t\t: 0x%08x\n[BadVAddr]\t: 0x%08x\n",
+			CURRENT_STATE.STATUS, CURRENT_STATE.CAUSE, CURRENT_STATE.EPC, CURRENT_STATE.BADVADDR);
+	for (i = 0; i < NUM_EXC; i++) {
+		if (EXC_COUNTS[i] != 0) {
+			printf("%s\t: %llu taken\n", exc_name(i), (unsigned long long)EXC_COUNTS[i]);
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef CP0_H
+#define CP0_H
+
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+/******************************************************************************/
+/* Coprocessor 0: precise exceptions delivered to a kernel handler              */
+/******************************************************************************/
+#define EXC_VECTOR MEM_KTEXT_BEGIN	/* every exception enters here */
+
+/* Cause.ExcCode */
+#define EXC_INT   0
+#define EXC_ADEL  4	/* address error on a load or fetch */
+#define EXC_ADES  5	/* address error on a store */
+#define EXC_SYS   8
+#define EXC_BP    9
+#define EXC_RI   10	/* reserved instruction */
+#define EXC_OV   12	/* arithmetic overflow */
+#define EXC_FPE  15	/* enabled floating-point exception */
+#define NUM_EXC  32
+
+/* CP0 register numbers (MFC0/MTC0 rd) */
+#define CP0_BADVADDR 8
+#define CP0_COUNT    9
+#define CP0_STATUS  12
+#define CP0_CAUSE   13
+#define CP0_EPC     14
+
+#define STATUS_IE  0x1	/* interrupts enabled */
+#define STATUS_EXL 0x2	/* in the handler: a further exception stops the simulation */
+#define STATUS_IM  0x0000FF00	/* per-line interrupt mask, lined up with Cause.IP */
+#define CAUSE_IP   0x0000FF00	/* pending interrupt lines, driven by the devices */
+
+extern int CP0_ENABLED;	/* off: the historical behaviour (wrap, print, read 0) */
+extern int EXC_HANDLER;	/* code was loaded at EXC_VECTOR: exceptions and interrupts are delivered */
+extern __thread int EXC_PENDING;	/* ExcCode + 1 of the exception the current instruction raised */
+extern uint64_t EXC_COUNTS[NUM_EXC];
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void cp0_loaded(uint32_t address, uint64_t length);
+void exception_raise(int code, uint32_t badvaddr);
+void exception_take();
+void interrupt_take();
+void exception_return();
+uint32_t cp0_read(int reg);
+void cp0_write(int reg, uint32_t value);
+void cp0_print();
+
+/* an unaligned access faults when exceptions are on; the caller then skips it */
+static inline int misaligned(uint32_t address, uint32_t mask, int code)
+{
+	if (__builtin_expect((address & mask) != 0, 0) && CP0_ENABLED) {
+		exception_raise(code, address);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+#endif
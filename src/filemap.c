@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mu-mips.h"
+#include "filemap.h"
+
+static filemap_t FILEMAPS[MAX_FILEMAPS];
+int NUM_FILEMAPS;
+
+/***************************************************************/
+/* Replace guest pages with a view of the file (no copy)                 */
+/***************************************************************/
+static int filemap_apply(filemap_t *map)
+{
+	uint8_t *host = mem_host_ptr(map->address);
+	int fd;
+
+	fd = open(map->path, map->shared ? O_RDWR : O_RDONLY);
+	if (fd < 0) {
+		printf("Error: Can't open %s\n", map->path);
+		return FALSE;
+	}
+	if (mmap(host, map->length, PROT_READ | PROT_WRITE,
+			(map->shared ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		printf("Error: Can't map %s at 0x%08x\n", map->path, map->address);
+		close(fd);
+		return FALSE;
+	}
+	close(fd);
+	return TRUE;
+}
+
+/***************************************************************/
+/* Put anonymous zero pages back over a mapping                           */
+/***************************************************************/
+static void filemap_release(filemap_t *map)
+{
+	mmap(mem_host_ptr(map->address), map->length, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+}
+
+/***************************************************************/
+/* Map <path> at guest <address>, private copy-on-write or shared  */
+/***************************************************************/
+int filemap_map(const char *path, uint32_t address, int shared)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	filemap_t *map;
+	struct stat st;
+	int i;
+
+	if (NUM_FILEMAPS == MAX_FILEMAPS) {
+		printf("Error: at most %d files can be mapped\n", MAX_FILEMAPS);
+		return FALSE;
+	}
+	if (stat(path, &st) != 0 || st.st_size == 0) {
+		printf("Error: Can't map %s (missing or empty)\n", path);
+		return FALSE;
+	}
+	if (address < MEM_DATA_BEGIN || (address - MEM_DATA_BEGIN) % page != 0) {
+		printf("Error: mapping address must be a page-aligned address in the data segment\n");
+		return FALSE;
+	}
+	map = &FILEMAPS[NUM_FILEMAPS];
+	map->length = ((uint64_t)st.st_size + page - 1) / page * page;
+	if ((uint64_t)address + map->length - 1 > MEM_DATA_END) {
+		printf("Error: %s does not fit in the data segment at 0x%08x\n", path, address);
+		return FALSE;
+	}
+	for (i = 0; i < NUM_FILEMAPS; i++) {
+		if (address < FILEMAPS[i].address + FILEMAPS[i].length && FILEMAPS[i].address < address + map->length) {
+			printf("Error: 0x%08x overlaps the mapping of %s\n", address, FILEMAPS[i].path);
+			return FALSE;
+		}
+	}
+	snprintf(map->path, sizeof(map->path), "%s", path);
+	map->address = address;
+	map->shared = shared;
+	if (!filemap_apply(map)) {
+		return FALSE;
+	}
+	NUM_FILEMAPS++;
+	if (INTERACTIVE) {
+		printf("%s mapped at 0x%08x (%llu bytes, %s)\n", path, address,
+				(unsigned long long)st.st_size, shared ? "shared" : "private");
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Drop the mapping that starts at <address>                                 */
+/***************************************************************/
+void filemap_unmap(uint32_t address)
+{
+	int i;
+	for (i = 0; i < NUM_FILEMAPS; i++) {
+		if (FILEMAPS[i].address == address) {
+			filemap_release(&FILEMAPS[i]);
+			FILEMAPS[i] = FILEMAPS[--NUM_FILEMAPS];
+			return;
+		}
+	}
+	printf("Error: nothing is mapped at 0x%08x\n", address);
+}
+
+/***************************************************************/
+/* Drop every mapping                                                                          */
+/***************************************************************/
+void filemap_clear()
+{
+	while (NUM_FILEMAPS > 0) {
+		filemap_unmap(FILEMAPS[0].address);
+	}
+}
+
+/***************************************************************/
+/* Re-establish every mapping after reset() wiped guest memory       */
+/***************************************************************/
+void filemap_restore()
+{
+	int i;
+	for (i = 0; i < NUM_FILEMAPS; i++) {
+		filemap_apply(&FILEMAPS[i]);
+	}
+}
+
+/***************************************************************/
+/* Print the current mappings                                                         */
+/***************************************************************/
+void filemap_list()
+{
+	int i;
+	for (i = 0; i < NUM_FILEMAPS; i++) {
+		printf("0x%08x..0x%08llx\t%s\t%s\n", FILEMAPS[i].address,
+				(unsigned long long)FILEMAPS[i].address + FILEMAPS[i].length - 1,
+				FILEMAPS[i].shared ? "shared" : "private", FILEMAPS[i].path);
+	}
+}
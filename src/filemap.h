@@ -0,0 +1,29 @@
+#ifndef FILEMAP_H
+#define FILEMAP_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Host files mapped into MEM_DATA_BEGIN..MEM_DATA_END                                     */
+/******************************************************************************/
+#define MAX_FILEMAPS 16
+
+typedef struct {
+	char path[256];
+	uint32_t address;	/* guest address of the first byte */
+	uint64_t length;	/* mapped bytes, a whole number of host pages */
+	int shared;		/* write-through to the file instead of copy-on-write */
+} filemap_t;
+
+extern int NUM_FILEMAPS;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int filemap_map(const char *path, uint32_t address, int shared);
+void filemap_unmap(uint32_t address);
+void filemap_clear();
+void filemap_restore();
+void filemap_list();
+
+#endif
@@ -0,0 +1,519 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#else
+#include <fenv.h>
+#endif
+
+#include "mu-mips.h"
+#include "counters.h"
+#include "cp0.h"
+#include "fpu.h"
+
+/* legacy MIPS NaNs are quiet with the top fraction bit clear, the reverse of the host */
+__thread int FPU_DIRTY;
+
+#define NAN_S 0x7FBFFFFFu
+#define NAN_D 0x7FF7FFFFFFFFFFFFull
+#define WORD_INVALID 0x7FFFFFFF	/* float to word result of NaN or out of range */
+
+/***************************************************************/
+/* Each guest operation runs on the host unit in the guest rounding */
+/* mode with the sticky flags cleared, then the simulator's own     */
+/* floating-point environment comes back                                  */
+/***************************************************************/
+#if defined(__SSE2__)
+typedef uint32_t host_env_t;
+static const uint32_t host_rc[4] = { 0x0000, 0x6000, 0x4000, 0x2000 };	/* MXCSR RC of RN, RZ, RP, RM */
+#define FP_BARRIER(v) __asm__ volatile("" : "+x"(v))	/* keep the operation between the MXCSR accesses */
+
+static inline host_env_t host_begin(uint32_t rm)
+{
+	host_env_t saved = _mm_getcsr();
+	_mm_setcsr((saved & ~0x603F) | host_rc[rm]);
+	return saved;
+}
+
+static inline uint32_t host_end(host_env_t saved)
+{
+	uint32_t x = _mm_getcsr();
+	_mm_setcsr(saved);
+	return ((x & 0x20) ? FPE_I : 0) | ((x & 0x10) ? FPE_U : 0) | ((x & 0x08) ? FPE_O : 0) |
+			((x & 0x04) ? FPE_Z : 0) | ((x & 0x01) ? FPE_V : 0);
+}
+
+/* CVTSD2SI: current rounding mode, 0x80000000 and invalid when out of range */
+static inline int32_t host_to_word(double v)
+{
+	return _mm_cvtsd_si32(_mm_set_sd(v));
+}
+#else
+typedef fenv_t host_env_t;
+static const int host_rc[4] = { FE_TONEAREST, FE_TOWARDZERO, FE_UPWARD, FE_DOWNWARD };
+#define FP_BARRIER(v) __asm__ volatile("" : "+m"(v))
+
+static inline host_env_t host_begin(uint32_t rm)
+{
+	host_env_t saved;
+	feholdexcept(&saved);
+	fesetround(host_rc[rm]);
+	return saved;
+}
+
+static inline uint32_t host_end(host_env_t saved)
+{
+	int x = fetestexcept(FE_ALL_EXCEPT);
+	fesetenv(&saved);
+	return ((x & FE_INEXACT) ? FPE_I : 0) | ((x & FE_UNDERFLOW) ? FPE_U : 0) | ((x & FE_OVERFLOW) ? FPE_O : 0) |
+			((x & FE_DIVBYZERO) ? FPE_Z : 0) | ((x & FE_INVALID) ? FPE_V : 0);
+}
+
+static inline int32_t host_to_word(double v)
+{
+	double r = rint(v);
+	if (r != r || r >= 2147483648.0 || r < -2147483648.0) {
+		feraiseexcept(FE_INVALID);
+		return INT32_MIN;
+	}
+	return (int32_t)r;
+}
+#endif
+
+/***************************************************************/
+/* Register file: doubles live in even/odd pairs, low word first    */
+/***************************************************************/
+static inline float get_s(int r)
+{
+	float f;
+	memcpy(&f, &CURRENT_STATE.FPR[r], 4);
+	return f;
+}
+
+static inline double get_d(int r)
+{
+	uint64_t bits = (uint64_t)CURRENT_STATE.FPR[r | 1] << 32 | CURRENT_STATE.FPR[r & ~1];
+	double d;
+	memcpy(&d, &bits, 8);
+	return d;
+}
+
+static inline void set_s(int r, float f)
+{
+	memcpy(&NEXT_STATE.FPR[r], &f, 4);
+}
+
+static inline void set_d(int r, double d)
+{
+	uint64_t bits;
+	memcpy(&bits, &d, 8);
+	NEXT_STATE.FPR[r & ~1] = (uint32_t)bits;
+	NEXT_STATE.FPR[r | 1] = bits >> 32;
+}
+
+static inline void set_d_bits(int r, uint64_t bits)
+{
+	NEXT_STATE.FPR[r & ~1] = (uint32_t)bits;
+	NEXT_STATE.FPR[r | 1] = bits >> 32;
+}
+
+static inline int snan_s_bits(uint32_t u)
+{
+	return (u & 0x7FC00000) == 0x7FC00000;
+}
+
+static inline int snan_s(float f)
+{
+	uint32_t u;
+	memcpy(&u, &f, 4);
+	return snan_s_bits(u);
+}
+
+static inline int snan_d(double d)
+{
+	uint64_t u;
+	memcpy(&u, &d, 8);
+	return (u & 0x7FF8000000000000ull) == 0x7FF8000000000000ull;
+}
+
+/***************************************************************/
+/* Record an operation's exceptions in Cause and Flags; FALSE when  */
+/* an enabled one traps, which leaves the destination untouched      */
+/***************************************************************/
+static int fpu_raise(uint32_t cause)
+{
+	uint32_t fcsr = (CURRENT_STATE.FCSR & ~(0x3Fu << FCSR_CAUSE)) | cause << FCSR_CAUSE;
+
+	if ((cause & (fcsr >> FCSR_ENABLES)) && CP0_ENABLED) {
+		CURRENT_STATE.FCSR = fcsr;	/* the handler reads Cause; the trap discards everything else */
+		exception_raise(EXC_FPE, 0);
+		return FALSE;
+	}
+	NEXT_STATE.FCSR = fcsr | cause << FCSR_FLAGS;
+	return TRUE;
+}
+
+static void reserved()
+{
+	PERF[PERF_UNIMPLEMENTED]++;
+	if (CP0_ENABLED) {
+		exception_raise(EXC_RI, 0);
+	}
+	else if (!QUIET) {
+		printf("Instruction at 0x%x is not implemented!\n", CURRENT_STATE.PC);
+	}
+}
+
+/***************************************************************/
+/* ADD, SUB, MUL, DIV, SQRT                                                                                 */
+/***************************************************************/
+static void arith_s(int funct, int fd, int fs, int ft)
+{
+	float a = get_s(fs), b = get_s(ft), r;
+	uint32_t flags;
+	host_env_t env;
+
+	env = host_begin(CURRENT_STATE.FCSR & FCSR_RM);
+	FP_BARRIER(a);
+	FP_BARRIER(b);
+	switch (funct) {
+		case 0x00: r = a + b; break;
+		case 0x01: r = a - b; break;
+		case 0x02: r = a * b; break;
+		case 0x03: r = a / b; break;
+		default: r = __builtin_sqrtf(a); break;
+	}
+	FP_BARRIER(r);
+	flags = host_end(env);
+	if (r != r) {
+		/* NaN operands propagate quietly unless signaling; invalid operations raise V */
+		if (a != a || (funct != 0x04 && b != b)) {
+			flags = (snan_s(a) || (funct != 0x04 && snan_s(b))) ? FPE_V : 0;
+		}
+		if (fpu_raise(flags)) {
+			NEXT_STATE.FPR[fd] = NAN_S;
+		}
+		return;
+	}
+	if (fpu_raise(flags)) {
+		set_s(fd, r);
+	}
+}
+
+static void arith_d(int funct, int fd, int fs, int ft)
+{
+	double a = get_d(fs), b = get_d(ft), r;
+	uint32_t flags;
+	host_env_t env;
+
+	env = host_begin(CURRENT_STATE.FCSR & FCSR_RM);
+	FP_BARRIER(a);
+	FP_BARRIER(b);
+	switch (funct) {
+		case 0x00: r = a + b; break;
+		case 0x01: r = a - b; break;
+		case 0x02: r = a * b; break;
+		case 0x03: r = a / b; break;
+		default: r = __builtin_sqrt(a); break;
+	}
+	FP_BARRIER(r);
+	flags = host_end(env);
+	if (r != r) {
+		if (a != a || (funct != 0x04 && b != b)) {
+			flags = (snan_d(a) || (funct != 0x04 && snan_d(b))) ? FPE_V : 0;
+		}
+		if (fpu_raise(flags)) {
+			set_d_bits(fd, NAN_D);
+		}
+		return;
+	}
+	if (fpu_raise(flags)) {
+		set_d(fd, r);
+	}
+}
+
+/***************************************************************/
+/* CVT.W, ROUND.W, TRUNC.W, CEIL.W, FLOOR.W                                                 */
+/***************************************************************/
+static void to_word(double v, uint32_t rm, int fd)
+{
+	uint32_t flags;
+	int32_t w;
+	host_env_t env;
+
+	if (v != v) {
+		if (fpu_raise(FPE_V)) {
+			NEXT_STATE.FPR[fd] = WORD_INVALID;
+		}
+		return;
+	}
+	env = host_begin(rm);
+	FP_BARRIER(v);
+	w = host_to_word(v);
+	__asm__ volatile("" : "+r"(w));
+	flags = host_end(env);
+	if (flags & FPE_V) {
+		flags = FPE_V;
+		w = WORD_INVALID;
+	}
+	if (fpu_raise(flags)) {
+		NEXT_STATE.FPR[fd] = w;
+	}
+}
+
+/***************************************************************/
+/* CVT.S, CVT.D                                                                                                      */
+/***************************************************************/
+static void convert(int fmt, int funct, int fd, int fs)
+{
+	uint32_t flags;
+	host_env_t env;
+	int32_t w = (int32_t)CURRENT_STATE.FPR[fs];
+
+	if (funct == 0x20) {	/* CVT.S.D, CVT.S.W */
+		float r;
+		double d = fmt == FMT_D ? get_d(fs) : (double)w;	/* a word is exact in a double */
+		if (d != d) {
+			if (fpu_raise(snan_d(d) ? FPE_V : 0)) {
+				NEXT_STATE.FPR[fd] = NAN_S;
+			}
+			return;
+		}
+		env = host_begin(CURRENT_STATE.FCSR & FCSR_RM);
+		FP_BARRIER(d);
+		r = (float)d;
+		FP_BARRIER(r);
+		flags = host_end(env);
+		if (fpu_raise(flags)) {
+			set_s(fd, r);
+		}
+	} else {	/* CVT.D.S, CVT.D.W: always exact */
+		float s = get_s(fs);
+		if (fmt == FMT_S && s != s) {
+			if (fpu_raise(snan_s(s) ? FPE_V : 0)) {
+				set_d_bits(fd, NAN_D);
+			}
+			return;
+		}
+		if (fpu_raise(0)) {
+			set_d(fd, fmt == FMT_S ? (double)s : (double)w);
+		}
+	}
+}
+
+/***************************************************************/
+/* C.cond.fmt: cond bit 3 signals on NaN, bits 2/1/0 select less,   */
+/* equal and unordered                                                                                  */
+/***************************************************************/
+static void compare(int fmt, int cond, int fs, int ft)
+{
+	double a, b;
+	int snan, unordered, result;
+
+	if (fmt == FMT_S) {
+		/* from the register bits: widening to double may quiet the NaN first */
+		snan = snan_s_bits(CURRENT_STATE.FPR[fs]) || snan_s_bits(CURRENT_STATE.FPR[ft]);
+		a = get_s(fs);
+		b = get_s(ft);
+	} else {
+		a = get_d(fs);
+		b = get_d(ft);
+		snan = snan_d(a) || snan_d(b);
+	}
+	unordered = isunordered(a, b);
+	result = ((cond & 4) && isless(a, b)) || ((cond & 2) && a == b && !unordered) || ((cond & 1) && unordered);
+	if (fpu_raise(unordered && ((cond & 8) || snan) ? FPE_V : 0)) {
+		if (result) {
+			NEXT_STATE.FCSR |= FCSR_FCC;
+		} else {
+			NEXT_STATE.FCSR &= ~FCSR_FCC;
+		}
+	}
+}
+
+/***************************************************************/
+/* fmt S, D and W operations                                                                              */
+/***************************************************************/
+static void operate(int fmt, int funct, int fd, int fs, int ft)
+{
+	if (fmt == FMT_W) {
+		if (funct == 0x20 || funct == 0x21) {
+			convert(fmt, funct, fd, fs);
+		} else {
+			reserved();
+		}
+		return;
+	}
+	switch (funct) {
+		case 0x00: case 0x01: case 0x02: case 0x03: case 0x04: //ADD, SUB, MUL, DIV, SQRT
+			if (fmt == FMT_S) {
+				arith_s(funct, fd, fs, ft);
+			} else {
+				arith_d(funct, fd, fs, ft);
+			}
+			break;
+		case 0x05: case 0x06: case 0x07: //ABS, MOV, NEG: sign bit only, no exceptions
+			if (fmt == FMT_S) {
+				NEXT_STATE.FPR[fd] = CURRENT_STATE.FPR[fs];
+			} else {
+				NEXT_STATE.FPR[fd & ~1] = CURRENT_STATE.FPR[fs & ~1];
+				NEXT_STATE.FPR[fd | 1] = CURRENT_STATE.FPR[fs | 1];
+				fd |= 1;
+			}
+			if (funct == 0x05) {
+				NEXT_STATE.FPR[fd] &= 0x7FFFFFFF;
+			} else if (funct == 0x07) {
+				NEXT_STATE.FPR[fd] ^= 0x80000000;
+			}
+			break;
+		case 0x0C: case 0x0D: case 0x0E: case 0x0F: case 0x24: { //ROUND.W, TRUNC.W, CEIL.W, FLOOR.W, CVT.W
+			/* the low funct bits of ROUND..FLOOR are the RN, RZ, RP, RM encodings */
+			uint32_t rm = funct == 0x24 ? CURRENT_STATE.FCSR & FCSR_RM : funct & 3;
+			to_word(fmt == FMT_S ? get_s(fs) : get_d(fs), rm, fd);
+			break;
+		}
+		case 0x20: case 0x21: //CVT.S, CVT.D
+			if ((funct == 0x20 && fmt == FMT_S) || (funct == 0x21 && fmt == FMT_D)) {
+				reserved();
+			} else {
+				convert(fmt, funct, fd, fs);
+			}
+			break;
+		default:
+			if (funct >= 0x30) { //C.cond
+				compare(fmt, funct & 0xF, fs, ft);
+			} else {
+				reserved();
+			}
+			break;
+	}
+}
+
+/***************************************************************/
+/* Execute a COP1 instruction; returns TRUE when a branch was taken */
+/***************************************************************/
+int fpu_execute(uint32_t instruction)
+{
+	uint32_t fmt = (instruction >> 21) & 0x1F;
+	uint32_t ft = (instruction >> 16) & 0x1F;
+	uint32_t fs = (instruction >> 11) & 0x1F;
+	uint32_t fd = (instruction >> 6) & 0x1F;
+	uint32_t immediate = instruction & 0xFFFF;
+	int taken;
+
+	FPU_DIRTY = TRUE;
+	switch (fmt) {
+		case 0x00: //MFC1
+			NEXT_STATE.REGS[ft] = CURRENT_STATE.FPR[fs];
+			break;
+		case 0x02: //CFC1
+			NEXT_STATE.REGS[ft] = fs == 31 ? CURRENT_STATE.FCSR : fs == 0 ? FIR_VALUE : 0;
+			break;
+		case 0x04: //MTC1
+			NEXT_STATE.FPR[fs] = CURRENT_STATE.REGS[ft];
+			break;
+		case 0x06: //CTC1
+			if (fs == 31) {
+				NEXT_STATE.FCSR = CURRENT_STATE.REGS[ft] & FCSR_WRITABLE;
+			}
+			break;
+		case 0x08: //BC1F, BC1T
+			taken = ((CURRENT_STATE.FCSR & FCSR_FCC) != 0) == (ft & 1);
+			if (taken) {
+				NEXT_STATE.PC = CURRENT_STATE.PC + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
+			}
+			PERF_BRANCH(taken);
+			return taken;
+		case FMT_S: case FMT_D: case FMT_W:
+			operate(fmt, instruction & 0x3F, fd, fs, ft);
+			break;
+		default:
+			reserved();
+			break;
+	}
+	return FALSE;
+}
+
+/***************************************************************/
+/* Mnemonics, shared by the disassembler and the assembler           */
+/***************************************************************/
+static const char *fpu_names[64] = {
+	[0x00] = "ADD", [0x01] = "SUB", [0x02] = "MUL", [0x03] = "DIV",
+	[0x04] = "SQRT", [0x05] = "ABS", [0x06] = "MOV", [0x07] = "NEG",
+	[0x0C] = "ROUND.W", [0x0D] = "TRUNC.W", [0x0E] = "CEIL.W", [0x0F] = "FLOOR.W",
+	[0x20] = "CVT.S", [0x21] = "CVT.D", [0x24] = "CVT.W",
+	[0x30] = "C.F", [0x31] = "C.UN", [0x32] = "C.EQ", [0x33] = "C.UEQ",
+	[0x34] = "C.OLT", [0x35] = "C.ULT", [0x36] = "C.OLE", [0x37] = "C.ULE",
+	[0x38] = "C.SF", [0x39] = "C.NGLE", [0x3A] = "C.SEQ", [0x3B] = "C.NGL",
+	[0x3C] = "C.LT", [0x3D] = "C.NGE", [0x3E] = "C.LE", [0x3F] = "C.NGT"
+};
+
+/* fd, fs, ft for arithmetic; fs, ft for compares; fd, fs otherwise */
+static int fpu_operands(int funct)
+{
+	return funct <= 0x03 ? 3 : 2;
+}
+
+void fpu_disassemble(uint32_t instruction)
+{
+	uint32_t fmt = (instruction >> 21) & 0x1F;
+	uint32_t ft = (instruction >> 16) & 0x1F;
+	uint32_t fs = (instruction >> 11) & 0x1F;
+	uint32_t fd = (instruction >> 6) & 0x1F;
+	uint32_t funct = instruction & 0x3F;
+	char suffix = fmt == FMT_S ? 'S' : fmt == FMT_D ? 'D' : 'W';
+
+	switch (fmt) {
+		case 0x00: printf("MFC1 $r%u, $f%u\n", ft, fs); return;
+		case 0x02: printf("CFC1 $r%u, $%u\n", ft, fs); return;
+		case 0x04: printf("MTC1 $r%u, $f%u\n", ft, fs); return;
+		case 0x06: printf("CTC1 $r%u, $%u\n", ft, fs); return;
+		case 0x08: printf("%s 0x%x\n", (ft & 1) ? "BC1T" : "BC1F", (instruction & 0xFFFF) << 2); return;
+		case FMT_S: case FMT_D: case FMT_W:
+			if (fpu_names[funct] == NULL) {
+				break;
+			}
+			if (funct >= 0x30) {
+				printf("%s.%c $f%u, $f%u\n", fpu_names[funct], suffix, fs, ft);
+			} else if (fpu_operands(funct) == 3) {
+				printf("%s.%c $f%u, $f%u, $f%u\n", fpu_names[funct], suffix, fd, fs, ft);
+			} else {
+				printf("%s.%c $f%u, $f%u\n", fpu_names[funct], suffix, fd, fs);
+			}
+			return;
+	}
+	printf("Instruction is not implemented!\n");
+}
+
+/***************************************************************/
+/* "add.s", "c.lt.d", "cvt.d.w": fmt, funct and operand count       */
+/***************************************************************/
+int fpu_lookup(const char *mnemonic, int *fmt, int *funct, int *operands)
+{
+	const char *dot = strrchr(mnemonic, '.');
+	size_t length;
+	int i;
+
+	if (dot == NULL || dot[1] == '\0' || dot[2] != '\0') {
+		return FALSE;
+	}
+	switch (dot[1]) {
+		case 's': case 'S': *fmt = FMT_S; break;
+		case 'd': case 'D': *fmt = FMT_D; break;
+		case 'w': case 'W': *fmt = FMT_W; break;
+		default: return FALSE;
+	}
+	length = dot - mnemonic;
+	for (i = 0; i < 64; i++) {
+		if (fpu_names[i] != NULL && strlen(fpu_names[i]) == length && !strncasecmp(fpu_names[i], mnemonic, length)) {
+			*funct = i;
+			*operands = fpu_operands(i);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
@@ -0,0 +1,39 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Coprocessor 1: IEEE single/double arithmetic on the host SSE unit          */
+/******************************************************************************/
+#define FMT_S 0x10
+#define FMT_D 0x11
+#define FMT_W 0x14
+
+/* FCSR: RM in bits 0-1, then Flags, Enables and Cause fields of E/V/Z/O/U/I */
+#define FCSR_RM       0x00000003	/* 0 nearest, 1 toward zero, 2 up, 3 down */
+#define FCSR_FLAGS    2
+#define FCSR_ENABLES  7
+#define FCSR_CAUSE   12
+#define FCSR_FCC     0x00800000	/* condition bit set by C.cond.fmt, tested by BC1T/BC1F */
+#define FCSR_WRITABLE 0x0183FFFF
+
+/* one bit per IEEE exception, in field order */
+#define FPE_I 0x01	/* inexact */
+#define FPE_U 0x02	/* underflow */
+#define FPE_O 0x04	/* overflow */
+#define FPE_Z 0x08	/* divide by zero */
+#define FPE_V 0x10	/* invalid */
+
+#define FIR_VALUE 0x00130000	/* implements S, D and W */
+
+extern __thread int FPU_DIRTY;	/* the instruction wrote NEXT_STATE's FP registers: cycle() copies them too */
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int fpu_execute(uint32_t instruction);
+void fpu_disassemble(uint32_t instruction);
+int fpu_lookup(const char *mnemonic, int *fmt, int *funct, int *operands);
+
+#endif
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mu-mips.h"
+#include "guard.h"
+#include "cp0.h"
+#include "mmio.h"
+
+uint8_t *MEM_BASE;
+__thread int IN_GUEST;
+__thread int GUARD_FAULT;
+
+static __thread uint32_t fault_address;
+static __thread uint8_t *fault_pages[2];	/* an unaligned word can straddle two holes */
+static __thread int num_fault_pages;
+static __thread int fault_hole;	/* some access hit a real hole, not only device windows */
+static uintptr_t page_mask;
+static struct sigaction old_segv;
+
+/* SB, SH, SW, SC, SWC1, SDC1 */
+static int is_store(uint32_t opcode)
+{
+	return opcode == 0x28 || opcode == 0x29 || opcode == 0x2B || opcode == 0x38 || opcode == 0x39 || opcode == 0x3D;
+}
+
+/***************************************************************/
+/* A load from a device window: the scratch page gets the register */
+/* words the instruction reads (two for LDC1). Stores see zeros,    */
+/* so SB/SH write a whole register with the other bytes clear       */
+/***************************************************************/
+static void device_load(device_t *dev, uint32_t address)
+{
+	uint32_t opcode = guest_load_32(CURRENT_STATE.PC) >> 26;
+
+	if (is_store(opcode)) {
+		return;
+	}
+	address &= ~3u;
+	guest_store_32(address, mmio_read(dev, address));
+	if (opcode == 0x35 && mmio_find(address + 4) == dev) {
+		guest_store_32(address + 4, mmio_read(dev, address + 4));
+	}
+}
+
+/***************************************************************/
+/* SIGSEGV inside the guest range while an instruction runs: lend  */
+/* the hole a scratch page so the access completes, and let cycle() */
+/* discard the instruction (or, for a device window, complete the   */
+/* register access). Anything else belongs to whoever was handling  */
+/* the signal before us                                                           */
+/***************************************************************/
+static void guard_handler(int sig, siginfo_t *info, void *context)
+{
+	uint8_t *host = info->si_addr;
+	uint8_t *page = (uint8_t *)((uintptr_t)host & page_mask);
+
+	if (IN_GUEST && host >= MEM_BASE && host < MEM_BASE + GUEST_SPACE + GUARD_SIZE && num_fault_pages < 2 &&
+			mmap(page, ~page_mask + 1, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) != MAP_FAILED) {
+		uint32_t address = host - MEM_BASE;
+		device_t *dev = MMIO_ACTIVE && address - CURRENT_STATE.PC >= 4 ? mmio_find(address) : NULL;
+
+		if (!GUARD_FAULT) {
+			fault_address = address;
+			GUARD_FAULT = TRUE;
+		}
+		fault_pages[num_fault_pages++] = page;
+		if (dev != NULL) {
+			device_load(dev, address);
+		} else {
+			fault_hole = TRUE;
+		}
+		return;
+	}
+	if (old_segv.sa_flags & SA_SIGINFO) {
+		old_segv.sa_sigaction(sig, info, context);
+	} else if (old_segv.sa_handler != SIG_DFL && old_segv.sa_handler != SIG_IGN) {
+		old_segv.sa_handler(sig);
+	} else {
+		signal(sig, SIG_DFL);	/* returning re-executes the access and dies as usual */
+	}
+}
+
+/***************************************************************/
+/* Reserve the guest address space and map the regions into it     */
+/***************************************************************/
+void guard_reserve()
+{
+	struct sigaction sa;
+	int i;
+
+	MEM_BASE = mmap(NULL, GUEST_SPACE + GUARD_SIZE, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (MEM_BASE == MAP_FAILED) {
+		printf("Error: Can't reserve the guest address space\n");
+		exit(-1);
+	}
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
+		/* anonymous mappings are zero-filled and only cost memory once touched */
+		MEM_REGIONS[i].mem = mmap(MEM_BASE + MEM_REGIONS[i].begin, region_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+		if (MEM_REGIONS[i].mem == MAP_FAILED) {
+			printf("Error: Can't allocate guest memory\n");
+			exit(-1);
+		}
+	}
+
+	page_mask = ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1);
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = guard_handler;
+	sa.sa_flags = SA_SIGINFO;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGSEGV, &sa, &old_segv);
+}
+
+void guard_release()
+{
+	int i;
+
+	if (MEM_BASE == NULL) {
+		return;
+	}
+	sigaction(SIGSEGV, &old_segv, NULL);
+	munmap(MEM_BASE, GUEST_SPACE + GUARD_SIZE);
+	MEM_BASE = NULL;
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		MEM_REGIONS[i].mem = NULL;
+	}
+}
+
+/***************************************************************/
+/* The instruction at PC trapped. Device register accesses complete: */
+/* a store hands the word(s) it left on the scratch page to the      */
+/* device. Otherwise put the holes back, discard the instruction and  */
+/* either raise an address error or stop with a report naming the    */
+/* PC and address                                                                               */
+/***************************************************************/
+void guard_fault()
+{
+	uint32_t pc = CURRENT_STATE.PC;
+	uint32_t opcode, address;
+	int fetch, store, device;
+
+	fetch = fault_address - pc < 4;
+	opcode = fetch ? 0 : mem_read_32(pc) >> 26;
+	store = is_store(opcode);
+	address = fetch ? pc : RETIRED.mem_addr;
+	/* LL/SC have nothing to link to in a device */
+	device = !fault_hole && !fetch && opcode != 0x30 && opcode != 0x38;
+	if (device && store) {
+		address &= ~3u;
+		mmio_write(mmio_find(address), address, guest_load_32(address));
+		if (opcode == 0x3D && mmio_find(address + 4) != NULL) {
+			mmio_write(mmio_find(address + 4), address + 4, guest_load_32(address + 4));
+		}
+	}
+
+	while (num_fault_pages > 0) {
+		mmap(fault_pages[--num_fault_pages], ~page_mask + 1, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+	}
+	GUARD_FAULT = FALSE;
+	fault_hole = FALSE;
+	if (device) {
+		return;
+	}
+
+	NEXT_STATE = CURRENT_STATE;
+	if (CP0_ENABLED) {
+		exception_raise(store ? EXC_ADES : EXC_ADEL, address);
+		return;
+	}
+	sim_error("guest %s at PC 0x%08x touched unmapped address 0x%08x",
+			fetch ? "fetch" : store ? "store" : "load", pc, address);
+	RUN_FLAG = FALSE;
+}
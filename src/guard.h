@@ -0,0 +1,78 @@
+#ifndef GUARD_H
+#define GUARD_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cosim.h"
+
+/******************************************************************************/
+/* Guest memory as one reserved host range: the regions are mapped at             */
+/* MEM_BASE + address and every hole is PROT_NONE, so a wild guest access       */
+/* traps in the host MMU instead of being bounds checked in software             */
+/******************************************************************************/
+#define GUEST_SPACE ((uint64_t)1 << 32)
+#define GUARD_SIZE 4096	/* past the top of the guest space: the last word's spill traps too */
+
+extern uint8_t *MEM_BASE;	/* host address of guest address 0 */
+extern __thread int IN_GUEST;	/* handle_instruction() is running: a trap is a guest fault */
+extern __thread int GUARD_FAULT;	/* the running instruction trapped; cycle() must discard it */
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void guard_reserve();
+void guard_release();
+void guard_fault();
+
+/* the guest is little endian like the host; unaligned words are fine */
+static inline uint32_t guest_load_32(uint32_t address)
+{
+	uint32_t value;
+	memcpy(&value, MEM_BASE + address, 4);
+	return value;
+}
+
+/* sub-word loads read only their own bytes: the last byte of a region is legal */
+/* even when the next page is a hole */
+static inline uint32_t guest_load_16(uint32_t address)
+{
+	uint16_t value;
+	memcpy(&value, MEM_BASE + address, 2);
+	return value;
+}
+
+static inline uint32_t guest_load_8(uint32_t address)
+{
+	return MEM_BASE[address];
+}
+
+static inline void guest_store_32(uint32_t address, uint32_t value)
+{
+	if (__builtin_expect(COSIM_TRACK, 0)) {
+		cosim_dirty(address);
+		cosim_dirty(address + 3);
+	}
+	memcpy(MEM_BASE + address, &value, 4);
+}
+
+/* sub-word stores write only their own bytes: harts running on host threads */
+/* share memory, and a read-modify-write of the word would lose a neighbour's store */
+static inline void guest_store_16(uint32_t address, uint16_t value)
+{
+	if (__builtin_expect(COSIM_TRACK, 0)) {
+		cosim_dirty(address);
+		cosim_dirty(address + 1);
+	}
+	memcpy(MEM_BASE + address, &value, 2);
+}
+
+static inline void guest_store_8(uint32_t address, uint8_t value)
+{
+	if (__builtin_expect(COSIM_TRACK, 0)) {
+		cosim_dirty(address);
+	}
+	MEM_BASE[address] = value;
+}
+
+#endif
@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "smp.h"
+#include "timing.h"
+#include "hle.h"
+#include "callprof.h"
+
+int HLE_ACTIVE;
+int HLE_CHECK;
+
+static hle_hook_t hooks[MAX_HOOKS];
+static int num_hooks;
+static uint8_t filter[HLE_FILTER];
+
+static const char *kind_names[NUM_HLE] = { "memcpy", "memset", "strlen", "sort", "sortu" };
+
+/* a call being verified: the native result waits for the guest code to return */
+static struct {
+	int active;
+	hle_hook_t *hook;
+	uint32_t ret, sp;
+	uint32_t start_count;
+	CPU_State expect;
+	uint32_t addr, len;
+	uint8_t *bytes;
+} check;
+
+/***************************************************************/
+/* Symbols come from <program>.sym: one "address name" per line   */
+/***************************************************************/
+static int hle_symbol(const char *name, uint32_t *addr)
+{
+	char path[300], line[256], sym[128];
+	char *dot;
+	unsigned int value;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s", prog_file);
+	dot = strrchr(path, '.');
+	if (dot != NULL && strchr(dot, '/') == NULL) {
+		*dot = '\0';
+	}
+	strcat(path, ".sym");
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		printf("Error: Can't open symbol file %s\n", path);
+		return FALSE;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "%x %127s", &value, sym) == 2 && !strcmp(sym, name)) {
+			*addr = value;
+			fclose(fp);
+			return TRUE;
+		}
+	}
+	fclose(fp);
+	printf("Error: no symbol %s in %s\n", name, path);
+	return FALSE;
+}
+
+/***************************************************************/
+/* Hook registry                                               */
+/***************************************************************/
+int hle_hook(const char *where, const char *kind, int estimate, uint32_t base, uint32_t per_unit)
+{
+	hle_hook_t *h;
+	uint32_t pc;
+	char *end;
+	int i, k;
+
+	for (k = 0; k < NUM_HLE && strcmp(kind, kind_names[k]); k++);
+	if (k == NUM_HLE) {
+		printf("Error: unknown hook %s (memcpy, memset, strlen, sort, sortu)\n", kind);
+		return FALSE;
+	}
+	pc = strtoul(where, &end, 16);
+	if (*end != '\0' && !hle_symbol(where, &pc)) {
+		return FALSE;
+	}
+	for (i = 0; i < num_hooks && hooks[i].pc != pc; i++);
+	if (i == MAX_HOOKS) {
+		printf("Error: at most %d hooks\n", MAX_HOOKS);
+		return FALSE;
+	}
+	h = &hooks[i];
+	memset(h, 0, sizeof(*h));
+	h->pc = pc;
+	h->kind = k;
+	snprintf(h->name, sizeof(h->name), "%s", where);
+	h->estimate = estimate;
+	h->base = base;
+	h->per_unit = per_unit;
+	if (i == num_hooks) {
+		num_hooks++;
+	}
+	filter[(pc >> 2) & (HLE_FILTER - 1)] = 1;
+	HLE_ACTIVE = TRUE;
+	return TRUE;
+}
+
+/* a reset abandons the call being checked */
+void hle_reset()
+{
+	check.active = FALSE;
+	free(check.bytes);
+	check.bytes = NULL;
+}
+
+void hle_clear()
+{
+	num_hooks = 0;
+	memset(filter, 0, sizeof(filter));
+	HLE_ACTIVE = FALSE;
+	hle_reset();
+}
+
+void hle_list()
+{
+	int i;
+
+	if (JSON_OUTPUT) {
+		printf("{\"hooks\":[");
+		for (i = 0; i < num_hooks; i++) {
+			printf("%s{\"pc\":%u,\"name\":\"%s\",\"kind\":\"%s\",\"calls\":%llu,\"fallbacks\":%llu,"
+					"\"units\":%llu,\"checks\":%llu,\"mismatches\":%llu,\"emulated\":%llu}",
+					i ? "," : "", hooks[i].pc, hooks[i].name, kind_names[hooks[i].kind],
+					(unsigned long long)hooks[i].calls, (unsigned long long)hooks[i].fallbacks,
+					(unsigned long long)hooks[i].units, (unsigned long long)hooks[i].checks,
+					(unsigned long long)hooks[i].mismatches, (unsigned long long)hooks[i].emulated);
+		}
+		printf("]}\n");
+		return;
+	}
+	printf("PC\t\tHook\t\tKind\tCalls\tFallbacks\tChecks\tMismatches\tEmulated instructions\n");
+	for (i = 0; i < num_hooks; i++) {
+		printf("0x%08x\t%-15s\t%s\t%llu\t%llu\t\t%llu\t%llu\t\t%llu\n", hooks[i].pc, hooks[i].name,
+				kind_names[hooks[i].kind], (unsigned long long)hooks[i].calls,
+				(unsigned long long)hooks[i].fallbacks, (unsigned long long)hooks[i].checks,
+				(unsigned long long)hooks[i].mismatches, (unsigned long long)hooks[i].emulated);
+	}
+}
+
+/***************************************************************/
+/* Native routines: host pointers into guest memory, so the copies */
+/* run through the host's vectorized libc. FALSE leaves the call to */
+/* the guest code (range spans regions, or overlap the guest loop   */
+/* would handle differently).                                                                                    */
+/***************************************************************/
+static int cmp_signed(const void *a, const void *b)
+{
+	int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static int cmp_unsigned(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* the guest bytes a call writes, for checking */
+static void written_range(hle_hook_t *h, uint32_t *addr, uint32_t *len)
+{
+	*addr = CURRENT_STATE.REGS[4];
+	switch (h->kind) {
+		case HLE_MEMCPY:
+		case HLE_MEMSET: *len = CURRENT_STATE.REGS[6]; break;
+		case HLE_SORT:
+		case HLE_SORTU: *len = CURRENT_STATE.REGS[5] * 4; break;
+		default: *len = 0; break;
+	}
+}
+
+static int native(hle_hook_t *h, uint64_t *units)
+{
+	uint32_t a0 = CURRENT_STATE.REGS[4], a1 = CURRENT_STATE.REGS[5], a2 = CURRENT_STATE.REGS[6];
+	uint64_t len, span;
+	uint8_t *dst, *src, *nul;
+	uint32_t *words;
+
+	switch (h->kind) {
+		case HLE_MEMCPY:
+			if (a2 > 0) {
+				/* a forward byte loop replicates when dst overlaps src from above */
+				if (a0 > a1 && a0 - a1 < a2) return FALSE;
+				len = a2;
+				dst = mem_span(a0, &len);
+				if (dst == NULL || len != a2) return FALSE;
+				src = mem_span(a1, &len);
+				if (src == NULL || len != a2) return FALSE;
+				memmove(dst, src, a2);
+			}
+			CURRENT_STATE.REGS[2] = a0;
+			*units = a2;
+			break;
+		case HLE_MEMSET:
+			if (a2 > 0) {
+				len = a2;
+				dst = mem_span(a0, &len);
+				if (dst == NULL || len != a2) return FALSE;
+				memset(dst, a1 & 0xFF, a2);
+			}
+			CURRENT_STATE.REGS[2] = a0;
+			*units = a2;
+			break;
+		case HLE_STRLEN:
+			span = UINT32_MAX;
+			src = mem_span(a0, &span);
+			if (src == NULL) return FALSE;
+			nul = memchr(src, 0, span);
+			if (nul == NULL) return FALSE;
+			CURRENT_STATE.REGS[2] = nul - src;
+			*units = nul - src;
+			break;
+		case HLE_SORT:
+		case HLE_SORTU:
+			len = (uint64_t)a1 * 4;
+			dst = mem_span(a0, &len);
+			if (dst == NULL || len != (uint64_t)a1 * 4) return FALSE;
+			words = malloc(len);	/* guest words may be unaligned on the host */
+			memcpy(words, dst, len);
+			qsort(words, a1, 4, h->kind == HLE_SORT ? cmp_signed : cmp_unsigned);
+			memcpy(dst, words, len);
+			free(words);
+			*units = (uint64_t)a1 * a1;
+			break;
+	}
+	CURRENT_STATE.PC = CURRENT_STATE.REGS[31];
+	return TRUE;
+}
+
+/***************************************************************/
+/* The checked call returned: compare what callers can observe         */
+/***************************************************************/
+static void check_done()
+{
+	static const int compared[] = { 2, 16, 17, 18, 19, 20, 21, 22, 23, 28, 29, 30 };
+	hle_hook_t *h = check.hook;
+	uint8_t *host;
+	uint64_t len = check.len;
+	int i, ok = TRUE;
+
+	check.active = FALSE;
+	h->checks++;
+	h->emulated += INSTRUCTION_COUNT - check.start_count;
+	for (i = 0; i < sizeof(compared) / sizeof(compared[0]); i++) {
+		int r = compared[i];
+		if (r == 2 && (h->kind == HLE_SORT || h->kind == HLE_SORTU)) {
+			continue;	/* sorts return nothing */
+		}
+		if (CURRENT_STATE.REGS[r] != check.expect.REGS[r]) {
+			printf("Hook %s at 0x%08x: $r%d is 0x%08x, native gave 0x%08x\n", h->name, h->pc, r,
+					CURRENT_STATE.REGS[r], check.expect.REGS[r]);
+			ok = FALSE;
+		}
+	}
+	if (len > 0) {
+		host = mem_span(check.addr, &len);
+		for (i = 0; host != NULL && i < len; i++) {
+			if (host[i] != check.bytes[i]) {
+				printf("Hook %s at 0x%08x: memory at 0x%08x is 0x%02x, native gave 0x%02x\n", h->name, h->pc,
+						check.addr + i, host[i], check.bytes[i]);
+				ok = FALSE;
+				break;
+			}
+		}
+	}
+	if (!ok) {
+		h->mismatches++;
+	}
+	free(check.bytes);
+	check.bytes = NULL;
+}
+
+/***************************************************************/
+/* Start of every cycle: finish a pending check, then run a hook at */
+/* PC natively. TRUE when the hook replaced the call.                        */
+/***************************************************************/
+int hle_cycle()
+{
+	hle_hook_t *h;
+	CPU_State before;
+	uint64_t units = 0, len;
+	uint8_t *host;
+	int i;
+
+	if (check.active) {
+		if (CURRENT_STATE.PC == check.ret && CURRENT_STATE.REGS[29] == check.sp) {
+			check_done();
+		}
+		return FALSE;	/* hooks nested in a checked call run as guest code */
+	}
+	if (!filter[(CURRENT_STATE.PC >> 2) & (HLE_FILTER - 1)] || TIMING_ACTIVE) {
+		return FALSE;
+	}
+	for (i = 0; i < num_hooks && hooks[i].pc != CURRENT_STATE.PC; i++);
+	if (i == num_hooks) {
+		return FALSE;
+	}
+	h = &hooks[i];
+
+	if (HLE_CHECK && NUM_HARTS == 1) {
+		/* run native on the side, then let the guest code run for real */
+		before = CURRENT_STATE;
+		written_range(h, &check.addr, &check.len);
+		len = check.len;
+		host = check.len ? mem_span(check.addr, &len) : NULL;
+		if (check.len && (host == NULL || len != check.len)) {
+			return FALSE;
+		}
+		check.bytes = malloc(check.len + 1);
+		memcpy(check.bytes, host, check.len);	/* the guest's bytes, for the moment */
+		if (!native(h, &units)) {
+			free(check.bytes);
+			check.bytes = NULL;
+			h->fallbacks++;
+			return FALSE;
+		}
+		check.expect = CURRENT_STATE;
+		CURRENT_STATE = before;
+		for (i = 0; i < check.len; i++) {
+			uint8_t native_byte = host[i];
+			host[i] = check.bytes[i];
+			check.bytes[i] = native_byte;
+		}
+		check.hook = h;
+		check.ret = before.REGS[31];
+		check.sp = before.REGS[29];
+		check.start_count = INSTRUCTION_COUNT;
+		check.active = TRUE;
+		return FALSE;
+	}
+
+	if (!native(h, &units)) {
+		h->fallbacks++;
+		return FALSE;
+	}
+	NEXT_STATE = CURRENT_STATE;
+	h->calls++;
+	h->units += units;
+	INSTRUCTION_COUNT += h->estimate ? h->base + h->per_unit * units : 1;
+	if (CALLPROF_ACTIVE && HART_ID == 0) {
+		callprof_return(CURRENT_STATE.PC, INSTRUCTION_COUNT);	/* the native routine returned to $ra */
+	}
+	return TRUE;
+}
@@ -0,0 +1,43 @@
+#ifndef HLE_H
+#define HLE_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* High-level emulation: native host code for hooked guest routines                    */
+/******************************************************************************/
+#define HLE_MEMCPY 0	/* memcpy(dst $a0, src $a1, n $a2) -> $v0 = dst */
+#define HLE_MEMSET 1	/* memset(dst $a0, c $a1, n $a2) -> $v0 = dst */
+#define HLE_STRLEN 2	/* strlen(s $a0) -> $v0 */
+#define HLE_SORT   3	/* sort(base $a0, n $a1): signed words, ascending */
+#define HLE_SORTU  4	/* the same with unsigned compares (this core's SLT) */
+#define NUM_HLE    5
+
+#define MAX_HOOKS 64
+#define HLE_FILTER 4096	/* per-pc filter slots checked before the hook table */
+
+typedef struct {
+	uint32_t pc;
+	int kind;
+	char name[64];
+	int estimate;	/* charge base + per_unit * units instructions instead of 1 */
+	uint32_t base, per_unit;
+	uint64_t calls, fallbacks;	/* native runs, and calls left to the guest code */
+	uint64_t checks, mismatches;
+	uint64_t emulated;	/* instructions the checked calls took in the guest code */
+	uint64_t units;	/* bytes, characters or elements (squared for sorts) handled */
+} hle_hook_t;
+
+extern int HLE_ACTIVE;	/* any hook registered: cycle() must look */
+extern int HLE_CHECK;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int hle_hook(const char *where, const char *kind, int estimate, uint32_t base, uint32_t per_unit);
+void hle_clear();
+void hle_reset();
+void hle_list();
+int hle_cycle();
+
+#endif
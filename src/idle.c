@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "counters.h"
+#include "idle.h"
+#include "cp0.h"
+#include "mmio.h"
+
+int IDLE_SKIP = TRUE;
+uint64_t IDLE_LOOPS, IDLE_SKIPPED;
+
+static idle_loop_t loops[IDLE_SLOTS];
+
+#define SKIP_CAP 0x40000000	/* instructions skipped at once; INSTRUCTION_COUNT is 32-bit */
+
+void idle_reset()
+{
+	memset(loops, 0, sizeof(loops));
+}
+
+/***************************************************************/
+/* Accept a loop whose body only steps registers by constants           */
+/* (r += imm, r += s, r -= s with s constant in the loop) or            */
+/* recomputes the same value every iteration from registers the        */
+/* body never writes, closed by a conditional branch. No memory,       */
+/* no HI/LO, no jumps: such a loop is fully described by the steps.   */
+/***************************************************************/
+static void analyse(idle_loop_t *e)
+{
+	uint32_t instruction, opcode, function, rs, rt, rd, pc;
+	uint32_t written = 0, invariant_src = 0;
+	int n = 0, i;
+
+	e->loop = FALSE;
+	e->ninduct = 0;
+	e->length = (e->pc - e->target) / 4 + 1;
+	if (e->length > IDLE_MAX_BODY) {
+		return;
+	}
+	opcode = e->branch >> 26;
+	rt = (e->branch >> 16) & 0x1F;
+	if (!(opcode >= 0x04 && opcode <= 0x07) && !(opcode == 0x01 && rt <= 0x01)) {
+		return;
+	}
+
+	for (pc = e->target; pc < e->pc; pc += 4) {
+		instruction = mem_read_32(pc);
+		opcode = instruction >> 26;
+		function = instruction & 0x3F;
+		rs = (instruction >> 21) & 0x1F;
+		rt = (instruction >> 16) & 0x1F;
+		rd = (instruction >> 11) & 0x1F;
+		if (instruction == 0) {
+			continue;	/* NOP */
+		}
+		if (CP0_ENABLED && (opcode == 0x08 || (opcode == 0x00 && (function == 0x20 || function == 0x22)))) {
+			return;	/* ADDI, ADD, SUB may trap on overflow */
+		}
+		if (opcode == 0x08 || opcode == 0x09) {	/* ADDI, ADDIU */
+			if (rt == 0 || (written >> rt) & 1) return;
+			written |= 1u << rt;
+			if (rs == rt) {
+				if (n == IDLE_MAX_INDUCT) return;
+				e->reg[n] = rt;
+				e->step_reg[n] = 0xFF;
+				e->step[n] = (int16_t)(instruction & 0xFFFF);
+				n++;
+			} else {
+				invariant_src |= 1u << rs;
+			}
+		} else if (opcode >= 0x0C && opcode <= 0x0F) {	/* ANDI, ORI, XORI, LUI */
+			if (rt == 0 || (written >> rt) & 1 || rs == rt) return;
+			written |= 1u << rt;
+			if (opcode != 0x0F) invariant_src |= 1u << rs;
+		} else if (opcode == 0x00 && function >= 0x20 && function <= 0x27) {
+			if (rd == 0 || (written >> rd) & 1) return;
+			written |= 1u << rd;
+			if (function <= 0x23 && (rd == rs || rd == rt) && rs != rt) {
+				/* ADD(U): either operand may be the register; SUB(U): only the first */
+				if (function >= 0x22 && rd != rs) return;
+				if (n == IDLE_MAX_INDUCT) return;
+				e->reg[n] = rd;
+				e->step_reg[n] = rd == rs ? rt : rs;
+				e->step[n] = function >= 0x22 ? -1 : 1;
+				invariant_src |= 1u << e->step_reg[n];
+				n++;
+			} else if (rd != rs && rd != rt) {
+				invariant_src |= (1u << rs) | (1u << rt);
+			} else {
+				return;
+			}
+		} else if (opcode == 0x00 && (function == 0x00 || function == 0x02 || function == 0x03)) {
+			if (rd == 0 || (written >> rd) & 1 || rd == rt) return;	/* SLL, SRL, SRA */
+			written |= 1u << rd;
+			invariant_src |= 1u << rt;
+		} else {
+			return;
+		}
+	}
+	/* values read every iteration must not change inside the loop */
+	if (invariant_src & written) {
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		if ((invariant_src >> e->reg[i]) & 1) return;
+	}
+	e->ninduct = n;
+	e->loop = TRUE;
+}
+
+static uint32_t step_of(idle_loop_t *e, uint32_t reg)
+{
+	int i;
+
+	for (i = 0; i < e->ninduct; i++) {
+		if (e->reg[i] == reg) {
+			return e->step_reg[i] == 0xFF ? (uint32_t)e->step[i] :
+				e->step[i] * CURRENT_STATE.REGS[e->step_reg[i]];
+		}
+	}
+	return 0;
+}
+
+/* multiplicative inverse of an odd number modulo 2^32 */
+static uint32_t inverse(uint32_t a)
+{
+	uint32_t x = a;
+	int i;
+
+	for (i = 0; i < 5; i++) {
+		x *= 2 - a * x;
+	}
+	return x;
+}
+
+/***************************************************************/
+/* Further iterations until the branch falls through, counting the */
+/* one that exits; 0 when no exact answer without wrap-around is      */
+/* known, IDLE_NEVER when the branch is taken forever                           */
+/***************************************************************/
+static uint64_t iterations(idle_loop_t *e)
+{
+	uint32_t opcode = e->branch >> 26;
+	uint32_t rs = (e->branch >> 21) & 0x1F, rt = (e->branch >> 16) & 0x1F;
+	uint32_t x = CURRENT_STATE.REGS[rs], cx = step_of(e, rs);
+	uint32_t d, c, odd;
+	int64_t s = (int32_t)x, sc = (int32_t)cx, j;
+	int tz;
+
+	if (opcode == 0x04 || opcode == 0x05) {	/* BEQ, BNE: on the difference */
+		d = x - CURRENT_STATE.REGS[rt];
+		c = cx - step_of(e, rt);
+		if (c == 0) {
+			return IDLE_NEVER;
+		}
+		if (opcode == 0x04) {
+			return 1;
+		}
+		/* smallest j >= 1 with d + j*c == 0 (mod 2^32) */
+		tz = __builtin_ctz(c);
+		if (d & ((1u << tz) - 1)) {
+			return IDLE_NEVER;
+		}
+		odd = c >> tz;
+		return (uint64_t)(((0u - d) >> tz) * inverse(odd)) & ((tz ? 1ull << (32 - tz) : 1ull << 32) - 1);
+	}
+	if (opcode == 0x07) {	/* BGTZ is always taken in this core */
+		return IDLE_NEVER;
+	}
+	if (sc == 0) {
+		return IDLE_NEVER;
+	}
+	if (opcode == 0x01 && rt == 0x00) {	/* BLTZ: s < 0 */
+		if (sc < 0) return 0;
+		j = (-s + sc - 1) / sc;
+	} else if (opcode == 0x01) {	/* BGEZ: s >= 0 */
+		if (sc > 0) return 0;
+		j = s / -sc + 1;
+	} else {	/* BLEZ: s <= 0 */
+		if (sc < 0) return 0;
+		j = -s / sc + 1;
+	}
+	if (s + j * sc < INT32_MIN || s + j * sc > INT32_MAX) {
+		return 0;
+	}
+	return j;
+}
+
+/***************************************************************/
+/* Called after the backward branch at pc was taken: run as many  */
+/* whole iterations as fit in budget (UINT32_MAX: unbounded) in   */
+/* one step. Returns the instructions skipped.                                   */
+/***************************************************************/
+uint32_t idle_skip(uint32_t pc, uint32_t budget)
+{
+	idle_loop_t *e = &loops[(pc >> 2) & (IDLE_SLOTS - 1)];
+	uint64_t n, limit;
+	uint32_t skipped;
+	int exits, i;
+
+	if (e->pc != pc || !e->analysed || e->target != CURRENT_STATE.PC) {
+		e->pc = pc;
+		e->target = CURRENT_STATE.PC;
+		e->branch = mem_read_32(pc);
+		e->analysed = TRUE;
+		e->last_count = INSTRUCTION_COUNT;
+		analyse(e);
+	}
+	if (!e->loop) {
+		return 0;
+	}
+	/* stop at the next timer event so its interrupt arrives on time */
+	if (MMIO_ACTIVE) {
+		if ((int32_t)(MMIO_DEADLINE - INSTRUCTION_COUNT) <= 0) {
+			return 0;
+		}
+		if (MMIO_DEADLINE - INSTRUCTION_COUNT < budget) {
+			budget = MMIO_DEADLINE - INSTRUCTION_COUNT;
+		}
+	}
+	/* skip only after one whole iteration ran from the top, so every
+	   recomputed value already holds what the next iteration produces */
+	if (INSTRUCTION_COUNT - e->last_count != e->length) {
+		e->last_count = INSTRUCTION_COUNT;
+		return 0;
+	}
+	e->last_count = INSTRUCTION_COUNT;
+	n = iterations(e);
+	if (n == 0 || (n == IDLE_NEVER && budget == UINT32_MAX)) {
+		return 0;	/* an endless loop in runAll() keeps spinning, as it would */
+	}
+	limit = (budget < SKIP_CAP ? budget : SKIP_CAP) / e->length;
+	exits = n <= limit;
+	if (!exits) {
+		n = limit;
+	}
+	if (n == 0) {
+		return 0;
+	}
+
+	for (i = 0; i < e->ninduct; i++) {
+		CURRENT_STATE.REGS[e->reg[i]] += (uint32_t)n * step_of(e, e->reg[i]);
+	}
+	if (exits) {
+		CURRENT_STATE.PC = pc + 4;
+		PERF[PERF_BRANCH_TAKEN] += n - 1;
+		PERF[PERF_BRANCH_NOT_TAKEN]++;
+	} else {
+		PERF[PERF_BRANCH_TAKEN] += n;
+	}
+	NEXT_STATE = CURRENT_STATE;
+	skipped = n * e->length;
+	INSTRUCTION_COUNT += skipped;
+	IDLE_LOOPS++;
+	IDLE_SKIPPED += skipped;
+	return skipped;
+}
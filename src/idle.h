@@ -0,0 +1,36 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Idle and affine counting loop fast-forward (functional runs only)                    */
+/******************************************************************************/
+#define IDLE_SLOTS      1024	/* analysed loops, direct-mapped by branch pc */
+#define IDLE_MAX_BODY   32	/* instructions in a loop body, branch included */
+#define IDLE_MAX_INDUCT 8	/* registers stepped by a constant per iteration */
+#define IDLE_NEVER      UINT64_MAX	/* the loop cannot exit */
+
+typedef struct {
+	uint32_t pc;	/* backward branch closing the loop */
+	uint32_t target;
+	uint32_t branch;	/* branch instruction word */
+	uint32_t last_count;	/* INSTRUCTION_COUNT when the branch was last taken */
+	uint8_t analysed, loop;
+	uint8_t length;	/* instructions per iteration */
+	uint8_t ninduct;
+	uint8_t reg[IDLE_MAX_INDUCT];
+	uint8_t step_reg[IDLE_MAX_INDUCT];	/* register holding the step, 0xFF: immediate */
+	int32_t step[IDLE_MAX_INDUCT];	/* immediate step, or +1/-1 for a register step */
+} idle_loop_t;
+
+extern int IDLE_SKIP;
+extern uint64_t IDLE_LOOPS, IDLE_SKIPPED;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void idle_reset();
+uint32_t idle_skip(uint32_t pc, uint32_t budget);
+
+#endif
@@ -0,0 +1,677 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "mu-mips.h"
+#include "guard.h"
+#include "lanes.h"
+#include "cp0.h"
+#include "mmio.h"
+
+lanes_t LANES;
+
+/* one clone per ISA level, picked by the loader on the host CPU */
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__) && !defined(__clang__)
+#define LANE_KERNEL __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define LANE_KERNEL
+#endif
+
+#define LANE_FOR for (l = lo; l < hi; l++)
+/* write val to dst[l] in the lanes selected by m, keep the others */
+#define BLEND(dst, val) LANE_FOR { uint32_t v_ = (val); (dst)[l] = (v_ & m[l]) | ((dst)[l] & ~m[l]); }
+
+typedef struct {
+	uint64_t steps, converged, scalar, unimplemented;
+} lane_stats_t;
+
+static __thread uint32_t window_begin, window_size;	/* where a word of the region read last may start */
+
+static const uint32_t all_lanes[LANE_WIDTH] = {
+	~0u, ~0u, ~0u, ~0u, ~0u, ~0u, ~0u, ~0u, ~0u, ~0u, ~0u, ~0u, ~0u, ~0u, ~0u, ~0u
+};
+
+/***************************************************************/
+/* Lane-private memory: stores land in an overlay, loads fall back */
+/* to the shared guest memory                                                                                     */
+/***************************************************************/
+static uint32_t *overlay_find(lane_overlay_t *o, uint32_t word)
+{
+	uint32_t key = word | 1, i;
+
+	if (o->used == 0) {
+		return NULL;
+	}
+	for (i = (word >> 2) * 2654435761u & (o->capacity - 1); o->keys[i] != 0; i = (i + 1) & (o->capacity - 1)) {
+		if (o->keys[i] == key) {
+			return &o->vals[i];
+		}
+	}
+	return NULL;
+}
+
+static void overlay_store(lane_overlay_t *o, uint32_t word, uint32_t value)
+{
+	uint32_t *slot = overlay_find(o, word), i, old;
+	uint32_t *keys, *vals;
+
+	if (slot != NULL) {
+		*slot = value;
+		return;
+	}
+	if (2 * (o->used + 1) > o->capacity) {
+		keys = o->keys;
+		vals = o->vals;
+		old = o->capacity;
+		o->capacity = old ? 2 * old : 64;
+		o->keys = calloc(o->capacity, sizeof(uint32_t));
+		o->vals = calloc(o->capacity, sizeof(uint32_t));
+		o->used = 0;
+		for (i = 0; i < old; i++) {
+			if (keys[i] != 0) {
+				overlay_store(o, keys[i] & ~1u, vals[i]);
+			}
+		}
+		free(keys);
+		free(vals);
+	}
+	for (i = (word >> 2) * 2654435761u & (o->capacity - 1); o->keys[i] != 0; i = (i + 1) & (o->capacity - 1));
+	o->keys[i] = word | 1;
+	o->vals[i] = value;
+	o->used++;
+}
+
+/***************************************************************/
+/* A word of shared guest memory, straight from MEM_BASE while it    */
+/* stays in the region read last; only a new region costs the scan  */
+/***************************************************************/
+static inline uint32_t shared_read_32(uint32_t address)
+{
+	int i;
+
+	if (address - window_begin >= window_size) {
+		for (i = 0; i < NUM_MEM_REGION; i++) {
+			if (address >= MEM_REGIONS[i].begin && address <= MEM_REGIONS[i].end - 3) {
+				break;
+			}
+		}
+		if (i == NUM_MEM_REGION) {
+			return mem_read_32(address);	/* unmapped: zero, as in the scalar core */
+		}
+		window_begin = MEM_REGIONS[i].begin;
+		window_size = MEM_REGIONS[i].end - 3 - MEM_REGIONS[i].begin + 1;
+	}
+	return guest_load_32(address);
+}
+
+static uint32_t lane_word(lane_overlay_t *o, uint32_t word)
+{
+	uint32_t *v = overlay_find(o, word);
+	return v != NULL ? *v : shared_read_32(word);
+}
+
+/* same little-endian, possibly unaligned access as mem_read_32/mem_write_32 */
+static uint32_t lane_read_32(lane_overlay_t *o, uint32_t addr)
+{
+	uint32_t value = 0, a;
+	int i;
+
+	if ((addr & 3) == 0) {
+		return lane_word(o, addr);
+	}
+	for (i = 0; i < 4; i++) {
+		a = addr + i;
+		value |= ((lane_word(o, a & ~3u) >> (8 * (a & 3))) & 0xFF) << (8 * i);
+	}
+	return value;
+}
+
+static void lane_write_32(lane_overlay_t *o, uint32_t addr, uint32_t value)
+{
+	uint32_t a, w;
+	int i;
+
+	if ((addr & 3) == 0) {
+		overlay_store(o, addr, value);
+		return;
+	}
+	for (i = 0; i < 4; i++) {
+		a = addr + i;
+		w = lane_word(o, a & ~3u);
+		w = (w & ~(0xFFu << (8 * (a & 3)))) | (((value >> (8 * i)) & 0xFF) << (8 * (a & 3)));
+		overlay_store(o, a & ~3u, w);
+	}
+}
+
+/***************************************************************/
+/* Execute one instruction in lanes [lo, hi) selected by m. With    */
+/* the full range the loops vectorize; a one-lane range is the      */
+/* scalar fallback. Mirrors handle_instruction, quirks included.  */
+/***************************************************************/
+static inline __attribute__((always_inline)) void lane_exec(lane_group_t *g, lane_overlay_t *ov,
+		uint32_t instruction, const uint32_t *m, int lo, int hi, lane_stats_t *st)
+{
+	uint32_t opcode = instruction >> 26, function = instruction & 0x3F;
+	uint32_t rs = (instruction >> 21) & 0x1F, rt = (instruction >> 16) & 0x1F, rd = (instruction >> 11) & 0x1F;
+	uint32_t sa = (instruction >> 6) & 0x1F;
+	uint32_t imm = (uint32_t)(int32_t)(int16_t)(instruction & 0xFFFF);
+	uint32_t zimm = instruction & 0xFFFF, target = instruction & 0x03FFFFFF;
+	uint32_t *S = g->regs[rs], *T = g->regs[rt], *D = g->regs[rd], *pc = g->pc;
+	uint32_t addr, data;
+	int l, advance = TRUE, halting = FALSE;
+
+#define BRANCH(cond) LANE_FOR { uint32_t n_ = (cond) ? pc[l] + (imm << 2) : pc[l] + 4; \
+	pc[l] = (n_ & m[l]) | (pc[l] & ~m[l]); } advance = FALSE;
+
+	if (opcode == 0x00) {
+		switch (function) {
+			case 0x00: BLEND(D, T[l] << sa); break;	/* SLL */
+			case 0x02: BLEND(D, T[l] >> sa); break;	/* SRL */
+			case 0x03: BLEND(D, T[l] >> sa); break;	/* SRA: logical, as in the scalar core */
+			case 0x08: BLEND(pc, S[l]); advance = FALSE; break;	/* JR */
+			case 0x09:	/* JALR */
+				LANE_FOR {
+					uint32_t t_ = S[l], link_ = pc[l] + 4;
+					D[l] = (link_ & m[l]) | (D[l] & ~m[l]);
+					pc[l] = (t_ & m[l]) | (pc[l] & ~m[l]);
+				}
+				advance = FALSE;
+				break;
+			case 0x0C:	/* SYSCALL */
+				LANE_FOR {
+					if (m[l] && g->regs[2][l] == 0xA) {
+						g->halted |= 1u << l;
+						halting = TRUE;
+					}
+				}
+				break;
+			case 0x10: BLEND(D, g->hi[l]); break;	/* MFHI */
+			case 0x11: BLEND(g->hi, S[l]); break;	/* MTHI */
+			case 0x12: BLEND(D, g->lo[l]); break;	/* MFLO */
+			case 0x13: BLEND(g->lo, S[l]); break;	/* MTLO */
+			case 0x18:	/* MULT */
+				LANE_FOR {
+					uint64_t p_ = (uint64_t)((int64_t)(int32_t)S[l] * (int32_t)T[l]);
+					g->lo[l] = ((uint32_t)p_ & m[l]) | (g->lo[l] & ~m[l]);
+					g->hi[l] = ((uint32_t)(p_ >> 32) & m[l]) | (g->hi[l] & ~m[l]);
+				}
+				break;
+			case 0x19:	/* MULTU */
+				LANE_FOR {
+					uint64_t p_ = (uint64_t)S[l] * T[l];
+					g->lo[l] = ((uint32_t)p_ & m[l]) | (g->lo[l] & ~m[l]);
+					g->hi[l] = ((uint32_t)(p_ >> 32) & m[l]) | (g->hi[l] & ~m[l]);
+				}
+				break;
+			case 0x1A:	/* DIV */
+				LANE_FOR {
+					if (m[l] && T[l] != 0) {
+						if (S[l] == 0x80000000 && T[l] == 0xFFFFFFFF) {
+							g->lo[l] = 0x80000000;
+							g->hi[l] = 0;
+						} else {
+							g->lo[l] = (int32_t)S[l] / (int32_t)T[l];
+							g->hi[l] = (int32_t)S[l] % (int32_t)T[l];
+						}
+					}
+				}
+				break;
+			case 0x1B:	/* DIVU */
+				LANE_FOR {
+					if (m[l] && T[l] != 0) {
+						g->lo[l] = S[l] / T[l];
+						g->hi[l] = S[l] % T[l];
+					}
+				}
+				break;
+			case 0x20: case 0x21: BLEND(D, S[l] + T[l]); break;	/* ADD, ADDU */
+			case 0x22: case 0x23: BLEND(D, S[l] - T[l]); break;	/* SUB, SUBU */
+			case 0x24: BLEND(D, S[l] & T[l]); break;	/* AND */
+			case 0x25: BLEND(D, S[l] | T[l]); break;	/* OR */
+			case 0x26: BLEND(D, S[l] ^ T[l]); break;	/* XOR */
+			case 0x27: BLEND(D, ~(S[l] | T[l])); break;	/* NOR */
+			case 0x2A: BLEND(D, S[l] < T[l]); break;	/* SLT: unsigned, as in the scalar core */
+			default: st->unimplemented++; break;
+		}
+	} else {
+		switch (opcode) {
+			case 0x01:
+				if (rt == 0x00) {	/* BLTZ */
+					BRANCH(S[l] >> 31);
+				} else if (rt == 0x01) {	/* BGEZ */
+					BRANCH(!(S[l] >> 31));
+				}
+				break;
+			case 0x02: BLEND(pc, (pc[l] & 0xF0000000) | (target << 2)); advance = FALSE; break;	/* J */
+			case 0x03:	/* JAL */
+				LANE_FOR {
+					uint32_t link_ = pc[l] + 4, n_ = (pc[l] & 0xF0000000) | (target << 2);
+					g->regs[31][l] = (link_ & m[l]) | (g->regs[31][l] & ~m[l]);
+					pc[l] = (n_ & m[l]) | (pc[l] & ~m[l]);
+				}
+				advance = FALSE;
+				break;
+			case 0x04: BRANCH(S[l] == T[l]); break;	/* BEQ */
+			case 0x05: BRANCH(S[l] != T[l]); break;	/* BNE */
+			case 0x06: BRANCH((S[l] >> 31) || S[l] == 0); break;	/* BLEZ */
+			case 0x07: BRANCH((S[l] >> 31) == 0 || S[l] != 0); break;	/* BGTZ, as in the scalar core */
+			case 0x08: case 0x09: BLEND(T, S[l] + imm); break;	/* ADDI, ADDIU */
+			case 0x0A: BLEND(T, (int32_t)(S[l] - imm) < 0); break;	/* SLTI */
+			case 0x0C: BLEND(T, S[l] & zimm); break;	/* ANDI */
+			case 0x0D: BLEND(T, S[l] | zimm); break;	/* ORI */
+			case 0x0E: BLEND(T, S[l] ^ zimm); break;	/* XORI */
+			case 0x0F: BLEND(T, zimm << 16); break;	/* LUI */
+			case 0x20: case 0x21: case 0x23: case 0x30:	/* LB, LH, LW, LL */
+				LANE_FOR {
+					if (m[l]) {
+						data = lane_read_32(ov + l, S[l] + imm);
+						if (opcode == 0x20) {
+							data = (uint32_t)(int32_t)(int8_t)data;
+						} else if (opcode == 0x21) {
+							data = (uint32_t)(int32_t)(int16_t)data;
+						}
+						T[l] = data;
+					}
+				}
+				break;
+			case 0x28: case 0x29: case 0x2B: case 0x38:	/* SB, SH, SW, SC */
+				LANE_FOR {
+					if (m[l]) {
+						addr = S[l] + imm;
+						data = T[l];
+						if (opcode == 0x28) {
+							data = (lane_read_32(ov + l, addr) & 0xFFFFFF00) | (data & 0xFF);
+						} else if (opcode == 0x29) {
+							data = (lane_read_32(ov + l, addr) & 0xFFFF0000) | (data & 0xFFFF);
+						}
+						lane_write_32(ov + l, addr, data);
+						if (opcode == 0x38) {
+							T[l] = 1;	/* lanes share nothing, so SC always succeeds */
+						}
+					}
+				}
+				break;
+			case 0x1F:
+				if (function == 0x3B) {	/* RDHWR: CPUNum is the lane number */
+					BLEND(T, rd == 0 ? (uint32_t)(g->base + l) : rd == 2 ? g->count[l] : rd == 3 ? 1 : 0);
+				} else {
+					st->unimplemented++;
+				}
+				break;
+			default:
+				st->unimplemented++;
+				break;
+		}
+	}
+#undef BRANCH
+
+	if (advance) {
+		BLEND(pc, pc[l] + 4);
+	}
+	LANE_FOR {
+		g->count[l] += m[l] & 1;
+		g->key[l] = (pc[l] & m[l]) | (g->key[l] & ~m[l]);
+		g->key[l] = g->count[l] >= g->limit[l] ? LANE_DEAD : g->key[l];
+	}
+	if (halting) {
+		LANE_FOR {
+			if ((g->halted >> l) & 1) {
+				g->key[l] = LANE_DEAD;
+			}
+		}
+	}
+}
+
+/***************************************************************/
+/* Run a group until every lane halts or hits its limit. The lanes */
+/* at the lowest pc go next, so diverged paths reconverge; a lone  */
+/* lane runs scalar until it catches up with another one.               */
+/***************************************************************/
+static void LANE_KERNEL lane_group_run(lane_group_t *g, lane_overlay_t *ov, lane_stats_t *st)
+{
+	uint32_t m[LANE_WIDTH], min, next, active, live;
+	int l, lo = 0, hi = LANE_WIDTH, lane;
+
+	for (;;) {
+		min = LANE_DEAD;
+		LANE_FOR {
+			min = g->key[l] < min ? g->key[l] : min;
+		}
+		if (min == LANE_DEAD) {
+			break;
+		}
+		active = live = 0;
+		LANE_FOR {
+			m[l] = g->key[l] == min ? ~0u : 0;
+			active += m[l] & 1;
+			live += g->key[l] != LANE_DEAD;
+		}
+		st->steps++;
+		if (active == live) {
+			st->converged++;
+		}
+		if (active > 1) {
+			lane_exec(g, ov, shared_read_32(min), m, 0, LANE_WIDTH, st);
+			continue;
+		}
+
+		/* scalar fallback for a diverged lane */
+		for (lane = 0; m[lane] == 0; lane++);
+		next = LANE_DEAD;
+		LANE_FOR {
+			if (l != lane && g->key[l] < next) {
+				next = g->key[l];
+			}
+		}
+		while (g->key[lane] < next) {
+			lane_exec(g, ov, shared_read_32(g->key[lane]), all_lanes, lane, lane + 1, st);
+			st->scalar++;
+		}
+	}
+}
+
+typedef struct {
+	int first, stride;
+	lane_stats_t stats;
+} lane_job_t;
+
+static void *lane_worker(void *arg)
+{
+	lane_job_t *job = arg;
+	int i;
+
+	for (i = job->first; i < LANES.groups; i += job->stride) {
+		lane_group_run(&LANES.group[i], &LANES.overlay[i * LANE_WIDTH], &job->stats);
+	}
+	return NULL;
+}
+
+/***************************************************************/
+/* Commands                                                                                                                       */
+/***************************************************************/
+void lanes_destroy()
+{
+	int i;
+
+	for (i = 0; i < LANES.groups * LANE_WIDTH; i++) {
+		free(LANES.overlay[i].keys);
+		free(LANES.overlay[i].vals);
+	}
+	free(LANES.group);
+	free(LANES.overlay);
+	memset(&LANES, 0, sizeof(LANES));
+}
+
+/* every lane starts from the current architectural state */
+int lanes_create(int count)
+{
+	lane_group_t *g;
+	int i, l, r;
+
+	if (CP0_ENABLED) {
+		printf("Error: lanes do not model exceptions; turn them off first\n");
+		return FALSE;
+	}
+	if (MMIO_ACTIVE) {
+		printf("Error: lanes do not model devices; detach them first\n");
+		return FALSE;
+	}
+	if (count < 1 || count > MAX_LANES) {
+		printf("Error: between 1 and %d lanes\n", MAX_LANES);
+		return FALSE;
+	}
+	lanes_destroy();
+	LANES.count = count;
+	LANES.groups = (count + LANE_WIDTH - 1) / LANE_WIDTH;
+	LANES.group = aligned_alloc(64, LANES.groups * sizeof(lane_group_t));
+	LANES.overlay = calloc(LANES.groups * LANE_WIDTH, sizeof(lane_overlay_t));
+	memset(LANES.group, 0, LANES.groups * sizeof(lane_group_t));
+	for (i = 0; i < LANES.groups; i++) {
+		g = &LANES.group[i];
+		g->base = i * LANE_WIDTH;
+		for (l = 0; l < LANE_WIDTH; l++) {
+			for (r = 0; r < MIPS_REGS; r++) {
+				g->regs[r][l] = CURRENT_STATE.REGS[r];
+			}
+			g->hi[l] = CURRENT_STATE.HI;
+			g->lo[l] = CURRENT_STATE.LO;
+			g->pc[l] = CURRENT_STATE.PC;
+			g->key[l] = LANE_DEAD;
+			if (g->base + l >= count) {
+				g->halted |= 1u << l;	/* padding lanes never run */
+			}
+		}
+	}
+	if (INTERACTIVE) {
+		printf("%d lanes in %d groups of %d\n", count, LANES.groups, LANE_WIDTH);
+	}
+	return TRUE;
+}
+
+static lane_group_t *lane_group(int lane, int *l)
+{
+	if (lane < 0 || lane >= LANES.count) {
+		printf("Error: no lane %d\n", lane);
+		return NULL;
+	}
+	*l = lane % LANE_WIDTH;
+	return &LANES.group[lane / LANE_WIDTH];
+}
+
+/* register operand by name: a number, hi, lo, or (for reading) pc */
+int lanes_reg(const char *name, int allow_pc)
+{
+	char *end;
+	unsigned long reg;
+
+	if (!strcmp(name, "hi")) return MIPS_REGS;
+	if (!strcmp(name, "lo")) return MIPS_REGS + 1;
+	if (!strcmp(name, "pc")) return allow_pc ? MIPS_REGS + 2 : -1;
+	reg = strtoul(name, &end, 10);
+	return *end == '\0' && end != name && reg < MIPS_REGS ? (int)reg : -1;
+}
+
+/* reg is a register number, MIPS_REGS for HI, MIPS_REGS + 1 for LO */
+int lanes_set(int lane, int reg, uint32_t value)
+{
+	int l;
+	lane_group_t *g = lane_group(lane, &l);
+
+	if (g == NULL) {
+		return FALSE;
+	}
+	if (reg < MIPS_REGS) g->regs[reg][l] = value;
+	else if (reg == MIPS_REGS) g->hi[l] = value;
+	else g->lo[l] = value;
+	return TRUE;
+}
+
+void lanes_sweep(int reg, uint32_t start, uint32_t step)
+{
+	int i;
+
+	for (i = 0; i < LANES.count; i++) {
+		lanes_set(i, reg, start + i * step);
+	}
+}
+
+int lanes_poke(int lane, uint32_t addr, uint32_t value)
+{
+	int l;
+
+	if (lane_group(lane, &l) == NULL) {
+		return FALSE;
+	}
+	lane_write_32(&LANES.overlay[lane], addr, value);
+	return TRUE;
+}
+
+/* fold a lane back into the architectural state: its registers, and */
+/* its stores written through to guest memory. Meant for one lane.  */
+int lanes_commit(int lane)
+{
+	lane_overlay_t *o;
+	uint32_t i;
+	int l, r;
+	lane_group_t *g = lane_group(lane, &l);
+
+	if (g == NULL) {
+		return FALSE;
+	}
+	for (r = 0; r < MIPS_REGS; r++) {
+		CURRENT_STATE.REGS[r] = g->regs[r][l];
+	}
+	CURRENT_STATE.HI = g->hi[l];
+	CURRENT_STATE.LO = g->lo[l];
+	CURRENT_STATE.PC = g->pc[l];
+	NEXT_STATE = CURRENT_STATE;
+	o = &LANES.overlay[lane];
+	for (i = 0; i < o->capacity; i++) {
+		if (o->keys[i] != 0) {
+			mem_write_32(o->keys[i] & ~1u, o->vals[i]);
+			o->keys[i] = 0;
+		}
+	}
+	o->used = 0;
+	if ((g->halted >> l) & 1) {
+		RUN_FLAG = FALSE;
+	}
+	return TRUE;
+}
+
+/* max bounds the instructions each lane runs in this call (0: no bound) */
+void lanes_run(uint32_t max)
+{
+	struct timespec begin, end;
+	lane_group_t *g;
+	lane_job_t *jobs;
+	pthread_t *threads;
+	uint64_t before = 0, after = 0;
+	int i, l, nthreads;
+
+	if (LANES.count == 0) {
+		printf("Error: create lanes first\n");
+		return;
+	}
+	for (i = 0; i < LANES.groups; i++) {
+		g = &LANES.group[i];
+		for (l = 0; l < LANE_WIDTH; l++) {
+			before += g->count[l];
+			g->limit[l] = max == 0 || g->count[l] > UINT32_MAX - max ? UINT32_MAX : g->count[l] + max;
+			g->key[l] = ((g->halted >> l) & 1) || g->count[l] >= g->limit[l] ? LANE_DEAD : g->pc[l];
+		}
+	}
+
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads > LANES.groups) nthreads = LANES.groups;
+	if (nthreads < 1) nthreads = 1;
+	jobs = calloc(nthreads, sizeof(lane_job_t));
+	threads = calloc(nthreads, sizeof(pthread_t));
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (i = 0; i < nthreads; i++) {
+		jobs[i].first = i;
+		jobs[i].stride = nthreads;
+		pthread_create(&threads[i], NULL, lane_worker, &jobs[i]);
+	}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+		LANES.steps += jobs[i].stats.steps;
+		LANES.converged += jobs[i].stats.converged;
+		LANES.scalar += jobs[i].stats.scalar;
+		LANES.unimplemented += jobs[i].stats.unimplemented;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	free(jobs);
+	free(threads);
+
+	for (i = 0; i < LANES.groups; i++) {
+		for (l = 0; l < LANE_WIDTH; l++) {
+			after += LANES.group[i].count[l];
+		}
+	}
+	LANES.instructions += after - before;
+	LANES.host_seconds += (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+	if (INTERACTIVE) {
+		printf("Ran %llu instructions over %d lanes\n\n", (unsigned long long)(after - before), LANES.count);
+	}
+}
+
+void lanes_stats()
+{
+	int i, halted = 0;
+	double mips = LANES.host_seconds > 0 ? LANES.instructions / LANES.host_seconds / 1e6 : 0;
+	double converged = LANES.steps ? 100.0 * LANES.converged / LANES.steps : 0;
+
+	for (i = 0; i < LANES.count; i++) {
+		halted += (LANES.group[i / LANE_WIDTH].halted >> (i % LANE_WIDTH)) & 1;
+	}
+	if (JSON_OUTPUT) {
+		printf("{\"lanes\":{\"count\":%d,\"halted\":%d,\"instructions\":%llu,\"steps\":%llu,"
+				"\"converged_pct\":%.2f,\"scalar\":%llu,\"unimplemented\":%llu,"
+				"\"host_seconds\":%.6f,\"mips\":%.3f}}\n",
+				LANES.count, halted, (unsigned long long)LANES.instructions,
+				(unsigned long long)LANES.steps, converged, (unsigned long long)LANES.scalar,
+				(unsigned long long)LANES.unimplemented, LANES.host_seconds, mips);
+		return;
+	}
+	printf("-------------------------------------\n");
+	printf("Lanes (%d, %d halted)\n", LANES.count, halted);
+	printf("-------------------------------------\n");
+	printf("instructions\t: %llu\n", (unsigned long long)LANES.instructions);
+	printf("group steps\t: %llu (%.2f%% converged)\n", (unsigned long long)LANES.steps, converged);
+	printf("scalar\t\t: %llu\n", (unsigned long long)LANES.scalar);
+	printf("unimplemented\t: %llu\n", (unsigned long long)LANES.unimplemented);
+	printf("host_seconds\t: %.6f\n", LANES.host_seconds);
+	printf("mips\t\t: %.3f\n", mips);
+	printf("-------------------------------------\n");
+}
+
+static uint32_t lane_value(int lane, int reg)
+{
+	lane_group_t *g = &LANES.group[lane / LANE_WIDTH];
+	int l = lane % LANE_WIDTH;
+
+	if (reg < MIPS_REGS) return g->regs[reg][l];
+	if (reg == MIPS_REGS) return g->hi[l];
+	if (reg == MIPS_REGS + 1) return g->lo[l];
+	return g->pc[l];
+}
+
+/* reg as in lanes_set, MIPS_REGS + 2 for the PC */
+void lanes_dump(int reg)
+{
+	int i;
+
+	if (JSON_OUTPUT) {
+		printf("{\"lanes\":[");
+		for (i = 0; i < LANES.count; i++) {
+			printf("%s%u", i ? "," : "", lane_value(i, reg));
+		}
+		printf("]}\n");
+		return;
+	}
+	for (i = 0; i < LANES.count; i++) {
+		printf("[%d]\t0x%08x\n", i, lane_value(i, reg));
+	}
+}
+
+void lanes_mdump(uint32_t addr)
+{
+	int i;
+
+	if (JSON_OUTPUT) {
+		printf("{\"lanes\":[");
+		for (i = 0; i < LANES.count; i++) {
+			printf("%s%u", i ? "," : "", lane_read_32(&LANES.overlay[i], addr));
+		}
+		printf("]}\n");
+		return;
+	}
+	for (i = 0; i < LANES.count; i++) {
+		printf("[%d]\t0x%08x\n", i, lane_read_32(&LANES.overlay[i], addr));
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef LANES_H
+#define LANES_H
+
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+/******************************************************************************/
+/* Lockstep multi-lane execution: one program, many register/memory inputs           */
+/******************************************************************************/
+#define LANE_WIDTH 16	/* lanes per group, executed together by one kernel */
+#define LANE_DEAD  0xFFFFFFFF	/* key of a lane that halted or ran out of budget */
+#define MAX_LANES  65536
+
+/* structure-of-arrays state for one group of lanes */
+typedef struct {
+	uint32_t regs[MIPS_REGS][LANE_WIDTH];
+	uint32_t hi[LANE_WIDTH], lo[LANE_WIDTH];
+	uint32_t pc[LANE_WIDTH];
+	uint32_t key[LANE_WIDTH];	/* pc while live, LANE_DEAD afterwards */
+	uint32_t count[LANE_WIDTH];	/* instructions executed */
+	uint32_t limit[LANE_WIDTH];	/* count at which this run stops the lane */
+	uint32_t halted;	/* bitmask: lane ran SYSCALL 10 */
+	int base;	/* number of the group's first lane */
+} lane_group_t;
+
+/* lane-private stores, layered over the shared guest memory */
+typedef struct {
+	uint32_t *keys;	/* word address | 1, 0 when empty */
+	uint32_t *vals;
+	uint32_t capacity, used;
+} lane_overlay_t;
+
+typedef struct {
+	int count;
+	int groups;
+	lane_group_t *group;
+	lane_overlay_t *overlay;
+	uint64_t steps;	/* kernel invocations over all groups */
+	uint64_t converged;	/* steps where every live lane of the group took part */
+	uint64_t scalar;	/* instructions run by the single-lane fallback */
+	uint64_t instructions;
+	uint64_t unimplemented;
+	double host_seconds;
+} lanes_t;
+
+extern lanes_t LANES;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int lanes_create(int count);
+void lanes_destroy();
+int lanes_reg(const char *name, int allow_pc);
+int lanes_set(int lane, int reg, uint32_t value);
+void lanes_sweep(int reg, uint32_t start, uint32_t step);
+int lanes_poke(int lane, uint32_t addr, uint32_t value);
+int lanes_commit(int lane);
+void lanes_run(uint32_t max);
+void lanes_stats();
+void lanes_dump(int reg);
+void lanes_mdump(uint32_t addr);
+
+#endif
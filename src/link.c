@@ -0,0 +1,457 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <elf.h>
+#include <sys/stat.h>
+
+#include "mu-mips.h"
+#include "asm.h"
+#include "link.h"
+
+typedef struct {
+	const char *path;
+	object_t obj;
+	uint32_t base[NUM_SECTIONS];	/* where its sections land */
+	int source;	/* assembled from text rather than read as an object */
+	int cached;	/* the object came from LINK_CACHE */
+	char cache_path[300];
+} link_input_t;
+
+/* defined global symbols, sorted by name */
+typedef struct {
+	const char *name;
+	uint32_t address;
+	const char *path;
+} link_global_t;
+
+static struct {
+	link_input_t *inputs;
+	int *pending;	/* indexes of the sources to assemble */
+	int num_pending;
+	int next;	/* next pending entry a worker takes */
+} jobs;
+
+/***************************************************************/
+/* 64-bit FNV-1a of a file's contents, or 0 if it can't be read      */
+/***************************************************************/
+static uint64_t hash_file(const char *path)
+{
+	uint64_t hash = 0xCBF29CE484222325ull ^ OBJ_VERSION;
+	unsigned char buffer[65536];
+	size_t n, i;
+	FILE *fp = fopen(path, "rb");
+
+	if (fp == NULL) {
+		return 0;
+	}
+	while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+		for (i = 0; i < n; i++) {
+			hash = (hash ^ buffer[i]) * 0x100000001B3ull;
+		}
+	}
+	fclose(fp);
+	return hash;
+}
+
+static int is_source(const char *path)
+{
+	const char *dot = strrchr(path, '.');
+	return dot != NULL && (!strcmp(dot, ".s") || !strcmp(dot, ".S") || !strcmp(dot, ".asm"));
+}
+
+/***************************************************************/
+/* Worker: assemble pending sources until none are left, leaving    */
+/* each object in the cache (written aside, then renamed, so a       */
+/* concurrent build never reads half a file)                                   */
+/***************************************************************/
+static void *assemble_worker(void *arg)
+{
+	char temp[320];
+	int i;
+
+	while ((i = __atomic_fetch_add(&jobs.next, 1, __ATOMIC_RELAXED)) < jobs.num_pending) {
+		link_input_t *in = &jobs.inputs[jobs.pending[i]];
+		if (assemble(in->path, &in->obj) && in->cache_path[0] != '\0') {
+			snprintf(temp, sizeof(temp), "%s.%d.%d", in->cache_path, (int)getpid(), i);
+			if (object_write(&in->obj, temp)) {
+				rename(temp, in->cache_path);
+			} else {
+				unlink(temp);
+			}
+		}
+	}
+	return NULL;
+}
+
+/***************************************************************/
+/* Get every input's object: read objects and cache hits, and      */
+/* assemble the rest on one host thread per core                            */
+/***************************************************************/
+static int load_inputs(link_input_t *inputs, int count)
+{
+	pthread_t threads[64];
+	int i, num_threads, ok = TRUE;
+	uint64_t hash;
+
+	mkdir(LINK_CACHE, 0777);
+	jobs.inputs = inputs;
+	jobs.pending = malloc(count * sizeof(int));
+	jobs.num_pending = 0;
+	jobs.next = 0;
+	for (i = 0; i < count; i++) {
+		link_input_t *in = &inputs[i];
+		if (!is_source(in->path)) {
+			if (!object_read(in->path, &in->obj)) {
+				printf("Error: %s\n", in->obj.error);
+				ok = FALSE;
+			}
+			continue;
+		}
+		in->source = TRUE;
+		hash = hash_file(in->path);
+		if (hash == 0) {
+			printf("Error: Can't open %s\n", in->path);
+			ok = FALSE;
+			continue;
+		}
+		snprintf(in->cache_path, sizeof(in->cache_path), "%s/%016llx.mo", LINK_CACHE, (unsigned long long)hash);
+		if (object_read(in->cache_path, &in->obj)) {
+			in->cached = TRUE;
+		} else {
+			jobs.pending[jobs.num_pending++] = i;
+		}
+	}
+
+	num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads > jobs.num_pending) num_threads = jobs.num_pending;
+	if (num_threads > 64) num_threads = 64;
+	if (num_threads < 1) num_threads = 1;
+	for (i = 1; i < num_threads; i++) {
+		if (pthread_create(&threads[i], NULL, assemble_worker, NULL) != 0) {
+			num_threads = i;
+			break;
+		}
+	}
+	assemble_worker(NULL);
+	for (i = 1; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	for (i = 0; i < jobs.num_pending; i++) {
+		link_input_t *in = &inputs[jobs.pending[i]];
+		if (in->obj.error[0] != '\0') {
+			printf("Error: %s\n", in->obj.error);
+			ok = FALSE;
+		}
+	}
+	free(jobs.pending);
+	return ok;
+}
+
+static int compare_globals(const void *a, const void *b)
+{
+	return strcmp(((const link_global_t *)a)->name, ((const link_global_t *)b)->name);
+}
+
+static link_global_t *find_global(link_global_t *globals, int count, const char *name)
+{
+	link_global_t key = { name, 0, NULL };
+	return bsearch(&key, globals, count, sizeof(link_global_t), compare_globals);
+}
+
+/***************************************************************/
+/* Patch one word with S + A                                                        */
+/***************************************************************/
+static int apply(link_input_t *in, obj_reloc_t *r, uint32_t value, const char *name)
+{
+	uint32_t p = in->base[r->section] + r->offset;
+	uint8_t *at = in->obj.bytes[r->section] + r->offset;
+	uint32_t word;
+	int64_t delta;
+
+	memcpy(&word, at, 4);
+	switch (r->type) {
+		case RELOC_32:
+			word = value;
+			break;
+		case RELOC_26:
+			if ((value & 0xF0000000) != (p & 0xF0000000) || (value & 3)) {
+				printf("Error: %s: jump to %s (0x%08x) leaves the 256 MB segment or is unaligned\n", in->path, name, value);
+				return FALSE;
+			}
+			word = (word & 0xFC000000) | ((value >> 2) & 0x03FFFFFF);
+			break;
+		case RELOC_PC16:
+			delta = (int64_t)value - p;
+			if ((delta & 3) || delta / 4 < -32768 || delta / 4 > 32767) {
+				printf("Error: %s: branch to %s (0x%08x) is out of range or unaligned\n", in->path, name, value);
+				return FALSE;
+			}
+			word = (word & 0xFFFF0000) | ((delta >> 2) & 0xFFFF);
+			break;
+		case RELOC_HI16:
+			word = (word & 0xFFFF0000) | (((value + 0x8000) >> 16) & 0xFFFF);
+			break;
+		case RELOC_LO16:
+			word = (word & 0xFFFF0000) | (value & 0xFFFF);
+			break;
+		default:
+			printf("Error: %s: unknown relocation type %d\n", in->path, r->type);
+			return FALSE;
+	}
+	memcpy(at, &word, 4);
+	return TRUE;
+}
+
+/***************************************************************/
+/* The ELF32 executable load_image() reads: one PT_LOAD segment    */
+/* for the text and one for the data                                              */
+/***************************************************************/
+static int write_image(const char *output, link_input_t *inputs, int count, uint32_t entry,
+		uint32_t text_size, uint32_t data_size)
+{
+	Elf32_Ehdr eh;
+	Elf32_Phdr ph[NUM_SECTIONS];
+	uint32_t size[NUM_SECTIONS] = { text_size, data_size };
+	uint32_t start[NUM_SECTIONS] = { MEM_TEXT_BEGIN, MEM_DATA_BEGIN };
+	uint32_t offset = sizeof(eh) + sizeof(ph), pad;
+	int i, s, ok;
+	FILE *fp;
+
+	memset(&eh, 0, sizeof(eh));
+	memcpy(eh.e_ident, ELFMAG, SELFMAG);
+	eh.e_ident[EI_CLASS] = ELFCLASS32;
+	eh.e_ident[EI_DATA] = ELFDATA2LSB;
+	eh.e_ident[EI_VERSION] = EV_CURRENT;
+	eh.e_type = ET_EXEC;
+	eh.e_machine = EM_MIPS;
+	eh.e_version = EV_CURRENT;
+	eh.e_entry = entry;
+	eh.e_phoff = sizeof(eh);
+	eh.e_ehsize = sizeof(eh);
+	eh.e_phentsize = sizeof(Elf32_Phdr);
+	eh.e_phnum = NUM_SECTIONS;
+	memset(ph, 0, sizeof(ph));
+	for (s = 0; s < NUM_SECTIONS; s++) {
+		ph[s].p_type = PT_LOAD;
+		ph[s].p_offset = offset;
+		ph[s].p_vaddr = ph[s].p_paddr = start[s];
+		ph[s].p_filesz = ph[s].p_memsz = size[s];
+		ph[s].p_flags = s == SEC_TEXT ? PF_R | PF_X : PF_R | PF_W;
+		ph[s].p_align = 4;
+		offset += size[s];
+	}
+
+	fp = fopen(output, "wb");
+	if (fp == NULL) {
+		printf("Error: Can't create %s\n", output);
+		return FALSE;
+	}
+	ok = fwrite(&eh, sizeof(eh), 1, fp) == 1 && fwrite(ph, sizeof(ph), 1, fp) == 1;
+	for (s = 0; s < NUM_SECTIONS; s++) {
+		for (i = 0; i < count; i++) {
+			link_input_t *in = &inputs[i];
+			ok = ok && fwrite(in->obj.bytes[s], 1, in->obj.size[s], fp) == in->obj.size[s];
+			/* the gap up to the next object's section */
+			pad = (i + 1 < count ? inputs[i + 1].base[s] : start[s] + size[s]) - in->base[s] - in->obj.size[s];
+			while (ok && pad-- > 0) {
+				ok = fputc(0, fp) != EOF;
+			}
+		}
+	}
+	if (fclose(fp) != 0 || !ok) {
+		printf("Error: Can't write %s\n", output);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* <output minus extension>.sym: "address name" per symbol, the      */
+/* globals first, for hooks and the profilers                                   */
+/***************************************************************/
+static void write_symbols(const char *output, link_input_t *inputs, int count)
+{
+	char path[300], *dot;
+	int i, global;
+	uint32_t k;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s", output);
+	dot = strrchr(path, '.');
+	if (dot != NULL && strchr(dot, '/') == NULL) {
+		*dot = '\0';
+	}
+	strcat(path, ".sym");
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		printf("Error: Can't create %s\n", path);
+		return;
+	}
+	for (global = TRUE; global >= FALSE; global--) {
+		for (i = 0; i < count; i++) {
+			object_t *obj = &inputs[i].obj;
+			for (k = 0; k < obj->num_symbols; k++) {
+				obj_symbol_t *sym = &obj->symbols[k];
+				if (sym->section != SEC_UNDEF && sym->global == global) {
+					fprintf(fp, "%08x %s\n", inputs[i].base[sym->section] + sym->value, sym->name);
+				}
+			}
+		}
+	}
+	fclose(fp);
+}
+
+/* a __start or main the first object did not declare .globl */
+static int local_entry(link_input_t *first, uint32_t *entry)
+{
+	static const char *names[] = { "__start", "main" };
+	object_t *obj = &first->obj;
+	uint32_t k;
+	int n;
+
+	for (n = 0; n < 2; n++) {
+		for (k = 0; k < obj->num_symbols; k++) {
+			obj_symbol_t *sym = &obj->symbols[k];
+			if (sym->section == SEC_TEXT && !sym->global && !strcmp(sym->name, names[n])) {
+				*entry = first->base[SEC_TEXT] + sym->value;
+				return TRUE;
+			}
+		}
+	}
+	return FALSE;
+}
+
+/***************************************************************/
+/* Link sources (.s, assembled through the cache) and objects into */
+/* <output>: text from MEM_TEXT_BEGIN and data from MEM_DATA_BEGIN  */
+/* in input order, entry at __start or main (global, else local to the  */
+/* first object) or the first word                                                 */
+/***************************************************************/
+int link_program(const char *output, int count, char **inputs)
+{
+	link_input_t *in;
+	link_global_t *globals = NULL, *g;
+	int num_globals = 0, assembled = 0, cached = 0, ok = TRUE, i;
+	uint64_t text = MEM_TEXT_BEGIN, data = MEM_DATA_BEGIN;
+	uint32_t k, entry = MEM_TEXT_BEGIN;
+
+	if (count < 1 || count > MAX_LINK_INPUTS) {
+		printf("Error: link takes 1 to %d inputs\n", MAX_LINK_INPUTS);
+		return FALSE;
+	}
+	in = calloc(count, sizeof(link_input_t));
+	for (i = 0; i < count; i++) {
+		in[i].path = inputs[i];
+	}
+	ok = load_inputs(in, count);
+
+	/* lay out the sections and collect the globals */
+	for (i = 0; ok && i < count; i++) {
+		object_t *obj = &in[i].obj;
+		in[i].base[SEC_TEXT] = text;
+		in[i].base[SEC_DATA] = data;
+		text += (obj->size[SEC_TEXT] + 3) & ~3u;
+		data += (obj->size[SEC_DATA] + DATA_ALIGN - 1) & ~(DATA_ALIGN - 1u);
+		globals = realloc(globals, (num_globals + obj->num_symbols + 1) * sizeof(link_global_t));
+		for (k = 0; k < obj->num_symbols; k++) {
+			obj_symbol_t *sym = &obj->symbols[k];
+			if (sym->section >= NUM_SECTIONS && sym->section != SEC_UNDEF) {
+				printf("Error: %s: symbol %s has a bad section\n", in[i].path, sym->name);
+				ok = FALSE;
+			} else if (sym->global && sym->section != SEC_UNDEF) {
+				globals[num_globals].name = sym->name;
+				globals[num_globals].address = in[i].base[sym->section] + sym->value;
+				globals[num_globals].path = in[i].path;
+				num_globals++;
+			}
+		}
+		assembled += in[i].source && !in[i].cached;
+		cached += in[i].cached;
+	}
+	if (ok && (text - 1 > MEM_TEXT_END || data - 1 > MEM_DATA_END)) {
+		printf("Error: the program does not fit in the text or data segment\n");
+		ok = FALSE;
+	}
+	if (ok) {
+		qsort(globals, num_globals, sizeof(link_global_t), compare_globals);
+		for (i = 1; i < num_globals; i++) {
+			if (!strcmp(globals[i - 1].name, globals[i].name)) {
+				printf("Error: %s is defined in both %s and %s\n", globals[i].name, globals[i - 1].path, globals[i].path);
+				ok = FALSE;
+			}
+		}
+	}
+
+	/* resolve and patch */
+	for (i = 0; ok && i < count; i++) {
+		object_t *obj = &in[i].obj;
+		for (k = 0; ok && k < obj->num_relocs; k++) {
+			obj_reloc_t *r = &obj->relocs[k];
+			obj_symbol_t *sym;
+			uint32_t address;
+
+			if (r->section >= NUM_SECTIONS || r->symbol >= obj->num_symbols || (uint64_t)r->offset + 4 > obj->size[r->section]) {
+				printf("Error: %s: bad relocation %u\n", in[i].path, k);
+				ok = FALSE;
+				break;
+			}
+			sym = &obj->symbols[r->symbol];
+			if (sym->section != SEC_UNDEF) {
+				address = in[i].base[sym->section] + sym->value;
+			} else if ((g = find_global(globals, num_globals, sym->name)) != NULL) {
+				address = g->address;
+			} else {
+				printf("Error: undefined symbol %s referenced from %s\n", sym->name, in[i].path);
+				ok = FALSE;
+				break;
+			}
+			ok = apply(&in[i], r, address + r->addend, sym->name);
+		}
+	}
+
+	if (ok) {
+		if ((g = find_global(globals, num_globals, "__start")) != NULL ||
+				(g = find_global(globals, num_globals, "main")) != NULL) {
+			entry = g->address;
+		} else if (!local_entry(&in[0], &entry) && !QUIET) {
+			printf("Warning: no __start or main; %s starts at its first word\n", output);
+		}
+		ok = write_image(output, in, count, entry, text - MEM_TEXT_BEGIN, data - MEM_DATA_BEGIN);
+	}
+	if (ok) {
+		write_symbols(output, in, count);
+		if (!QUIET) {
+			printf("%s: %d objects (%d assembled, %d cached), %u text bytes, %u data bytes, entry 0x%08x\n",
+					output, count, assembled, cached, (uint32_t)(text - MEM_TEXT_BEGIN),
+					(uint32_t)(data - MEM_DATA_BEGIN), entry);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		object_free(&in[i].obj);
+	}
+	free(globals);
+	free(in);
+	return ok;
+}
+
+/***************************************************************/
+/* Assemble one source into an object file                                      */
+/***************************************************************/
+int assemble_file(const char *source, const char *output)
+{
+	object_t obj;
+	int ok = assemble(source, &obj);
+
+	if (!ok) {
+		printf("Error: %s\n", obj.error);
+	} else if (!object_write(&obj, output)) {
+		printf("Error: Can't write %s\n", output);
+		ok = FALSE;
+	}
+	object_free(&obj);
+	return ok;
+}
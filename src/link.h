@@ -0,0 +1,20 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Linker: sources and objects into one ELF32 image plus a .sym file, with      */
+/* sources reassembled only when their contents change                              */
+/******************************************************************************/
+#define LINK_CACHE ".mucache"	/* assembled objects, named by a hash of their source */
+#define MAX_LINK_INPUTS 256
+#define DATA_ALIGN 8	/* every object's data starts doubleword aligned, for LDC1/SDC1 */
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int link_program(const char *output, int count, char **inputs);
+int assemble_file(const char *source, const char *output);
+
+#endif
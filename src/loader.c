@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <elf.h>
+
+#include "mu-mips.h"
+#include "cp0.h"
+#include "loader.h"
+
+/***************************************************************/
+/* ELF by its magic, raw words by a .bin extension, hex otherwise  */
+/***************************************************************/
+int image_format(const char *path)
+{
+	unsigned char magic[SELFMAG];
+	const char *dot = strrchr(path, '.');
+	FILE *fp = fopen(path, "rb");
+
+	if (fp != NULL) {
+		if (fread(magic, 1, SELFMAG, fp) == SELFMAG && !memcmp(magic, ELFMAG, SELFMAG)) {
+			fclose(fp);
+			return IMAGE_ELF;
+		}
+		fclose(fp);
+	}
+	if (dot != NULL && !strcmp(dot, ".bin")) {
+		return IMAGE_BIN;
+	}
+	return IMAGE_HEX;
+}
+
+/* copy host bytes into guest memory, region by region */
+static int copy_in(uint32_t address, const uint8_t *bytes, uint64_t length)
+{
+	uint64_t span;
+	uint8_t *host;
+
+	while (length > 0) {
+		span = length;
+		host = mem_span(address, &span);
+		if (host == NULL) {
+			sim_error("0x%08x is outside guest memory", address);
+			return FALSE;
+		}
+		memcpy(host, bytes, span);
+		cp0_loaded(address, span);
+		address += span;
+		bytes += span;
+		length -= span;
+	}
+	return TRUE;
+}
+
+static int load_hex(FILE *fp)
+{
+	uint32_t address;
+	int i, word;
+
+	i = 0;
+	while( fscanf(fp, "%x\n", &word) != EOF ) {
+		address = MEM_TEXT_BEGIN + i;
+		mem_write_32(address, word);
+		if (INTERACTIVE) {
+			printf("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
+		}
+		i += 4;
+	}
+	PROGRAM_SIZE = i/4;
+	PROGRAM_ENTRY = MEM_TEXT_BEGIN;
+	return TRUE;
+}
+
+static int load_bin(FILE *fp)
+{
+	uint8_t buffer[4096];
+	uint32_t address = MEM_TEXT_BEGIN;
+	size_t n;
+
+	while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+		if (!copy_in(address, buffer, n)) {
+			return FALSE;
+		}
+		address += n;
+	}
+	PROGRAM_SIZE = (address - MEM_TEXT_BEGIN) / 4;
+	PROGRAM_ENTRY = MEM_TEXT_BEGIN;
+	return TRUE;
+}
+
+/***************************************************************/
+/* Little-endian MIPS ELF32: every PT_LOAD segment at its address   */
+/***************************************************************/
+static int load_elf(FILE *fp)
+{
+	Elf32_Ehdr eh;
+	Elf32_Phdr ph;
+	uint8_t *bytes;
+	uint64_t span;
+	int i, ok;
+
+	if (fread(&eh, sizeof(eh), 1, fp) != 1 || eh.e_ident[EI_CLASS] != ELFCLASS32) {
+		sim_error("not a 32-bit ELF file");
+		return FALSE;
+	}
+	if (eh.e_ident[EI_DATA] != ELFDATA2LSB || eh.e_machine != EM_MIPS) {
+		sim_error("not a little-endian MIPS executable");
+		return FALSE;
+	}
+	PROGRAM_SIZE = 0;
+	for (i = 0; i < eh.e_phnum; i++) {
+		if (fseek(fp, eh.e_phoff + i * eh.e_phentsize, SEEK_SET) != 0 || fread(&ph, sizeof(ph), 1, fp) != 1) {
+			sim_error("truncated program header");
+			return FALSE;
+		}
+		if (ph.p_type != PT_LOAD || ph.p_filesz == 0) {
+			continue;	/* memory is zero after a reset, so .bss needs nothing */
+		}
+		/* sizes come from the file: check them before allocating */
+		span = ph.p_filesz;
+		if (ph.p_filesz > ph.p_memsz || mem_span(ph.p_vaddr, &span) == NULL || span != ph.p_filesz) {
+			sim_error("segment at 0x%08x (%u bytes) does not fit guest memory", ph.p_vaddr, ph.p_filesz);
+			return FALSE;
+		}
+		bytes = malloc(ph.p_filesz);
+		if (bytes == NULL) {
+			sim_error("out of memory for the segment at 0x%08x", ph.p_vaddr);
+			return FALSE;
+		}
+		ok = fseek(fp, ph.p_offset, SEEK_SET) == 0 && fread(bytes, ph.p_filesz, 1, fp) == 1;
+		if (!ok) {
+			sim_error("truncated segment at 0x%08x", ph.p_vaddr);
+		}
+		ok = ok && copy_in(ph.p_vaddr, bytes, ph.p_filesz);
+		free(bytes);
+		if (!ok) {
+			return FALSE;
+		}
+		if (eh.e_entry >= ph.p_vaddr && eh.e_entry < ph.p_vaddr + ph.p_filesz) {
+			PROGRAM_SIZE = ph.p_filesz / 4;	/* the text print_program shows */
+		}
+	}
+	PROGRAM_ENTRY = eh.e_entry;
+	return TRUE;
+}
+
+/***************************************************************/
+/* Load a program image into (reset) memory                                   */
+/***************************************************************/
+int load_image(const char *path)
+{
+	int format = image_format(path);
+	FILE *fp;
+	int ok;
+
+	fp = fopen(path, format == IMAGE_HEX ? "r" : "rb");
+	if (fp == NULL) {
+		sim_error("Can't open program file %s", path);
+		return FALSE;
+	}
+	switch (format) {
+		case IMAGE_ELF: ok = load_elf(fp); break;
+		case IMAGE_BIN: ok = load_bin(fp); break;
+		default: ok = load_hex(fp); break;
+	}
+	fclose(fp);
+	if (ok && INTERACTIVE) {
+		printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
+	}
+	return ok;
+}
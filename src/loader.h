@@ -0,0 +1,19 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Program images: hex text (one word per line), raw little-endian words or ELF32 */
+/******************************************************************************/
+#define IMAGE_HEX 0
+#define IMAGE_BIN 1
+#define IMAGE_ELF 2
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int image_format(const char *path);
+int load_image(const char *path);
+
+#endif
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mumips.h"
+#include "mu-mips.h"
+#include "counters.h"
+
+/***************************************************************/
+/* main: the command-line front end of libmumips                                                   */
+/***************************************************************/
+int main(int argc, char *argv[]) {
+	const char *commands = NULL, *script = NULL;
+	mumips_t *sim;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:x:s:")) != -1) {
+		switch (opt) {
+			case 'c':
+				commands = optarg;
+				break;
+			case 'x':
+				script = optarg;
+				break;
+			case 's':
+				perf_dump_at_exit(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-c \"<cmds>\"] [-x <script>] [-s <stats.json>] <input program>\n", argv[0]);
+				exit(1);
+		}
+	}
+
+	if (commands != NULL || script != NULL) {
+		/* scripted runs: no prompts, no per-instruction trace, JSON dumps */
+		sim = mumips_create(MUMIPS_VERBOSE);
+		if (optind < argc && mumips_load(sim, argv[optind]) != 0) {
+			exit(-1);
+		}
+		if (script != NULL) {
+			run_script_file(script);
+		}
+		if (commands != NULL) {
+			run_script(commands);
+		}
+		return 0;
+	}
+
+	printf("\n**************************\n");
+	printf("Welcome to MU-MIPS SIM...\n");
+	printf("**************************\n\n");
+
+
+	if (optind >= argc) {
+		printf("Error: You should provide input file.\nUsage: %s <input program> \n\n",  argv[0]);
+		exit(1);
+	}
+	doWork(argv[optind + 1]);
+
+	sim = mumips_create(MUMIPS_INTERACTIVE);
+	if (mumips_load(sim, argv[optind]) != 0) {
+		exit(-1);
+	}
+	help();
+	while (1){
+		handle_command();
+	}
+	return 0;
+}
@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "timing.h"
+#include "memprof.h"
+
+static int log2_exact(uint32_t v)
+{
+	return v != 0 && (v & (v - 1)) == 0 ? __builtin_ctz(v) : -1;
+}
+
+static int bucket(uint64_t v)
+{
+	int b = v == 0 ? 0 : 64 - __builtin_clzll(v);
+	return b < MP_BUCKETS ? b : MP_BUCKETS - 1;
+}
+
+/***************************************************************/
+/* Parse "line=64,page=4096,interval=1000000,sample=1"                    */
+/***************************************************************/
+memprof_t *memprof_create(const char *spec)
+{
+	memprof_t *m = calloc(1, sizeof(memprof_t));
+	char buffer[MAX_CMD_LINE], *opt, *value, *end;
+	int line = 6, page = 12, sample = 0;
+
+	m->interval = 1000000;
+	snprintf(buffer, sizeof(buffer), "%s", spec != NULL ? spec : "");
+	for (opt = strtok_r(buffer, ",", &end); opt != NULL; opt = strtok_r(NULL, ",", &end)) {
+		value = strchr(opt, '=');
+		if (value == NULL) {
+			printf("Error: memprof option %s needs a value\n", opt);
+			free(m);
+			return NULL;
+		}
+		*value++ = '\0';
+		if (!strcmp(opt, "line")) line = log2_exact(atoi(value));
+		else if (!strcmp(opt, "page")) page = log2_exact(atoi(value));
+		else if (!strcmp(opt, "sample")) sample = log2_exact(atoi(value));
+		else if (!strcmp(opt, "interval")) m->interval = strtoul(value, NULL, 0);
+		else {
+			printf("Error: unknown memprof option %s\n", opt);
+			free(m);
+			return NULL;
+		}
+	}
+	if (line < 2 || page < 10 || page < line || sample < 0 || sample > 16 || m->interval == 0) {
+		printf("Error: line (>= 4), page (>= 1024) and sample must be powers of two, sample at most 65536, interval positive\n");
+		free(m);
+		return NULL;
+	}
+	m->line_shift = line;
+	m->page_shift = page;
+	m->sample_shift = sample;
+	m->page_epoch = calloc((size_t)1 << (32 - page), sizeof(uint32_t));
+	memprof_clear(m);
+	return m;
+}
+
+void memprof_destroy(memprof_t *m)
+{
+	if (m == NULL) {
+		return;
+	}
+	free(m->page_epoch);
+	free(m->ws);
+	free(m->lines);
+	free(m->tree);
+	free(m->pcs);
+	free(m);
+}
+
+/***************************************************************/
+/* Forget every access (configuration is kept)                                 */
+/***************************************************************/
+void memprof_clear(memprof_t *m)
+{
+	m->instructions = m->loads = m->stores = 0;
+	memset(m->page_epoch, 0, ((size_t)1 << (32 - m->page_shift)) * sizeof(uint32_t));
+	m->epoch = 1;
+	m->interval_pages = 0;
+	m->interval_end = m->interval;
+	m->footprint = 0;
+	m->ws_count = 0;
+
+	free(m->lines);
+	m->lines = NULL;
+	m->line_capacity = m->line_count = 0;
+	free(m->tree);
+	m->tree_size = MP_TREE;
+	m->tree = calloc(m->tree_size + 1, sizeof(uint32_t));
+	m->now = 0;
+	m->sampled = m->cold = 0;
+	memset(m->reuse, 0, sizeof(m->reuse));
+
+	free(m->pcs);
+	m->pcs = NULL;
+	m->pc_capacity = m->pc_count = 0;
+	memset(m->strides, 0, sizeof(m->strides));
+}
+
+/***************************************************************/
+/* Working set: distinct pages per interval and in total                 */
+/***************************************************************/
+static void page_touch(memprof_t *m, uint32_t address)
+{
+	uint32_t *stamp = &m->page_epoch[address >> m->page_shift];
+
+	if (*stamp != m->epoch) {
+		if (*stamp == 0) {
+			m->footprint++;
+		}
+		*stamp = m->epoch;
+		m->interval_pages++;
+	}
+}
+
+static void interval_close(memprof_t *m)
+{
+	if (m->ws_count == m->ws_capacity) {
+		m->ws_capacity = m->ws_capacity ? m->ws_capacity * 2 : 256;
+		m->ws = realloc(m->ws, m->ws_capacity * sizeof(uint32_t));
+	}
+	m->ws[m->ws_count++] = m->interval_pages;
+	m->interval_pages = 0;
+	m->epoch++;
+	m->interval_end += m->interval;
+}
+
+/***************************************************************/
+/* Reuse distance                                                                                                 */
+/***************************************************************/
+static mp_line_t *line_entry(memprof_t *m, uint32_t line)
+{
+	uint32_t i, mask;
+
+	if (m->line_count * 2 >= m->line_capacity) {
+		mp_line_t *old = m->lines;
+		uint32_t old_capacity = m->line_capacity;
+		m->line_capacity = old_capacity ? old_capacity * 2 : 4096;
+		m->lines = calloc(m->line_capacity, sizeof(mp_line_t));
+		m->line_count = 0;
+		for (i = 0; i < old_capacity; i++) {
+			if (old[i].last != 0) {
+				*line_entry(m, old[i].line) = old[i];
+			}
+		}
+		free(old);
+	}
+	mask = m->line_capacity - 1;
+	for (i = line * 2654435761u & mask; m->lines[i].last != 0 && m->lines[i].line != line; i = (i + 1) & mask)
+		;
+	if (m->lines[i].last == 0) {
+		m->lines[i].line = line;
+		m->line_count++;
+	}
+	return &m->lines[i];
+}
+
+static void tree_add(memprof_t *m, uint32_t t, int32_t delta)
+{
+	for (; t <= m->tree_size; t += t & -t) {
+		m->tree[t] += delta;
+	}
+}
+
+static uint32_t tree_prefix(memprof_t *m, uint32_t t)
+{
+	uint32_t sum = 0;
+
+	for (; t > 0; t -= t & -t) {
+		sum += m->tree[t];
+	}
+	return sum;
+}
+
+/***************************************************************/
+/* Out of time slots: renumber the marks 1..lines in access order    */
+/* (one linear pass), growing the tree to 8 slots per line            */
+/***************************************************************/
+static void tree_compact(memprof_t *m)
+{
+	uint32_t *order = calloc(m->tree_size + 1, sizeof(uint32_t));
+	uint32_t i, t, j, n = 0;
+
+	for (i = 0; i < m->line_capacity; i++) {
+		if (m->lines[i].last != 0) {
+			order[m->lines[i].last] = i + 1;
+		}
+	}
+	for (t = 1; t <= m->tree_size; t++) {
+		if (order[t] != 0) {
+			m->lines[order[t] - 1].last = ++n;
+		}
+	}
+	free(order);
+	while (n * 8 > m->tree_size) {
+		m->tree_size *= 2;
+		free(m->tree);
+		m->tree = malloc((m->tree_size + 1) * sizeof(uint32_t));
+	}
+	/* linear Fenwick build over n leading ones */
+	memset(m->tree, 0, (m->tree_size + 1) * sizeof(uint32_t));
+	for (t = 1; t <= n; t++) {
+		m->tree[t]++;
+		j = t + (t & -t);
+		if (j <= m->tree_size) {
+			m->tree[j] += m->tree[t];
+		}
+	}
+	for (t = n + 1; t <= m->tree_size; t++) {
+		j = t + (t & -t);
+		if (j <= m->tree_size) {
+			m->tree[j] += m->tree[t];
+		}
+	}
+	m->now = n;
+}
+
+static void reuse_access(memprof_t *m, uint32_t line)
+{
+	mp_line_t *e;
+	uint64_t distance;
+
+	/* spatial sampling: a hash-selected subset of lines, distances scaled up */
+	if (m->sample_shift && (line * 2654435761u) >> (32 - m->sample_shift) != 0) {
+		return;
+	}
+	m->sampled++;
+	if (m->now == m->tree_size) {
+		tree_compact(m);
+	}
+	e = line_entry(m, line);
+	if (e->last == 0) {
+		m->cold++;
+	} else {
+		distance = m->line_count - tree_prefix(m, e->last);
+		m->reuse[bucket(distance << m->sample_shift)]++;
+		tree_add(m, e->last, -1);
+	}
+	e->last = ++m->now;
+	tree_add(m, e->last, 1);
+}
+
+/***************************************************************/
+/* Strides per PC                                                                                                  */
+/***************************************************************/
+static mp_pc_t *pc_entry(memprof_t *m, uint32_t pc)
+{
+	uint32_t i, mask;
+
+	if (m->pc_count * 2 >= m->pc_capacity) {
+		mp_pc_t *old = m->pcs;
+		uint32_t old_capacity = m->pc_capacity;
+		m->pc_capacity = old_capacity ? old_capacity * 2 : 1024;
+		m->pcs = calloc(m->pc_capacity, sizeof(mp_pc_t));
+		m->pc_count = 0;
+		for (i = 0; i < old_capacity; i++) {
+			if (old[i].pc != 0) {
+				*pc_entry(m, old[i].pc) = old[i];
+			}
+		}
+		free(old);
+	}
+	mask = m->pc_capacity - 1;
+	for (i = (pc >> 2) * 2654435761u & mask; m->pcs[i].pc != 0 && m->pcs[i].pc != pc; i = (i + 1) & mask)
+		;
+	if (m->pcs[i].pc == 0) {
+		m->pcs[i].pc = pc;
+		m->pc_count++;
+	}
+	return &m->pcs[i];
+}
+
+static void stride_access(memprof_t *m, uint32_t pc, uint32_t address)
+{
+	mp_pc_t *p = pc_entry(m, pc);
+	int32_t stride;
+
+	if (p->accesses > 0) {
+		stride = (int32_t)(address - p->last_addr);
+		m->strides[bucket(stride < 0 ? -(int64_t)stride : stride)]++;
+		if (p->accesses > 1 && stride == p->last_stride) {
+			p->regular++;
+		}
+		if (p->votes == 0) {
+			p->stride = stride;
+			p->votes = 1;
+		} else if (stride == p->stride) {
+			p->votes++;
+		} else {
+			p->votes--;
+		}
+		p->last_stride = stride;
+	}
+	p->last_addr = address;
+	p->accesses++;
+}
+
+/***************************************************************/
+/* One retired instruction                                                                                    */
+/***************************************************************/
+void memprof_retire(memprof_t *m, const inst_record_t *r, uint16_t flags)
+{
+	if (flags & (INST_LOAD | INST_STORE)) {
+		if (flags & INST_STORE) {
+			m->stores++;
+		} else {
+			m->loads++;
+		}
+		page_touch(m, r->mem_addr);
+		reuse_access(m, r->mem_addr >> m->line_shift);
+		stride_access(m, r->pc, r->mem_addr);
+	}
+	if (++m->instructions == m->interval_end) {
+		interval_close(m);
+	}
+}
+
+/***************************************************************/
+/* Report                                                                                                             */
+/***************************************************************/
+static int by_accesses(const void *a, const void *b)
+{
+	const mp_pc_t *x = a, *y = b;
+	return (y->accesses > x->accesses) - (y->accesses < x->accesses);
+}
+
+/* histograms end at their last non-empty bucket */
+static int used_buckets(const uint64_t *h)
+{
+	int n = MP_BUCKETS;
+
+	while (n > 0 && h[n - 1] == 0) {
+		n--;
+	}
+	return n;
+}
+
+static void print_histogram(FILE *fp, const uint64_t *h, uint64_t scale)
+{
+	int i, n = used_buckets(h);
+
+	fprintf(fp, "[");
+	for (i = 0; i < n; i++) {
+		fprintf(fp, i ? ",%llu" : "%llu", (unsigned long long)(h[i] * scale));
+	}
+	fprintf(fp, "]");
+}
+
+void memprof_print(memprof_t *m, FILE *fp, int json)
+{
+	mp_pc_t *top = malloc((m->pc_count + 1) * sizeof(mp_pc_t));
+	uint64_t scale = 1ull << m->sample_shift, sum, total;
+	uint32_t i, n = 0, points = m->ws_count + (m->interval_pages != 0);
+	int b, used;
+
+	for (i = 0; i < m->pc_capacity; i++) {
+		if (m->pcs[i].pc != 0) {
+			top[n++] = m->pcs[i];
+		}
+	}
+	qsort(top, n, sizeof(mp_pc_t), by_accesses);
+	if (n > MP_TOP) {
+		n = MP_TOP;
+	}
+
+	if (json) {
+		fprintf(fp, ",\"memprof\":{\"instructions\":%llu,\"loads\":%llu,\"stores\":%llu,\"line\":%u,\"page\":%u,"
+				"\"interval\":%u,\"sample\":%llu,\"footprint\":{\"pages\":%llu,\"lines\":%llu},\"working_set\":[",
+				(unsigned long long)m->instructions, (unsigned long long)m->loads,
+				(unsigned long long)m->stores, 1u << m->line_shift, 1u << m->page_shift, m->interval,
+				(unsigned long long)scale, (unsigned long long)m->footprint,
+				(unsigned long long)m->line_count * scale);
+		for (i = 0; i < points; i++) {
+			fprintf(fp, i ? ",%u" : "%u", i < m->ws_count ? m->ws[i] : m->interval_pages);
+		}
+		fprintf(fp, "],\"reuse\":{\"cold\":%llu,\"histogram\":", (unsigned long long)(m->cold * scale));
+		print_histogram(fp, m->reuse, scale);
+		fprintf(fp, "},\"strides\":{\"histogram\":");
+		print_histogram(fp, m->strides, 1);
+		fprintf(fp, ",\"pcs\":[");
+		for (i = 0; i < n; i++) {
+			fprintf(fp, "%s{\"pc\":%u,\"accesses\":%llu,\"stride\":%d,\"regular\":%.3f}", i ? "," : "",
+					top[i].pc, (unsigned long long)top[i].accesses, top[i].stride,
+					top[i].accesses > 2 ? (double)top[i].regular / (top[i].accesses - 2) : 0.0);
+		}
+		fprintf(fp, "]}}");
+	} else {
+		fprintf(fp, "Memory accesses (%u-byte lines, %u-byte pages%s)\n", 1u << m->line_shift,
+				1u << m->page_shift, m->sample_shift ? ", sampled reuse" : "");
+		fprintf(fp, "-------------------------------------\n");
+		fprintf(fp, "%llu loads, %llu stores in %llu instructions; footprint %llu pages, %llu lines\n",
+				(unsigned long long)m->loads, (unsigned long long)m->stores,
+				(unsigned long long)m->instructions, (unsigned long long)m->footprint,
+				(unsigned long long)m->line_count * scale);
+		fprintf(fp, "Working set per %u instructions (pages):", m->interval);
+		for (i = 0; i < points; i++) {
+			fprintf(fp, " %u", i < m->ws_count ? m->ws[i] : m->interval_pages);
+		}
+		fprintf(fp, "\n[Reuse distance < lines]\t[Bytes]\t[Accesses]\t[Cumulative %%]\n");
+		total = m->sampled * scale;
+		sum = 0;
+		used = used_buckets(m->reuse);
+		for (b = 0; b < used; b++) {
+			sum += m->reuse[b] * scale;
+			fprintf(fp, "%llu\t\t\t%llu\t%llu\t\t%.1f\n", 1ull << b, (1ull << b) << m->line_shift,
+					(unsigned long long)(m->reuse[b] * scale), total ? 100.0 * sum / total : 0.0);
+		}
+		fprintf(fp, "cold\t\t\t-\t%llu\n", (unsigned long long)(m->cold * scale));
+		fprintf(fp, "[Stride < bytes]\t[Accesses]\n");
+		used = used_buckets(m->strides);
+		for (b = 0; b < used; b++) {
+			fprintf(fp, "%llu\t\t\t%llu\n", 1ull << b, (unsigned long long)m->strides[b]);
+		}
+		fprintf(fp, "[PC]\t\t[Accesses]\t[Stride]\t[Regular %%]\n");
+		for (i = 0; i < n; i++) {
+			fprintf(fp, "0x%08x\t%llu\t\t%d\t\t%.1f\n", top[i].pc, (unsigned long long)top[i].accesses,
+					top[i].stride, top[i].accesses > 2 ? 100.0 * top[i].regular / (top[i].accesses - 2) : 0.0);
+		}
+		fprintf(fp, "\n");
+	}
+	free(top);
+}
@@ -0,0 +1,69 @@
+#ifndef MEMPROF_H
+#define MEMPROF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "timing.h"
+
+/******************************************************************************/
+/* Memory access analyzer: working set, reuse distance and per-PC strides      */
+/******************************************************************************/
+#define MP_BUCKETS 40	/* log2 histograms: bucket 0 holds 0, bucket k holds [2^(k-1), 2^k) */
+#define MP_TOP 16	/* PCs listed in the stride report */
+#define MP_TREE 4096	/* initial access-time slots of the reuse-distance tree; grows to 8 per line */
+
+typedef struct {
+	uint32_t pc;
+	uint32_t last_addr;
+	int32_t last_stride;
+	int32_t stride;	/* majority vote over the strides seen */
+	uint32_t votes;
+	uint64_t accesses;
+	uint64_t regular;	/* accesses that repeated the previous stride */
+} mp_pc_t;
+
+typedef struct {
+	uint32_t line;
+	uint32_t last;	/* access time of its mark in the tree, 0: empty slot */
+} mp_line_t;
+
+typedef struct memprof {
+	uint32_t line_shift, page_shift;
+	uint32_t sample_shift;	/* reuse distance follows 1 in 2^sample_shift lines */
+	uint32_t interval;	/* instructions per working-set point */
+
+	uint64_t instructions, loads, stores;
+
+	/* working set: pages stamped with the interval that last touched them */
+	uint32_t *page_epoch;
+	uint32_t epoch, interval_pages;
+	uint64_t interval_end, footprint;
+	uint32_t *ws;	/* pages touched in each finished interval */
+	uint32_t ws_count, ws_capacity;
+
+	/* reuse distance: a Fenwick tree over access times holds one mark per
+	   line at its last access, so the marks after it count distinct lines */
+	mp_line_t *lines;
+	uint32_t line_capacity, line_count;
+	uint32_t *tree;
+	uint32_t tree_size, now;
+	uint64_t sampled, cold;
+	uint64_t reuse[MP_BUCKETS];
+
+	/* strides */
+	mp_pc_t *pcs;
+	uint32_t pc_capacity, pc_count;
+	uint64_t strides[MP_BUCKETS];
+} memprof_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+memprof_t *memprof_create(const char *spec);
+void memprof_destroy(memprof_t *m);
+void memprof_clear(memprof_t *m);
+void memprof_retire(memprof_t *m, const inst_record_t *r, uint16_t flags);
+void memprof_print(memprof_t *m, FILE *fp, int json);
+
+#endif
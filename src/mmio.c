@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mu-mips.h"
+#include "smp.h"
+#include "cp0.h"
+#include "guard.h"
+#include "mmio.h"
+
+int MMIO_ACTIVE;
+uint32_t MMIO_DEADLINE;
+
+static device_t devices[MAX_DEVICES];
+static int num_devices;
+static uint32_t window;	/* host page size */
+
+static const char *kind_names[NUM_DEV_KINDS] = { "uart", "timer", "block" };
+
+/* the timer runs on hart 0, whichever hart is looking */
+static uint32_t now()
+{
+	return HART_ID == 0 ? INSTRUCTION_COUNT : HARTS[0].instruction_count;
+}
+
+static int reached(uint32_t count, uint32_t when)
+{
+	return (int32_t)(count - when) >= 0;
+}
+
+/***************************************************************/
+/* Take the window's page out of (or put it back into) guest memory */
+/***************************************************************/
+static void protect(device_t *dev, int hidden)
+{
+	mmap(MEM_BASE + dev->base, window, hidden ? PROT_NONE : PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+}
+
+/***************************************************************/
+/* Attach a device of <kind> at guest <base>                                   */
+/***************************************************************/
+int mmio_attach(const char *kind, uint32_t base, const char *path)
+{
+	device_t *dev;
+	struct stat st;
+	int k;
+
+	window = sysconf(_SC_PAGESIZE);
+	for (k = 0; k < NUM_DEV_KINDS && strcmp(kind, kind_names[k]); k++);
+	if (k == NUM_DEV_KINDS) {
+		printf("Error: unknown device %s (uart, timer or block)\n", kind);
+		return FALSE;
+	}
+	if (num_devices == MAX_DEVICES) {
+		printf("Error: at most %d devices can be attached\n", MAX_DEVICES);
+		return FALSE;
+	}
+	if (base < MEM_KDATA_BEGIN || base % window != 0 || (uint64_t)base + window - 1 > MEM_KDATA_END) {
+		printf("Error: device address must be a page-aligned address in the kernel data segment\n");
+		return FALSE;
+	}
+	if (mmio_find(base) != NULL) {
+		printf("Error: 0x%08x is already decoded by a device\n", base);
+		return FALSE;
+	}
+	if (k == DEV_BLOCK && path == NULL) {
+		printf("Error: a block device needs a backing file\n");
+		return FALSE;
+	}
+
+	dev = &devices[num_devices];
+	memset(dev, 0, sizeof(*dev));
+	dev->kind = k;
+	dev->base = base;
+	if (path != NULL) {
+		snprintf(dev->path, sizeof(dev->path), "%s", path);
+		dev->fp = fopen(path, k == DEV_BLOCK ? "r+b" : "rb");
+		if (dev->fp == NULL) {
+			printf("Error: Can't open %s\n", path);
+			return FALSE;
+		}
+		if (k == DEV_BLOCK) {
+			fstat(fileno(dev->fp), &st);
+			dev->regs[BLOCK_SIZE / 4] = st.st_size / SECTOR_SIZE;
+		}
+	}
+	num_devices++;
+	protect(dev, TRUE);
+	MMIO_ACTIVE = TRUE;
+	mmio_kick();
+	if (INTERACTIVE) {
+		printf("%s at 0x%08x%s%s\n", kind_names[k], base, path ? " on " : "", path ? path : "");
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Detach every device and give the windows back to memory            */
+/***************************************************************/
+void mmio_clear()
+{
+	int i;
+
+	for (i = 0; i < num_devices; i++) {
+		if (devices[i].fp != NULL) {
+			fclose(devices[i].fp);
+		}
+		if (MEM_BASE != NULL) {
+			protect(&devices[i], FALSE);
+		}
+	}
+	num_devices = 0;
+	MMIO_ACTIVE = FALSE;
+	CURRENT_STATE.CAUSE &= ~CAUSE_IP;
+	NEXT_STATE.CAUSE &= ~CAUSE_IP;
+}
+
+/***************************************************************/
+/* After reset() wiped guest memory: hide the windows again and      */
+/* restart the devices (the block device keeps its contents)         */
+/***************************************************************/
+void mmio_reset()
+{
+	int i;
+
+	for (i = 0; i < num_devices; i++) {
+		device_t *dev = &devices[i];
+		protect(dev, TRUE);
+		if (dev->kind == DEV_UART && dev->fp != NULL) {
+			rewind(dev->fp);
+		}
+		/* the block device's registers below BLOCK_SIZE; its capacity stays */
+		memset(dev->regs, 0, dev->kind == DEV_BLOCK ? BLOCK_SIZE : sizeof(dev->regs));
+		dev->reads = dev->writes = 0;
+	}
+	MMIO_DEADLINE = 0;
+}
+
+/***************************************************************/
+/* Print the attached devices                                                           */
+/***************************************************************/
+void mmio_list()
+{
+	int i;
+	for (i = 0; i < num_devices; i++) {
+		printf("0x%08x\t%s\t%llu reads, %llu writes\t%s\n", devices[i].base, kind_names[devices[i].kind],
+				(unsigned long long)devices[i].reads, (unsigned long long)devices[i].writes, devices[i].path);
+	}
+}
+
+/***************************************************************/
+/* Devices that only print leave a run nothing to depend on but    */
+/* their addresses: fills bases and returns how many, or -1 if a   */
+/* device has inputs or state of its own                                       */
+/***************************************************************/
+int mmio_output_only(uint32_t *bases)
+{
+	int i;
+	for (i = 0; i < num_devices; i++) {
+		if (devices[i].kind != DEV_UART || devices[i].fp != NULL) {
+			return -1;
+		}
+		bases[i] = devices[i].base;
+	}
+	return num_devices;
+}
+
+/* device registers changed: have hart 0 look at them before its next instruction */
+void mmio_kick()
+{
+	MMIO_DEADLINE = now() + 1;
+}
+
+/***************************************************************/
+/* Hart 0 reached MMIO_DEADLINE: fire the timers, drive Cause.IP and */
+/* take an unmasked interrupt in place of the instruction at PC. The */
+/* next deadline is the earliest timer, or never; a masked interrupt */
+/* waits for the MTC0 or ERET that unmasks it to kick us again        */
+/***************************************************************/
+int mmio_poll()
+{
+	uint32_t count = INSTRUCTION_COUNT, lines = 0;
+	uint32_t next = count + INT32_MAX;
+	int i;
+
+	for (i = 0; i < num_devices; i++) {
+		device_t *dev = &devices[i];
+		uint32_t *compare = &dev->regs[TIMER_COMPARE / 4], period = dev->regs[TIMER_PERIOD / 4];
+		uint32_t *control = &dev->regs[TIMER_CONTROL / 4];
+
+		if (dev->kind != DEV_TIMER || !(*control & 1)) {
+			continue;
+		}
+		if (reached(count, *compare) && !(*control & 2)) {
+			*control |= 2;
+			if (period != 0) {
+				*compare += ((count - *compare) / period + 1) * period;
+			}
+		}
+		if (!(*control & 2) || period != 0) {
+			if ((int32_t)(*compare - count) < (int32_t)(next - count)) {
+				next = *compare;
+			}
+		}
+		if (*control & 2) {
+			lines |= IRQ_TIMER;
+		}
+	}
+	MMIO_DEADLINE = next;
+
+	CURRENT_STATE.CAUSE = (CURRENT_STATE.CAUSE & ~CAUSE_IP) | lines;
+	if (lines && CP0_ENABLED && (CURRENT_STATE.STATUS & STATUS_IE) && !(CURRENT_STATE.STATUS & STATUS_EXL) &&
+			(lines & CURRENT_STATE.STATUS & STATUS_IM)) {
+		interrupt_take();
+		return TRUE;
+	}
+	NEXT_STATE.CAUSE = CURRENT_STATE.CAUSE;
+	return FALSE;
+}
+
+/***************************************************************/
+/* The device whose window holds address, or NULL                        */
+/***************************************************************/
+device_t *mmio_find(uint32_t address)
+{
+	int i;
+	for (i = 0; i < num_devices; i++) {
+		if (address - devices[i].base < window) {
+			return &devices[i];
+		}
+	}
+	return NULL;
+}
+
+/***************************************************************/
+/* Clip a host-side access of *len bytes at address so it stops    */
+/* short of the next window. TRUE: address is itself in a window     */
+/* (and *len is what is left of it)                                               */
+/***************************************************************/
+int mmio_clip(uint32_t address, uint64_t *len)
+{
+	int i;
+	for (i = 0; i < num_devices; i++) {
+		uint32_t base = devices[i].base;
+		if (address - base < window) {
+			if (*len > base + window - address) {
+				*len = base + window - address;
+			}
+			return TRUE;
+		}
+		if (base > address && base - address < *len) {
+			*len = base - address;
+		}
+	}
+	return FALSE;
+}
+
+/***************************************************************/
+/* Block transfer of COUNT sectors between the file and memory      */
+/***************************************************************/
+static uint32_t block_transfer(device_t *dev, int write)
+{
+	uint64_t offset = (uint64_t)dev->regs[BLOCK_SECTOR / 4] * SECTOR_SIZE;
+	uint64_t left = (uint64_t)dev->regs[BLOCK_COUNT / 4] * SECTOR_SIZE, len;
+	uint32_t address = dev->regs[BLOCK_ADDRESS / 4];
+	uint8_t *host;
+	ssize_t done;
+
+	if ((uint64_t)dev->regs[BLOCK_SECTOR / 4] + dev->regs[BLOCK_COUNT / 4] > dev->regs[BLOCK_SIZE / 4]) {
+		return 1;
+	}
+	while (left > 0) {
+		len = left;
+		host = mem_span(address, &len);
+		if (host == NULL) {
+			return 1;
+		}
+		done = write ? pwrite(fileno(dev->fp), host, len, offset) : pread(fileno(dev->fp), host, len, offset);
+		if (done != (ssize_t)len) {
+			return 1;
+		}
+		address += len;
+		offset += len;
+		left -= len;
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* Register read: UART input has the side effect of consuming it    */
+/***************************************************************/
+uint32_t mmio_read(device_t *dev, uint32_t address)
+{
+	uint32_t offset = (address - dev->base) & ~3u;
+	int c;
+
+	dev->reads++;
+	switch (dev->kind) {
+		case DEV_UART:
+			if (dev->fp == NULL) {
+				return offset == UART_STATUS ? 2 : 0;
+			}
+			c = fgetc(dev->fp);
+			if (offset == UART_STATUS) {
+				if (c != EOF) {
+					ungetc(c, dev->fp);
+				}
+				return (c != EOF) | 2;
+			}
+			return offset == UART_DATA && c != EOF ? (uint32_t)c : 0;
+		case DEV_TIMER:
+			if (offset == TIMER_COUNT) {
+				return now();
+			}
+			break;
+	}
+	return offset < sizeof(dev->regs) ? dev->regs[offset / 4] : 0;
+}
+
+/***************************************************************/
+/* Register write                                                                                   */
+/***************************************************************/
+void mmio_write(device_t *dev, uint32_t address, uint32_t value)
+{
+	uint32_t offset = (address - dev->base) & ~3u;
+
+	dev->writes++;
+	switch (dev->kind) {
+		case DEV_UART:
+			if (offset == UART_DATA) {
+				putchar(value & 0xFF);
+				if ((value & 0xFF) == '\n') {
+					fflush(stdout);
+				}
+			}
+			return;
+		case DEV_TIMER:
+			if (offset == TIMER_COMPARE) {
+				dev->regs[TIMER_COMPARE / 4] = value;
+				dev->regs[TIMER_CONTROL / 4] &= ~2u;
+			} else if (offset == TIMER_PERIOD) {
+				dev->regs[TIMER_PERIOD / 4] = value;
+			} else if (offset == TIMER_CONTROL) {
+				/* bit 0 enables, writing 1 to bit 1 acknowledges */
+				dev->regs[TIMER_CONTROL / 4] = (value & 1) | (dev->regs[TIMER_CONTROL / 4] & ~value & 2);
+			}
+			mmio_kick();
+			return;
+		case DEV_BLOCK:
+			if (offset == BLOCK_COMMAND) {
+				if (value == 1 || value == 2) {
+					dev->regs[BLOCK_STATUS / 4] = block_transfer(dev, value == 2);
+				}
+			} else if (offset < BLOCK_STATUS) {
+				dev->regs[offset / 4] = value;
+			}
+			return;
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef MMIO_H
+#define MMIO_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/******************************************************************************/
+/* Memory-mapped devices in the kernel data segment. A device window is left    */
+/* PROT_NONE in the guest range, so only accesses to it trap (see guard.c);      */
+/* every other load and store runs at full speed                                      */
+/******************************************************************************/
+#define MAX_DEVICES 16	/* each decodes one host page of registers */
+
+#define DEV_UART  0
+#define DEV_TIMER 1
+#define DEV_BLOCK 2
+#define NUM_DEV_KINDS 3
+
+/* UART: a console on stdout, input from an optional host file */
+#define UART_DATA   0x00	/* write: send a byte; read: next input byte (0 when none) */
+#define UART_STATUS 0x04	/* bit 0: input ready, bit 1: output ready */
+
+/* timer: counts hart 0 instructions, the functional model's cycles */
+#define TIMER_COUNT   0x00	/* read only */
+#define TIMER_COMPARE 0x04	/* interrupt when COUNT reaches it; writing it acknowledges */
+#define TIMER_PERIOD  0x08	/* nonzero: COMPARE advances by PERIOD every time it fires */
+#define TIMER_CONTROL 0x0C	/* bit 0: enable; reading bit 1: interrupt pending */
+
+/* block device: 512-byte sectors of a host file, copied synchronously */
+#define BLOCK_SECTOR  0x00
+#define BLOCK_ADDRESS 0x04	/* guest buffer */
+#define BLOCK_COUNT   0x08	/* sectors per command */
+#define BLOCK_COMMAND 0x0C	/* write 1: read sectors into memory, 2: write them out */
+#define BLOCK_STATUS  0x10	/* 0 after a good transfer, 1 after a failed one */
+#define BLOCK_SIZE    0x14	/* capacity in sectors, read only */
+#define SECTOR_SIZE 512
+
+#define IRQ_TIMER 0x8000	/* Cause.IP7, like the MIPS count/compare timer */
+
+typedef struct {
+	int kind;
+	uint32_t base;
+	char path[256];
+	FILE *fp;	/* UART input or block device backing file */
+	uint32_t regs[8];	/* register file, indexed by offset / 4 */
+	uint64_t reads, writes;
+} device_t;
+
+extern int MMIO_ACTIVE;	/* any device attached: cycle() must look */
+extern uint32_t MMIO_DEADLINE;	/* hart 0 INSTRUCTION_COUNT at which mmio_poll() must run */
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int mmio_attach(const char *kind, uint32_t base, const char *path);
+void mmio_clear();
+void mmio_reset();
+void mmio_list();
+int mmio_poll();
+device_t *mmio_find(uint32_t address);
+uint32_t mmio_read(device_t *dev, uint32_t address);
+void mmio_write(device_t *dev, uint32_t address, uint32_t value);
+int mmio_clip(uint32_t address, uint64_t *len);
+void mmio_kick();
+int mmio_output_only(uint32_t *bases);
+
+#endif
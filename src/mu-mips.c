@@ -1,10 +1,95 @@
 #include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <stdint.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "mu-mips.h"
+#include "counters.h"
+#include "filemap.h"
+#include "timing.h"
+#include "trace.h"
+#include "sample.h"
+#include "lanes.h"
+#include "idle.h"
+#include "hle.h"
+#include "loader.h"
+#include "smp.h"
+#include "cp0.h"
+#include "guard.h"
+#include "fpu.h"
+#include "mmio.h"
+#include "link.h"
+#include "rcache.h"
+#include "checkpoint.h"
+#include "cosim.h"
+#include "callprof.h"
+
+/* memory will be dynamically allocated at initialization */
+mem_region_t MEM_REGIONS[] = {
+	{ MEM_TEXT_BEGIN, MEM_TEXT_END, NULL },
+	{ MEM_DATA_BEGIN, MEM_DATA_END, NULL },
+	{ MEM_KDATA_BEGIN, MEM_KDATA_END, NULL },
+	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END, NULL },
+	{ MEM_GP_BEGIN, MEM_GP_END, NULL }
+};
+
+/* cache-line aligned: cycle() copies NEXT_STATE over CURRENT_STATE every instruction */
+__thread CPU_State CURRENT_STATE __attribute__((aligned(64))), NEXT_STATE __attribute__((aligned(64)));
+__thread int RUN_FLAG;
+__thread uint32_t INSTRUCTION_COUNT;
+__thread inst_record_t RETIRED;
+uint32_t PROGRAM_SIZE;
+uint32_t PROGRAM_ENTRY = MEM_TEXT_BEGIN;
+
+char prog_file[256];
+
+int INTERACTIVE = TRUE;	/* prompts, banners and progress messages */
+int TRACE = TRUE;	/* print every executed instruction */
+int JSON_OUTPUT = FALSE;	/* rdump/mdump emit JSON */
+int QUIET = FALSE;	/* embedded: stdout belongs to the host program */
+char LAST_ERROR[256];
+
+/***************************************************************/
+/* Report an error: kept for the library API, printed unless QUIET */
+/***************************************************************/
+void sim_error(const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(LAST_ERROR, sizeof(LAST_ERROR), format, args);
+	va_end(args);
+	if (!QUIET) {
+		printf("Error: %s\n", LAST_ERROR);
+	}
+}
+
+/***************************************************************/
+/* The number in a "name=value" option, at most max; a typo is an   */
+/* error rather than a silent 0                                                                                    */
+/***************************************************************/
+int parse_option(const char *name, const char *text, uint32_t max, uint32_t *value)
+{
+	unsigned long long v;
+	char *end;
+
+	errno = 0;
+	v = strtoull(text, &end, 0);
+	if (*text < '0' || *text > '9' || *end != '\0' || errno != 0 || v > max) {
+		printf("Error: option %s needs a number up to %u, not %s\n", name, max, text);
+		return FALSE;
+	}
+	*value = v;
+	return TRUE;
+}
 
 /***************************************************************/
 /* Print out a list of commands available                                                                  */
@@ -18,9 +103,45 @@ void help() {
 	printf("reset\t-- clears all registers/memory and re-loads the program\n");
 	printf("input <reg> <val>\t-- set GPR <reg> to <val>\n");
 	printf("mdump <start> <stop>\t-- dump memory from <start> to <stop> address\n");
+	printf("hexdump <start> <stop>\t-- hex/ASCII dump of memory from <start> to <stop> address\n");
+	printf("msave <start> <stop> <file>\t-- save raw memory bytes to <file>\n");
+	printf("mload <file> <addr>\t-- load raw bytes from <file> at <addr>\n");
+	printf("mmap <file> <addr> [private|shared]\t-- map <file> into the data segment at <addr>\n");
+	printf("munmap <addr>\t-- remove the file mapping at <addr>\n");
 	printf("high <val>\t-- set the HI register to <val>\n");
 	printf("low <val>\t-- set the LO register to <val>\n");
 	printf("print\t-- print the program loaded into memory\n");
+	printf("load <file>\t-- load a new program and reset\n");
+	printf("asm <source> <object>\t-- assemble one source into a relocatable object\n");
+	printf("link <image> <source|object>...\t-- link into an ELF image and <image>.sym, reassembling only changed sources\n");
+	printf("checkpoint <file> | checkpoint every <n> <file> | checkpoint off\t-- save the simulation in the background, now or every <n> instructions of a run\n");
+	printf("resume <file>\t-- continue from a checkpoint\n");
+	printf("snapshot\t-- dump the state of every hart as JSON\n");
+	printf("stats\t-- print the performance counters\n");
+	printf("timing off | timing pipeline [forward=on,branch=id,mult=4,div=32]\t-- select a timing model\n");
+	printf("timing ooo [width=4,rob=128,iq=32,prf=128,alu=4,mul=1,lsu=2,mullat=4,divlat=32,loadlat=2,depth=5]\t-- out-of-order model\n");
+	printf("cache [off | l1i=16k:2:32,l1d=16k:4:32:lru:wb,l2=256k:8:64:plru:wb,l2lat=10,memlat=100]\t-- attach caches\n");
+	printf("bpred [off | static|bimodal|gshare|tournament|tage,bits=12,hist=12,btb=512,ras=16]\t-- attach a branch predictor\n");
+	printf("memprof [off | line=64,page=4096,interval=1000000,sample=1]\t-- working set, reuse distance and strides in stats\n");
+	printf("sample periodic <ffwd> <warm> <detail>\t-- sample the timing model every ffwd+warm+detail instructions\n");
+	printf("sample simpoint <interval> <k> <warm> | sample off\t-- time k basic-block-vector clusters instead\n");
+	printf("lanes <n> | lanes off\t-- run n copies of the program in lockstep from the current state\n");
+	printf("lanes set <lane> <reg> <value> | lanes sweep <reg> <start> <step> | lanes mem <lane> <addr> <value>\t-- per-lane inputs\n");
+	printf("lanes run [max] | lanes stats | lanes dump <reg|hi|lo|pc> | lanes mdump <addr>\t-- run the lanes and read results\n");
+	printf("record <file> | record off\t-- record a compressed instruction trace\n");
+	printf("replay <trace> <configs>\t-- replay a trace into every configuration line (timing ...; cache ...; bpred ...; memprof ...)\n");
+	printf("idle [on|off]\t-- jump over side-effect-free and counting loops in functional runs\n");
+	printf("hook <addr|symbol> <memcpy|memset|strlen|sort|sortu> [base per_unit]\t-- run a guest routine natively\n");
+	printf("hook check on|off | hook clear | hooks\t-- verify hooks against the guest code, drop them, list them\n");
+	printf("trace on|off\t-- print every executed instruction\n");
+	printf("exceptions [on|off|handler]\t-- deliver faults, traps and overflow to the handler at 0x%08x (handler: one stored there, not loaded)\n", MEM_KTEXT_BEGIN);
+	printf("device uart|timer <addr> [input] | device block <addr> <file> | device off | devices\t-- memory-mapped devices in the kernel data segment\n");
+	printf("rcache <dir> [max_mb] | rcache off | rcache\t-- replay repeated functional runs from an on-disk result cache\n");
+	printf("cosim idle|lanes [interval|block] [max]\t-- run the program under the reference and a fast engine, bisect any divergence\n");
+	printf("callprof on|off | callprof [n] | callprof folded <file> [cycles]\t-- shadow call stack: cost per function and call path, collapsed stacks for flame graphs\n");
+	printf("json on|off\t-- rdump/mdump output as JSON\n");
+	printf("smp <n> lockstep <q> | smp <n> free\t-- simulate <n> harts, in lockstep quanta of <q> instructions or on host threads\n");
+	printf("hart <i>\t-- select hart <i> for rdump/input/high/low\n");
 	printf("?\t-- display help menu\n");
 	printf("quit\t-- exit the simulator\n\n");
 	printf("------------------------------------------------------------------\n\n");
@@ -31,7 +152,11 @@ void help() {
 /***************************************************************/
 uint32_t mem_read_32(uint32_t address)
 {
+	device_t *dev;
 	int i;
+	if (MMIO_ACTIVE && (dev = mmio_find(address)) != NULL) {
+		return mmio_read(dev, address);
+	}
 	for (i = 0; i < NUM_MEM_REGION; i++) {
 		if ( (address >= MEM_REGIONS[i].begin) &&  ( address <= MEM_REGIONS[i].end) ) {
 			uint32_t offset = address - MEM_REGIONS[i].begin;
@@ -49,8 +174,17 @@ uint32_t mem_read_32(uint32_t address)
 /***************************************************************/
 void mem_write_32(uint32_t address, uint32_t value)
 {
+	device_t *dev;
 	int i;
 	uint32_t offset;
+	if (MMIO_ACTIVE && (dev = mmio_find(address)) != NULL) {
+		mmio_write(dev, address, value);
+		return;
+	}
+	if (COSIM_TRACK) {
+		cosim_dirty(address);
+		cosim_dirty(address + 3);
+	}
 	for (i = 0; i < NUM_MEM_REGION; i++) {
 		if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
 			offset = address - MEM_REGIONS[i].begin;
@@ -63,12 +197,50 @@ void mem_write_32(uint32_t address, uint32_t value)
 	}
 }
 
+/***************************************************************/
+/* Host address backing a guest address (NULL if unmapped)           */
+/***************************************************************/
+uint8_t *mem_host_ptr(uint32_t address)
+{
+	int i;
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
+			return MEM_REGIONS[i].mem + (address - MEM_REGIONS[i].begin);
+		}
+	}
+	return NULL;
+}
+
 /***************************************************************/
 /* Execute one cycle                                                                                                              */
 /***************************************************************/
 void cycle() {                                                
+	if (MMIO_ACTIVE && HART_ID == 0 && (int32_t)(INSTRUCTION_COUNT - MMIO_DEADLINE) >= 0) {
+		mmio_poll();	/* may redirect PC to the interrupt handler */
+	}
+	if (HLE_ACTIVE && hle_cycle()) {
+		return;
+	}
+	IN_GUEST = TRUE;
 	handle_instruction();
-	CURRENT_STATE = NEXT_STATE;
+	IN_GUEST = FALSE;
+	if (GUARD_FAULT) {
+		guard_fault();
+	}
+	if (EXC_PENDING) {
+		exception_take();
+	}
+	if (TIMING_ACTIVE && HART_ID == 0) {
+		RETIRED.next_pc = NEXT_STATE.PC;
+		timing_retire(&RETIRED);
+	}
+	/* the FP registers at the end of the state are copied only when written */
+	if (__builtin_expect(FPU_DIRTY, 0)) {
+		CURRENT_STATE = NEXT_STATE;
+		FPU_DIRTY = FALSE;
+	} else {
+		memcpy(&CURRENT_STATE, &NEXT_STATE, offsetof(CPU_State, FPR));
+	}
 	INSTRUCTION_COUNT++;
 }
 
@@ -77,19 +249,57 @@ void cycle() {
 /***************************************************************/
 void run(int num_cycles) {                                      
 	
+	if (NUM_HARTS > 1) {
+		if (INTERACTIVE) {
+			printf("Running %d harts for %d cycles...\n\n", NUM_HARTS, num_cycles);
+		}
+		perf_timer_start();
+		smp_run(num_cycles);
+		perf_timer_stop();
+		return;
+	}
+
 	if (RUN_FLAG == FALSE) {
-		printf("Simulation Stopped\n\n");
+		if (!QUIET) {
+			printf("Simulation Stopped\n\n");
+		}
 		return;
 	}
 
-	printf("Running simulator for %d cycles...\n\n", num_cycles);
+	if (INTERACTIVE) {
+		printf("Running simulator for %d cycles...\n\n", num_cycles);
+	}
+	if (RCACHE.active && rcache_begin(num_cycles)) {
+		return;
+	}
+	if (SAMPLER.mode != SAMPLE_OFF) {
+		perf_timer_start();
+		sample_run(num_cycles);
+		perf_timer_stop();
+		return;
+	}
 	int i;
+	uint32_t pc;
+	perf_timer_start();
 	for (i = 0; i < num_cycles; i++) {
 		if (RUN_FLAG == FALSE) {
-			printf("Simulation Stopped.\n\n");
+			if (!QUIET) {
+				printf("Simulation Stopped.\n\n");
+			}
 			break;
 		}
+		pc = CURRENT_STATE.PC;
 		cycle();
+		if (CURRENT_STATE.PC <= pc && IDLE_SKIP && !TIMING_ACTIVE && !TRACE) {
+			i += idle_skip(pc, num_cycles - i - 1);
+		}
+		if (CKPT_INTERVAL != 0 && (int32_t)(INSTRUCTION_COUNT - CKPT_DEADLINE) >= 0) {
+			checkpoint_tick();
+		}
+	}
+	perf_timer_stop();
+	if (RCACHE.active) {
+		rcache_end();
 	}
 }
 
@@ -97,16 +307,58 @@ void run(int num_cycles) {
 /* simulate to completion                                                                                               */
 /***************************************************************/
 void runAll() {                                                     
+	if (NUM_HARTS > 1) {
+		if (INTERACTIVE) {
+			printf("Simulation Started (%d harts)...\n\n", NUM_HARTS);
+		}
+		perf_timer_start();
+		smp_run(0);
+		perf_timer_stop();
+		if (INTERACTIVE) {
+			printf("Simulation Finished.\n\n");
+		}
+		return;
+	}
+
 	if (RUN_FLAG == FALSE) {
-		printf("Simulation Stopped.\n\n");
+		if (!QUIET) {
+			printf("Simulation Stopped.\n\n");
+		}
 		return;
 	}
 
-	printf("Simulation Started...\n\n");
-	while (RUN_FLAG){
-		cycle();
+	if (INTERACTIVE) {
+		printf("Simulation Started...\n\n");
+	}
+	if (RCACHE.active && rcache_begin(0)) {
+		if (INTERACTIVE) {
+			printf("Simulation Finished.\n\n");
+		}
+		return;
+	}
+	perf_timer_start();
+	if (SAMPLER.mode != SAMPLE_OFF) {
+		sample_run(0);
+	} else {
+		uint32_t pc;
+		while (RUN_FLAG){
+			pc = CURRENT_STATE.PC;
+			cycle();
+			if (CURRENT_STATE.PC <= pc && IDLE_SKIP && !TIMING_ACTIVE && !TRACE) {
+				idle_skip(pc, UINT32_MAX);
+			}
+			if (CKPT_INTERVAL != 0 && (int32_t)(INSTRUCTION_COUNT - CKPT_DEADLINE) >= 0) {
+				checkpoint_tick();
+			}
+		}
+	}
+	perf_timer_stop();
+	if (RCACHE.active) {
+		rcache_end();
+	}
+	if (INTERACTIVE) {
+		printf("Simulation Finished.\n\n");
 	}
-	printf("Simulation Finished.\n\n");
 }
 
 /***************************************************************/ 
@@ -115,6 +367,15 @@ void runAll() {
 void mdump(uint32_t start, uint32_t stop) {          
 	uint32_t address;
 
+	if (JSON_OUTPUT) {
+		printf("{\"start\":%u,\"stop\":%u,\"words\":[", start, stop);
+		for (address = start; address <= stop && address >= start; address += 4){
+			printf(address == start ? "%u" : ",%u", mem_read_32(address));
+		}
+		printf("]}\n");
+		return;
+	}
+
 	printf("-------------------------------------------------------------\n");
 	printf("Memory content [0x%08x..0x%08x] :\n", start, stop);
 	printf("-------------------------------------------------------------\n");
@@ -125,14 +386,267 @@ void mdump(uint32_t start, uint32_t stop) {
 	printf("\n");
 }
 
+/***************************************************************/
+/* Host memory backing [address, address+len): returns the pointer */
+/* and clips *len to the part that lies in a single region               */
+/***************************************************************/
+uint8_t *mem_span(uint32_t address, uint64_t *len)
+{
+	int i;
+	/* device registers have no host bytes behind them */
+	if (MMIO_ACTIVE && mmio_clip(address, len)) {
+		return NULL;
+	}
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
+			uint64_t avail = (uint64_t)MEM_REGIONS[i].end - address + 1;
+			if (*len > avail) {
+				*len = avail;
+			}
+			return MEM_REGIONS[i].mem + (address - MEM_REGIONS[i].begin);
+		}
+	}
+	/* unmapped: clip to the start of the next region above */
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		if (MEM_REGIONS[i].begin > address && MEM_REGIONS[i].begin - address < *len) {
+			*len = MEM_REGIONS[i].begin - address;
+		}
+	}
+	return NULL;
+}
+
+/***************************************************************/
+/* Call fn on every guest page the host has populated; the rest    */
+/* have never been touched and read as zero. FALSE without a       */
+/* readable /proc/self/pagemap                                                    */
+/***************************************************************/
+int mem_scan(void (*fn)(uint32_t address, const uint8_t *page))
+{
+	uint64_t entries[4096];
+	uint64_t page_size = sysconf(_SC_PAGESIZE);
+	uint64_t first, count, done, n, j;
+	int fd, i;
+
+	fd = open("/proc/self/pagemap", O_RDONLY);
+	if (fd < 0) {
+		return FALSE;
+	}
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		first = (uintptr_t)MEM_REGIONS[i].mem / page_size;
+		count = ((uint64_t)MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1) / page_size;
+		for (done = 0; done < count; done += n) {
+			n = count - done < 4096 ? count - done : 4096;
+			if (pread(fd, entries, n * 8, (first + done) * 8) != (ssize_t)(n * 8)) {
+				close(fd);
+				return FALSE;
+			}
+			for (j = 0; j < n; j++) {
+				/* present or swapped */
+				if (entries[j] >> 62) {
+					fn(MEM_REGIONS[i].begin + (done + j) * page_size, MEM_REGIONS[i].mem + (done + j) * page_size);
+				}
+			}
+		}
+	}
+	close(fd);
+	return TRUE;
+}
+
+/***************************************************************/
+/* Drop every guest page instead of writing zeros over gigabytes;  */
+/* FALSE if the host would not hand the pages back                      */
+/***************************************************************/
+int mem_clear()
+{
+	int i;
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
+		if (mmap(MEM_REGIONS[i].mem, region_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED) {
+			sim_error("Can't clear guest memory");
+			return FALSE;
+		}
+	}
+	EXC_HANDLER = FALSE;
+	filemap_restore();
+	mmio_reset();
+	return TRUE;
+}
+
+/***************************************************************/
+/* Stream the raw bytes [start..stop] to a host file                       */
+/***************************************************************/
+void msave(uint32_t start, uint32_t stop, const char *path)
+{
+	static const uint8_t zeros[4096];
+	uint64_t remaining = (uint64_t)stop - start + 1, len, n;
+	uint32_t address = start;
+	uint8_t *host;
+	FILE *fp;
+
+	if (stop < start) {
+		printf("Error: msave range is empty\n");
+		return;
+	}
+	fp = fopen(path, "wb");
+	if (fp == NULL) {
+		printf("Error: Can't open %s\n", path);
+		return;
+	}
+	while (remaining > 0) {
+		len = remaining;
+		host = mem_span(address, &len);
+		if (host != NULL) {
+			fwrite(host, 1, len, fp);
+		} else {
+			/* holes between regions read as zero, like mem_read_32 */
+			for (n = 0; n < len; n += sizeof(zeros)) {
+				fwrite(zeros, 1, len - n < sizeof(zeros) ? len - n : sizeof(zeros), fp);
+			}
+		}
+		address += len;
+		remaining -= len;
+	}
+	fclose(fp);
+	if (INTERACTIVE) {
+		printf("%llu bytes saved to %s\n", (unsigned long long)stop - start + 1, path);
+	}
+}
+
+/***************************************************************/
+/* Read a host file straight into guest memory at <address>           */
+/***************************************************************/
+void mload(const char *path, uint32_t address)
+{
+	uint64_t total = 0, len, got;
+	uint8_t *host;
+	FILE *fp;
+
+	fp = fopen(path, "rb");
+	if (fp == NULL) {
+		printf("Error: Can't open %s\n", path);
+		return;
+	}
+	for (;;) {
+		len = 0x100000000ULL - address;
+		if (len > (1u << 30)) {
+			len = 1u << 30;
+		}
+		host = mem_span(address, &len);
+		if (host == NULL) {
+			printf("Error: 0x%08x is outside guest memory\n", address);
+			break;
+		}
+		got = fread(host, 1, len, fp);
+		cp0_loaded(address, got);
+		total += got;
+		if (got < len || (uint64_t)address + len > 0xFFFFFFFFULL) {
+			break;
+		}
+		address += len;
+	}
+	fclose(fp);
+	if (INTERACTIVE) {
+		printf("%llu bytes loaded from %s\n", (unsigned long long)total, path);
+	}
+}
+
+/***************************************************************/
+/* Hex dump [start..stop], 16 bytes and an ASCII column per row     */
+/***************************************************************/
+void hexdump(uint32_t start, uint32_t stop)
+{
+	static const char digits[] = "0123456789abcdef";
+	uint64_t count = (uint64_t)stop - start + 1, rows, i, j, len;
+	uint32_t address;
+	uint8_t row[16];
+	uint8_t *host;
+	char *out, *p;
+
+	if (stop < start) {
+		return;
+	}
+	/* "aaaaaaaa  " + 16 * "xx " + 1 + "|" + 16 + "|\n" per row, written with one fwrite */
+	rows = (count + 15) / 16;
+	out = malloc(rows * 79 + 1);
+	if (out == NULL) {
+		printf("Error: hexdump range too large\n");
+		return;
+	}
+	p = out;
+	for (i = 0; i < rows; i++) {
+		address = start + i * 16;
+		len = count - i * 16 < 16 ? count - i * 16 : 16;
+		for (j = 0; j < len; ) {
+			uint64_t span = len - j;
+			host = mem_span(address + j, &span);
+			if (host != NULL) {
+				memcpy(row + j, host, span);
+			} else {
+				memset(row + j, 0, span);
+			}
+			j += span;
+		}
+		for (j = 8; j-- > 0; ) {
+			p[j] = digits[(address >> ((7 - j) * 4)) & 0xF];
+		}
+		p += 8;
+		*p++ = ' ';
+		*p++ = ' ';
+		for (j = 0; j < 16; j++) {
+			if (j < len) {
+				*p++ = digits[row[j] >> 4];
+				*p++ = digits[row[j] & 0xF];
+			} else {
+				*p++ = ' ';
+				*p++ = ' ';
+			}
+			*p++ = ' ';
+			if (j == 7) {
+				*p++ = ' ';
+			}
+		}
+		*p++ = '|';
+		for (j = 0; j < len; j++) {
+			*p++ = (row[j] >= 0x20 && row[j] < 0x7F) ? row[j] : '.';
+		}
+		*p++ = '|';
+		*p++ = '\n';
+	}
+	fwrite(out, 1, p - out, stdout);
+	free(out);
+}
+
+/***************************************************************/
+/* Coprocessor 1 registers are only shown once a program used them */
+/***************************************************************/
+static int fpu_state(CPU_State *state) {
+	int i;
+	for (i = 0; i < 32; i++) {
+		if (state->FPR[i] != 0) {
+			return TRUE;
+		}
+	}
+	return state->FCSR != 0;
+}
+
 /***************************************************************/
 /* Dump current values of registers to the teminal                                              */   
 /***************************************************************/
 void rdump() {                               
 	int i; 
+
+	if (JSON_OUTPUT) {
+		rdump_json(HART_ID, &CURRENT_STATE, INSTRUCTION_COUNT);
+		printf("\n");
+		return;
+	}
 	printf("-------------------------------------\n");
 	printf("Dumping Register Content\n");
 	printf("-------------------------------------\n");
+	if (NUM_HARTS > 1) {
+		printf("Hart\t: %d of %d\n", HART_ID, NUM_HARTS);
+	}
 	printf("# Instructions Executed\t: %u\n", INSTRUCTION_COUNT);
 	printf("PC\t: 0x%08x\n", CURRENT_STATE.PC);
 	printf("-------------------------------------\n");
@@ -145,97 +659,527 @@ void rdump() {
 	printf("[HI]\t: 0x%08x\n", CURRENT_STATE.HI);
 	printf("[LO]\t: 0x%08x\n", CURRENT_STATE.LO);
 	printf("-------------------------------------\n");
+	if (fpu_state(&CURRENT_STATE)) {
+		for (i = 0; i < 32; i++){
+			printf("[F%d]\t: 0x%08x\n", i, CURRENT_STATE.FPR[i]);
+		}
+		printf("[FCSR]\t: 0x%08x\n", CURRENT_STATE.FCSR);
+		printf("-------------------------------------\n");
+	}
 }
 
 /***************************************************************/
-/* Read a command from standard input.                                                               */  
+/* Print one hart's registers as a JSON object                                  */
 /***************************************************************/
-void handle_command() {                         
-	char buffer[20];
-	uint32_t start, stop, cycles;
-	uint32_t register_no;
-	int register_value;
-	int hi_reg_value, lo_reg_value;
+void rdump_json(int hart, CPU_State *state, uint32_t count) {
+	int i;
+	printf("{\"hart\":%d,\"instructions\":%u,\"pc\":%u,\"regs\":[", hart, count, state->PC);
+	for (i = 0; i < MIPS_REGS; i++){
+		printf(i == 0 ? "%u" : ",%u", state->REGS[i]);
+	}
+	printf("],\"hi\":%u,\"lo\":%u", state->HI, state->LO);
+	if (fpu_state(state)) {
+		for (i = 0; i < 32; i++){
+			printf(i == 0 ? ",\"fpr\":[%u" : ",%u", state->FPR[i]);
+		}
+		printf("],\"fcsr\":%u", state->FCSR);
+	}
+	printf("}");
+}
 
-	printf("MU-MIPS SIM:> ");
+/***************************************************************/
+/* Dump the architectural state of every hart as JSON                   */
+/***************************************************************/
+void snapshot() {
+	const char *p;
+	int i;
+	smp_save(HART_ID);
+	printf("{\"program\":\"");
+	/* the path is arbitrary text: escape it so the document stays JSON */
+	for (p = prog_file; *p != '\0'; p++) {
+		if (*p == '"' || *p == '\\') {
+			printf("\\%c", *p);
+		} else if ((unsigned char)*p < 0x20) {
+			printf("\\u%04x", (unsigned char)*p);
+		} else {
+			putchar(*p);
+		}
+	}
+	printf("\",\"harts\":[");
+	for (i = 0; i < NUM_HARTS; i++){
+		if (i > 0) {
+			printf(",");
+		}
+		rdump_json(i, &HARTS[i].state, HARTS[i].instruction_count);
+	}
+	printf("]}\n");
+}
 
-	if (scanf("%s", buffer) == EOF){
-		exit(0);
+/***************************************************************/
+/* Execute one command line; returns FALSE if it was not understood */
+/* or the program it (re)loads failed to load                              */
+/***************************************************************/
+int execute_command(char *line) {
+	char *argv[MAX_CMD_ARGS];
+	int argc = 0;
+	char *cmd, *tok;
+	uint32_t register_no, n[3];
+
+	for (tok = strtok(line, " \t\r\n"); tok != NULL && argc < MAX_CMD_ARGS; tok = strtok(NULL, " \t\r\n")) {
+		argv[argc++] = tok;
+	}
+	if (argc == 0 || argv[0][0] == '#') {
+		return TRUE;
+	}
+	cmd = argv[0];
+
+	/* full command names first, then the historical one/two-letter abbreviations */
+	if (!strcmp(cmd, "load")) {
+		if (argc != 2) {
+			return FALSE;
+		}
+		snprintf(prog_file, sizeof(prog_file), "%s", argv[1]);
+		return reset_program();
+	}
+	if (!strcmp(cmd, "snapshot")) {
+		snapshot();
+		return TRUE;
+	}
+	if (!strcmp(cmd, "msave")) {
+		if (argc != 4) {
+			return FALSE;
+		}
+		msave(strtoul(argv[1], NULL, 16), strtoul(argv[2], NULL, 16), argv[3]);
+		return TRUE;
+	}
+	if (!strcmp(cmd, "mload")) {
+		if (argc != 3) {
+			return FALSE;
+		}
+		mload(argv[1], strtoul(argv[2], NULL, 16));
+		idle_reset();
+		return TRUE;
+	}
+	if (!strcmp(cmd, "hexdump")) {
+		if (argc != 3) {
+			return FALSE;
+		}
+		hexdump(strtoul(argv[1], NULL, 16), strtoul(argv[2], NULL, 16));
+		return TRUE;
+	}
+	if (!strcmp(cmd, "mmap")) {
+		if (argc == 1) {
+			filemap_list();
+			return TRUE;
+		}
+		if (argc != 3 && argc != 4) {
+			return FALSE;
+		}
+		if (argc == 4 && strcmp(argv[3], "private") && strcmp(argv[3], "shared")) {
+			printf("Error: mmap takes private or shared, not %s\n", argv[3]);
+			return TRUE;
+		}
+		filemap_map(argv[1], strtoul(argv[2], NULL, 16), argc == 4 && !strcmp(argv[3], "shared"));
+		return TRUE;
+	}
+	if (!strcmp(cmd, "munmap")) {
+		if (argc != 2) {
+			return FALSE;
+		}
+		filemap_unmap(strtoul(argv[1], NULL, 16));
+		return TRUE;
+	}
+	if (!strcmp(cmd, "timing")) {
+		if (argc != 2 && argc != 3) {
+			return FALSE;
+		}
+		timing_select(argv[1], argc == 3 ? argv[2] : NULL);
+		return TRUE;
+	}
+	if (!strcmp(cmd, "record")) {
+		if (argc != 2) {
+			return FALSE;
+		}
+		timing_record(strcmp(argv[1], "off") ? argv[1] : NULL);
+		return TRUE;
+	}
+	if (!strcmp(cmd, "replay")) {
+		if (argc != 3) {
+			return FALSE;
+		}
+		trace_replay(argv[1], argv[2]);
+		return TRUE;
+	}
+	if (!strcmp(cmd, "sample")) {
+		if (argc == 2 && !strcmp(argv[1], "off")) {
+			sample_off();
+		} else if (argc == 5 && !strcmp(argv[1], "periodic")) {
+			if (parse_option("ffwd", argv[2], UINT32_MAX, &n[0]) && parse_option("warm", argv[3], UINT32_MAX, &n[1]) &&
+					parse_option("detail", argv[4], UINT32_MAX, &n[2])) {
+				sample_periodic(n[0], n[1], n[2]);
+			}
+		} else if (argc == 5 && !strcmp(argv[1], "simpoint")) {
+			if (parse_option("interval", argv[2], UINT32_MAX, &n[0]) && parse_option("k", argv[3], MAX_SIMPOINTS, &n[1]) &&
+					parse_option("warm", argv[4], UINT32_MAX, &n[2])) {
+				sample_simpoint(n[0], n[1], n[2]);
+			}
+		} else {
+			return FALSE;
+		}
+		return TRUE;
+	}
+	if (!strcmp(cmd, "lanes")) {
+		if (argc == 2 && !strcmp(argv[1], "off")) {
+			lanes_destroy();
+		} else if (argc == 5 && !strcmp(argv[1], "set") && lanes_reg(argv[3], FALSE) >= 0) {
+			lanes_set(atoi(argv[2]), lanes_reg(argv[3], FALSE), strtoul(argv[4], NULL, 0));
+		} else if (argc == 5 && !strcmp(argv[1], "sweep") && lanes_reg(argv[2], FALSE) >= 0) {
+			lanes_sweep(lanes_reg(argv[2], FALSE), strtoul(argv[3], NULL, 0), strtoul(argv[4], NULL, 0));
+		} else if (argc == 5 && !strcmp(argv[1], "mem")) {
+			lanes_poke(atoi(argv[2]), strtoul(argv[3], NULL, 16), strtoul(argv[4], NULL, 0));
+		} else if (argc <= 3 && !strcmp(argv[1], "run")) {
+			lanes_run(argc == 3 ? strtoul(argv[2], NULL, 0) : 0);
+		} else if (argc == 2 && !strcmp(argv[1], "stats")) {
+			lanes_stats();
+		} else if (argc == 3 && !strcmp(argv[1], "dump") && lanes_reg(argv[2], TRUE) >= 0) {
+			lanes_dump(lanes_reg(argv[2], TRUE));
+		} else if (argc == 3 && !strcmp(argv[1], "mdump")) {
+			lanes_mdump(strtoul(argv[2], NULL, 16));
+		} else if (argc == 2 && isdigit((unsigned char)argv[1][0])) {
+			lanes_create(atoi(argv[1]));
+		} else {
+			return FALSE;
+		}
+		return TRUE;
+	}
+	if (!strcmp(cmd, "cache")) {
+		if (argc > 2) {
+			return FALSE;
+		}
+		timing_caches(argc == 2 ? argv[1] : NULL);
+		return TRUE;
+	}
+	if (!strcmp(cmd, "bpred")) {
+		if (argc > 2) {
+			return FALSE;
+		}
+		timing_bpred(argc == 2 ? argv[1] : NULL);
+		return TRUE;
+	}
+	if (!strcmp(cmd, "memprof")) {
+		if (argc > 2) {
+			return FALSE;
+		}
+		timing_memprof(argc == 2 ? argv[1] : NULL);
+		return TRUE;
+	}
+	if (!strcmp(cmd, "stats")) {
+		perf_print(stdout, JSON_OUTPUT);
+		return TRUE;
+	}
+	if (!strcmp(cmd, "trace")) {
+		if (argc != 2) {
+			return FALSE;
+		}
+		TRACE = !strcmp(argv[1], "on");
+		return TRUE;
+	}
+	if (!strcmp(cmd, "idle")) {
+		if (argc == 2) {
+			IDLE_SKIP = !strcmp(argv[1], "on");
+		} else if (argc != 1) {
+			return FALSE;
+		}
+		if (INTERACTIVE || argc == 1) {
+			printf("Idle-loop fast-forward %s: %llu loops, %llu instructions skipped\n",
+					IDLE_SKIP ? "on" : "off", (unsigned long long)IDLE_LOOPS, (unsigned long long)IDLE_SKIPPED);
+		}
+		return TRUE;
+	}
+	if (!strcmp(cmd, "hook")) {
+		if (argc == 3 && !strcmp(argv[1], "check")) {
+			HLE_CHECK = !strcmp(argv[2], "on");
+		} else if (argc == 2 && !strcmp(argv[1], "clear")) {
+			hle_clear();
+		} else if (argc == 3) {
+			hle_hook(argv[1], argv[2], FALSE, 0, 0);
+		} else if (argc == 5) {
+			hle_hook(argv[1], argv[2], TRUE, strtoul(argv[3], NULL, 0), strtoul(argv[4], NULL, 0));
+		} else {
+			return FALSE;
+		}
+		return TRUE;
+	}
+	if (!strcmp(cmd, "hooks")) {
+		hle_list();
+		return TRUE;
+	}
+	if (!strcmp(cmd, "exceptions")) {
+		if (argc == 2) {
+			if (!strcmp(argv[1], "handler")) {
+				EXC_HANDLER = TRUE;	/* written some other way, e.g. by guest stores */
+			} else {
+				CP0_ENABLED = !strcmp(argv[1], "on");
+			}
+			idle_reset();
+		} else if (argc != 1) {
+			return FALSE;
+		}
+		if (INTERACTIVE || argc == 1) {
+			cp0_print();
+		}
+		return TRUE;
+	}
+	if (!strcmp(cmd, "asm")) {
+		if (argc != 3) {
+			return FALSE;
+		}
+		assemble_file(argv[1], argv[2]);
+		return TRUE;
+	}
+	if (!strcmp(cmd, "link")) {
+		if (argc < 3) {
+			return FALSE;
+		}
+		link_program(argv[1], argc - 2, argv + 2);
+		return TRUE;
+	}
+	if (!strcmp(cmd, "device")) {
+		if (argc == 2 && !strcmp(argv[1], "off")) {
+			mmio_clear();
+		} else if (argc == 3 || argc == 4) {
+			mmio_attach(argv[1], strtoul(argv[2], NULL, 16), argc == 4 ? argv[3] : NULL);
+		} else {
+			return FALSE;
+		}
+		return TRUE;
+	}
+	if (!strcmp(cmd, "devices")) {
+		mmio_list();
+		return TRUE;
+	}
+	if (!strcmp(cmd, "checkpoint")) {
+		if (argc == 2 && !strcmp(argv[1], "off")) {
+			checkpoint_every(0, NULL);
+		} else if (argc == 4 && !strcmp(argv[1], "every")) {
+			checkpoint_every(strtoul(argv[2], NULL, 0), argv[3]);
+		} else if (argc == 2) {
+			checkpoint_write(argv[1]);
+		} else {
+			return FALSE;
+		}
+		return TRUE;
+	}
+	if (!strcmp(cmd, "resume")) {
+		if (argc != 2) {
+			return FALSE;
+		}
+		checkpoint_resume(argv[1]);
+		return TRUE;
+	}
+	if (!strcmp(cmd, "rcache")) {
+		if (argc == 2 && !strcmp(argv[1], "off")) {
+			rcache_close();
+		} else if (argc == 2 || argc == 3) {
+			rcache_open(argv[1], (argc == 3 ? strtoull(argv[2], NULL, 0) : RCACHE_MAX_MB) << 20);
+		} else if (argc != 1) {
+			return FALSE;
+		}
+		if (INTERACTIVE || argc == 1) {
+			rcache_print();
+		}
+		return TRUE;
+	}
+	if (!strcmp(cmd, "cosim")) {
+		if (argc < 2 || argc > 4) {
+			return FALSE;
+		}
+		cosim_run(argv[1], argc < 3 ? COSIM_INTERVAL : !strcmp(argv[2], "block") ? COSIM_BLOCK : strtoul(argv[2], NULL, 0),
+				argc == 4 ? strtoul(argv[3], NULL, 0) : 0);
+		return TRUE;
+	}
+	if (!strcmp(cmd, "callprof")) {
+		if (argc == 2 && !strcmp(argv[1], "on")) {
+			callprof_start();
+		} else if (argc == 2 && !strcmp(argv[1], "off")) {
+			callprof_stop();
+		} else if ((argc == 3 || argc == 4) && !strcmp(argv[1], "folded")) {
+			if (argc == 4 && strcmp(argv[3], "cycles")) {
+				return FALSE;
+			}
+			callprof_folded(argv[2], argc == 4);
+		} else if (argc <= 2) {
+			callprof_print(argc == 2 ? atoi(argv[1]) : CALLPROF_TOP);
+		} else {
+			return FALSE;
+		}
+		return TRUE;
+	}
+	if (!strcmp(cmd, "json")) {
+		if (argc != 2) {
+			return FALSE;
+		}
+		JSON_OUTPUT = !strcmp(argv[1], "on");
+		return TRUE;
 	}
 
-	switch(buffer[0]) {
+	switch(cmd[0]) {
 		case 'S':
 		case 's':
+			if (cmd[1] == 'm' || cmd[1] == 'M') {
+				if (argc == 3 && (argv[2][0] == 'f' || argv[2][0] == 'F')) {
+					smp_configure(strtoul(argv[1], NULL, 0), SMP_FREE, 0);
+				} else if (argc == 4) {
+					smp_configure(strtoul(argv[1], NULL, 0), SMP_LOCKSTEP, strtoul(argv[3], NULL, 0));
+				} else {
+					return FALSE;
+				}
+				break;
+			}
 			runAll(); 
 			break;
 		case 'M':
 		case 'm':
-			if (scanf("%x %x", &start, &stop) != 2){
-				break;
+			if (argc != 3) {
+				return FALSE;
 			}
-			mdump(start, stop);
+			mdump(strtoul(argv[1], NULL, 16), strtoul(argv[2], NULL, 16));
 			break;
 		case '?':
 			help();
 			break;
 		case 'Q':
 		case 'q':
-			printf("**************************\n");
-			printf("Exiting MU-MIPS! Good Bye...\n");
-			printf("**************************\n");
+			if (INTERACTIVE) {
+				printf("**************************\n");
+				printf("Exiting MU-MIPS! Good Bye...\n");
+				printf("**************************\n");
+			}
 			exit(0);
 		case 'R':
 		case 'r':
-			if (buffer[1] == 'd' || buffer[1] == 'D'){
+			if (cmd[1] == 'd' || cmd[1] == 'D'){
 				rdump();
-			}else if(buffer[1] == 'e' || buffer[1] == 'E'){
-				reset();
+			}else if(cmd[1] == 'e' || cmd[1] == 'E'){
+				return reset_program();
 			}
 			else {
-				if (scanf("%d", &cycles) != 1) {
-					break;
+				if (argc != 2) {
+					return FALSE;
 				}
-				run(cycles);
+				run(atoi(argv[1]));
 			}
 			break;
 		case 'I':
 		case 'i':
-			if (scanf("%u %i", &register_no, &register_value) != 2){
-				break;
+			if (argc != 3) {
+				return FALSE;
 			}
-			CURRENT_STATE.REGS[register_no] = register_value;
-			NEXT_STATE.REGS[register_no] = register_value;
+			register_no = strtoul(argv[1], NULL, 10);
+			if (register_no >= MIPS_REGS) {
+				return FALSE;
+			}
+			CURRENT_STATE.REGS[register_no] = strtol(argv[2], NULL, 0);
+			NEXT_STATE.REGS[register_no] = CURRENT_STATE.REGS[register_no];
 			break;
 		case 'H':
 		case 'h':
-			if (scanf("%i", &hi_reg_value) != 1){
+			if (argc != 2) {
+				return FALSE;
+			}
+			if (cmd[1] == 'a' || cmd[1] == 'A') {
+				smp_select(strtoul(argv[1], NULL, 0));
 				break;
 			}
-			CURRENT_STATE.HI = hi_reg_value; 
-			NEXT_STATE.HI = hi_reg_value; 
+			CURRENT_STATE.HI = strtol(argv[1], NULL, 0); 
+			NEXT_STATE.HI = CURRENT_STATE.HI; 
 			break;
 		case 'L':
 		case 'l':
-			if (scanf("%i", &lo_reg_value) != 1){
-				break;
+			if (argc != 2) {
+				return FALSE;
 			}
-			CURRENT_STATE.LO = lo_reg_value;
-			NEXT_STATE.LO = lo_reg_value;
+			CURRENT_STATE.LO = strtol(argv[1], NULL, 0);
+			NEXT_STATE.LO = CURRENT_STATE.LO;
 			break;
 		case 'P':
 		case 'p':
 			print_program(); 
 			break;
 		default:
-			printf("Invalid Command.\n");
-			break;
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Read a command from standard input.                                                               */  
+/***************************************************************/
+void handle_command() {                         
+	char buffer[MAX_CMD_LINE];
+
+	printf("MU-MIPS SIM:> ");
+
+	if (fgets(buffer, sizeof(buffer), stdin) == NULL){
+		exit(0);
+	}
+	LAST_ERROR[0] = '\0';
+	/* a command that failed has already said why */
+	if (!execute_command(buffer) && LAST_ERROR[0] == '\0') {
+		printf("Invalid Command.\n");
+	}
+}
+
+/***************************************************************/
+/* Run a ';' or newline separated command sequence without prompts */
+/***************************************************************/
+void run_script(const char *commands) {
+	char *copy = strdup(commands);
+	char *line, *next;
+
+	for (line = copy; line != NULL; line = next) {
+		next = strpbrk(line, ";\n");
+		if (next != NULL) {
+			*next++ = '\0';
+		}
+		if (!execute_command(line)) {
+			fprintf(stderr, "Error: invalid command in script\n");
+			exit(1);
+		}
 	}
+	free(copy);
+}
+
+/***************************************************************/
+/* Run every command in a script file                                              */
+/***************************************************************/
+void run_script_file(const char *path) {
+	FILE *fp = fopen(path, "r");
+	char buffer[MAX_CMD_LINE];
+
+	if (fp == NULL) {
+		fprintf(stderr, "Error: Can't open script file %s\n", path);
+		exit(1);
+	}
+	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+		run_script(buffer);
+	}
+	fclose(fp);
 }
 
 /***************************************************************/
 /* reset registers/memory and reload program                                                    */
 /***************************************************************/
 void reset() {   
+	if (!reset_program()) {
+		exit(-1);
+	}
+}
+
+/***************************************************************/
+/* reset() for callers that survive a program that fails to load   */
+/***************************************************************/
+int reset_program() {
 	int i;
 	/*reset registers*/
 	for (i = 0; i < MIPS_REGS; i++){
@@ -244,60 +1188,52 @@ void reset() {
 	CURRENT_STATE.HI = 0;
 	CURRENT_STATE.LO = 0;
 	
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-		memset(MEM_REGIONS[i].mem, 0, region_size);
+	/*load program; nothing runs if it fails*/
+	if (!mem_clear() || !load_image(prog_file)) {
+		RUN_FLAG = FALSE;
+		return FALSE;
 	}
 	
-	/*load program*/
-	load_program();
-	
 	/*reset PC*/
 	INSTRUCTION_COUNT = 0;
-	CURRENT_STATE.PC =  MEM_TEXT_BEGIN;
+	CURRENT_STATE.PC =  PROGRAM_ENTRY;
+	CURRENT_STATE.LL_BIT = 0;
+	CURRENT_STATE.STATUS = 0;
+	CURRENT_STATE.CAUSE = 0;
+	CURRENT_STATE.EPC = 0;
+	CURRENT_STATE.BADVADDR = 0;
+	memset(CURRENT_STATE.FPR, 0, sizeof(CURRENT_STATE.FPR));
+	CURRENT_STATE.FCSR = 0;
 	NEXT_STATE = CURRENT_STATE;
 	RUN_FLAG = TRUE;
+	perf_reset();
+	timing_reset();
+	sample_reset();
+	idle_reset();
+	hle_reset();
+
+	/*every other hart restarts at the same entry point*/
+	smp_reset();
+	callprof_reset();
+	return TRUE;
 }
 
 /***************************************************************/
 /* Allocate and set memory to zero                                                                            */
 /***************************************************************/
 void init_memory() {                                           
-	int i;
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-		MEM_REGIONS[i].mem = malloc(region_size);
-		memset(MEM_REGIONS[i].mem, 0, region_size);
-	}
+	guard_reserve();
 }
 
 /**************************************************************/
 /* load program into memory                                                                                      */
 /**************************************************************/
 void load_program() {                   
-	FILE * fp;
-	int i, word;
-	uint32_t address;
-
-	/* Open program file. */
-	fp = fopen(prog_file, "r");
-	if (fp == NULL) {
-		printf("Error: Can't open program file %s\n", prog_file);
+	if (!load_image(prog_file)) {
 		exit(-1);
 	}
-
-	/* Read in the program. */
-
-	i = 0;
-	while( fscanf(fp, "%x\n", &word) != EOF ) {
-		address = MEM_TEXT_BEGIN + i;
-		mem_write_32(address, word);
-		printf("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
-		i += 4;
-	}
-	PROGRAM_SIZE = i/4;
-	printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
-	fclose(fp);
+	CURRENT_STATE.PC = PROGRAM_ENTRY;
+	NEXT_STATE = CURRENT_STATE;
 }
 
 /************************************************************/
@@ -364,6 +1300,17 @@ int parseReg(char * reg){
     }
 }
 
+// "$f12," -> 12
+int parseFReg(char * reg){
+    const char s[2] = ",";
+    reg = strtok(reg, s);
+    if(reg[0] != '$' || reg[1] != 'f'){
+        printf("Error: %s is not a floating-point register\n", reg);
+        return 0;
+    }
+    return atoi(reg + 2) & 0x1F;
+}
+
 
 // thx codeFTW 
 // https://codeforwin.org/2015/08/c-program-to-convert-hexadecimal-to-binary-number-system.html
@@ -717,6 +1664,85 @@ void doWork(char * name){
             printf("%x", special); // write to file ...
             writeInstruction(special);
         }
+
+        // lwc1/swc1/ldc1/sdc1 ft, off(bs)
+        if(!strncmp(word, "lwc1", 10) || !strncmp(word, "swc1", 10) || !strncmp(word, "ldc1", 10) || !strncmp(word, "sdc1", 10)){
+            char wrdCopy[50];
+            int fpMem = word[0] == 'l' ? (word[1] == 'w' ? 0b110001 : 0b110101) : (word[1] == 'w' ? 0b111001 : 0b111101);
+
+            if(fscanf(fp, "%s", word) == EOF) break;
+            int ft = parseFReg(word);
+            if(fscanf(fp, "%s", word) == EOF) break;
+            strcpy (wrdCopy, word);
+            int off = parseArg(word,1); // offset
+            int bs = parseArg(wrdCopy,0); // bs
+            fpMem = (fpMem << 5) | bs;
+            fpMem = (fpMem << 5) | ft;
+            fpMem = (fpMem << 16) | off;
+            printf("%x\n", fpMem);
+            writeInstruction(fpMem);
+        }
+
+        // mfc1/mtc1 rt, fs   cfc1/ctc1 rt, fcr
+        if(!strncmp(word, "mfc1", 10) || !strncmp(word, "mtc1", 10) || !strncmp(word, "cfc1", 10) || !strncmp(word, "ctc1", 10)){
+            int cop1 = 0b010001;
+            int move = word[0] == 'm' ? (word[1] == 'f' ? 0b00000 : 0b00100) : (word[1] == 'f' ? 0b00010 : 0b00110);
+            int control = word[0] == 'c';
+
+            if(fscanf(fp, "%s", word) == EOF) break;
+            int rt = parseArg(word,0);
+            if(fscanf(fp, "%s", word) == EOF) break;
+            int fs = control ? atoi(word + 1) & 0x1F : parseFReg(word);
+            cop1 = (cop1 << 5) | move;
+            cop1 = (cop1 << 5) | rt;
+            cop1 = (cop1 << 5) | fs;
+            cop1 = cop1 << 11;
+            printf("%x\n", cop1);
+            writeInstruction(cop1);
+        }
+
+        // bc1t/bc1f offset
+        if(!strncmp(word, "bc1t", 10) || !strncmp(word, "bc1f", 10)){
+            int cop1 = 0b010001;
+            int tf = word[3] == 't';
+
+            if(fscanf(fp, "%s", word) == EOF) break;
+            int off = parseArg(word,0); // offset
+            cop1 = (cop1 << 5) | 0b01000;
+            cop1 = (cop1 << 5) | tf;
+            cop1 = (cop1 << 16) | off;
+            printf("%x\n", cop1);
+            writeInstruction(cop1);
+        }
+
+        // add.s fd, fs, ft   sqrt.d fd, fs   cvt.d.w fd, fs   c.lt.s fs, ft
+        int fmt, funct, operands;
+        if(fpu_lookup(word, &fmt, &funct, &operands)){
+            int cop1 = 0b010001;
+            int fd = 0, fs, ft = 0;
+
+            if(fscanf(fp, "%s", word) == EOF) break;
+            if(funct >= 0x30){
+                fs = parseFReg(word);
+                if(fscanf(fp, "%s", word) == EOF) break;
+                ft = parseFReg(word);
+            }else{
+                fd = parseFReg(word);
+                if(fscanf(fp, "%s", word) == EOF) break;
+                fs = parseFReg(word);
+                if(operands == 3){
+                    if(fscanf(fp, "%s", word) == EOF) break;
+                    ft = parseFReg(word);
+                }
+            }
+            cop1 = (cop1 << 5) | fmt;
+            cop1 = (cop1 << 5) | ft;
+            cop1 = (cop1 << 5) | fs;
+            cop1 = (cop1 << 5) | fd;
+            cop1 = (cop1 << 6) | funct;
+            printf("%x\n", cop1);
+            writeInstruction(cop1);
+        }
         
     }
     fclose(fp);
@@ -749,9 +1775,13 @@ void handle_instruction()
 	
 	int branch_jump = FALSE;
 	
-	printf("[0x%x]\t", CURRENT_STATE.PC);
+	if (TRACE) {
+		printf("[0x%x]\t", CURRENT_STATE.PC);
+	}
 	
-	instruction = mem_read_32(CURRENT_STATE.PC);
+	instruction = misaligned(CURRENT_STATE.PC, 3, EXC_ADEL) ? 0 : guest_load_32(CURRENT_STATE.PC);
+	RETIRED.pc = CURRENT_STATE.PC;
+	RETIRED.instruction = instruction;
 	
 	opcode = (instruction & 0xFC000000) >> 26;
 	function = instruction & 0x0000003F;
@@ -766,11 +1796,11 @@ void handle_instruction()
 		switch(function){
 			case 0x00: //SLL
 				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rt] << sa;
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x02: //SRL
 				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rt] >> sa;
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x03: //SRA 
 				if ((CURRENT_STATE.REGS[rt] & 0x80000000) == 1)
@@ -780,42 +1810,53 @@ void handle_instruction()
 				else{
 					NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rt] >> sa;
 				}
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x08: //JR
+				PERF[PERF_JUMPS]++;
 				NEXT_STATE.PC = CURRENT_STATE.REGS[rs];
+				if (rs == 31) {
+					CALLPROF_RETURN(NEXT_STATE.PC);
+				}
 				branch_jump = TRUE;
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x09: //JALR
+				PERF[PERF_JUMPS]++;
 				NEXT_STATE.REGS[rd] = CURRENT_STATE.PC + 4;
 				NEXT_STATE.PC = CURRENT_STATE.REGS[rs];
+				CALLPROF_CALL(NEXT_STATE.PC, CURRENT_STATE.PC + 4);
 				branch_jump = TRUE;
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x0C: //SYSCALL
-				if(CURRENT_STATE.REGS[2] == 0xa){
+				PERF[PERF_SYSCALLS]++;
+				if (CP0_ENABLED && !(CURRENT_STATE.STATUS & STATUS_EXL)) {
+					exception_raise(EXC_SYS, 0);
+				}
+				else if(CURRENT_STATE.REGS[2] == 0xa){
 					RUN_FLAG = FALSE;
-					print_instruction(CURRENT_STATE.PC);
+					TRACE_INSTRUCTION();
 				}
 				break;
 			case 0x10: //MFHI
 				NEXT_STATE.REGS[rd] = CURRENT_STATE.HI;
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x11: //MTHI
 				NEXT_STATE.HI = CURRENT_STATE.REGS[rs];
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x12: //MFLO
 				NEXT_STATE.REGS[rd] = CURRENT_STATE.LO;
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x13: //MTLO
 				NEXT_STATE.LO = CURRENT_STATE.REGS[rs];
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x18: //MULT
+				PERF[PERF_MULDIV]++;
 				if ((CURRENT_STATE.REGS[rs] & 0x80000000) == 0x80000000){
 					p1 = 0xFFFFFFFF00000000 | CURRENT_STATE.REGS[rs];
 				}else{
@@ -829,61 +1870,76 @@ void handle_instruction()
 				product = p1 * p2;
 				NEXT_STATE.LO = (product & 0X00000000FFFFFFFF);
 				NEXT_STATE.HI = (product & 0XFFFFFFFF00000000)>>32;
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x19: //MULTU
+				PERF[PERF_MULDIV]++;
 				product = (uint64_t)CURRENT_STATE.REGS[rs] * (uint64_t)CURRENT_STATE.REGS[rt];
 				NEXT_STATE.LO = (product & 0X00000000FFFFFFFF);
 				NEXT_STATE.HI = (product & 0XFFFFFFFF00000000)>>32;
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x1A: //DIV 
+				PERF[PERF_MULDIV]++;
 				if(CURRENT_STATE.REGS[rt] != 0)
 				{
 					NEXT_STATE.LO = (int32_t)CURRENT_STATE.REGS[rs] / (int32_t)CURRENT_STATE.REGS[rt];
 					NEXT_STATE.HI = (int32_t)CURRENT_STATE.REGS[rs] % (int32_t)CURRENT_STATE.REGS[rt];
 				}
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x1B: //DIVU
+				PERF[PERF_MULDIV]++;
 				if(CURRENT_STATE.REGS[rt] != 0)
 				{
 					NEXT_STATE.LO = CURRENT_STATE.REGS[rs] / CURRENT_STATE.REGS[rt];
 					NEXT_STATE.HI = CURRENT_STATE.REGS[rs] % CURRENT_STATE.REGS[rt];
 				}
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
+				break;
+			case 0x0D: //BREAK
+				if (CP0_ENABLED) {
+					exception_raise(EXC_BP, 0);
+				}
+				TRACE_INSTRUCTION();
 				break;
 			case 0x20: //ADD
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] + CURRENT_STATE.REGS[rt];
-				print_instruction(CURRENT_STATE.PC);
+				if (__builtin_add_overflow((int32_t)CURRENT_STATE.REGS[rs], (int32_t)CURRENT_STATE.REGS[rt], (int32_t *)&data) && CP0_ENABLED) {
+					exception_raise(EXC_OV, 0);
+				}
+				NEXT_STATE.REGS[rd] = data;
+				TRACE_INSTRUCTION();
 				break;
 			case 0x21: //ADDU 
 				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rt] + CURRENT_STATE.REGS[rs];
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x22: //SUB
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] - CURRENT_STATE.REGS[rt];
-				print_instruction(CURRENT_STATE.PC);
+				if (__builtin_sub_overflow((int32_t)CURRENT_STATE.REGS[rs], (int32_t)CURRENT_STATE.REGS[rt], (int32_t *)&data) && CP0_ENABLED) {
+					exception_raise(EXC_OV, 0);
+				}
+				NEXT_STATE.REGS[rd] = data;
+				TRACE_INSTRUCTION();
 				break;
 			case 0x23: //SUBU
 				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] - CURRENT_STATE.REGS[rt];
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x24: //AND
 				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] & CURRENT_STATE.REGS[rt];
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x25: //OR
 				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] | CURRENT_STATE.REGS[rt];
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x26: //XOR
 				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] ^ CURRENT_STATE.REGS[rt];
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x27: //NOR
 				NEXT_STATE.REGS[rd] = ~(CURRENT_STATE.REGS[rs] | CURRENT_STATE.REGS[rt]);
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x2A: //SLT
 				if(CURRENT_STATE.REGS[rs] < CURRENT_STATE.REGS[rt]){
@@ -892,10 +1948,16 @@ void handle_instruction()
 				else{
 					NEXT_STATE.REGS[rd] = 0x0;
 				}
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			default:
-				printf("Instruction at 0x%x is not implemented!\n", CURRENT_STATE.PC);
+				PERF[PERF_UNIMPLEMENTED]++;
+				if (CP0_ENABLED) {
+					exception_raise(EXC_RI, 0);
+				}
+				else if (!QUIET) {
+					printf("Instruction at 0x%x is not implemented!\n", CURRENT_STATE.PC);
+				}
 				break;
 		}
 	}
@@ -907,62 +1969,74 @@ void handle_instruction()
 						NEXT_STATE.PC = CURRENT_STATE.PC + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
 						branch_jump = TRUE;
 					}
-					print_instruction(CURRENT_STATE.PC);
+					PERF_BRANCH(branch_jump);
+					TRACE_INSTRUCTION();
 				}
 				else if(rt == 0x00001){ //BGEZ
 					if((CURRENT_STATE.REGS[rs] & 0x80000000) == 0x0){
 						NEXT_STATE.PC = CURRENT_STATE.PC + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
 						branch_jump = TRUE;
 					}
-					print_instruction(CURRENT_STATE.PC);
+					PERF_BRANCH(branch_jump);
+					TRACE_INSTRUCTION();
 				}
 				break;
 			case 0x02: //J
+				PERF[PERF_JUMPS]++;
 				NEXT_STATE.PC = (CURRENT_STATE.PC & 0xF0000000) | (target << 2);
 				branch_jump = TRUE;
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x03: //JAL
+				PERF[PERF_JUMPS]++;
 				NEXT_STATE.PC = (CURRENT_STATE.PC & 0xF0000000) | (target << 2);
 				NEXT_STATE.REGS[31] = CURRENT_STATE.PC + 4;
+				CALLPROF_CALL(NEXT_STATE.PC, CURRENT_STATE.PC + 4);
 				branch_jump = TRUE;
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x04: //BEQ
 				if(CURRENT_STATE.REGS[rs] == CURRENT_STATE.REGS[rt]){
 					NEXT_STATE.PC = CURRENT_STATE.PC + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
 					branch_jump = TRUE;
 				}
-				print_instruction(CURRENT_STATE.PC);
+				PERF_BRANCH(branch_jump);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x05: //BNE
 				if(CURRENT_STATE.REGS[rs] != CURRENT_STATE.REGS[rt]){
 					NEXT_STATE.PC = CURRENT_STATE.PC + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
 					branch_jump = TRUE;
 				}
-				print_instruction(CURRENT_STATE.PC);
+				PERF_BRANCH(branch_jump);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x06: //BLEZ
 				if((CURRENT_STATE.REGS[rs] & 0x80000000) > 0 || CURRENT_STATE.REGS[rs] == 0){
 					NEXT_STATE.PC = CURRENT_STATE.PC +  ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
 					branch_jump = TRUE;
 				}
-				print_instruction(CURRENT_STATE.PC);
+				PERF_BRANCH(branch_jump);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x07: //BGTZ
 				if((CURRENT_STATE.REGS[rs] & 0x80000000) == 0x0 || CURRENT_STATE.REGS[rs] != 0){
 					NEXT_STATE.PC = CURRENT_STATE.PC +  ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
 					branch_jump = TRUE;
 				}
-				print_instruction(CURRENT_STATE.PC);
+				PERF_BRANCH(branch_jump);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x08: //ADDI
-				NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-				print_instruction(CURRENT_STATE.PC);
+				if (__builtin_add_overflow((int32_t)CURRENT_STATE.REGS[rs], (int16_t)immediate, (int32_t *)&data) && CP0_ENABLED) {
+					exception_raise(EXC_OV, 0);
+				}
+				NEXT_STATE.REGS[rt] = data;
+				TRACE_INSTRUCTION();
 				break;
 			case 0x09: //ADDIU
 				NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x0A: //SLTI
 				if ( (  (int32_t)CURRENT_STATE.REGS[rs] - (int32_t)( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF))) < 0){
@@ -970,60 +2044,180 @@ void handle_instruction()
 				}else{
 					NEXT_STATE.REGS[rt] = 0x0;
 				}
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x0C: //ANDI
 				NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] & (immediate & 0x0000FFFF);
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x0D: //ORI
 				NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] | (immediate & 0x0000FFFF);
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x0E: //XORI
 				NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] ^ (immediate & 0x0000FFFF);
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x0F: //LUI
 				NEXT_STATE.REGS[rt] = immediate << 16;
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x20: //LB
-				data = mem_read_32( CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF)) );
+				PERF[PERF_LOADS]++;
+				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
+				RETIRED.mem_addr = addr;
+				data = guest_load_8(addr);
 				NEXT_STATE.REGS[rt] = ((data & 0x000000FF) & 0x80) > 0 ? (data | 0xFFFFFF00) : (data & 0x000000FF);
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x21: //LH
-				data = mem_read_32( CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF)) );
+				PERF[PERF_LOADS]++;
+				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
+				RETIRED.mem_addr = addr;
+				data = misaligned(addr, 1, EXC_ADEL) ? 0 : guest_load_16(addr);
 				NEXT_STATE.REGS[rt] = ((data & 0x0000FFFF) & 0x8000) > 0 ? (data | 0xFFFF0000) : (data & 0x0000FFFF);
-				print_instruction(CURRENT_STATE.PC);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x23: //LW
-				NEXT_STATE.REGS[rt] = mem_read_32( CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF)) );
-				print_instruction(CURRENT_STATE.PC);
+				PERF[PERF_LOADS]++;
+				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
+				RETIRED.mem_addr = addr;
+				NEXT_STATE.REGS[rt] = misaligned(addr, 3, EXC_ADEL) ? 0 : guest_load_32(addr);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x28: //SB
+				PERF[PERF_STORES]++;
 				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-				data = mem_read_32( addr);
-				data = (data & 0xFFFFFF00) | (CURRENT_STATE.REGS[rt] & 0x000000FF);
-				mem_write_32(addr, data);
-				print_instruction(CURRENT_STATE.PC);				
+				RETIRED.mem_addr = addr;
+				guest_store_8(addr, CURRENT_STATE.REGS[rt] & 0x000000FF);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x29: //SH
+				PERF[PERF_STORES]++;
 				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-				data = mem_read_32( addr);
-				data = (data & 0xFFFF0000) | (CURRENT_STATE.REGS[rt] & 0x0000FFFF);
-				mem_write_32(addr, data);
-				print_instruction(CURRENT_STATE.PC);
+				RETIRED.mem_addr = addr;
+				if (misaligned(addr, 1, EXC_ADES)) {
+					break;
+				}
+				guest_store_16(addr, CURRENT_STATE.REGS[rt] & 0x0000FFFF);
+				TRACE_INSTRUCTION();
 				break;
 			case 0x2B: //SW
+				PERF[PERF_STORES]++;
 				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-				mem_write_32(addr, CURRENT_STATE.REGS[rt]);
-				print_instruction(CURRENT_STATE.PC);
+				RETIRED.mem_addr = addr;
+				if (misaligned(addr, 3, EXC_ADES)) {
+					break;
+				}
+				guest_store_32(addr, CURRENT_STATE.REGS[rt]);
+				TRACE_INSTRUCTION();
+				break;
+			case 0x1F: //SPECIAL3
+				if (function == 0x3B) { //RDHWR
+					switch (rd) {
+						case 0: NEXT_STATE.REGS[rt] = HART_ID; break; /* CPUNum */
+						case 2: NEXT_STATE.REGS[rt] = INSTRUCTION_COUNT; break; /* CC */
+						case 3: NEXT_STATE.REGS[rt] = 1; break; /* CCRes */
+						default: NEXT_STATE.REGS[rt] = 0; break;
+					}
+					TRACE_INSTRUCTION();
+				} else {
+					PERF[PERF_UNIMPLEMENTED]++;
+					if (CP0_ENABLED) {
+						exception_raise(EXC_RI, 0);
+					}
+					else if (!QUIET) {
+						printf("Instruction at 0x%x is not implemented!\n", CURRENT_STATE.PC);
+					}
+				}
+				break;
+			case 0x10: //COP0
+				if (instruction == 0x42000018) { //ERET
+					exception_return();
+					branch_jump = TRUE;
+				} else if (rs == 0x00) { //MFC0
+					NEXT_STATE.REGS[rt] = cp0_read(rd);
+				} else if (rs == 0x04) { //MTC0
+					cp0_write(rd, CURRENT_STATE.REGS[rt]);
+				}
+				TRACE_INSTRUCTION();
+				break;
+			case 0x11: //COP1
+				branch_jump = fpu_execute(instruction);
+				TRACE_INSTRUCTION();
+				break;
+			case 0x31: //LWC1
+				PERF[PERF_LOADS]++;
+				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
+				RETIRED.mem_addr = addr;
+				NEXT_STATE.FPR[rt] = misaligned(addr, 3, EXC_ADEL) ? 0 : guest_load_32(addr);
+				FPU_DIRTY = TRUE;
+				TRACE_INSTRUCTION();
+				break;
+			case 0x35: //LDC1
+				PERF[PERF_LOADS]++;
+				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
+				RETIRED.mem_addr = addr;
+				if (misaligned(addr, 7, EXC_ADEL)) {
+					break;
+				}
+				NEXT_STATE.FPR[rt & ~1] = guest_load_32(addr);
+				NEXT_STATE.FPR[rt | 1] = guest_load_32(addr + 4);
+				FPU_DIRTY = TRUE;
+				TRACE_INSTRUCTION();
+				break;
+			case 0x39: //SWC1
+				PERF[PERF_STORES]++;
+				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
+				RETIRED.mem_addr = addr;
+				if (misaligned(addr, 3, EXC_ADES)) {
+					break;
+				}
+				guest_store_32(addr, CURRENT_STATE.FPR[rt]);
+				TRACE_INSTRUCTION();
+				break;
+			case 0x3D: //SDC1
+				PERF[PERF_STORES]++;
+				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
+				RETIRED.mem_addr = addr;
+				if (misaligned(addr, 7, EXC_ADES)) {
+					break;
+				}
+				guest_store_32(addr, CURRENT_STATE.FPR[rt & ~1]);
+				guest_store_32(addr + 4, CURRENT_STATE.FPR[rt | 1]);
+				TRACE_INSTRUCTION();
+				break;
+			case 0x30: //LL
+				PERF[PERF_LOADS]++;
+				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
+				RETIRED.mem_addr = addr;
+				data = misaligned(addr, 3, EXC_ADEL) ? 0 : guest_load_32(addr);
+				NEXT_STATE.REGS[rt] = data;
+				NEXT_STATE.LL_ADDR = addr;
+				NEXT_STATE.LL_VALUE = data;
+				NEXT_STATE.LL_BIT = 1;
+				TRACE_INSTRUCTION();
+				break;
+			case 0x38: //SC
+				PERF[PERF_STORES]++;
+				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
+				RETIRED.mem_addr = addr;
+				if (misaligned(addr, 3, EXC_ADES)) {
+					break;
+				}
+				NEXT_STATE.REGS[rt] = smp_store_conditional(addr, CURRENT_STATE.REGS[rt]);
+				NEXT_STATE.LL_BIT = 0;
+				TRACE_INSTRUCTION();
 				break;
 			default:
 				// put more things here
-				printf("Instruction at 0x%x is not implemented!\n", CURRENT_STATE.PC);
+				PERF[PERF_UNIMPLEMENTED]++;
+				if (CP0_ENABLED) {
+					exception_raise(EXC_RI, 0);
+				}
+				else if (!QUIET) {
+					printf("Instruction at 0x%x is not implemented!\n", CURRENT_STATE.PC);
+				}
 				break;
 		}
 	}
@@ -1042,6 +2236,7 @@ void initialize() {
 	CURRENT_STATE.PC = MEM_TEXT_BEGIN;
 	NEXT_STATE = CURRENT_STATE;
 	RUN_FLAG = TRUE;
+	smp_configure(1, SMP_LOCKSTEP, SMP_DEFAULT_QUANTUM);
 }
 
 /************************************************************/
@@ -1102,6 +2297,9 @@ void print_instruction(uint32_t addr){
 			case 0x0C:
 				printf("SYSCALL\n");
 				break;
+			case 0x0D:
+				printf("BREAK\n");
+				break;
 			case 0x10:
 				printf("MFHI $r%u\n", rd);
 				break;
@@ -1225,35 +2423,48 @@ void print_instruction(uint32_t addr){
 			case 0x2B:
 				printf("SW $r%u, 0x%x($r%u)\n", rt, immediate, rs);
 				break;
+			case 0x11:
+				fpu_disassemble(instruction);
+				break;
+			case 0x31:
+				printf("LWC1 $f%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
+			case 0x35:
+				printf("LDC1 $f%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
+			case 0x39:
+				printf("SWC1 $f%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
+			case 0x3D:
+				printf("SDC1 $f%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
+			case 0x10:
+				if (instruction == 0x42000018) {
+					printf("ERET\n");
+				} else if (rs == 0x00) {
+					printf("MFC0 $r%u, $%u\n", rt, rd);
+				} else if (rs == 0x04) {
+					printf("MTC0 $r%u, $%u\n", rt, rd);
+				} else {
+					printf("Instruction is not implemented!\n");
+				}
+				break;
+			case 0x1F:
+				if (function == 0x3B) {
+					printf("RDHWR $r%u, $%u\n", rt, rd);
+				} else {
+					printf("Instruction is not implemented!\n");
+				}
+				break;
+			case 0x30:
+				printf("LL $r%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
+			case 0x38:
+				printf("SC $r%u, 0x%x($r%u)\n", rt, immediate, rs);
+				break;
 			default:
 				printf("Instruction is not implemented!\n");
 				break;
 		}
 	}
 }
-
-/***************************************************************/
-/* main                                                                                                                                   */
-/***************************************************************/
-int main(int argc, char *argv[]) {      
-
-	printf("\n**************************\n");
-	printf("Welcome to MU-MIPS SIM...\n");
-	printf("**************************\n\n");
-
-	
-	if (argc < 2) {
-		printf("Error: You should provide input file.\nUsage: %s <input program> \n\n",  argv[0]);
-		exit(1);
-	}
-	doWork(argv[2]);
-
-	strcpy(prog_file, argv[1]);
-	initialize();
-	load_program();
-	help();
-	while (1){
-		handle_command();
-	}
-	return 0;
-}
@@ -1,3 +1,6 @@
+#ifndef MU_MIPS_H
+#define MU_MIPS_H
+
 #include <stdint.h>
 
 #define FALSE 0
@@ -9,6 +12,8 @@
 #define MEM_TEXT_BEGIN  0x00400000
 #define MEM_TEXT_END      0x0FFFFFFF
 /*Memory address 0x10000000 to 0x1000FFFF access by $gp*/
+#define MEM_GP_BEGIN  0x10000000
+#define MEM_GP_END   0x1000FFFF
 #define MEM_DATA_BEGIN  0x10010000
 #define MEM_DATA_END   0x7FFFFFFF
 
@@ -28,14 +33,9 @@ typedef struct {
 } mem_region_t;
 
 /* memory will be dynamically allocated at initialization */
-mem_region_t MEM_REGIONS[] = {
-	{ MEM_TEXT_BEGIN, MEM_TEXT_END, NULL },
-	{ MEM_DATA_BEGIN, MEM_DATA_END, NULL },
-	{ MEM_KDATA_BEGIN, MEM_KDATA_END, NULL },
-	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END, NULL }
-};
-
-#define NUM_MEM_REGION 4
+extern mem_region_t MEM_REGIONS[];
+
+#define NUM_MEM_REGION 5
 #define MIPS_REGS 32
 
 typedef struct CPU_State_Struct {
@@ -43,20 +43,47 @@ typedef struct CPU_State_Struct {
   uint32_t PC;		                   /* program counter */
   uint32_t REGS[MIPS_REGS]; /* register file. */
   uint32_t HI, LO;                          /* special regs for mult/div. */
+  uint32_t LL_ADDR, LL_VALUE;         /* address/value linked by the last LL */
+  uint32_t LL_BIT;                            /* set by LL, consumed by SC */
+  uint32_t STATUS, CAUSE, EPC, BADVADDR; /* coprocessor 0 */
+  uint32_t FPR[32];                         /* coprocessor 1: doubles in even/odd pairs */
+  uint32_t FCSR;                              /* rounding mode, exception fields, condition bit */
 } CPU_State;
 
 
 
+/* what the last executed instruction did, for the timing models */
+typedef struct {
+	uint32_t pc;
+	uint32_t instruction;
+	uint32_t mem_addr;	/* effective address of a load/store */
+	uint32_t next_pc;
+} inst_record_t;
+
 /***************************************************************/
 /* CPU State info.                                                                                                               */
 /***************************************************************/
 
-CPU_State CURRENT_STATE, NEXT_STATE;
-int RUN_FLAG;	/* run flag*/
-uint32_t INSTRUCTION_COUNT;
-uint32_t PROGRAM_SIZE; /*in words*/
+/* per-hart state lives in thread-local storage so every host thread runs its own hart */
+extern __thread CPU_State CURRENT_STATE, NEXT_STATE;
+extern __thread int RUN_FLAG;	/* run flag*/
+extern __thread uint32_t INSTRUCTION_COUNT;
+extern __thread inst_record_t RETIRED;
+extern uint32_t PROGRAM_SIZE; /*in words*/
+extern uint32_t PROGRAM_ENTRY;	/* first PC after a reset */
+
+extern char prog_file[256];
+
+extern int INTERACTIVE;	/* prompts, banners and progress messages */
+extern int TRACE;	/* print every executed instruction */
+extern int JSON_OUTPUT;	/* rdump/mdump emit JSON */
+extern int QUIET;	/* embedded: no messages of our own on stdout */
+extern char LAST_ERROR[256];	/* the last sim_error(), for the library API */
+
+#define MAX_CMD_LINE 256
+#define MAX_CMD_ARGS 64
 
-char prog_file[32];
+#define TRACE_INSTRUCTION() do { if (TRACE) print_instruction(CURRENT_STATE.PC); } while (0)
 
 
 /***************************************************************/
@@ -65,17 +92,34 @@ char prog_file[32];
 void help();
 uint32_t mem_read_32(uint32_t address);
 void mem_write_32(uint32_t address, uint32_t value);
+uint8_t *mem_host_ptr(uint32_t address);
+uint8_t *mem_span(uint32_t address, uint64_t *len);
+int mem_scan(void (*fn)(uint32_t address, const uint8_t *page));
+int mem_clear();
 void cycle();
 void run(int num_cycles);
 void runAll();
 void mdump(uint32_t start, uint32_t stop) ;
+void msave(uint32_t start, uint32_t stop, const char *path);
+void mload(const char *path, uint32_t address);
+void hexdump(uint32_t start, uint32_t stop);
 void rdump();
 void handle_command();
+int execute_command(char *line);
+void run_script(const char *commands);
+void run_script_file(const char *path);
+void rdump_json(int hart, CPU_State *state, uint32_t count);
+void snapshot();
 void reset();
+int reset_program();
+void sim_error(const char *format, ...);
+int parse_option(const char *name, const char *text, uint32_t max, uint32_t *value);
 void init_memory();
 void load_program();
 void handle_instruction(); /*IMPLEMENT THIS*/
 void initialize();
 void print_program(); /*IMPLEMENT THIS*/
 void print_instruction(uint32_t);
+void doWork(char * name);
 
+#endif
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "mumips.h"
+#include "counters.h"
+#include "filemap.h"
+#include "timing.h"
+#include "sample.h"
+#include "lanes.h"
+#include "mmio.h"
+#include "idle.h"
+#include "hle.h"
+#include "smp.h"
+#include "guard.h"
+#include "cp0.h"
+#include "rcache.h"
+#include "checkpoint.h"
+#include "callprof.h"
+
+struct mumips {
+	int flags;
+};
+
+static mumips_t *live;	/* the machine is global: one simulator per process */
+
+/***************************************************************/
+/* Bring up guest memory and a single hart with nothing loaded      */
+/***************************************************************/
+mumips_t *mumips_create(int flags)
+{
+	if (live != NULL) {
+		sim_error("a simulator already exists in this process");
+		return NULL;
+	}
+	live = calloc(1, sizeof(*live));
+	if (live == NULL) {
+		sim_error("out of memory for a simulator");
+		return NULL;
+	}
+	live->flags = flags;
+	QUIET = !(flags & (MUMIPS_VERBOSE | MUMIPS_INTERACTIVE));
+	INTERACTIVE = (flags & MUMIPS_INTERACTIVE) != 0;
+	TRACE = INTERACTIVE;
+	JSON_OUTPUT = !INTERACTIVE;
+	LAST_ERROR[0] = '\0';
+	initialize();
+	return live;
+}
+
+/***************************************************************/
+/* Drop memory and every attached model so a new simulator starts  */
+/* from scratch                                                                                          */
+/***************************************************************/
+void mumips_destroy(mumips_t *sim)
+{
+	if (sim == NULL || sim != live) {
+		return;
+	}
+	timing_ctx_destroy(&TIMING);
+	timing_record(NULL);
+	sample_off();
+	hle_clear();
+	callprof_stop();
+	HLE_CHECK = FALSE;
+	IDLE_SKIP = TRUE;
+	IDLE_LOOPS = IDLE_SKIPPED = 0;
+	idle_reset();
+	lanes_destroy();
+	filemap_clear();
+	mmio_clear();
+	CP0_ENABLED = FALSE;
+	EXC_HANDLER = FALSE;
+	memset(EXC_COUNTS, 0, sizeof(EXC_COUNTS));
+	checkpoint_wait();	/* reap a writer still in flight */
+	checkpoint_every(0, "");
+	rcache_close();
+	memset(&RCACHE, 0, sizeof(RCACHE));	/* directory and counters */
+	guard_release();
+	perf_reset();
+	INSTRUCTION_COUNT = 0;
+	PROGRAM_SIZE = 0;
+	free(sim);
+	live = NULL;
+}
+
+int mumips_load(mumips_t *sim, const char *path)
+{
+	snprintf(prog_file, sizeof(prog_file), "%s", path);
+	return reset_program() ? 0 : -1;
+}
+
+int mumips_reset(mumips_t *sim)
+{
+	return reset_program() ? 0 : -1;
+}
+
+/***************************************************************/
+/* Run n instructions (0: to completion); returns how many ran          */
+/***************************************************************/
+uint64_t mumips_run(mumips_t *sim, uint32_t n)
+{
+	uint32_t before = INSTRUCTION_COUNT;
+	uint32_t chunk;
+
+	if (n == 0) {
+		runAll();
+	}
+	while (n > 0 && RUN_FLAG) {
+		chunk = n < INT32_MAX ? n : INT32_MAX;	/* run() counts in an int */
+		run(chunk);
+		n -= chunk;
+	}
+	return (uint32_t)(INSTRUCTION_COUNT - before);
+}
+
+/***************************************************************/
+/* Step until PC reaches pc (not executed), the program exits or max */
+/* instructions ran. Plain cycles: no loop skipping over the target   */
+/***************************************************************/
+uint64_t mumips_run_until(mumips_t *sim, uint32_t pc, uint64_t max)
+{
+	uint64_t n;
+
+	if (NUM_HARTS > 1) {
+		sim_error("run_until steps a single hart");
+		return 0;
+	}
+	perf_timer_start();
+	for (n = 0; n < max && RUN_FLAG && CURRENT_STATE.PC != pc; n++) {
+		cycle();
+	}
+	perf_timer_stop();
+	return n;
+}
+
+int mumips_halted(mumips_t *sim)
+{
+	return RUN_FLAG == FALSE;
+}
+
+uint32_t mumips_get_reg(mumips_t *sim, int reg)
+{
+	switch (reg) {
+		case MUMIPS_PC: return CURRENT_STATE.PC;
+		case MUMIPS_HI: return CURRENT_STATE.HI;
+		case MUMIPS_LO: return CURRENT_STATE.LO;
+	}
+	return reg >= 0 && reg < MIPS_REGS ? CURRENT_STATE.REGS[reg] : 0;
+}
+
+int mumips_set_reg(mumips_t *sim, int reg, uint32_t value)
+{
+	switch (reg) {
+		case MUMIPS_PC: CURRENT_STATE.PC = value; break;
+		case MUMIPS_HI: CURRENT_STATE.HI = value; break;
+		case MUMIPS_LO: CURRENT_STATE.LO = value; break;
+		default:
+			if (reg < 0 || reg >= MIPS_REGS) {
+				sim_error("no register %d", reg);
+				return -1;
+			}
+			CURRENT_STATE.REGS[reg] = value;
+			break;
+	}
+	NEXT_STATE = CURRENT_STATE;
+	return 0;
+}
+
+/***************************************************************/
+/* Guest memory as bytes, across regions                                        */
+/***************************************************************/
+static uint8_t *guest_span(uint32_t address, uint64_t *span)
+{
+	uint8_t *host = mem_span(address, span);
+
+	if (host == NULL) {
+		sim_error("0x%08x is outside guest memory", address);
+	}
+	return host;
+}
+
+int mumips_read(mumips_t *sim, uint32_t address, void *buffer, uint32_t length)
+{
+	uint8_t *out = buffer, *host;
+	uint64_t span;
+
+	while (length > 0) {
+		span = length;
+		if ((host = guest_span(address, &span)) == NULL) {
+			return -1;
+		}
+		memcpy(out, host, span);
+		out += span;
+		address += span;
+		length -= span;
+	}
+	return 0;
+}
+
+int mumips_write(mumips_t *sim, uint32_t address, const void *buffer, uint32_t length)
+{
+	const uint8_t *in = buffer;
+	uint8_t *host;
+	uint64_t span;
+
+	while (length > 0) {
+		span = length;
+		if ((host = guest_span(address, &span)) == NULL) {
+			return -1;
+		}
+		memcpy(host, in, span);
+		cp0_loaded(address, span);
+		in += span;
+		address += span;
+		length -= span;
+	}
+	return 0;
+}
+
+void mumips_stats(mumips_t *sim, mumips_stats_t *out)
+{
+	perf_counters_t c;
+
+	perf_read(&c);
+	out->instructions = c.instructions;
+	out->cycles = timing_cycles();
+	out->loads = c.loads;
+	out->stores = c.stores;
+	out->branches_taken = c.branches_taken;
+	out->branches_not_taken = c.branches_not_taken;
+	out->jumps = c.jumps;
+	out->muldiv = c.muldiv;
+	out->syscalls = c.syscalls;
+	out->unimplemented = c.unimplemented;
+	out->host_seconds = c.host_seconds;
+	out->mips = c.mips;
+}
+
+void mumips_stats_print(mumips_t *sim, FILE *fp, int json)
+{
+	perf_print(fp, json);
+}
+
+int mumips_command(mumips_t *sim, const char *line)
+{
+	char buffer[MAX_CMD_LINE];
+	char word[16] = "";
+
+	/* quit would exit() the host program: that is mumips_destroy()'s job */
+	sscanf(line, "%15s", word);
+	if (!INTERACTIVE && (word[0] == 'q' || word[0] == 'Q')) {
+		sim_error("quit is not available to an embedded simulator, use mumips_destroy()");
+		return -1;
+	}
+	snprintf(buffer, sizeof(buffer), "%s", line);
+	LAST_ERROR[0] = '\0';
+	if (!execute_command(buffer)) {
+		/* a failed load or reset has already set the reason */
+		if (LAST_ERROR[0] == '\0') {
+			snprintf(LAST_ERROR, sizeof(LAST_ERROR), "invalid command: %s", line);
+		}
+		return -1;
+	}
+	return 0;
+}
+
+const char *mumips_error(mumips_t *sim)
+{
+	return LAST_ERROR;
+}
@@ -0,0 +1,52 @@
+#ifndef MUMIPS_H
+#define MUMIPS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/******************************************************************************/
+/* libmumips: the simulator as a library. The machine is process-wide state,  */
+/* so one simulator exists at a time; create it, load, run, inspect, destroy.  */
+/* Calls return 0 on success and -1 on failure, with mumips_error() set.       */
+/******************************************************************************/
+typedef struct mumips mumips_t;
+
+/* mumips_create() flags */
+#define MUMIPS_VERBOSE     1	/* error and warning messages on stdout */
+#define MUMIPS_INTERACTIVE 2	/* also progress messages, the instruction trace and text dumps */
+
+/* mumips_get_reg()/mumips_set_reg() numbers beyond $0-$31 */
+#define MUMIPS_PC 32
+#define MUMIPS_HI 33
+#define MUMIPS_LO 34
+
+typedef struct {
+	uint64_t instructions;	/* since the last load/reset */
+	uint64_t cycles;	/* of the selected timing model, 0 without one */
+	uint64_t loads, stores;
+	uint64_t branches_taken, branches_not_taken;
+	uint64_t jumps, muldiv, syscalls, unimplemented;
+	double host_seconds;
+	double mips;
+} mumips_stats_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+mumips_t *mumips_create(int flags);
+void mumips_destroy(mumips_t *sim);
+int mumips_load(mumips_t *sim, const char *path);	/* hex text, raw .bin words or ELF32 */
+int mumips_reset(mumips_t *sim);
+uint64_t mumips_run(mumips_t *sim, uint32_t n);	/* 0: until the program exits */
+uint64_t mumips_run_until(mumips_t *sim, uint32_t pc, uint64_t max);	/* stops before pc runs */
+int mumips_halted(mumips_t *sim);
+uint32_t mumips_get_reg(mumips_t *sim, int reg);
+int mumips_set_reg(mumips_t *sim, int reg, uint32_t value);
+int mumips_read(mumips_t *sim, uint32_t address, void *buffer, uint32_t length);
+int mumips_write(mumips_t *sim, uint32_t address, const void *buffer, uint32_t length);
+void mumips_stats(mumips_t *sim, mumips_stats_t *out);
+void mumips_stats_print(mumips_t *sim, FILE *fp, int json);
+int mumips_command(mumips_t *sim, const char *line);	/* any CLI command but quit; prints what it prints there */
+const char *mumips_error(mumips_t *sim);
+
+#endif
@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "ooo.h"
+#include "bpred.h"
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+static const char *fu_names[NUM_FU] = { "alu", "mul", "div", "lsu" };
+
+/***************************************************************/
+/* "width=4,rob=128,iq=32,prf=128,alu=4,mul=1,lsu=2,mullat=4,divlat=32,loadlat=2,depth=5" */
+/***************************************************************/
+ooo_t *ooo_create(const char *spec)
+{
+	ooo_t *o = calloc(1, sizeof(ooo_t));
+	char buffer[MAX_CMD_LINE], *opt, *value, *end;
+	int i;
+	const struct {
+		const char *name;
+		uint32_t *field;
+		uint32_t max;
+	} options[] = {
+		{ "width", &o->cfg.width, OOO_MAX_SIZE }, { "rob", &o->cfg.rob, OOO_MAX_SIZE },
+		{ "iq", &o->cfg.iq, OOO_MAX_SIZE }, { "prf", &o->cfg.prf, OOO_MAX_SIZE },
+		{ "alu", &o->cfg.units[FU_ALU], 255 }, { "mul", &o->cfg.units[FU_MUL], 255 },
+		{ "lsu", &o->cfg.units[FU_LSU], 255 },
+		{ "mullat", &o->cfg.latency[FU_MUL], OOO_MAX_LATENCY }, { "divlat", &o->cfg.latency[FU_DIV], OOO_MAX_LATENCY },
+		{ "loadlat", &o->cfg.latency[FU_LSU], OOO_MAX_LATENCY }, { "depth", &o->cfg.depth, OOO_MAX_LATENCY },
+	};
+
+	o->cfg.width = 4;
+	o->cfg.rob = 128;
+	o->cfg.iq = 32;
+	o->cfg.prf = 128;
+	o->cfg.units[FU_ALU] = 4;
+	o->cfg.units[FU_MUL] = 1;
+	o->cfg.units[FU_DIV] = 1;
+	o->cfg.units[FU_LSU] = 2;
+	o->cfg.latency[FU_ALU] = 1;
+	o->cfg.latency[FU_MUL] = 4;
+	o->cfg.latency[FU_DIV] = 32;
+	o->cfg.latency[FU_LSU] = 2;
+	o->cfg.depth = 5;
+
+	snprintf(buffer, sizeof(buffer), "%s", spec != NULL ? spec : "");
+	for (opt = strtok_r(buffer, ",", &end); opt != NULL; opt = strtok_r(NULL, ",", &end)) {
+		value = strchr(opt, '=');
+		if (value == NULL) {
+			printf("Error: ooo option %s needs a value\n", opt);
+			free(o);
+			return NULL;
+		}
+		*value++ = '\0';
+		for (i = 0; i < (int)(sizeof(options) / sizeof(options[0])) && strcmp(opt, options[i].name); i++);
+		if (i == (int)(sizeof(options) / sizeof(options[0]))) {
+			printf("Error: unknown ooo option %s\n", opt);
+			free(o);
+			return NULL;
+		}
+		if (!parse_option(opt, value, options[i].max, options[i].field)) {
+			free(o);
+			return NULL;
+		}
+	}
+	for (i = 0; i < NUM_FU; i++) {
+		if (o->cfg.units[i] == 0 || o->cfg.units[i] > 255 || o->cfg.latency[i] == 0) {
+			printf("Error: every functional unit class needs 1-255 units and a latency\n");
+			free(o);
+			return NULL;
+		}
+	}
+	if (o->cfg.width == 0 || o->cfg.rob == 0 || o->cfg.iq == 0 || o->cfg.prf <= MIPS_REGS + 2) {
+		printf("Error: width, rob and iq must be positive and prf larger than %d\n", MIPS_REGS + 2);
+		free(o);
+		return NULL;
+	}
+	o->rob_commit = calloc(o->cfg.rob, sizeof(uint64_t));
+	o->reg_commit = calloc(o->cfg.prf - MIPS_REGS - 2, sizeof(uint64_t));
+	o->iq_heap = calloc(o->cfg.iq, sizeof(uint64_t));
+	return o;
+}
+
+void ooo_destroy(ooo_t *o)
+{
+	if (o == NULL) {
+		return;
+	}
+	free(o->rob_commit);
+	free(o->reg_commit);
+	free(o->iq_heap);
+	free(o);
+}
+
+void ooo_clear(ooo_t *o)
+{
+	ooo_config_t cfg = o->cfg;
+	uint64_t *rob = o->rob_commit, *regs = o->reg_commit, *heap = o->iq_heap;
+
+	memset(o, 0, sizeof(*o));
+	o->cfg = cfg;
+	o->rob_commit = rob;
+	o->reg_commit = regs;
+	o->iq_heap = heap;
+	memset(rob, 0, cfg.rob * sizeof(uint64_t));
+	memset(regs, 0, (cfg.prf - MIPS_REGS - 2) * sizeof(uint64_t));
+}
+
+/***************************************************************/
+/* Min-heap of the issue cycles of instructions sitting in the IQ    */
+/***************************************************************/
+static void heap_push(ooo_t *o, uint64_t v)
+{
+	uint32_t i = o->iq_count++;
+	while (i > 0 && o->iq_heap[(i - 1) / 2] > v) {
+		o->iq_heap[i] = o->iq_heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	o->iq_heap[i] = v;
+}
+
+static void heap_pop(ooo_t *o)
+{
+	uint64_t v = o->iq_heap[--o->iq_count];
+	uint32_t i = 0, c;
+	while ((c = 2 * i + 1) < o->iq_count) {
+		if (c + 1 < o->iq_count && o->iq_heap[c + 1] < o->iq_heap[c]) {
+			c++;
+		}
+		if (o->iq_heap[c] >= v) {
+			break;
+		}
+		o->iq_heap[i] = o->iq_heap[c];
+		i = c;
+	}
+	o->iq_heap[i] = v;
+}
+
+/***************************************************************/
+/* Earliest cycle >= t with a free unit of class fu, and claim it   */
+/***************************************************************/
+static uint64_t fu_claim(ooo_t *o, int fu, uint64_t t)
+{
+	for (;; t++) {
+		uint32_t slot = t % FU_WINDOW;
+		if (o->fu_cycle[fu][slot] != t) {
+			o->fu_cycle[fu][slot] = t;
+			o->fu_used[fu][slot] = 0;
+		}
+		if (o->fu_used[fu][slot] < o->cfg.units[fu]) {
+			o->fu_used[fu][slot]++;
+			return t;
+		}
+	}
+}
+
+/***************************************************************/
+/* Place one instruction: fetch, rename, issue, complete, commit    */
+/***************************************************************/
+void ooo_retire(ooo_t *o, const inst_record_t *r, const inst_deps_t *d,
+		uint32_t fetch_stall, uint32_t mem_stall, int bp)
+{
+	uint64_t fetch, rename, natural, issue, ready, complete, commit, t;
+	uint32_t latency;
+	int i, fu, writes;
+
+	/* fetch: width per cycle, restarts after a mispredict or an I-cache miss */
+	if (o->fetch_slots == o->cfg.width || o->redirect > o->fetch_cycle) {
+		o->fetch_cycle = MAX(o->fetch_cycle + 1, o->redirect);
+		o->fetch_slots = 0;
+	}
+	o->fetch_cycle += fetch_stall;
+	fetch = o->fetch_cycle;
+	o->fetch_slots++;
+
+	/* rename: in order, width per cycle, needs ROB, IQ and physical register space */
+	if (o->rename_slots == o->cfg.width) {
+		o->rename_cycle++;
+		o->rename_slots = 0;
+	}
+	natural = o->rename_cycle;
+	rename = MAX(natural, fetch + o->cfg.depth);
+	if (rename > natural) {
+		o->stall_frontend += rename - natural;
+		natural = rename;
+	}
+	if (o->instructions >= o->cfg.rob) {
+		t = o->rob_commit[o->instructions % o->cfg.rob] + 1;
+		if (t > rename) {
+			o->stall_rob += t - rename;
+			rename = t;
+		}
+	}
+	while (o->iq_count > 0 && o->iq_heap[0] < rename) {
+		heap_pop(o);
+	}
+	if (o->iq_count == o->cfg.iq) {
+		t = o->iq_heap[0] + 1;
+		o->stall_iq += t - rename;
+		rename = t;
+		while (o->iq_count > 0 && o->iq_heap[0] < rename) {
+			heap_pop(o);
+		}
+	}
+	writes = d->dst[0] != DEP_NONE;
+	if (writes && o->writers >= o->cfg.prf - MIPS_REGS - 2) {
+		t = o->reg_commit[o->writers % (o->cfg.prf - MIPS_REGS - 2)] + 1;
+		if (t > rename) {
+			o->stall_regs += t - rename;
+			rename = t;
+		}
+	}
+	if (rename > o->rename_cycle) {
+		o->rename_cycle = rename;
+		o->rename_slots = 0;
+	}
+	o->rename_slots++;
+
+	/* issue: operands ready and a functional unit free */
+	if (d->flags & (INST_LOAD | INST_STORE)) fu = FU_LSU;
+	else if (d->flags & INST_DIV) fu = FU_DIV;
+	else if (d->flags & INST_MULT) fu = FU_MUL;
+	else fu = FU_ALU;
+	ready = rename + 1;
+	for (i = 0; i < 2; i++) {
+		if (d->src[i] != DEP_NONE && o->ready[d->src[i]] > ready) {
+			ready = o->ready[d->src[i]];
+		}
+	}
+	o->wait_operands += ready - (rename + 1);
+	if (fu == FU_DIV) {
+		issue = MAX(ready, o->div_free);
+		o->div_free = issue + o->cfg.latency[FU_DIV];
+	} else {
+		issue = fu_claim(o, fu, ready);
+	}
+	o->wait_units += issue - ready;
+	heap_push(o, issue);
+
+	latency = o->cfg.latency[fu];
+	if (d->flags & INST_STORE) {
+		latency = 1;	/* the store buffer absorbs the write */
+	} else if (d->flags & INST_LOAD) {
+		latency += mem_stall;
+	}
+	complete = issue + latency;
+	for (i = 0; i < 2; i++) {
+		if (d->dst[i] != DEP_NONE) {
+			o->ready[d->dst[i]] = complete;
+		}
+	}
+
+	/* commit: in order, width per cycle */
+	commit = MAX(complete + 1, o->commit_cycle);
+	if (commit == o->commit_cycle && o->commit_slots == o->cfg.width) {
+		commit++;
+	}
+	if (commit != o->commit_cycle) {
+		o->commit_cycle = commit;
+		o->commit_slots = 0;
+	}
+	o->commit_slots++;
+	o->rob_commit[o->instructions % o->cfg.rob] = commit;
+	if (writes) {
+		o->reg_commit[o->writers % (o->cfg.prf - MIPS_REGS - 2)] = commit;
+		o->writers++;
+	}
+	o->last_commit = commit;
+
+	/* control flow: a wrong prediction refetches once the branch executes;
+	   without a predictor, a taken branch just ends the fetch group */
+	if (d->flags & (INST_BRANCH | INST_JUMP | INST_JUMP_REG)) {
+		if (bp == BP_WRONG) {
+			o->mispredicts++;
+			o->redirect = complete + 1;
+		} else if (bp == BP_NONE && r->next_pc != r->pc + 4) {
+			o->redirect = fetch + 1;
+		}
+	}
+	o->instructions++;
+}
+
+uint64_t ooo_cycles(ooo_t *o)
+{
+	return o->instructions ? o->last_commit + 1 : 0;
+}
+
+void ooo_print(ooo_t *o, FILE *fp, int json)
+{
+	uint64_t cycles = ooo_cycles(o);
+	double ipc = cycles ? (double)o->instructions / cycles : 0;
+	int i;
+
+	if (json) {
+		fprintf(fp, ",\"ooo\":{\"cycles\":%llu,\"instructions\":%llu,\"ipc\":%.4f,"
+				"\"stall_rob\":%llu,\"stall_iq\":%llu,\"stall_regs\":%llu,\"stall_frontend\":%llu,"
+				"\"wait_operands\":%llu,\"wait_units\":%llu,\"mispredicts\":%llu}",
+				(unsigned long long)cycles, (unsigned long long)o->instructions, ipc,
+				(unsigned long long)o->stall_rob, (unsigned long long)o->stall_iq,
+				(unsigned long long)o->stall_regs, (unsigned long long)o->stall_frontend,
+				(unsigned long long)o->wait_operands, (unsigned long long)o->wait_units,
+				(unsigned long long)o->mispredicts);
+		return;
+	}
+	fprintf(fp, "Out-of-order core (width %u, ROB %u, IQ %u, %u physical registers)\n",
+			o->cfg.width, o->cfg.rob, o->cfg.iq, o->cfg.prf);
+	fprintf(fp, "units\t\t:");
+	for (i = 0; i < NUM_FU; i++) {
+		fprintf(fp, " %u %s (%u cycles)", o->cfg.units[i], fu_names[i], o->cfg.latency[i]);
+	}
+	fprintf(fp, "\n-------------------------------------\n");
+	fprintf(fp, "cycles\t\t: %llu\n", (unsigned long long)cycles);
+	fprintf(fp, "instructions\t: %llu\n", (unsigned long long)o->instructions);
+	fprintf(fp, "IPC\t\t: %.4f\n", ipc);
+	fprintf(fp, "rename stalls\t: %llu ROB full, %llu IQ full, %llu registers, %llu front end\n",
+			(unsigned long long)o->stall_rob, (unsigned long long)o->stall_iq,
+			(unsigned long long)o->stall_regs, (unsigned long long)o->stall_frontend);
+	fprintf(fp, "issue waits\t: %llu operands, %llu functional units\n",
+			(unsigned long long)o->wait_operands, (unsigned long long)o->wait_units);
+	fprintf(fp, "mispredicts\t: %llu\n", (unsigned long long)o->mispredicts);
+	fprintf(fp, "-------------------------------------\n");
+}
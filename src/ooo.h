@@ -0,0 +1,67 @@
+#ifndef OOO_H
+#define OOO_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "timing.h"
+
+/******************************************************************************/
+/* Out-of-order superscalar timing model                                                         */
+/******************************************************************************/
+#define FU_ALU  0
+#define FU_MUL  1	/* multiplier, pipelined */
+#define FU_DIV  2	/* divider, not pipelined */
+#define FU_LSU  3
+#define NUM_FU  4
+
+#define FU_WINDOW 4096	/* cycles of functional unit reservations kept */
+#define OOO_MAX_SIZE    (1u << 20)	/* width=, rob=, iq= and prf= */
+#define OOO_MAX_LATENCY 1024	/* the latencies and depth= */
+
+typedef struct {
+	uint32_t width;	/* fetch, rename and commit width */
+	uint32_t rob, iq, prf;
+	uint32_t units[NUM_FU];
+	uint32_t latency[NUM_FU];
+	uint32_t depth;	/* fetch to rename stages, also the refill after a mispredict */
+} ooo_config_t;
+
+typedef struct ooo {
+	ooo_config_t cfg;
+
+	uint64_t instructions;
+	uint64_t last_commit;
+	uint64_t stall_rob, stall_iq, stall_regs, stall_frontend;	/* rename cycles lost */
+	uint64_t wait_operands, wait_units;	/* issue cycles lost */
+	uint64_t mispredicts;
+
+	uint64_t fetch_cycle, fetch_slots;
+	uint64_t rename_cycle, rename_slots;
+	uint64_t commit_cycle, commit_slots;
+	uint64_t redirect;	/* first cycle fetch can resume after a mispredict */
+	uint64_t div_free;
+
+	uint64_t ready[NUM_DEP_REGS];	/* cycle each architectural value is produced */
+	uint64_t *rob_commit;	/* ring: commit cycle of the last rob instructions */
+	uint64_t *reg_commit;	/* ring: commit cycle of the last prf-32 register writers */
+	uint64_t writers;
+	uint64_t *iq_heap;	/* issue cycles of the instructions waiting in the IQ */
+	uint32_t iq_count;
+
+	uint64_t fu_cycle[NUM_FU][FU_WINDOW];
+	uint8_t fu_used[NUM_FU][FU_WINDOW];
+} ooo_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+ooo_t *ooo_create(const char *spec);
+void ooo_destroy(ooo_t *o);
+void ooo_clear(ooo_t *o);
+void ooo_retire(ooo_t *o, const inst_record_t *r, const inst_deps_t *d,
+		uint32_t fetch_stall, uint32_t mem_stall, int bp);
+uint64_t ooo_cycles(ooo_t *o);
+void ooo_print(ooo_t *o, FILE *fp, int json);
+
+#endif
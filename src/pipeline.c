@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "pipeline.h"
+#include "bpred.h"
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/***************************************************************/
+/* Build a pipeline from "forward=on,branch=id,mult=4,div=32"      */
+/***************************************************************/
+pipeline_t *pipeline_create(const char *spec)
+{
+	pipeline_t *p = calloc(1, sizeof(pipeline_t));
+	char buffer[MAX_CMD_LINE], *opt, *value;
+	uint32_t n = 0;
+	int ok;
+
+	p->cfg.forwarding = TRUE;
+	p->cfg.branch_stage = PIPE_ID;
+	p->cfg.mult_latency = 4;
+	p->cfg.div_latency = 32;
+
+	snprintf(buffer, sizeof(buffer), "%s", spec != NULL ? spec : "");
+	for (opt = strtok(buffer, ","); opt != NULL; opt = strtok(NULL, ",")) {
+		value = strchr(opt, '=');
+		if (value == NULL) {
+			printf("Error: pipeline option %s needs a value\n", opt);
+			free(p);
+			return NULL;
+		}
+		*value++ = '\0';
+		if (!strcmp(opt, "forward")) {
+			ok = !strcmp(value, "on") || !strcmp(value, "off");
+			p->cfg.forwarding = !strcmp(value, "on");
+			if (!ok) {
+				printf("Error: forward takes on or off, not %s\n", value);
+			}
+		} else if (!strcmp(opt, "branch")) {
+			ok = !strcmp(value, "id") || !strcmp(value, "ex");
+			p->cfg.branch_stage = !strcmp(value, "ex") ? PIPE_EX : PIPE_ID;
+			if (!ok) {
+				printf("Error: branch takes id or ex, not %s\n", value);
+			}
+		} else if (!strcmp(opt, "mult")) {
+			ok = parse_option(opt, value, PIPE_MAX_LATENCY, &n);
+			p->cfg.mult_latency = n;
+		} else if (!strcmp(opt, "div")) {
+			ok = parse_option(opt, value, PIPE_MAX_LATENCY, &n);
+			p->cfg.div_latency = n;
+		} else {
+			printf("Error: unknown pipeline option %s\n", opt);
+			free(p);
+			return NULL;
+		}
+		if (!ok) {
+			free(p);
+			return NULL;
+		}
+	}
+	return p;
+}
+
+void pipeline_destroy(pipeline_t *p)
+{
+	free(p);
+}
+
+/***************************************************************/
+/* Empty the pipeline and zero the statistics                                   */
+/***************************************************************/
+void pipeline_clear(pipeline_t *p)
+{
+	pipeline_config_t cfg = p->cfg;
+	memset(p, 0, sizeof(*p));
+	p->cfg = cfg;
+}
+
+/***************************************************************/
+/* Advance the model by one instruction.                                          */
+/* Each instruction is placed by the cycle it enters ID and EX;       */
+/* MEM and WB follow EX by one and two cycles.                              */
+/***************************************************************/
+void pipeline_retire(pipeline_t *p, const inst_record_t *r, const inst_deps_t *d,
+		uint32_t fetch_stall, uint32_t mem_stall, int bp)
+{
+	uint64_t fetch, id, id_natural, ex, need, t;
+	uint64_t *stall = NULL;
+	int i, in_id, latency;
+
+	/* an instruction enters IF when its predecessor leaves it, unless fetch was redirected */
+	fetch = MAX(p->prev_id, p->redirect);
+	id = MAX(fetch + 1, p->prev_ex);
+	id_natural = MAX(p->prev_id + 1, p->prev_ex);
+	if (p->instructions > 0 && id > id_natural) {
+		p->stall_branch += id - id_natural;
+	}
+	/* an instruction cache miss holds the instruction in IF */
+	if (fetch_stall > 0) {
+		id += fetch_stall;
+		p->stall_memory += fetch_stall;
+	}
+
+	/* operands: branches resolved in ID need them a stage earlier */
+	in_id = p->cfg.branch_stage == PIPE_ID && (d->flags & (INST_BRANCH | INST_JUMP_REG));
+	need = id + 1;
+	for (i = 0; i < 2; i++) {
+		if (d->src[i] == DEP_NONE) {
+			continue;
+		}
+		t = in_id ? p->ready_id[d->src[i]] + 1 : p->ready_ex[d->src[i]];
+		if (t > need) {
+			need = t;
+			if (p->from_load[d->src[i]]) {
+				stall = &p->stall_load_use;
+			} else if (d->src[i] >= DEP_HI) {
+				stall = &p->stall_muldiv;	/* HI/LO and FP results wait on the long-latency unit */
+			} else {
+				stall = &p->stall_raw;
+			}
+		}
+	}
+	ex = need;
+
+	/* one non-pipelined multiply/divide unit */
+	latency = 0;
+	if (d->flags & (INST_MULT | INST_DIV)) {
+		latency = (d->flags & INST_DIV) ? p->cfg.div_latency : p->cfg.mult_latency;
+		if (p->muldiv_free > ex) {
+			ex = p->muldiv_free;
+			stall = &p->stall_muldiv;
+		}
+		p->muldiv_free = ex + latency;
+	}
+	if (stall != NULL) {
+		*stall += ex - (id + 1);
+	}
+
+	for (i = 0; i < 2; i++) {
+		uint8_t dst = d->dst[i];
+		if (dst == DEP_NONE) {
+			continue;
+		}
+		if (latency > 0) {
+			p->ready_ex[dst] = p->ready_id[dst] = ex + latency;
+		} else if (d->flags & INST_LOAD) {
+			p->ready_ex[dst] = (p->cfg.forwarding ? ex + 2 : ex + 3) + mem_stall;
+			p->ready_id[dst] = ex + 2 + mem_stall;
+		} else {
+			p->ready_ex[dst] = p->cfg.forwarding ? ex + 1 : ex + 3;
+			p->ready_id[dst] = p->cfg.forwarding ? ex + 1 : ex + 2;
+		}
+		p->from_load[dst] = (d->flags & INST_LOAD) != 0;
+	}
+
+	/* without a predictor anything that leaves the fall-through path refetches;
+	   with one, only what it got wrong does */
+	if ((d->flags & (INST_BRANCH | INST_JUMP | INST_JUMP_REG))
+			&& (bp == BP_NONE ? r->next_pc != r->pc + 4 : bp == BP_WRONG)) {
+		if (d->flags & INST_JUMP) {
+			p->redirect = id + 1;
+		} else if (p->cfg.branch_stage == PIPE_ID) {
+			p->redirect = ex;
+		} else {
+			p->redirect = ex + 1;
+		}
+	}
+
+	p->prev_id = id;
+	p->prev_ex = ex;
+	p->instructions++;
+
+	/* a data cache miss keeps MEM busy, so everything behind it slips */
+	if (mem_stall > 0) {
+		p->prev_ex += mem_stall;
+		p->stall_memory += mem_stall;
+	}
+}
+
+/***************************************************************/
+/* Cycles until the last instruction so far leaves WB                    */
+/***************************************************************/
+uint64_t pipeline_cycles(pipeline_t *p)
+{
+	return p->instructions ? p->prev_ex + 3 : 0;
+}
+
+
+void pipeline_print(pipeline_t *p, FILE *fp, int json)
+{
+	uint64_t cycles = pipeline_cycles(p);
+	double cpi = p->instructions ? (double)cycles / p->instructions : 0;
+
+	if (json) {
+		fprintf(fp, ",\"pipeline\":{\"cycles\":%llu,\"instructions\":%llu,\"cpi\":%.4f,"
+				"\"stall_load_use\":%llu,\"stall_raw\":%llu,\"stall_muldiv\":%llu,\"stall_branch\":%llu,\"stall_memory\":%llu}",
+				(unsigned long long)cycles, (unsigned long long)p->instructions, cpi,
+				(unsigned long long)p->stall_load_use, (unsigned long long)p->stall_raw,
+				(unsigned long long)p->stall_muldiv, (unsigned long long)p->stall_branch,
+				(unsigned long long)p->stall_memory);
+		return;
+	}
+	fprintf(fp, "Pipeline (forwarding %s, branches in %s, mult %d, div %d)\n",
+			p->cfg.forwarding ? "on" : "off", p->cfg.branch_stage == PIPE_ID ? "ID" : "EX",
+			p->cfg.mult_latency, p->cfg.div_latency);
+	fprintf(fp, "-------------------------------------\n");
+	fprintf(fp, "cycles\t\t: %llu\n", (unsigned long long)cycles);
+	fprintf(fp, "instructions\t: %llu\n", (unsigned long long)p->instructions);
+	fprintf(fp, "CPI\t\t: %.4f\n", cpi);
+	fprintf(fp, "load-use stalls\t: %llu\n", (unsigned long long)p->stall_load_use);
+	fprintf(fp, "RAW stalls\t: %llu\n", (unsigned long long)p->stall_raw);
+	fprintf(fp, "mult/div stalls\t: %llu\n", (unsigned long long)p->stall_muldiv);
+	fprintf(fp, "branch stalls\t: %llu\n", (unsigned long long)p->stall_branch);
+	fprintf(fp, "memory stalls\t: %llu\n", (unsigned long long)p->stall_memory);
+	fprintf(fp, "-------------------------------------\n");
+}
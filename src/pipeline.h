@@ -0,0 +1,52 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "timing.h"
+
+/******************************************************************************/
+/* In-order IF/ID/EX/MEM/WB timing model                                                          */
+/******************************************************************************/
+#define PIPE_ID 1	/* stage that resolves branches */
+#define PIPE_EX 2
+#define PIPE_MAX_LATENCY 1024	/* mult= and div= */
+
+typedef struct {
+	int forwarding;		/* EX/MEM and MEM/WB bypasses */
+	int branch_stage;	/* PIPE_ID or PIPE_EX */
+	int mult_latency;	/* cycles until HI/LO are ready */
+	int div_latency;
+} pipeline_config_t;
+
+typedef struct pipeline {
+	pipeline_config_t cfg;
+
+	uint64_t instructions;
+	uint64_t stall_load_use;	/* consumer waits for a load in MEM */
+	uint64_t stall_raw;		/* other data hazards (no forwarding, branch operands in ID) */
+	uint64_t stall_muldiv;	/* HI/LO not ready or multiplier busy */
+	uint64_t stall_branch;	/* fetch redirected by a taken branch/jump */
+	uint64_t stall_memory;	/* cache misses on fetch or in MEM */
+
+	/* cycle numbers of the previous instruction and of the next fetch redirect */
+	uint64_t prev_id, prev_ex, redirect;
+	uint64_t muldiv_free;
+	uint64_t ready_ex[NUM_DEP_REGS];	/* first cycle a consumer may be in EX */
+	uint64_t ready_id[NUM_DEP_REGS];	/* first cycle a branch may read it in ID */
+	uint8_t from_load[NUM_DEP_REGS];
+} pipeline_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+pipeline_t *pipeline_create(const char *spec);
+void pipeline_destroy(pipeline_t *p);
+void pipeline_clear(pipeline_t *p);
+void pipeline_retire(pipeline_t *p, const inst_record_t *r, const inst_deps_t *d,
+		uint32_t fetch_stall, uint32_t mem_stall, int bp);
+uint64_t pipeline_cycles(pipeline_t *p);
+void pipeline_print(pipeline_t *p, FILE *fp, int json);
+
+#endif
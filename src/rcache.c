@@ -0,0 +1,509 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "mu-mips.h"
+#include "counters.h"
+#include "smp.h"
+#include "cp0.h"
+#include "guard.h"
+#include "hle.h"
+#include "filemap.h"
+#include "mmio.h"
+#include "sample.h"
+#include "timing.h"
+#include "callprof.h"
+#include "checkpoint.h"
+#include "rcache.h"
+
+rcache_t RCACHE;
+
+/* what the guest pages hashed to when the run started */
+typedef struct {
+	uint32_t address;
+	uint64_t hash;
+} page_hash_t;
+
+/* an entry on disk: the header, then the result, the changed pages */
+/* as (address, bytes) and the console output                                */
+typedef struct {
+	uint32_t magic, version;
+	uint64_t key[2];
+	uint64_t length;	/* bytes after the header */
+	uint64_t checksum[2];	/* of those bytes */
+} entry_header_t;
+
+typedef struct {
+	CPU_State current, next;
+	uint32_t instructions;	/* executed by the run */
+	uint32_t run_flag;
+	uint64_t perf[NUM_PERF];	/* counted by the run */
+	uint64_t exceptions[NUM_EXC];
+	char error[256];	/* LAST_ERROR the run left, or "" */
+	uint32_t num_pages;
+	uint32_t output_length;
+} entry_result_t;
+
+/* the run being recorded after a miss */
+static struct {
+	int recording;
+	uint64_t key[2];
+	uint32_t start_count;
+	uint64_t perf[NUM_PERF];
+	uint64_t exceptions[NUM_EXC];
+	char error[256];
+	page_hash_t *pages;	/* nonzero at the start, by address */
+	uint32_t num_pages, capacity;
+	uint8_t *buffer;	/* the entry being built */
+	uint64_t length, buffer_capacity;
+	uint32_t dirty;
+	int saved_stdout;
+	FILE *output;
+} rec;
+
+static uint32_t page_size;
+
+/***************************************************************/
+/* Two 64-bit lanes over the data, a word at a time                   */
+/***************************************************************/
+static void hash_bytes(uint64_t h[2], const void *data, size_t length)
+{
+	const uint8_t *p = data;
+	uint64_t word;
+	size_t i;
+
+	for (i = 0; i < length; i += 8) {
+		word = 0;
+		memcpy(&word, p + i, length - i < 8 ? length - i : 8);
+		h[0] = (h[0] ^ word) * 0x100000001B3ull;
+		h[0] ^= h[0] >> 32;
+		h[1] = (h[1] + word) * 0x9E3779B97F4A7C15ull;
+		h[1] ^= h[1] >> 29;
+	}
+}
+
+static uint64_t hash_page(const uint8_t *page)
+{
+	uint64_t h[2] = { 0xCBF29CE484222325ull, 0x84222325CBF29CE4ull };
+	hash_bytes(h, page, page_size);
+	return h[0] ^ h[1];
+}
+
+static int zero_page(const uint8_t *page)
+{
+	return page[0] == 0 && !memcmp(page, page + 1, page_size - 1);
+}
+
+/* opening scan: the key covers every nonzero page */
+static void key_page(uint32_t address, const uint8_t *page)
+{
+	if (zero_page(page)) {
+		return;
+	}
+	hash_bytes(rec.key, &address, sizeof(address));
+	hash_bytes(rec.key, page, page_size);
+	if (rec.num_pages == rec.capacity) {
+		rec.capacity = rec.capacity * 2 + 256;
+		rec.pages = realloc(rec.pages, rec.capacity * sizeof(page_hash_t));
+	}
+	rec.pages[rec.num_pages].address = address;
+	rec.pages[rec.num_pages].hash = hash_page(page);
+	rec.num_pages++;
+}
+
+static void append(const void *data, uint64_t length)
+{
+	if (rec.length + length > rec.buffer_capacity) {
+		rec.buffer_capacity = (rec.length + length) * 2;
+		rec.buffer = realloc(rec.buffer, rec.buffer_capacity);
+	}
+	memcpy(rec.buffer + rec.length, data, length);
+	rec.length += length;
+}
+
+static int by_address(const void *a, const void *b)
+{
+	uint32_t x = ((const page_hash_t *)a)->address, y = ((const page_hash_t *)b)->address;
+	return (x > y) - (x < y);
+}
+
+/* closing scan: keep the pages the run changed */
+static void diff_page(uint32_t address, const uint8_t *page)
+{
+	page_hash_t want = { address, 0 };
+	page_hash_t *before = bsearch(&want, rec.pages, rec.num_pages, sizeof(page_hash_t), by_address);
+
+	if (before != NULL ? before->hash == hash_page(page) : zero_page(page)) {
+		return;
+	}
+	append(&address, sizeof(address));
+	append(page, page_size);
+	rec.dirty++;
+}
+
+/***************************************************************/
+/* Runs the key does not capture: other harts, timing and trace      */
+/* consumers, hooks, file mappings, devices with inputs or state and */
+/* automatic checkpoints, which a replayed run would never write        */
+/***************************************************************/
+static int cacheable(uint64_t h[2])
+{
+	uint32_t bases[MAX_DEVICES];
+	int n;
+
+	if (NUM_HARTS > 1 || TIMING_ACTIVE || SAMPLER.mode != SAMPLE_OFF || TRACE || HLE_ACTIVE || CALLPROF_ACTIVE ||
+			NUM_FILEMAPS > 0 || CKPT_INTERVAL != 0) {
+		return FALSE;
+	}
+	n = mmio_output_only(bases);
+	if (n < 0) {
+		return FALSE;
+	}
+	hash_bytes(h, bases, n * sizeof(uint32_t));
+	return TRUE;
+}
+
+static void entry_path(char *path, size_t size, const uint64_t key[2])
+{
+	snprintf(path, size, "%s/%016llx%016llx.res", RCACHE.dir, (unsigned long long)key[0], (unsigned long long)key[1]);
+}
+
+/***************************************************************/
+/* Enable the cache in <dir>, trimmed to max_bytes                       */
+/***************************************************************/
+int rcache_open(const char *dir, uint64_t max_bytes)
+{
+	int fd;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+		printf("Error: Can't create %s\n", dir);
+		return FALSE;
+	}
+	fd = open("/proc/self/pagemap", O_RDONLY);
+	if (fd < 0) {
+		printf("Error: the result cache needs /proc/self/pagemap\n");
+		return FALSE;
+	}
+	close(fd);
+	snprintf(RCACHE.dir, sizeof(RCACHE.dir), "%s", dir);
+	RCACHE.max_bytes = max_bytes;
+	RCACHE.active = TRUE;
+	return TRUE;
+}
+
+void rcache_close()
+{
+	RCACHE.active = FALSE;
+}
+
+/***************************************************************/
+/* Read and check the entry for key into a malloc()ed buffer; a     */
+/* damaged one is counted and removed                                           */
+/***************************************************************/
+static uint8_t *entry_read(const char *path, const uint64_t key[2])
+{
+	entry_header_t header;
+	uint64_t sum[2] = { 0xCBF29CE484222325ull, 0x84222325CBF29CE4ull };
+	entry_result_t result;
+	struct stat st;
+	uint8_t *payload = NULL;
+	int ok = FALSE;
+	FILE *fp = fopen(path, "rb");
+
+	if (fp == NULL) {
+		return NULL;
+	}
+	if (fstat(fileno(fp), &st) == 0 && fread(&header, sizeof(header), 1, fp) == 1 &&
+			header.magic == RCACHE_MAGIC && header.version == RCACHE_VERSION &&
+			header.key[0] == key[0] && header.key[1] == key[1] &&
+			header.length == (uint64_t)st.st_size - sizeof(header) && header.length >= sizeof(result)) {
+		payload = malloc(header.length);
+		if (fread(payload, 1, header.length, fp) == header.length) {
+			hash_bytes(sum, payload, header.length);
+			memcpy(&result, payload, sizeof(result));
+			ok = sum[0] == header.checksum[0] && sum[1] == header.checksum[1] &&
+					sizeof(result) + (uint64_t)result.num_pages * (4 + page_size) + result.output_length == header.length;
+		}
+	}
+	fclose(fp);
+	if (!ok) {
+		free(payload);
+		RCACHE.corrupt++;
+		unlink(path);
+		return NULL;
+	}
+	return payload;
+}
+
+/***************************************************************/
+/* A hit: put the run's outcome in place of running it                    */
+/***************************************************************/
+static int entry_apply(const uint8_t *payload)
+{
+	entry_result_t result;
+	const uint8_t *pages = payload + sizeof(result);
+	uint32_t address, i;
+	uint64_t len;
+
+	memcpy(&result, payload, sizeof(result));
+	for (i = 0; i < result.num_pages; i++) {
+		memcpy(&address, pages + i * (4 + page_size), 4);
+		len = page_size;
+		if (address % page_size != 0 || mem_span(address, &len) == NULL || len != page_size) {
+			return FALSE;
+		}
+	}
+	for (i = 0; i < result.num_pages; i++) {
+		memcpy(&address, pages + i * (4 + page_size), 4);
+		memcpy(MEM_BASE + address, pages + i * (4 + page_size) + 4, page_size);
+	}
+	CURRENT_STATE = result.current;
+	NEXT_STATE = result.next;
+	INSTRUCTION_COUNT += result.instructions;
+	RUN_FLAG = result.run_flag;
+	for (i = 0; i < NUM_PERF; i++) {
+		PERF[i] += result.perf[i];
+	}
+	for (i = 0; i < NUM_EXC; i++) {
+		EXC_COUNTS[i] += result.exceptions[i];
+	}
+	if (result.error[0] != '\0') {
+		memcpy(LAST_ERROR, result.error, sizeof(LAST_ERROR));
+	}
+	fwrite(pages + (uint64_t)result.num_pages * (4 + page_size), 1, result.output_length, stdout);
+	fflush(stdout);
+	return TRUE;
+}
+
+/***************************************************************/
+/* Before a run of budget instructions (0: to completion). TRUE: it */
+/* was a hit and the state is already the run's outcome. Otherwise   */
+/* a cacheable run is recorded until rcache_end(), with the console   */
+/* going to a temporary file so the output can be stored too          */
+/***************************************************************/
+int rcache_begin(uint32_t budget)
+{
+	uint32_t header[5] = { RCACHE_VERSION, page_size, budget, INSTRUCTION_COUNT, RUN_FLAG };
+	char path[512];
+	uint8_t *payload;
+	int ok;
+
+	rec.key[0] = 0xCBF29CE484222325ull;
+	rec.key[1] = 0x84222325CBF29CE4ull;
+	rec.num_pages = 0;
+	if (!cacheable(rec.key)) {
+		RCACHE.bypassed++;
+		return FALSE;
+	}
+	hash_bytes(rec.key, header, sizeof(header));
+	hash_bytes(rec.key, &CP0_ENABLED, sizeof(CP0_ENABLED));
+	hash_bytes(rec.key, &EXC_HANDLER, sizeof(EXC_HANDLER));	/* decides whether an interrupt stops the run */
+	hash_bytes(rec.key, &CURRENT_STATE, sizeof(CPU_State));
+	hash_bytes(rec.key, &NEXT_STATE, sizeof(CPU_State));
+	if (!mem_scan(key_page)) {
+		RCACHE.bypassed++;
+		return FALSE;
+	}
+	qsort(rec.pages, rec.num_pages, sizeof(page_hash_t), by_address);
+
+	entry_path(path, sizeof(path), rec.key);
+	payload = entry_read(path, rec.key);
+	if (payload != NULL) {
+		ok = entry_apply(payload);
+		free(payload);
+		if (ok) {
+			RCACHE.hits++;
+			utimensat(AT_FDCWD, path, NULL, 0);	/* most recently used */
+			return TRUE;
+		}
+		RCACHE.corrupt++;
+		unlink(path);
+	}
+
+	RCACHE.misses++;
+	fflush(stdout);
+	rec.output = tmpfile();
+	rec.saved_stdout = rec.output != NULL ? dup(STDOUT_FILENO) : -1;
+	if (rec.saved_stdout < 0) {
+		if (rec.output != NULL) {
+			fclose(rec.output);
+		}
+		return FALSE;
+	}
+	dup2(fileno(rec.output), STDOUT_FILENO);
+	rec.start_count = INSTRUCTION_COUNT;
+	memcpy(rec.perf, PERF, sizeof(rec.perf));
+	memcpy(rec.exceptions, EXC_COUNTS, sizeof(rec.exceptions));
+	memcpy(rec.error, LAST_ERROR, sizeof(rec.error));
+	LAST_ERROR[0] = '\0';
+	rec.recording = TRUE;
+	return FALSE;
+}
+
+/***************************************************************/
+/* Least recently used entries go until the directory fits             */
+/***************************************************************/
+typedef struct {
+	char name[64];
+	uint64_t size;
+	struct timespec used;
+} dir_entry_t;
+
+static int older(const void *a, const void *b)
+{
+	const struct timespec *x = &((const dir_entry_t *)a)->used, *y = &((const dir_entry_t *)b)->used;
+	if (x->tv_sec != y->tv_sec) {
+		return x->tv_sec < y->tv_sec ? -1 : 1;
+	}
+	return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+static void evict()
+{
+	dir_entry_t *entries = NULL;
+	int num_entries = 0, capacity = 0, i;
+	uint64_t total = 0;
+	char path[512];
+	struct dirent *e;
+	struct stat st;
+	DIR *dir = opendir(RCACHE.dir);
+
+	if (dir == NULL) {
+		return;
+	}
+	while ((e = readdir(dir)) != NULL) {
+		size_t len = strlen(e->d_name);
+		if (len < 4 || len >= sizeof(entries->name) || strcmp(e->d_name + len - 4, ".res")) {
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s", RCACHE.dir, e->d_name);
+		if (stat(path, &st) != 0) {
+			continue;
+		}
+		if (num_entries == capacity) {
+			capacity = capacity * 2 + 64;
+			entries = realloc(entries, capacity * sizeof(dir_entry_t));
+		}
+		strcpy(entries[num_entries].name, e->d_name);
+		entries[num_entries].size = st.st_size;
+		entries[num_entries].used = st.st_mtim;
+		total += st.st_size;
+		num_entries++;
+	}
+	closedir(dir);
+
+	if (total > RCACHE.max_bytes) {
+		qsort(entries, num_entries, sizeof(dir_entry_t), older);
+		for (i = 0; i < num_entries && total > RCACHE.max_bytes; i++) {
+			snprintf(path, sizeof(path), "%s/%s", RCACHE.dir, entries[i].name);
+			if (unlink(path) == 0) {
+				total -= entries[i].size;
+				RCACHE.evicted++;
+			}
+		}
+	}
+	free(entries);
+}
+
+/***************************************************************/
+/* After a recorded run: give the console back, then store the      */
+/* outcome (written to a temporary name and renamed into place)      */
+/***************************************************************/
+void rcache_end()
+{
+	entry_header_t header = { RCACHE_MAGIC, RCACHE_VERSION, { rec.key[0], rec.key[1] }, 0,
+		{ 0xCBF29CE484222325ull, 0x84222325CBF29CE4ull } };
+	entry_result_t result;
+	char path[512], temp[600];
+	uint8_t buffer[65536];
+	size_t n;
+	FILE *fp;
+	int i, ok;
+
+	if (!rec.recording) {
+		return;
+	}
+	rec.recording = FALSE;
+
+	memset(&result, 0, sizeof(result));
+	result.current = CURRENT_STATE;
+	result.next = NEXT_STATE;
+	result.instructions = INSTRUCTION_COUNT - rec.start_count;
+	result.run_flag = RUN_FLAG;
+	for (i = 0; i < NUM_PERF; i++) {
+		result.perf[i] = PERF[i] - rec.perf[i];
+	}
+	for (i = 0; i < NUM_EXC; i++) {
+		result.exceptions[i] = EXC_COUNTS[i] - rec.exceptions[i];
+	}
+	memcpy(result.error, LAST_ERROR, sizeof(result.error));
+	if (LAST_ERROR[0] == '\0') {
+		memcpy(LAST_ERROR, rec.error, sizeof(LAST_ERROR));
+	}
+
+	rec.length = 0;
+	rec.dirty = 0;
+	append(&result, sizeof(result));
+	ok = mem_scan(diff_page);
+	memcpy(rec.buffer + offsetof(entry_result_t, num_pages), &rec.dirty, sizeof(rec.dirty));
+
+	/* the console output: kept, and shown now */
+	fflush(stdout);
+	dup2(rec.saved_stdout, STDOUT_FILENO);
+	close(rec.saved_stdout);
+	rewind(rec.output);
+	while ((n = fread(buffer, 1, sizeof(buffer), rec.output)) > 0) {
+		fwrite(buffer, 1, n, stdout);
+		append(buffer, n);
+		result.output_length += n;
+	}
+	fclose(rec.output);
+	fflush(stdout);
+	memcpy(rec.buffer + offsetof(entry_result_t, output_length), &result.output_length, sizeof(uint32_t));
+
+	if (!ok) {
+		return;
+	}
+	header.length = rec.length;
+	hash_bytes(header.checksum, rec.buffer, rec.length);
+	entry_path(path, sizeof(path), rec.key);
+	snprintf(temp, sizeof(temp), "%s.%d.tmp", path, (int)getpid());
+	fp = fopen(temp, "wb");
+	if (fp == NULL) {
+		return;
+	}
+	ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(rec.buffer, 1, rec.length, fp) == rec.length;
+	if (fclose(fp) == 0 && ok && rename(temp, path) == 0) {
+		RCACHE.stores++;
+		evict();
+	} else {
+		unlink(temp);
+	}
+}
+
+/***************************************************************/
+/* Print the cache's counters                                                            */
+/***************************************************************/
+void rcache_print()
+{
+	if (JSON_OUTPUT) {
+		printf("{\"rcache\":%s,\"dir\":\"%s\",\"max_bytes\":%llu,\"hits\":%llu,\"misses\":%llu,\"stores\":%llu,"
+				"\"bypassed\":%llu,\"corrupt\":%llu,\"evicted\":%llu}\n", RCACHE.active ? "true" : "false", RCACHE.dir,
+				(unsigned long long)RCACHE.max_bytes, (unsigned long long)RCACHE.hits, (unsigned long long)RCACHE.misses,
+				(unsigned long long)RCACHE.stores, (unsigned long long)RCACHE.bypassed,
+				(unsigned long long)RCACHE.corrupt, (unsigned long long)RCACHE.evicted);
+		return;
+	}
+	printf("Result cache %s%s: %llu hits, %llu misses, %llu stored, %llu bypassed, %llu corrupt, %llu evicted\n",
+			RCACHE.active ? "on in " : "off", RCACHE.active ? RCACHE.dir : "",
+			(unsigned long long)RCACHE.hits, (unsigned long long)RCACHE.misses, (unsigned long long)RCACHE.stores,
+			(unsigned long long)RCACHE.bypassed, (unsigned long long)RCACHE.corrupt, (unsigned long long)RCACHE.evicted);
+}
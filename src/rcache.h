@@ -0,0 +1,37 @@
+#ifndef RCACHE_H
+#define RCACHE_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Result cache: a functional run is keyed by a hash of everything it can        */
+/* depend on (registers, every nonzero guest page, the instruction budget) and  */
+/* its outcome (final state, the pages it changed, its console output) is kept  */
+/* on disk, so rerunning the same program on the same inputs is a file read      */
+/******************************************************************************/
+#define RCACHE_MAGIC   0x4352554D	/* "MURC" */
+#define RCACHE_VERSION 1
+#define RCACHE_MAX_MB  256	/* default size limit of the directory */
+
+typedef struct {
+	int active;
+	char dir[256];
+	uint64_t max_bytes;	/* least recently used entries go beyond this */
+	uint64_t hits, misses, stores;
+	uint64_t bypassed;	/* runs something outside the key could influence */
+	uint64_t corrupt;	/* entries that failed the integrity check */
+	uint64_t evicted;
+} rcache_t;
+
+extern rcache_t RCACHE;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int rcache_open(const char *dir, uint64_t max_bytes);
+void rcache_close();
+int rcache_begin(uint32_t budget);
+void rcache_end();
+void rcache_print();
+
+#endif
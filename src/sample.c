@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "mu-mips.h"
+#include "timing.h"
+#include "sample.h"
+
+sampler_t SAMPLER;
+
+static const char *mode_names[] = { "off", "periodic", "simpoint" };
+
+/***************************************************************/
+/* Configuration                                                                                                                 */
+/***************************************************************/
+void sample_periodic(uint64_t ffwd, uint64_t warm, uint64_t detail)
+{
+	if (detail == 0) {
+		printf("Error: the detailed interval must not be empty\n");
+		return;
+	}
+	SAMPLER.mode = SAMPLE_PERIODIC;
+	SAMPLER.ffwd = ffwd;
+	SAMPLER.warm = warm;
+	SAMPLER.detail = detail;
+	sample_reset();
+}
+
+void sample_simpoint(uint64_t interval, int k, uint64_t warm)
+{
+	if (interval == 0 || k < 1 || k > MAX_SIMPOINTS) {
+		printf("Error: simpoint needs an interval and 1-%d clusters\n", MAX_SIMPOINTS);
+		return;
+	}
+	SAMPLER.mode = SAMPLE_SIMPOINT;
+	SAMPLER.interval = interval;
+	SAMPLER.k = k;
+	SAMPLER.warm = warm;
+	sample_reset();
+}
+
+void sample_off()
+{
+	SAMPLER.mode = SAMPLE_OFF;
+	sample_reset();
+}
+
+void sample_reset()
+{
+	SAMPLER.phase = PHASE_FFWD;
+	SAMPLER.phase_done = 0;
+	SAMPLER.instructions = 0;
+	SAMPLER.count = 0;
+}
+
+static void add_point(uint64_t start, double cpi, double weight)
+{
+	if (SAMPLER.count == SAMPLER.capacity) {
+		SAMPLER.capacity = SAMPLER.capacity ? 2 * SAMPLER.capacity : 64;
+		SAMPLER.points = realloc(SAMPLER.points, SAMPLER.capacity * sizeof(sample_point_t));
+	}
+	SAMPLER.points[SAMPLER.count].start = start;
+	SAMPLER.points[SAMPLER.count].cpi = cpi;
+	SAMPLER.points[SAMPLER.count].weight = weight;
+	SAMPLER.count++;
+}
+
+/***************************************************************/
+/* Execute up to n instructions, timing on or off                             */
+/***************************************************************/
+static uint64_t step(uint64_t n, int timed)
+{
+	uint64_t i;
+
+	timing_suspend(!timed);
+	for (i = 0; RUN_FLAG && i < n; i++) {
+		cycle();
+	}
+	timing_suspend(FALSE);
+	return i;
+}
+
+/***************************************************************/
+/* Periodic: ffwd, warm, detail, ffwd, ... across run() calls          */
+/***************************************************************/
+static void run_periodic(uint64_t budget)
+{
+	uint64_t length, chunk, done, total = 0;
+
+	while (RUN_FLAG && (budget == 0 || total < budget)) {
+		length = SAMPLER.phase == PHASE_FFWD ? SAMPLER.ffwd :
+			SAMPLER.phase == PHASE_WARM ? SAMPLER.warm : SAMPLER.detail;
+		chunk = length - SAMPLER.phase_done;
+		if (budget != 0 && chunk > budget - total) {
+			chunk = budget - total;
+		}
+		if (SAMPLER.phase == PHASE_DETAIL && SAMPLER.phase_done == 0) {
+			SAMPLER.detail_start = timing_cycles();
+		}
+		done = chunk ? step(chunk, SAMPLER.phase != PHASE_FFWD) : 0;
+		total += done;
+		SAMPLER.phase_done += done;
+		if (SAMPLER.phase_done < length) {
+			break;	/* out of budget or the program halted */
+		}
+		if (SAMPLER.phase == PHASE_DETAIL) {
+			add_point(INSTRUCTION_COUNT - length,
+					(double)(timing_cycles() - SAMPLER.detail_start) / length, 1);
+		}
+		SAMPLER.phase = (SAMPLER.phase + 1) % 3;
+		SAMPLER.phase_done = 0;
+	}
+	SAMPLER.instructions += total;
+}
+
+/***************************************************************/
+/* SimPoint: profile basic block vectors, cluster them, then time     */
+/* one representative interval per cluster                                              */
+/***************************************************************/
+static inline uint32_t bbv_slot(uint32_t pc)
+{
+	return ((pc >> 2) * 2654435761u) >> 27;	/* 32 == 1 << 5 slots */
+}
+
+static double distance(const float *a, const float *b)
+{
+	double d = 0;
+	int i;
+	for (i = 0; i < BBV_DIMS; i++) {
+		d += (a[i] - b[i]) * (a[i] - b[i]);
+	}
+	return d;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static int put(int fd, const void *data, size_t length)
+{
+	const uint8_t *p = data;
+	ssize_t n;
+
+	while (length > 0) {
+		n = write(fd, p, length);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return FALSE;
+		}
+		p += n;
+		length -= n;
+	}
+	return TRUE;
+}
+
+static int get(int fd, void *data, size_t length)
+{
+	uint8_t *p = data;
+	ssize_t n;
+
+	while (length > 0) {
+		n = read(fd, p, length);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return FALSE;
+		}
+		p += n;
+		length -= n;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Pass 1, in a forked child so the parent keeps the starting state */
+/* for pass 2: basic block vectors of every full interval. Returns   */
+/* the number of intervals, -1 when the child could not run.          */
+/***************************************************************/
+static int profile(uint64_t budget, float **out, uint64_t *out_executed)
+{
+	float *bbv = NULL;
+	int count = 0, capacity = 0, fds[2], status, null_fd, ok;
+	uint64_t executed = 0, block_start, block_len;
+	uint32_t pc;
+	pid_t child;
+
+	if (pipe(fds) != 0) {
+		printf("Error: Can't create a pipe for the simpoint profile\n");
+		return -1;
+	}
+	fflush(stdout);
+	child = fork();
+	if (child < 0) {
+		printf("Error: Can't fork the simpoint profile\n");
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if (child > 0) {
+		close(fds[1]);
+		ok = get(fds[0], &count, sizeof(count)) && get(fds[0], &executed, sizeof(executed));
+		if (ok && count > 0) {
+			bbv = malloc((size_t)count * BBV_DIMS * sizeof(float));
+			ok = get(fds[0], bbv, (size_t)count * BBV_DIMS * sizeof(float));
+		}
+		close(fds[0]);
+		if (waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || !ok) {
+			printf("Error: the simpoint profile failed\n");
+			free(bbv);
+			return -1;
+		}
+		*out = bbv;
+		*out_executed = executed;
+		return count;
+	}
+
+	/* the child: the program's console output belongs to pass 2 */
+	close(fds[0]);
+	null_fd = open("/dev/null", O_WRONLY);
+	if (null_fd >= 0) {
+		dup2(null_fd, STDOUT_FILENO);
+		close(null_fd);
+	}
+	block_start = CURRENT_STATE.PC;
+	block_len = 0;
+	timing_suspend(TRUE);
+	while (RUN_FLAG && (budget == 0 || executed < budget)) {
+		if (executed % SAMPLER.interval == 0) {
+			if (count == capacity) {
+				capacity = capacity ? 2 * capacity : 256;
+				bbv = realloc(bbv, capacity * BBV_DIMS * sizeof(float));
+			}
+			memset(bbv + count * BBV_DIMS, 0, BBV_DIMS * sizeof(float));
+			count++;
+		}
+		pc = CURRENT_STATE.PC;
+		cycle();
+		executed++;
+		block_len++;
+		if (CURRENT_STATE.PC != pc + 4 || executed % SAMPLER.interval == 0) {
+			bbv[(count - 1) * BBV_DIMS + bbv_slot(block_start)] += block_len;
+			block_start = CURRENT_STATE.PC;
+			block_len = 0;
+		}
+	}
+	if (executed % SAMPLER.interval != 0) {
+		count--;	/* the trailing partial interval only counts towards the total */
+	}
+	ok = put(fds[1], &count, sizeof(count)) && put(fds[1], &executed, sizeof(executed)) &&
+			put(fds[1], bbv, (size_t)count * BBV_DIMS * sizeof(float));
+	_exit(ok ? 0 : 1);
+}
+
+static void run_simpoint(uint64_t budget)
+{
+	float *bbv = NULL, *centroid, *sum;
+	int *assign, *size, count, k, i, j, c, it, best;
+	uint64_t executed = 0, len, cur, start, warm_start, c0;
+	uint64_t reps[MAX_SIMPOINTS];
+	double weight[MAX_SIMPOINTS], d, best_d;
+
+	count = profile(budget, &bbv, &executed);
+	if (count < 0) {
+		return;
+	}
+	if (count == 0) {
+		printf("Error: the program ran for less than one simpoint interval\n");
+		free(bbv);
+		return;
+	}
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < BBV_DIMS; j++) {
+			bbv[i * BBV_DIMS + j] /= SAMPLER.interval;
+		}
+	}
+
+	/* k-means, seeded with the farthest-point heuristic so results are repeatable */
+	k = SAMPLER.k < count ? SAMPLER.k : count;
+	centroid = malloc(k * BBV_DIMS * sizeof(float));
+	sum = malloc(k * BBV_DIMS * sizeof(float));
+	assign = calloc(count, sizeof(int));
+	size = malloc(k * sizeof(int));
+	memcpy(centroid, bbv, BBV_DIMS * sizeof(float));
+	for (c = 1; c < k; c++) {
+		best = 0;
+		best_d = -1;
+		for (i = 0; i < count; i++) {
+			d = INFINITY;
+			for (j = 0; j < c; j++) {
+				d = fmin(d, distance(bbv + i * BBV_DIMS, centroid + j * BBV_DIMS));
+			}
+			if (d > best_d) {
+				best_d = d;
+				best = i;
+			}
+		}
+		memcpy(centroid + c * BBV_DIMS, bbv + best * BBV_DIMS, BBV_DIMS * sizeof(float));
+	}
+	for (it = 0; it < SIMPOINT_ITERATIONS; it++) {
+		memset(sum, 0, k * BBV_DIMS * sizeof(float));
+		memset(size, 0, k * sizeof(int));
+		for (i = 0; i < count; i++) {
+			best_d = INFINITY;
+			for (c = 0; c < k; c++) {
+				d = distance(bbv + i * BBV_DIMS, centroid + c * BBV_DIMS);
+				if (d < best_d) {
+					best_d = d;
+					assign[i] = c;
+				}
+			}
+			size[assign[i]]++;
+			for (j = 0; j < BBV_DIMS; j++) {
+				sum[assign[i] * BBV_DIMS + j] += bbv[i * BBV_DIMS + j];
+			}
+		}
+		for (c = 0; c < k; c++) {
+			for (j = 0; size[c] && j < BBV_DIMS; j++) {
+				centroid[c * BBV_DIMS + j] = sum[c * BBV_DIMS + j] / size[c];
+			}
+		}
+	}
+
+	/* the interval nearest each centroid stands for its cluster */
+	len = 0;
+	for (c = 0; c < k; c++) {
+		if (size[c] == 0) {
+			continue;
+		}
+		best = -1;
+		best_d = INFINITY;
+		for (i = 0; i < count; i++) {
+			d = distance(bbv + i * BBV_DIMS, centroid + c * BBV_DIMS);
+			if (assign[i] == c && d < best_d) {
+				best_d = d;
+				best = i;
+			}
+		}
+		reps[len] = (uint64_t)best << 32 | (uint32_t)size[c];
+		len++;
+	}
+	qsort(reps, len, sizeof(uint64_t), cmp_u64);
+	for (i = 0; i < len; i++) {
+		weight[i] = (double)(reps[i] & 0xFFFFFFFF) / count;
+		reps[i] >>= 32;
+	}
+	free(bbv);
+	free(centroid);
+	free(sum);
+	free(assign);
+	free(size);
+
+	/* pass 2: from the same starting state, fast-forward to each simpoint, warm up, measure */
+	SAMPLER.instructions = executed;
+	cur = 0;
+	for (i = 0; i < len && RUN_FLAG; i++) {
+		start = reps[i] * SAMPLER.interval;
+		warm_start = start > cur + SAMPLER.warm ? start - SAMPLER.warm : cur;
+		cur += step(warm_start - cur, FALSE);
+		cur += step(start - cur, TRUE);
+		c0 = timing_cycles();
+		cur += step(SAMPLER.interval, TRUE);
+		add_point(start, (double)(timing_cycles() - c0) / SAMPLER.interval, weight[i]);
+	}
+	if (budget == 0 || cur < budget) {
+		step(budget == 0 ? UINT64_MAX : budget - cur, FALSE);
+	}
+}
+
+void sample_run(uint64_t budget)
+{
+	if (TIMING.model == TIMING_NONE) {
+		printf("Error: sampling measures a timing model; select one with timing first\n");
+		return;
+	}
+	if (SAMPLER.mode == SAMPLE_PERIODIC) {
+		run_periodic(budget);
+	} else if (SAMPLER.mode == SAMPLE_SIMPOINT) {
+		run_simpoint(budget);
+	}
+}
+
+/***************************************************************/
+/* Weighted CPI, its 95% confidence half-width, and the cycles       */
+/* they extrapolate to                                                                                                    */
+/***************************************************************/
+void sample_print(FILE *fp, int json)
+{
+	double cpi = 0, var = 0, total = 0, half;
+	int i;
+
+	if (SAMPLER.count == 0) {
+		return;
+	}
+	for (i = 0; i < SAMPLER.count; i++) {
+		total += SAMPLER.points[i].weight;
+	}
+	for (i = 0; i < SAMPLER.count; i++) {
+		cpi += SAMPLER.points[i].weight / total * SAMPLER.points[i].cpi;
+	}
+	for (i = 0; i < SAMPLER.count; i++) {
+		var += SAMPLER.points[i].weight / total * (SAMPLER.points[i].cpi - cpi) * (SAMPLER.points[i].cpi - cpi);
+	}
+	/* periodic samples are an unbiased sample of the run; for simpoints the
+	   spread between clusters is only a rough bound on the error */
+	half = SAMPLER.count > 1 ? 1.96 * sqrt(var * SAMPLER.count / (SAMPLER.count - 1) / SAMPLER.count) : 0;
+
+	if (json) {
+		fprintf(fp, ",\"sampling\":{\"mode\":\"%s\",\"samples\":%d,\"cpi\":%.4f,\"cpi_ci95\":%.4f,"
+				"\"instructions\":%llu,\"cycles\":%.0f,\"cycles_ci95\":%.0f}",
+				mode_names[SAMPLER.mode], SAMPLER.count, cpi, half,
+				(unsigned long long)SAMPLER.instructions, cpi * SAMPLER.instructions,
+				half * SAMPLER.instructions);
+		return;
+	}
+	fprintf(fp, "Sampled estimate (%s, %d samples)\n", mode_names[SAMPLER.mode], SAMPLER.count);
+	fprintf(fp, "-------------------------------------\n");
+	fprintf(fp, "CPI\t\t: %.4f +/- %.4f (95%%)\n", cpi, half);
+	fprintf(fp, "instructions\t: %llu\n", (unsigned long long)SAMPLER.instructions);
+	fprintf(fp, "cycles\t\t: %.0f +/- %.0f\n", cpi * SAMPLER.instructions, half * SAMPLER.instructions);
+	fprintf(fp, "-------------------------------------\n");
+}
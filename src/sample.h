@@ -0,0 +1,54 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/******************************************************************************/
+/* Sampled simulation: fast-forward, warm-up and detailed intervals                     */
+/******************************************************************************/
+#define SAMPLE_OFF      0
+#define SAMPLE_PERIODIC 1
+#define SAMPLE_SIMPOINT 2
+
+#define PHASE_FFWD   0	/* functional only, timing models not fed */
+#define PHASE_WARM   1	/* caches, predictors and core fed, not measured */
+#define PHASE_DETAIL 2	/* fed and measured */
+
+#define BBV_DIMS 32	/* basic block vectors are hashed down to this many entries */
+#define SIMPOINT_ITERATIONS 20
+#define MAX_SIMPOINTS 64
+
+typedef struct {
+	uint64_t start;	/* first instruction of the sample */
+	double cpi;
+	double weight;	/* fraction of the program the sample stands for */
+} sample_point_t;
+
+typedef struct {
+	int mode;
+	uint64_t ffwd, warm, detail;	/* periodic: lengths of the three phases */
+	uint64_t interval;	/* simpoint: interval length (also the detailed length) */
+	int k;	/* simpoint: number of clusters */
+
+	int phase;	/* periodic runs resume where the last run() stopped */
+	uint64_t phase_done, detail_start;
+	uint64_t instructions;	/* instructions the estimate extrapolates to */
+
+	sample_point_t *points;
+	int count, capacity;
+} sampler_t;
+
+extern sampler_t SAMPLER;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void sample_periodic(uint64_t ffwd, uint64_t warm, uint64_t detail);
+void sample_simpoint(uint64_t interval, int k, uint64_t warm);
+void sample_off();
+void sample_reset();
+void sample_run(uint64_t budget);
+void sample_print(FILE *fp, int json);
+
+#endif
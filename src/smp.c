@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "mu-mips.h"
+#include "smp.h"
+#include "guard.h"
+#include "mmio.h"
+
+hart_t HARTS[MAX_HARTS];
+int NUM_HARTS = 1;
+int SMP_MODE = SMP_LOCKSTEP;
+uint32_t SMP_QUANTUM = SMP_DEFAULT_QUANTUM;
+__thread int HART_ID;
+
+/***************************************************************/
+/* Set the number of harts and how they are scheduled                  */
+/***************************************************************/
+void smp_configure(uint32_t harts, int mode, uint32_t quantum)
+{
+	int i;
+
+	if (harts < 1 || harts > MAX_HARTS) {
+		printf("Error: number of harts must be between 1 and %d\n", MAX_HARTS);
+		return;
+	}
+	if (mode == SMP_LOCKSTEP && quantum == 0) {
+		printf("Error: lockstep quantum must be at least one instruction\n");
+		return;
+	}
+
+	/* hart 0 keeps whatever the console has set up; new harts start fresh */
+	smp_save(HART_ID);
+	for (i = NUM_HARTS; i < (int)harts; i++) {
+		memset(&HARTS[i], 0, sizeof(hart_t));
+		HARTS[i].state.PC = PROGRAM_ENTRY;
+		HARTS[i].run_flag = TRUE;
+	}
+	NUM_HARTS = harts;
+	SMP_MODE = mode;
+	SMP_QUANTUM = quantum;
+	if (HART_ID >= NUM_HARTS) {
+		smp_load(0);
+	}
+	if (NUM_HARTS > 1 && INTERACTIVE) {
+		printf("%d harts, %s", NUM_HARTS, mode == SMP_FREE ? "free running\n" : "lockstep quantum ");
+		if (mode == SMP_LOCKSTEP) {
+			printf("%u\n", quantum);
+		}
+	}
+}
+
+/***************************************************************/
+/* Restart every hart other than the current one at the entry point */
+/***************************************************************/
+void smp_reset()
+{
+	int i;
+	for (i = 0; i < NUM_HARTS; i++) {
+		if (i == HART_ID) {
+			continue;
+		}
+		memset(&HARTS[i], 0, sizeof(hart_t));
+		HARTS[i].state.PC = PROGRAM_ENTRY;
+		HARTS[i].run_flag = TRUE;
+	}
+	smp_save(HART_ID);
+}
+
+/***************************************************************/
+/* Copy the running hart out of / into thread-local state             */
+/***************************************************************/
+void smp_save(int id)
+{
+	HARTS[id].state = CURRENT_STATE;
+	HARTS[id].instruction_count = INSTRUCTION_COUNT;
+	HARTS[id].run_flag = RUN_FLAG;
+	memcpy(HARTS[id].perf, PERF, sizeof(PERF));
+}
+
+void smp_load(int id)
+{
+	HART_ID = id;
+	CURRENT_STATE = HARTS[id].state;
+	NEXT_STATE = CURRENT_STATE;
+	INSTRUCTION_COUNT = HARTS[id].instruction_count;
+	RUN_FLAG = HARTS[id].run_flag;
+	memcpy(PERF, HARTS[id].perf, sizeof(PERF));
+}
+
+/***************************************************************/
+/* Make hart <id> the one seen by the console commands                 */
+/***************************************************************/
+void smp_select(uint32_t id)
+{
+	if (id >= (uint32_t)NUM_HARTS) {
+		printf("Error: hart %u does not exist (%d harts)\n", id, NUM_HARTS);
+		return;
+	}
+	smp_save(HART_ID);
+	smp_load(id);
+}
+
+/***************************************************************/
+/* Run the hart in thread-local state for up to n instructions        */
+/***************************************************************/
+static void hart_run(uint32_t n)
+{
+	uint32_t i;
+	for (i = 0; i < n && RUN_FLAG; i++) {
+		cycle();
+	}
+}
+
+typedef struct {
+	int id;
+	uint32_t num_cycles;
+} hart_job_t;
+
+static void *hart_thread(void *arg)
+{
+	hart_job_t *job = arg;
+
+	smp_load(job->id);
+	if (job->num_cycles == 0) {
+		while (RUN_FLAG) {
+			cycle();
+		}
+	} else {
+		hart_run(job->num_cycles);
+	}
+	smp_save(job->id);
+	return NULL;
+}
+
+/***************************************************************/
+/* Run every hart for n instructions (0 = until all have halted)      */
+/***************************************************************/
+void smp_run(uint32_t num_cycles)
+{
+	int i, running, selected = HART_ID;
+	uint32_t done = 0, slice;
+
+	if (SMP_MODE == SMP_FREE && MMIO_ACTIVE) {
+		/* a window lent to one thread's trapping access is visible to all */
+		printf("Error: free-running harts can't share devices; use lockstep\n");
+		return;
+	}
+	smp_save(selected);
+
+	if (SMP_MODE == SMP_FREE) {
+		pthread_t threads[MAX_HARTS];
+		hart_job_t jobs[MAX_HARTS];
+		for (i = 0; i < NUM_HARTS; i++) {
+			jobs[i].id = i;
+			jobs[i].num_cycles = num_cycles;
+			if (pthread_create(&threads[i], NULL, hart_thread, &jobs[i]) != 0) {
+				printf("Error: can't start host thread for hart %d\n", i);
+				exit(-1);
+			}
+		}
+		for (i = 0; i < NUM_HARTS; i++) {
+			pthread_join(threads[i], NULL);
+		}
+	} else {
+		/* harts take turns in fixed quanta, so every run is reproducible */
+		do {
+			slice = SMP_QUANTUM;
+			if (num_cycles != 0 && num_cycles - done < slice) {
+				slice = num_cycles - done;
+			}
+			running = 0;
+			for (i = 0; i < NUM_HARTS; i++) {
+				if (!HARTS[i].run_flag) {
+					continue;
+				}
+				smp_load(i);
+				hart_run(slice);
+				smp_save(i);
+				running |= RUN_FLAG;
+			}
+			done += slice;
+		} while (running && (num_cycles == 0 || done < num_cycles));
+	}
+
+	smp_load(selected);
+}
+
+/***************************************************************/
+/* SC: store only if the word still holds the value LL linked        */
+/***************************************************************/
+uint32_t smp_store_conditional(uint32_t address, uint32_t value)
+{
+	uint32_t *word = (uint32_t *)(MEM_BASE + address);
+	uint32_t expected = CURRENT_STATE.LL_VALUE;
+
+	if (address & 3) {
+		return 0;
+	}
+	/* an unmapped word traps in the guard pages even when the SC would fail */
+	(void)__atomic_load_n(word, __ATOMIC_RELAXED);
+	if (!CURRENT_STATE.LL_BIT || address != CURRENT_STATE.LL_ADDR) {
+		return 0;
+	}
+	/* guest memory is little endian like the host, so the word can be swapped in place */
+	return __atomic_compare_exchange_n(word, &expected, value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
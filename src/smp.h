@@ -0,0 +1,41 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+
+#include "counters.h"
+
+/******************************************************************************/
+/* Multi-hart simulation: N harts share MEM_REGIONS, each with its own state  */
+/******************************************************************************/
+#define MAX_HARTS 64
+#define SMP_DEFAULT_QUANTUM 1000
+
+#define SMP_LOCKSTEP 0	/* deterministic round robin on the calling thread */
+#define SMP_FREE     1	/* every hart on its own host thread */
+
+typedef struct {
+	CPU_State state;
+	uint32_t instruction_count;
+	int run_flag;
+	uint64_t perf[NUM_PERF];
+} hart_t;
+
+extern hart_t HARTS[MAX_HARTS];
+extern int NUM_HARTS;
+extern int SMP_MODE;
+extern uint32_t SMP_QUANTUM;
+extern __thread int HART_ID;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void smp_configure(uint32_t harts, int mode, uint32_t quantum);
+void smp_reset();
+void smp_select(uint32_t id);
+void smp_save(int id);
+void smp_load(int id);
+void smp_run(uint32_t num_cycles);
+uint32_t smp_store_conditional(uint32_t address, uint32_t value);
+
+#endif
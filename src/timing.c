@@ -0,0 +1,400 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "timing.h"
+#include "pipeline.h"
+#include "ooo.h"
+#include "cache.h"
+#include "bpred.h"
+#include "trace.h"
+#include "memprof.h"
+
+timing_ctx_t TIMING;
+int TIMING_ACTIVE;
+
+/***************************************************************/
+/* Register reads/writes and class of an instruction word               */
+/***************************************************************/
+void decode_deps(uint32_t instruction, inst_deps_t *d)
+{
+	uint32_t opcode = (instruction & 0xFC000000) >> 26;
+	uint32_t function = instruction & 0x0000003F;
+	uint8_t rs = (instruction & 0x03E00000) >> 21;
+	uint8_t rt = (instruction & 0x001F0000) >> 16;
+	uint8_t rd = (instruction & 0x0000F800) >> 11;
+
+	d->src[0] = d->src[1] = DEP_NONE;
+	d->dst[0] = d->dst[1] = DEP_NONE;
+	d->flags = 0;
+
+	if (opcode == 0x00) {
+		switch (function) {
+			case 0x00: case 0x02: case 0x03: //SLL, SRL, SRA
+				d->src[0] = rt; d->dst[0] = rd;
+				break;
+			case 0x08: //JR
+				d->src[0] = rs;
+				d->flags = INST_JUMP_REG | (rs == 31 ? INST_RETURN : 0);
+				break;
+			case 0x09: //JALR
+				d->src[0] = rs; d->dst[0] = rd;
+				d->flags = INST_JUMP_REG | INST_CALL;
+				break;
+			case 0x0C: //SYSCALL
+				d->src[0] = 2;
+				d->flags = INST_SYSCALL;
+				break;
+			case 0x10: d->src[0] = DEP_HI; d->dst[0] = rd; break; //MFHI
+			case 0x12: d->src[0] = DEP_LO; d->dst[0] = rd; break; //MFLO
+			case 0x11: d->src[0] = rs; d->dst[0] = DEP_HI; break; //MTHI
+			case 0x13: d->src[0] = rs; d->dst[0] = DEP_LO; break; //MTLO
+			case 0x18: case 0x19: case 0x1A: case 0x1B: //MULT, MULTU, DIV, DIVU
+				d->src[0] = rs; d->src[1] = rt;
+				d->dst[0] = DEP_HI; d->dst[1] = DEP_LO;
+				d->flags = function >= 0x1A ? INST_DIV : INST_MULT;
+				break;
+			default: //ADD..SLT
+				d->src[0] = rs; d->src[1] = rt; d->dst[0] = rd;
+				break;
+		}
+	} else {
+		switch (opcode) {
+			case 0x01: //BLTZ, BGEZ
+			case 0x06: case 0x07: //BLEZ, BGTZ
+				d->src[0] = rs;
+				d->flags = INST_BRANCH;
+				break;
+			case 0x02: //J
+				d->flags = INST_JUMP;
+				break;
+			case 0x03: //JAL
+				d->dst[0] = 31;
+				d->flags = INST_JUMP | INST_CALL;
+				break;
+			case 0x04: case 0x05: //BEQ, BNE
+				d->src[0] = rs; d->src[1] = rt;
+				d->flags = INST_BRANCH;
+				break;
+			case 0x0F: //LUI
+				d->dst[0] = rt;
+				break;
+			case 0x11: //COP1
+				switch (rs) {
+					case 0x00: d->src[0] = DEP_FPR + rd; d->dst[0] = rt; break; //MFC1
+					case 0x02: d->src[0] = DEP_FCSR; d->dst[0] = rt; break; //CFC1
+					case 0x04: d->src[0] = rt; d->dst[0] = DEP_FPR + rd; break; //MTC1
+					case 0x06: d->src[0] = rt; d->dst[0] = DEP_FCSR; break; //CTC1
+					case 0x08: d->src[0] = DEP_FCSR; d->flags = INST_BRANCH; break; //BC1F, BC1T
+					default:
+						d->src[0] = DEP_FPR + rd;
+						if (function <= 0x03 || function >= 0x30) {
+							d->src[1] = DEP_FPR + rt;
+						}
+						d->dst[0] = function >= 0x30 ? DEP_FCSR : DEP_FPR + ((instruction >> 6) & 0x1F);
+						if (function == 0x02) {
+							d->flags = INST_MULT;
+						} else if (function == 0x03 || function == 0x04) { //DIV, SQRT
+							d->flags = INST_DIV;
+						}
+						break;
+				}
+				break;
+			case 0x31: case 0x35: //LWC1, LDC1
+				d->src[0] = rs; d->dst[0] = DEP_FPR + rt;
+				d->flags = INST_LOAD;
+				break;
+			case 0x39: case 0x3D: //SWC1, SDC1
+				d->src[0] = rs; d->src[1] = DEP_FPR + rt;
+				d->flags = INST_STORE;
+				break;
+			case 0x1F: //RDHWR
+				d->dst[0] = rt;
+				break;
+			case 0x20: case 0x21: case 0x23: case 0x30: //LB, LH, LW, LL
+				d->src[0] = rs; d->dst[0] = rt;
+				d->flags = INST_LOAD;
+				break;
+			case 0x28: case 0x29: case 0x2B: //SB, SH, SW
+				d->src[0] = rs; d->src[1] = rt;
+				d->flags = INST_STORE;
+				break;
+			case 0x38: //SC
+				d->src[0] = rs; d->src[1] = rt; d->dst[0] = rt;
+				d->flags = INST_STORE;
+				break;
+			default: //immediate ALU
+				d->src[0] = rs; d->dst[0] = rt;
+				break;
+		}
+	}
+	/* $zero never carries a dependence */
+	if (d->src[0] == 0) d->src[0] = DEP_NONE;
+	if (d->src[1] == 0) d->src[1] = DEP_NONE;
+	if (d->dst[0] == 0) d->dst[0] = DEP_NONE;
+}
+
+/***************************************************************/
+/* Switch a context's model ("off", "pipeline", "ooo") with a spec  */
+/***************************************************************/
+int timing_ctx_select(timing_ctx_t *ctx, const char *model, const char *spec)
+{
+	if (!strcmp(model, "off")) {
+		ctx->model = TIMING_NONE;
+	} else if (!strcmp(model, "pipeline")) {
+		pipeline_t *p = pipeline_create(spec);
+		if (p == NULL) {
+			return FALSE;
+		}
+		pipeline_destroy(ctx->pipeline);
+		ctx->pipeline = p;
+		ctx->model = TIMING_PIPELINE;
+	} else if (!strcmp(model, "ooo")) {
+		ooo_t *o = ooo_create(spec);
+		if (o == NULL) {
+			return FALSE;
+		}
+		ooo_destroy(ctx->ooo);
+		ctx->ooo = o;
+		ctx->model = TIMING_OOO;
+	} else {
+		printf("Error: unknown timing model %s\n", model);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Attach a cache hierarchy ("off" detaches it)                               */
+/***************************************************************/
+int timing_ctx_caches(timing_ctx_t *ctx, const char *spec)
+{
+	cache_hier_t *h = NULL;
+
+	if (spec == NULL || strcmp(spec, "off") != 0) {
+		h = cache_hier_create(spec);
+		if (h == NULL) {
+			return FALSE;
+		}
+	}
+	cache_hier_destroy(ctx->caches);
+	ctx->caches = h;
+	return TRUE;
+}
+
+/***************************************************************/
+/* Attach a branch predictor ("off" detaches it)                             */
+/***************************************************************/
+int timing_ctx_bpred(timing_ctx_t *ctx, const char *spec)
+{
+	bpred_t *bp = NULL;
+
+	if (spec == NULL || strcmp(spec, "off") != 0) {
+		bp = bpred_create(spec);
+		if (bp == NULL) {
+			return FALSE;
+		}
+	}
+	bpred_destroy(ctx->bpred);
+	ctx->bpred = bp;
+	return TRUE;
+}
+
+/***************************************************************/
+/* Attach the memory access analyzer ("off" detaches it)             */
+/***************************************************************/
+int timing_ctx_memprof(timing_ctx_t *ctx, const char *spec)
+{
+	memprof_t *m = NULL;
+
+	if (spec == NULL || strcmp(spec, "off") != 0) {
+		m = memprof_create(spec);
+		if (m == NULL) {
+			return FALSE;
+		}
+	}
+	memprof_destroy(ctx->memprof);
+	ctx->memprof = m;
+	return TRUE;
+}
+
+void timing_ctx_destroy(timing_ctx_t *ctx)
+{
+	pipeline_destroy(ctx->pipeline);
+	ooo_destroy(ctx->ooo);
+	cache_hier_destroy(ctx->caches);
+	bpred_destroy(ctx->bpred);
+	memprof_destroy(ctx->memprof);
+	memset(ctx, 0, sizeof(*ctx));
+}
+
+/***************************************************************/
+/* cycle() only publishes RETIRED when something consumes it      */
+/***************************************************************/
+static void timing_refresh()
+{
+	TIMING_ACTIVE = TIMING.model != TIMING_NONE || TIMING.caches != NULL || TIMING.bpred != NULL
+		|| TIMING.memprof != NULL || trace_recording();
+}
+
+/* fast-forwarding skips the models without detaching them */
+void timing_suspend(int suspend)
+{
+	if (suspend) {
+		TIMING_ACTIVE = FALSE;
+	} else {
+		timing_refresh();
+	}
+}
+
+int timing_select(const char *model, const char *spec)
+{
+	int ok = timing_ctx_select(&TIMING, model, spec);
+	timing_refresh();
+	return ok;
+}
+
+int timing_caches(const char *spec)
+{
+	int ok = timing_ctx_caches(&TIMING, spec);
+	timing_refresh();
+	return ok;
+}
+
+int timing_bpred(const char *spec)
+{
+	int ok = timing_ctx_bpred(&TIMING, spec);
+	timing_refresh();
+	return ok;
+}
+
+int timing_memprof(const char *spec)
+{
+	int ok = timing_ctx_memprof(&TIMING, spec);
+	timing_refresh();
+	return ok;
+}
+
+int timing_record(const char *path)
+{
+	int ok = path != NULL ? trace_open(path) : (trace_close(), TRUE);
+	timing_refresh();
+	return ok;
+}
+
+/***************************************************************/
+/* Feed one retired instruction to every model of a context           */
+/***************************************************************/
+void timing_ctx_retire(timing_ctx_t *ctx, const inst_record_t *r)
+{
+	uint32_t fetch_stall = 0, mem_stall = 0;
+	int bp = BP_NONE;
+	inst_deps_t d;
+
+	decode_deps(r->instruction, &d);
+	if (ctx->caches != NULL) {
+		fetch_stall = cache_fetch(ctx->caches, r->pc);
+		if (d.flags & (INST_LOAD | INST_STORE)) {
+			mem_stall = cache_data(ctx->caches, r->pc, r->mem_addr, (d.flags & INST_STORE) != 0);
+		}
+	}
+	if (ctx->bpred != NULL && (d.flags & (INST_BRANCH | INST_JUMP | INST_JUMP_REG))) {
+		bp = bpred_retire(ctx->bpred, r, d.flags);
+	}
+	if (ctx->memprof != NULL) {
+		memprof_retire(ctx->memprof, r, d.flags);
+	}
+	switch (ctx->model) {
+		case TIMING_PIPELINE:
+			pipeline_retire(ctx->pipeline, r, &d, fetch_stall, mem_stall, bp);
+			break;
+		case TIMING_OOO:
+			ooo_retire(ctx->ooo, r, &d, fetch_stall, mem_stall, bp);
+			break;
+	}
+}
+
+void timing_retire(const inst_record_t *r)
+{
+	if (trace_recording()) {
+		trace_write(r);
+	}
+	if (TIMING.model != TIMING_NONE || TIMING.caches != NULL || TIMING.bpred != NULL
+			|| TIMING.memprof != NULL) {
+		timing_ctx_retire(&TIMING, r);
+	}
+}
+
+/***************************************************************/
+/* Restart the models' clocks (configuration is kept)                     */
+/***************************************************************/
+void timing_ctx_clear(timing_ctx_t *ctx)
+{
+	if (ctx->pipeline != NULL) {
+		pipeline_clear(ctx->pipeline);
+	}
+	if (ctx->ooo != NULL) {
+		ooo_clear(ctx->ooo);
+	}
+	if (ctx->caches != NULL) {
+		cache_hier_clear(ctx->caches);
+	}
+	if (ctx->bpred != NULL) {
+		bpred_clear(ctx->bpred);
+	}
+	if (ctx->memprof != NULL) {
+		memprof_clear(ctx->memprof);
+	}
+}
+
+void timing_reset()
+{
+	timing_ctx_clear(&TIMING);
+}
+
+uint64_t timing_ctx_cycles(timing_ctx_t *ctx)
+{
+	switch (ctx->model) {
+		case TIMING_PIPELINE:
+			return pipeline_cycles(ctx->pipeline);
+		case TIMING_OOO:
+			return ooo_cycles(ctx->ooo);
+	}
+	return 0;
+}
+
+uint64_t timing_cycles()
+{
+	return timing_ctx_cycles(&TIMING);
+}
+
+/***************************************************************/
+/* Append the models' reports to the stats output                           */
+/***************************************************************/
+void timing_ctx_print(timing_ctx_t *ctx, FILE *fp, int json)
+{
+	switch (ctx->model) {
+		case TIMING_PIPELINE:
+			pipeline_print(ctx->pipeline, fp, json);
+			break;
+		case TIMING_OOO:
+			ooo_print(ctx->ooo, fp, json);
+			break;
+	}
+	if (ctx->caches != NULL) {
+		cache_hier_print(ctx->caches, fp, json);
+	}
+	if (ctx->bpred != NULL) {
+		bpred_print(ctx->bpred, fp, json);
+	}
+	if (ctx->memprof != NULL) {
+		memprof_print(ctx->memprof, fp, json);
+	}
+}
+
+void timing_print(FILE *fp, int json)
+{
+	timing_ctx_print(&TIMING, fp, json);
+}
@@ -0,0 +1,84 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+/******************************************************************************/
+/* Timing models driven by the functional core (one inst_record_t per instruction) */
+/******************************************************************************/
+#define TIMING_NONE     0
+#define TIMING_PIPELINE 1
+#define TIMING_OOO      2
+
+/* register operands as seen by the timing models; HI/LO get their own slots */
+#define DEP_NONE 0xFF
+#define DEP_HI   32
+#define DEP_LO   33
+#define DEP_FPR  34	/* FPR n is DEP_FPR + n; a double is tracked by its even register */
+#define DEP_FCSR 66	/* rounding mode and the condition bit */
+#define NUM_DEP_REGS 67
+
+#define INST_LOAD    0x001
+#define INST_STORE   0x002
+#define INST_BRANCH  0x004	/* conditional branch */
+#define INST_JUMP    0x008	/* J/JAL: target known at decode */
+#define INST_JUMP_REG 0x010	/* JR/JALR: target read from a register */
+#define INST_MULT    0x020
+#define INST_DIV     0x040
+#define INST_CALL    0x080	/* JAL/JALR */
+#define INST_RETURN  0x100	/* JR $ra */
+#define INST_SYSCALL 0x200
+
+typedef struct {
+	uint8_t src[2];
+	uint8_t dst[2];
+	uint16_t flags;
+} inst_deps_t;
+
+struct pipeline;
+struct ooo;
+struct cache_hier;
+struct bpred;
+struct memprof;
+
+/* one set of models fed by the same instruction stream */
+typedef struct {
+	int model;	/* TIMING_NONE, TIMING_PIPELINE or TIMING_OOO */
+	struct pipeline *pipeline;
+	struct ooo *ooo;
+	struct cache_hier *caches;	/* NULL when caches are off */
+	struct bpred *bpred;	/* NULL when branch prediction is off */
+	struct memprof *memprof;	/* NULL when the access analyzer is off */
+} timing_ctx_t;
+
+extern timing_ctx_t TIMING;
+extern int TIMING_ACTIVE;	/* any model attached or a trace recording: cycle() must publish RETIRED */
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void decode_deps(uint32_t instruction, inst_deps_t *d);
+int timing_ctx_select(timing_ctx_t *ctx, const char *model, const char *spec);
+int timing_ctx_caches(timing_ctx_t *ctx, const char *spec);
+int timing_ctx_bpred(timing_ctx_t *ctx, const char *spec);
+int timing_ctx_memprof(timing_ctx_t *ctx, const char *spec);
+void timing_ctx_clear(timing_ctx_t *ctx);
+void timing_ctx_destroy(timing_ctx_t *ctx);
+int timing_select(const char *model, const char *spec);
+int timing_caches(const char *spec);
+int timing_bpred(const char *spec);
+int timing_memprof(const char *spec);
+int timing_record(const char *path);
+void timing_suspend(int suspend);
+void timing_ctx_retire(timing_ctx_t *ctx, const inst_record_t *r);
+void timing_ctx_print(timing_ctx_t *ctx, FILE *fp, int json);
+uint64_t timing_ctx_cycles(timing_ctx_t *ctx);
+void timing_retire(const inst_record_t *r);
+void timing_reset();
+uint64_t timing_cycles();
+void timing_print(FILE *fp, int json);
+
+#endif
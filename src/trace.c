@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mu-mips.h"
+#include "timing.h"
+#include "trace.h"
+
+static FILE *trace_fp;
+static char trace_path[256];
+static uint8_t *trace_buf;
+static size_t trace_len;
+static uint64_t trace_records, trace_bytes;
+static trace_codec_t trace_enc;
+
+/***************************************************************/
+/* Varints: 7 bits per byte, high bit set while more follow          */
+/***************************************************************/
+static inline uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+	while (v >= 0x80) {
+		*p++ = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return p;
+}
+
+/* NULL when the varint runs past end or beyond the 5 bytes a word needs */
+static inline const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint32_t *v)
+{
+	int shift;
+
+	*v = 0;
+	for (shift = 0; p < end && shift < 35; shift += 7) {
+		*v |= (uint32_t)(*p & 0x7F) << shift;
+		if (!(*p++ & 0x80)) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static inline uint32_t zigzag(int32_t v)
+{
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v)
+{
+	return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+/***************************************************************/
+/* Recording                                                                                                                       */
+/***************************************************************/
+static void trace_flush()
+{
+	fwrite(trace_buf, 1, trace_len, trace_fp);
+	trace_bytes += trace_len;
+	trace_len = 0;
+}
+
+int trace_open(const char *path)
+{
+	trace_close();
+	trace_fp = fopen(path, "wb");
+	if (trace_fp == NULL) {
+		printf("Error: Can't open trace file %s\n", path);
+		return FALSE;
+	}
+	if (trace_buf == NULL) {
+		trace_buf = malloc(TRACE_BUFFER);
+		atexit(trace_close);
+	}
+	snprintf(trace_path, sizeof(trace_path), "%s", path);
+	memset(&trace_enc, 0, sizeof(trace_enc));
+	fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), trace_fp);
+	trace_bytes = strlen(TRACE_MAGIC);
+	trace_records = 0;
+	trace_len = 0;
+	return TRUE;
+}
+
+void trace_close()
+{
+	if (trace_fp == NULL) {
+		return;
+	}
+	trace_flush();
+	fclose(trace_fp);
+	trace_fp = NULL;
+	if (INTERACTIVE) {
+		printf("Recorded %llu instructions to %s (%llu bytes, %.2f bytes/instruction)\n",
+				(unsigned long long)trace_records, trace_path, (unsigned long long)trace_bytes,
+				trace_records ? (double)trace_bytes / trace_records : 0);
+	}
+}
+
+int trace_recording()
+{
+	return trace_fp != NULL;
+}
+
+void trace_write(const inst_record_t *r)
+{
+	trace_codec_t *c = &trace_enc;
+	uint32_t slot = (r->pc >> 2) & (TRACE_WORDS - 1);
+	uint8_t *flags, *p;
+
+	if (trace_len > TRACE_BUFFER - 32) {
+		trace_flush();
+	}
+	flags = p = trace_buf + trace_len;
+	*p++ = 0;
+	if (r->pc != c->expected) {
+		*flags |= TR_PC;
+		p = put_varint(p, r->pc);
+	}
+	if (c->tags[slot] != r->pc || c->words[slot] != r->instruction) {
+		*flags |= TR_INST;
+		memcpy(p, &r->instruction, 4);
+		p += 4;
+		c->tags[slot] = r->pc;
+		c->words[slot] = r->instruction;
+	}
+	if ((r->instruction >> 26) >= 0x20) {	/* loads and stores */
+		*flags |= TR_MEM;
+		p = put_varint(p, zigzag(r->mem_addr - c->last_mem));
+		c->last_mem = r->mem_addr;
+	}
+	if (r->next_pc != r->pc + 4) {
+		*flags |= TR_JUMP;
+		p = put_varint(p, zigzag(r->next_pc - r->pc));
+	}
+	c->expected = r->next_pc;
+	trace_len = p - trace_buf;
+	trace_records++;
+}
+
+/***************************************************************/
+/* Decode one record; returns the position of the next one, NULL    */
+/* for a record cut short by end (a recording killed mid-write)       */
+/***************************************************************/
+static const uint8_t *trace_read(trace_codec_t *c, const uint8_t *p, const uint8_t *end, inst_record_t *r)
+{
+	uint8_t flags = *p++;
+	uint32_t v, slot;
+
+	r->pc = c->expected;
+	if ((flags & TR_PC) && (p = get_varint(p, end, &r->pc)) == NULL) {
+		return NULL;
+	}
+	slot = (r->pc >> 2) & (TRACE_WORDS - 1);
+	if (flags & TR_INST) {
+		if (end - p < 4) {
+			return NULL;
+		}
+		memcpy(&c->words[slot], p, 4);
+		c->tags[slot] = r->pc;
+		p += 4;
+	}
+	r->instruction = c->words[slot];
+	if (flags & TR_MEM) {
+		if ((p = get_varint(p, end, &v)) == NULL) {
+			return NULL;
+		}
+		c->last_mem += unzigzag(v);
+	}
+	r->mem_addr = c->last_mem;
+	r->next_pc = r->pc + 4;
+	if (flags & TR_JUMP) {
+		if ((p = get_varint(p, end, &v)) == NULL) {
+			return NULL;
+		}
+		r->next_pc = r->pc + unzigzag(v);
+	}
+	c->expected = r->next_pc;
+	return p;
+}
+
+/***************************************************************/
+/* Replay                                                                                                                           */
+/***************************************************************/
+typedef struct {
+	char text[MAX_CMD_LINE];
+	timing_ctx_t ctx;
+	uint64_t instructions;
+} replay_config_t;
+
+typedef struct {
+	const uint8_t *begin, *end;
+	replay_config_t *configs;
+	int count, first, stride;
+	const uint8_t *truncated;	/* the record decoding stopped at, NULL: read to the end */
+} replay_job_t;
+
+/* one thread decodes the trace once and feeds each of its configurations */
+static void *replay_worker(void *arg)
+{
+	replay_job_t *job = arg;
+	trace_codec_t *codec = calloc(1, sizeof(trace_codec_t));
+	const uint8_t *p = job->begin;
+	inst_record_t r;
+	uint64_t n = 0;
+	int i;
+
+	while (p < job->end) {
+		job->truncated = p;
+		if ((p = trace_read(codec, p, job->end, &r)) == NULL) {
+			break;
+		}
+		job->truncated = NULL;
+		for (i = job->first; i < job->count; i += job->stride) {
+			timing_ctx_retire(&job->configs[i].ctx, &r);
+		}
+		n++;
+	}
+	for (i = job->first; i < job->count; i += job->stride) {
+		job->configs[i].instructions = n;
+	}
+	free(codec);
+	return NULL;
+}
+
+/* "timing <model> [spec]; cache [spec]; bpred [spec]; memprof [spec]" builds one context */
+static int replay_parse(replay_config_t *cfg)
+{
+	char line[MAX_CMD_LINE], *cmd, *save_cmd, *argv[3], *save_arg, *tok;
+	int argc, ok;
+
+	snprintf(line, sizeof(line), "%s", cfg->text);
+	for (cmd = strtok_r(line, ";", &save_cmd); cmd != NULL; cmd = strtok_r(NULL, ";", &save_cmd)) {
+		argc = 0;
+		for (tok = strtok_r(cmd, " \t", &save_arg); tok != NULL; tok = strtok_r(NULL, " \t", &save_arg)) {
+			if (argc == 3) {
+				printf("Error: too many arguments in replay configuration %s\n", cfg->text);
+				return FALSE;
+			}
+			argv[argc++] = tok;
+		}
+		if (argc == 0) {
+			continue;
+		}
+		if (!strcmp(argv[0], "timing") && (argc == 2 || argc == 3)) {
+			ok = timing_ctx_select(&cfg->ctx, argv[1], argc == 3 ? argv[2] : NULL);
+		} else if (!strcmp(argv[0], "cache") && argc <= 2) {
+			ok = timing_ctx_caches(&cfg->ctx, argc == 2 ? argv[1] : NULL);
+		} else if (!strcmp(argv[0], "bpred") && argc <= 2) {
+			ok = timing_ctx_bpred(&cfg->ctx, argc == 2 ? argv[1] : NULL);
+		} else if (!strcmp(argv[0], "memprof") && argc <= 2) {
+			ok = timing_ctx_memprof(&cfg->ctx, argc == 2 ? argv[1] : NULL);
+		} else {
+			printf("Error: bad replay configuration command %s\n", argv[0]);
+			ok = FALSE;
+		}
+		if (!ok) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+int trace_replay(const char *trace, const char *configs)
+{
+	replay_config_t *cfg;
+	replay_job_t *jobs;
+	pthread_t *threads;
+	struct stat st;
+	uint8_t *data;
+	char line[MAX_CMD_LINE], *s;
+	FILE *fp;
+	int fd, count = 0, nthreads, i, ok = TRUE;
+	size_t magic = strlen(TRACE_MAGIC);
+
+	if (trace_fp != NULL && !strcmp(trace, trace_path)) {
+		trace_close();	/* replaying what is being recorded: finish it first */
+	}
+	fp = fopen(configs, "r");
+	if (fp == NULL) {
+		printf("Error: Can't open configuration file %s\n", configs);
+		return FALSE;
+	}
+	cfg = calloc(MAX_REPLAY_CONFIGS, sizeof(replay_config_t));
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		line[strcspn(line, "\r\n")] = '\0';
+		for (s = line; *s == ' ' || *s == '\t'; s++);
+		if (*s == '\0' || *s == '#') {
+			continue;
+		}
+		if (count == MAX_REPLAY_CONFIGS) {
+			printf("Error: at most %d replay configurations\n", MAX_REPLAY_CONFIGS);
+			ok = FALSE;
+			break;
+		}
+		snprintf(cfg[count].text, sizeof(cfg[count].text), "%s", s);
+		for (s = cfg[count].text; *s != '\0'; s++) {
+			if (*s == '"' || *s == '\\') {
+				*s = '\'';	/* keeps the JSON output well formed */
+			}
+		}
+		if (!replay_parse(&cfg[count])) {
+			ok = FALSE;
+			break;
+		}
+		count++;
+	}
+	fclose(fp);
+
+	data = MAP_FAILED;
+	if (ok) {
+		fd = open(trace, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < magic) {
+			printf("Error: Can't open trace file %s\n", trace);
+			ok = FALSE;
+		} else {
+			data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data == MAP_FAILED || memcmp(data, TRACE_MAGIC, magic) != 0) {
+				printf("Error: %s is not a trace file\n", trace);
+				ok = FALSE;
+			}
+		}
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+
+	if (ok && count > 0) {
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (nthreads > count) nthreads = count;
+		if (nthreads < 1) nthreads = 1;
+		jobs = calloc(nthreads, sizeof(replay_job_t));
+		threads = calloc(nthreads, sizeof(pthread_t));
+		for (i = 0; i < nthreads; i++) {
+			jobs[i].begin = data + magic;
+			jobs[i].end = data + st.st_size;
+			jobs[i].configs = cfg;
+			jobs[i].count = count;
+			jobs[i].first = i;
+			jobs[i].stride = nthreads;
+			pthread_create(&threads[i], NULL, replay_worker, &jobs[i]);
+		}
+		for (i = 0; i < nthreads; i++) {
+			pthread_join(threads[i], NULL);
+		}
+		if (jobs[0].truncated != NULL) {
+			printf("Error: %s ends in a partial record at byte %llu; the results cover the complete ones\n",
+					trace, (unsigned long long)(jobs[0].truncated - data));
+			ok = FALSE;
+		}
+		free(jobs);
+		free(threads);
+
+		for (i = 0; i < count; i++) {
+			if (JSON_OUTPUT) {
+				printf("{\"replay\":%d,\"config\":\"%s\",\"instructions\":%llu,\"cycles\":%llu",
+						i, cfg[i].text, (unsigned long long)cfg[i].instructions,
+						(unsigned long long)timing_ctx_cycles(&cfg[i].ctx));
+				timing_ctx_print(&cfg[i].ctx, stdout, TRUE);
+				printf("}\n");
+			} else {
+				printf("=====================================\n");
+				printf("Replay %d: %s\n", i, cfg[i].text);
+				printf("instructions\t: %llu\n", (unsigned long long)cfg[i].instructions);
+				printf("cycles\t\t: %llu\n", (unsigned long long)timing_ctx_cycles(&cfg[i].ctx));
+				timing_ctx_print(&cfg[i].ctx, stdout, FALSE);
+			}
+		}
+	}
+	if (data != MAP_FAILED) {
+		munmap(data, st.st_size);
+	}
+	for (i = 0; i < MAX_REPLAY_CONFIGS; i++) {
+		timing_ctx_destroy(&cfg[i].ctx);
+	}
+	free(cfg);
+	return ok;
+}
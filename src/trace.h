@@ -0,0 +1,39 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+/******************************************************************************/
+/* Compressed instruction trace: record once, replay into many timing configs */
+/******************************************************************************/
+#define TRACE_MAGIC "MUTRACE1"
+
+/* each record is a flag byte followed by the fields it announces, in this order */
+#define TR_PC   0x01	/* varint pc: the record does not follow the previous next_pc */
+#define TR_INST 0x02	/* 4-byte instruction word: not the cached word for this pc */
+#define TR_MEM  0x04	/* zigzag varint delta from the previous memory address */
+#define TR_JUMP 0x08	/* zigzag varint next_pc - pc: control flow left the fall-through */
+
+#define TRACE_WORDS 4096	/* instruction words remembered per pc slot, same on both ends */
+#define TRACE_BUFFER (1 << 20)
+#define MAX_REPLAY_CONFIGS 256
+
+typedef struct {
+	uint32_t expected;	/* next_pc of the previous record */
+	uint32_t last_mem;
+	uint32_t tags[TRACE_WORDS];
+	uint32_t words[TRACE_WORDS];
+} trace_codec_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int trace_open(const char *path);
+void trace_close();
+int trace_recording();
+void trace_write(const inst_record_t *r);
+int trace_replay(const char *trace, const char *configs);
+
+#endif